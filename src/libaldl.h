@@ -0,0 +1,66 @@
+#ifndef LIBALDL_INCLUDED
+#define LIBALDL_INCLUDED
+
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// ============================================================================
+// LIBALDL
+// ============================================================================
+// the serial, protocol, decoding, session and log code of linuxaldl, without
+// the GUI. built as lib/libaldl.a and lib/libaldl.so by "make lib".
+//
+// nothing in the library uses global state: a program opens as many
+// aldl_session_t as it needs (linuxaldl_session.h), runs them with an
+// aldl_mux_t, and either handles frames in its own sink or hands the
+// session to an aldl_logger_t (linuxaldl_log.h). the loggers of many
+// sessions can share one io_uring (linuxaldl_uring.h), and raw logs are read
+// back with an aldl_log_reader_t (linuxaldl_reader.h), seeking and searching
+// with the index built as they are written (linuxaldl_index.h). logs can be
+// compressed as they are written (linuxaldl_gz.h), and decoded frames turned
+// into csv lines (linuxaldl_csv.h) or columnar logs (linuxaldl_columns.h) in
+// bulk. decoded samples can be kept for plotting in an aldl_history_t
+// (linuxaldl_history.h). definitions are looked up by name with
+// aldl_get_definition() (linuxaldl_core.h).
+// see linuxaldl_headless.c for a complete example.
+//
+// this header can be included from C++.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sts_serial.h"
+#include "linuxaldl_stream.h"
+#include "linuxaldl_core.h"
+#include "linuxaldl_session.h"
+#include "linuxaldl_uring.h"
+#include "linuxaldl_index.h"
+#include "linuxaldl_gz.h"
+#include "linuxaldl_log.h"
+#include "linuxaldl_csv.h"
+#include "linuxaldl_columns.h"
+#include "linuxaldl_reader.h"
+#include "linuxaldl_history.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -30,17 +30,48 @@ LICENSING INFORMATION:
 #include <gtk/gtk.h>
 #include <stdlib.h>
 #include <string.h> // for memcpy
+#include <strings.h> // for strcasecmp
 #include <errno.h>
+#include <time.h>
 #include "linuxaldl.h"
-#include "linuxaldl_definitions.h"
 #include "linuxaldl_gui.h"
 #include "sts_serial.h"
+#include "linuxaldl_session.h"
+#include "linuxaldl_log.h"
 
 
 // global variables
 // =================================================
 
-linuxaldl_settings aldl_settings = { NULL, 0, NULL, 1, 0, NULL, NULL, aldl_definition_table, NULL, NULL, NULL, 150, 100};
+linuxaldl_settings aldl_settings = { NULL, 0, NULL, 1, 0, NULL, NULL, aldl_definition_table, NULL, NULL, NULL, 150, 100,
+										ALDL_SCAN_INTERVAL, 10};
+
+#ifdef _LINUXALDL_COUNT_ALLOCS
+// heap allocation counters, one per thread. see linuxaldl.h
+__thread unsigned long aldl_heap_allocs = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t nmemb, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+	aldl_heap_allocs++;
+	return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t nmemb, size_t size)
+{
+	aldl_heap_allocs++;
+	return __real_calloc(nmemb,size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+	aldl_heap_allocs++;
+	return __real_realloc(ptr,size);
+}
+#endif
 
 // ============================================================================
 //
@@ -53,6 +84,10 @@ int main(int argc, const char* argv[]){
 	int res; // temporary storage for function results
 
 	int guimode = 0;
+	int throughput = 0, passive = 0; // scan mode flags
+	const char* logformat = NULL; // -format argument
+	const char* fsync = NULL; // -fsync argument
+	unsigned int length;
 
 	// ========================================================================
 	// 			COMMAND LINE OPTION PARSING 
@@ -72,17 +107,92 @@ int main(int argc, const char* argv[]){
 				POPT_ARG_STRING | POPT_ARGFLAG_ONEDASH,&aldl_settings.aldldefname,0,
 				"ALDL code definition to use",
 				"DF"},
+				{ "interval",'\0',
+				POPT_ARG_INT | POPT_ARGFLAG_ONEDASH,&aldl_settings.scan_interval,0,
+				"msec between mode 1 requests (command line mode)",
+				"150"},
+				{ "timeout",'\0',
+				POPT_ARG_INT | POPT_ARGFLAG_ONEDASH,&aldl_settings.scan_timeout,0,
+				"msec to wait for a mode 1 response (command line mode)",
+				"100"},
+				{ "throughput",'\0',
+				POPT_ARG_NONE | POPT_ARGFLAG_ONEDASH,&throughput,0,
+				"request mode 1 messages as fast as the ECM answers (command line mode)",
+				NULL},
+				{ "guard",'\0',
+				POPT_ARG_INT | POPT_ARGFLAG_ONEDASH,&aldl_settings.bus_guard_time,0,
+				"msec of bus idle time between requests with -throughput",
+				"10"},
+				{ "passive",'\0',
+				POPT_ARG_NONE | POPT_ARGFLAG_ONEDASH,&passive,0,
+				"never transmit, only log frames seen on the line. for $DF only mode 1 responses "
+				"are known, so another tool has to be polling the ECM (command line mode)",
+				NULL},
+				{ "duration",'\0',
+				POPT_ARG_INT | POPT_ARGFLAG_ONEDASH,&aldl_settings.max_duration,0,
+				"stop logging after this many seconds (command line mode)",
+				"seconds"},
+				{ "frames",'\0',
+				POPT_ARG_INT | POPT_ARGFLAG_ONEDASH,&aldl_settings.max_frames,0,
+				"stop logging after this many frames (command line mode)",
+				"count"},
+				{ "format",'\0',
+				POPT_ARG_STRING | POPT_ARGFLAG_ONEDASH,&logformat,0,
+				"log file format. the default is csv for .csv files, raw otherwise",
+				"raw|csv"},
+				{ "fsync",'\0',
+				POPT_ARG_STRING | POPT_ARGFLAG_ONEDASH,&fsync,0,
+				"sync the log file every N msec, every N records, or never (default 1000ms)",
+				"Nms|N|none"},
+				{ "compact",'\0',
+				POPT_ARG_NONE | POPT_ARGFLAG_ONEDASH,&aldl_settings.compact_log,0,
+				"store raw logs as differences from frame to frame, with a full frame every 256",
+				NULL},
+				{ "compress",'\0',
+				POPT_ARG_INT | POPT_ARGFLAG_ONEDASH,&aldl_settings.compress_log,0,
+				"gzip log files as they are written, in the log writer thread (zlib level 1-9)",
+				"level"},
+				{ "columns",'\0',
+				POPT_ARG_NONE | POPT_ARGFLAG_ONEDASH,&aldl_settings.columns_log,0,
+				"write a columnar log (logfile" ALDL_COL_SUFFIX ") as well (command line mode)",
+				NULL},
 				POPT_AUTOHELP
 				{ NULL, 0, 0, NULL, 0, 0, NULL}
 			};
 
+	aldl_settings.fsync_policy = ALDL_LOG_DEFAULT_FSYNC;
+	aldl_settings.fsync_every = ALDL_LOG_DEFAULT_FSYNC_EVERY;
+
 	// popt context
 	popt_aldl = poptGetContext(NULL, argc, argv,aldl_opt_table,0);
-	poptSetOtherOptionHelp(popt_aldl,"[logfile.log]\nTo use GUI: linuxaldl [-serial=/dev/ttyUSB0]");
+	poptSetOtherOptionHelp(popt_aldl,"[logfile.log]\nTo use GUI: linuxaldl [-serial=/dev/ttyUSB0]"
+									"\nTo log without the GUI: linuxaldl -serial=/dev/ttyUSB0 -mask=DEF [options] logfile");
 
 	if (argc<2) { poptPrintUsage(popt_aldl,stderr,0); return 1; }
 
 	res = poptGetNextOpt(popt_aldl); // parse the command line arguments
+	if (res < -1)
+	{
+		fprintf(stderr,"%s: %s\n",poptBadOption(popt_aldl,0),poptStrerror(res));
+		return 1;
+	}
+
+	if (fsync != NULL && aldl_log_parse_fsync(fsync, &aldl_settings.fsync_policy, &aldl_settings.fsync_every) != 0)
+	{
+		fprintf(stderr,"Error: bad -fsync \"%s\". Use none, a number of records or msec followed by ms.\n",fsync);
+		return 1;
+	}
+
+	if (aldl_settings.compress_log < 0 || aldl_settings.compress_log > 9)
+	{
+		fprintf(stderr,"Error: bad -compress level %d. Use 1 (fastest) to 9 (smallest).\n",aldl_settings.compress_log);
+		return 1;
+	}
+
+	if (passive)
+		aldl_settings.scan_mode = ALDL_SCAN_PASSIVE;
+	else if (throughput)
+		aldl_settings.scan_mode = ALDL_SCAN_THROUGHPUT;
 
 	// if no serial port selected, print usage instructions and exit
 	if (aldl_settings.aldlportname == NULL)
@@ -109,6 +219,31 @@ int main(int argc, const char* argv[]){
 			fprintf(stderr," Note: definition names are case sensitive.\n");
 			return -1;	
 		}
+		if (aldl_load_definition(aldl_settings.definition)!=0)
+		{
+			fprintf(stderr,"Error: Couldn't allocate memory for the data set.\n");
+			return -1;
+		}
+
+		// log format: -format, or from the file extension (under any .gz)
+		length = strlen(aldl_settings.logfilename);
+		if (length>=3 && strcasecmp(aldl_settings.logfilename+length-3,".gz")==0)
+			length -= 3;
+		if (logformat != NULL)
+		{
+			if (strcmp(logformat,"csv")==0)
+				aldl_settings.log_format = ALDL_LOG_CSV;
+			else if (strcmp(logformat,"raw")==0)
+				aldl_settings.log_format = ALDL_LOG_RAW;
+			else
+			{
+				fprintf(stderr,"Error: unknown log format \"%s\". Use raw or csv.\n",logformat);
+				return -1;
+			}
+		}
+		else if (length>=4 && strncasecmp(aldl_settings.logfilename+length-4,".csv",4)==0)
+			aldl_settings.log_format = ALDL_LOG_CSV;
+		else aldl_settings.log_format = ALDL_LOG_RAW;
 	}
 	poptFreeContext(popt_aldl); // free the popt context
 
@@ -138,12 +273,21 @@ int main(int argc, const char* argv[]){
 		fprintf(stderr," Couldn't set baud rate to 8192. Using standard rate (9600).\n");
 		fprintf(stderr," There may be framing errors.\n");
 	}
+
+	// set up the receive engine used to wait for ECM responses
+	if (serial_rx_open(&aldl_settings.rx, aldl_settings.faldl)!=0)
+	{
+		fprintf(stderr," Couldn't set up the receive engine for %s.\n",aldl_settings.aldlportname);
+		close(aldl_settings.faldl);
+		return -1;
+	}
 	
 	// verify the aldl
 	if (verifyaldl()<0)
 	{
 		fprintf(stderr," ALDL verification failure. No response from ECM.\n");
 		tcflush(aldl_settings.faldl, TCIOFLUSH);
+		serial_rx_close(&aldl_settings.rx);
 		close(aldl_settings.faldl);
 		return -1;
 	}
@@ -163,21 +307,12 @@ int main(int argc, const char* argv[]){
 	// ========================================================================
 	else
 	{
-		// Open the .log file for writing, create if it doesnt exist
-		// ------------------------------------------------------------
-		aldl_settings.flogfile = open(aldl_settings.logfilename,O_RDWR | O_CREAT, 0666);
-		if (aldl_settings.flogfile == -1)
-		{
-			fprintf(stderr,"Unable to open/create %s for writing.\n",aldl_settings.logfilename);
-			return 0;	}
-		printf("Opened %s for writing.\n",aldl_settings.logfilename);
 		// Read from the aldl
 		// ------------------
-		res = aldl_scan_and_log(aldl_settings.flogfile);
+		// the log file is opened (or created) by aldl_scan_and_log()
+		res = aldl_scan_and_log(aldl_settings.logfilename);
 			if (res==-1) fprintf(stderr,"Error: Fatal read error occured. log file may be corrupted.\n");
 		else printf("Received %d bytes from device and wrote to file: %s.\n", res,aldl_settings.logfilename);
-	
-		close(aldl_settings.flogfile);
 	}
 
 
@@ -189,13 +324,13 @@ int main(int argc, const char* argv[]){
 	tcflush(aldl_settings.faldl, TCIOFLUSH);
 
 	// close the port
+	serial_rx_close(&aldl_settings.rx);
 	close(aldl_settings.faldl);
 	printf("Connection closed.\n"); 
 	return 0;
 }
 
 
-
 // ============================================================
 //
 // 			linuxaldl general function definitions 
@@ -204,21 +339,97 @@ int main(int argc, const char* argv[]){
 // (mostly used for the command line interface but also main())
 
 // wake up / verify the aldl
-// This function should check that the aldl interface is working by listening
-// for ECM chatter, or some other operation to determine whether there is
-// a line connected to the serial port.
+// checks that the aldl interface is working. with a definition loaded this
+// requests mode 1 messages (up to MAX_CONNECT_ATTEMPTS times) or, in passive
+// mode, waits for a broadcast frame. without one (GUI mode, where the
+// definition is picked later) it only listens for ECM chatter.
+// returns 0 if the interface looks usable, -1 if not.
 int verifyaldl()
 {
-	//XXX NOT IMPLEMENTED
-	return 0;
-	
-}
+	aldl_definition* def = aldl_settings.definition;
+	aldl_frame_desc* desc;
+	char buf[64];
+	int i, res;
 
+	if (def == NULL)
+	{
+		res = aldl_listen_raw(buf, sizeof(buf), 1);
+		if (res<0)
+			return -1;
+		if (res==0)
+			printf(" No ECM chatter heard. The ECM may already be silenced or the ignition may be off.\n");
+		return 0;
+	}
+
+	// never transmit in passive mode. nothing heard isn't an error since
+	// whatever makes the ECM send may not have started yet.
+	if (aldl_settings.scan_mode == ALDL_SCAN_PASSIVE)
+	{
+		if (aldl_setup_stream(ALDL_SCAN_PASSIVE) != 0)
+			return -1;
+		res = aldl_listen_frame(aldl_settings.mode1_buffer, aldl_definition_max_frame(def), &desc, 2000000);
+		if (res==0)
+			printf(" No broadcast frames heard yet.\n");
+		else if (res>0)
+			printf(" Heard a \"%s\" frame.\n",desc->name);
+		return (res<0) ? -1 : 0;
+	}
+
+	if (aldl_setup_stream(ALDL_SCAN_INTERVAL) != 0)
+		return -1;
+	for (i=0; i<MAX_CONNECT_ATTEMPTS; i++)
+	{
+		if (!aldl_settings.silenced)
+			aldl_silence();
+		res = get_mode1_message(aldl_settings.mode1_buffer, aldl_definition_max_frame(def));
+		if (res>0)
+			return 0;
+	}
 
-int aldl_scan_and_log(int fd)
+	aldl_unsilence();
+	return -1;
+}
+
+// scans the ECM with the current definition and scan settings in
+// aldl_settings and logs every frame to logfilename in
+// aldl_settings.log_format (see aldl_log_run()).
+// runs until SIGINT or SIGTERM arrives, aldl_settings.max_frames frames have
+// been logged or aldl_settings.max_duration seconds pass. the ECM gets a
+// mode 9 message and the log is flushed before this returns.
+// returns the number of frame bytes received, or -1 on failure.
+int aldl_scan_and_log(const char* logfilename)
 {
-	//XXX NOT IMPLEMENTED
-	return 0;
+	aldl_session_t session;
+	aldl_log_options_t opts;
+	long res;
+
+	if (aldl_session_attach(&session, aldl_settings.faldl, aldl_settings.definition) != 0)
+	{
+		fprintf(stderr,"Couldn't set up the scan session.\n");
+		return -1;
+	}
+	session.portname = aldl_settings.aldlportname;
+	session.scan_mode = aldl_settings.scan_mode;
+	session.scan_interval = aldl_settings.scan_interval;
+	session.scan_timeout = aldl_settings.scan_timeout;
+	session.bus_guard_time = aldl_settings.bus_guard_time;
+
+	memset(&opts,0,sizeof(opts));
+	opts.filename = logfilename;
+	opts.format = aldl_settings.log_format;
+	opts.backend = ALDL_LOG_THREAD;
+	opts.fsync_policy = aldl_settings.fsync_policy;
+	opts.fsync_every = aldl_settings.fsync_every;
+	opts.index = 1;
+	opts.compact = aldl_settings.compact_log;
+	opts.compress = aldl_settings.compress_log;
+	opts.columns = aldl_settings.columns_log;
+	opts.max_frames = aldl_settings.max_frames;
+	opts.max_duration = aldl_settings.max_duration;
+
+	res = aldl_log_run(&session, &opts);
+	aldl_session_close(&session);
+	return (res<0) ? -1 : (int)res;
 }
 
 // sends an artibtrary aldl message contained in the buffer msg_buf.
@@ -239,7 +450,7 @@ int send_aldl_message(char* msg_buf, unsigned int size)
 	printf("\n");
 #endif
 
-	res = write(aldl_settings.faldl,&msg_buf,size);
+	res = write(aldl_settings.faldl,msg_buf,size);
 	if (res <= 0)
 		return -1;
 	else if ((unsigned)res<size)
@@ -249,19 +460,48 @@ int send_aldl_message(char* msg_buf, unsigned int size)
 	return res;
 }
 
+// sends a mode 8 message to stop the ECM's normal mode chatter, flushes
+// anything received before it went quiet and sets aldl_settings.silenced.
+// the ECM stays silent across mode 1 requests, so this only needs to be
+// called when aldl_settings.silenced has been cleared.
+// returns 0 on success, -1 if the message could not be sent.
+int aldl_silence()
+{
+	if (send_aldl_message(_ALDL_MESSAGE_MODE8) < 0)
+		return -1;
+	tcflush(aldl_settings.faldl,TCIOFLUSH); // flush send and receive buffers
+	aldl_stream_reset(&aldl_settings.stream);
+	aldl_settings.silenced = 1;
+	aldl_settings.chatter_polls = 0;
+	return 0;
+}
+
+// sends a mode 9 message to let the ECM resume normal mode and clears
+// aldl_settings.silenced. returns 0 on success, -1 on failure.
+int aldl_unsilence()
+{
+	aldl_settings.silenced = 0;
+	if (send_aldl_message(_ALDL_MESSAGE_MODE9) < 0)
+		return -1;
+	return 0;
+}
+
 // requests a mode1 message from the ECM using the currently loaded
 // aldl definition. 
 // returns the number of bytes received, if the message was complete.
 //  0 is no response/timeout/partial message
 // -1 is returned if the checksum is bad.
-// XXX this is likely to fail if mode 8 is not set, because the call to read
-// will in all probability return part of a normal mode message. a correct
-// implementation should wait for a mode 1 message header in the response,
-// so that mode 8 isn't even required.
+// the echo of the request and normal mode frames that arrive ahead of the
+// mode 1 response are skipped, as are stray bytes. aldl_settings.silenced is
+// cleared, so the caller knows to send mode 8 again, if a normal mode frame
+// arrives, if stray bytes arrive on ALDL_SESSION_CHATTER_POLLS requests in
+// a row, or if the ECM doesn't answer.
 int get_mode1_message(char* inbuffer, unsigned int size)
 {
-	int res;
-	char checkval;
+	int res, id;
+	long usecs;
+	struct timespec now, deadline;
+	unsigned long bad_checksums, discarded;
 	char outbuffer[__MAX_REQUEST_SIZE]; // max request size defined in linuxaldl_definitions.h
 
 	aldl_definition* def = aldl_settings.definition;
@@ -277,11 +517,15 @@ int get_mode1_message(char* inbuffer, unsigned int size)
 	memcpy(outbuffer,def->mode1_request,def->mode1_request_length-1);
 	outbuffer[def->mode1_request_length-1] = get_checksum(outbuffer,def->mode1_request_length-1);
 
-	// form the response message start sequence
-	char seq[] = { def->mode1_request[0], 0x52+def->mode1_response_length, 0x01};
+	// set up the frame parser to look for the mode 1 response
+	if (aldl_settings.stream.num_headers == 0)
+		aldl_setup_stream(ALDL_SCAN_INTERVAL);
 
-	// flush the serial receive buffer
+	// flush the serial receive buffer, along with anything the parser still holds
 	tcflush(aldl_settings.faldl,TCIFLUSH);
+	aldl_stream_reset(&aldl_settings.stream);
+	bad_checksums = aldl_settings.stream.bad_checksums;
+	discarded = aldl_settings.stream.discarded;
 
 	// write the request to the serial interface
 	write(aldl_settings.faldl,&outbuffer,def->mode1_request_length); 
@@ -289,33 +533,97 @@ int get_mode1_message(char* inbuffer, unsigned int size)
 	// wait for the bytes to be written
 	tcdrain(aldl_settings.faldl); 
 
-	// wait for response from ECM
-	// read sequence, 50msec timeout
-	res=read_sequence(aldl_settings.faldl, inbuffer, mode1_len,
-											seq, 3, 0, 
-							aldl_settings.scan_timeout*1000);
+	// wait for response from ECM, scan_timeout msec timeout.
+	// the parser keeps partial frames across reads and only returns
+	// frames with a good checksum. the echo of the request and normal
+	// mode frames can come first.
+	clock_gettime(CLOCK_MONOTONIC,&deadline);
+	deadline.tv_sec += aldl_settings.scan_timeout/1000;
+	deadline.tv_nsec += (aldl_settings.scan_timeout%1000)*1000000L;
+	if (deadline.tv_nsec >= 1000000000L)
+	{
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+	for (;;)
+	{
+		clock_gettime(CLOCK_MONOTONIC,&now);
+		usecs = (deadline.tv_sec-now.tv_sec)*1000000L + (deadline.tv_nsec-now.tv_nsec)/1000;
+		if (usecs <= 0)
+		{
+			res = 0;
+			break;
+		}
+		res=aldl_stream_read_frame(&aldl_settings.stream, &aldl_settings.rx, inbuffer, size,
+												&id, usecs);
+		if (res<=0 || id == -1)
+			break;
+		// a normal mode frame: the ECM has to be silenced again
+		if (id != ALDL_FRAME_ECHO)
+			aldl_settings.silenced = 0;
+	}
+
+	// stray bytes on one request are tolerated, on several in a row
+	// they are taken to be chatter the parser doesn't recognize
+	if (aldl_settings.stream.discarded == discarded)
+		aldl_settings.chatter_polls = 0;
+	else if (++aldl_settings.chatter_polls >= ALDL_SESSION_CHATTER_POLLS)
+		aldl_settings.silenced = 0;
 
 	if (res<0)
 	{
 		fprintf(stderr,"Error receiving mode1 message: %s\n",strerror(errno));
+		aldl_settings.silenced = 0;
 		return -1;
 	}
-	if ((unsigned)res<mode1_len)
+	if (res==0)
 	{
-		
+		// a frame arrived but was corrupted
+		if (aldl_settings.stream.bad_checksums != bad_checksums)
+		{
+			fprintf(stderr,"MODE 1 bad checksum.\n");
+			return -1;
+		}
+		// no answer at all. the ECM may have been reset and resumed normal mode.
+		aldl_settings.silenced = 0;
 #ifdef _LINUXALDL_DEBUG
-		fprintf(stderr,"MODE1 timeout occured. (Received %d/%d bytes)\n",res,mode1_len);
+		fprintf(stderr,"MODE1 timeout occured.\n");
 #endif
 		return 0;
 	}
 
-	char checksum = get_checksum(inbuffer,mode1_len-1);
-	if (inbuffer[mode1_len-1]!=checksum)
+	return res;
+}
+
+// sets up the frame parser for the current definition: the mode 1 response
+// header when polling, or the definition's broadcast_frames for passive
+// listening. returns 0 on success, -1 if there is nothing to look for in that mode.
+int aldl_setup_stream(ALDL_SCAN_MODE_t mode)
+{
+	return aldl_definition_setup_stream(&aldl_settings.stream, aldl_settings.definition, mode);
+}
+
+
+// waits up to usecs microseconds for the next complete frame on the line
+// without transmitting anything. aldl_setup_stream(ALDL_SCAN_PASSIVE) must
+// have been called. *desc is set to the descriptor of the frame received.
+// returns the frame length, 0 on timeout, -1 on failure.
+int aldl_listen_frame(char* inbuffer, unsigned int size, aldl_frame_desc** desc, long usecs)
+{
+	int res, id = -1;
+
+	res = aldl_stream_read_frame(&aldl_settings.stream, &aldl_settings.rx, inbuffer, size, &id, usecs);
+	if (res<0)
 	{
-		fprintf(stderr,"MODE 1 bad checksum.\n");
+		fprintf(stderr,"Error receiving broadcast frame: %s\n",strerror(errno));
 		return -1;
 	}
-
+	if (res>0)
+	{
+		if (id < 0)
+			return -1; // the parser is still set up for mode 1 responses
+		*desc = aldl_settings.definition->broadcast_frames + id;
+	}
 	return res;
 }
 
@@ -330,152 +638,113 @@ int aldl_listen_raw(char* inbuffer, unsigned int len, int timeout)
 	return res;
 }
 
-// calculates the single-byte checksum, summing from the start of buffer
-// through len bytes. the checksum is calculated by adding each byte
-// together and ignoring overflow, then taking the two's complement and adding 1
-char get_checksum(char* buffer, unsigned int len)
+
+// makes def the current definition and allocates the data sets and receive
+// buffer for it. everything the scan path writes to lives in one block,
+// sized here from the definition, so scanning itself never allocates.
+// returns 0 on success, -1 if out of memory, in which case the current
+// definition and its data sets are left as they were.
+int aldl_load_definition(aldl_definition* def)
 {
-	char acc = 0x00;
+	unsigned int i, num_items = 0, buf_size;
+	size_t strings_size, seq_size, floats_size, slots_size;
+	aldl_decode_plan_t plan;
+	char* pool;
+
+	// count the items in the definition (seperators included, since the
+	// data sets are indexed the same way as mode1_def)
+	while (def->mode1_def[num_items].label != NULL)
+		num_items++;
+
+	// the receive buffer has to hold the largest frame that can be received
+	buf_size = aldl_definition_max_frame(def);
+
+	strings_size = num_items*sizeof(char*);
+	seq_size = num_items*sizeof(unsigned long);
+	floats_size = num_items*sizeof(float);
+	slots_size = num_items*ALDL_STRING_SLOT_SIZE;
+
+	// pointers and sequence numbers first, then floats, then byte arrays,
+	// so each part stays aligned
+	pool = calloc(1, strings_size + 2*seq_size + floats_size + slots_size
+						+ def->mode1_data_length + buf_size);
+	if (pool == NULL)
+		return -1;
 
-	unsigned int i;
-	for (i=0; i<len; i++)
+	// the current definition and its data sets stay in place if this fails
+	if (aldl_decode_plan_compile(&plan, def) != 0)
 	{
-		//printf("%d,",buffer[i]);
-		//if (!(i%16)) printf("\n");
-		acc+=buffer[i];
+		free(pool);
+		return -1;
 	}
-	
-	acc=0xFF-acc;
-	acc+=0x01;
-	//printf("Checksum: %d\n",acc);
 
-	return acc;
-}
+	aldl_free_data_sets();
+	aldl_settings.decode_plan = plan;
+	aldl_settings.definition = def;
+	aldl_settings.num_items = num_items;
+	aldl_settings.data_set_pool = pool;
+
+	aldl_settings.data_set_strings = (char**)pool;
+	pool += strings_size;
+	aldl_settings.data_set_changed = (unsigned long*)pool;
+	pool += seq_size;
+	aldl_settings.data_set_formatted = (unsigned long*)pool;
+	pool += seq_size;
+	aldl_settings.data_set_floats = (float*)pool;
+	pool += floats_size;
+	for (i=0; i<num_items; i++)
+		aldl_settings.data_set_strings[i] = pool + i*ALDL_STRING_SLOT_SIZE;
+	pool += slots_size;
+	aldl_settings.data_set_raw = pool;
+	pool += def->mode1_data_length;
+	aldl_settings.mode1_buffer = pool;
+
+	// the data sets start out decoded from an all zero block
+	aldl_settings.data_set_seq = 1;
+	aldl_decode_plan_update(&aldl_settings.decode_plan, NULL, aldl_settings.data_set_raw,
+							aldl_settings.data_set_floats, aldl_settings.data_set_changed, 1);
+
+	// the frame parser is set up again for the new definition
+	aldl_stream_init(&aldl_settings.stream);
 
-// looks up def_name in the aldl_definition_table until it finds the first 
-// definition in the table with the name def_name
-// if the definition is not in the table, returns NULL
-aldl_definition* aldl_get_definition(const char* defname)
-{
-	int index = 0;
-	aldl_definition* result = aldl_definition_table[0];
-	if (defname == NULL)
-		return NULL;
-	while(result!=NULL){
-		if (strcmp(defname,result->name)==0)
-			break;
-		index++;
-		result = aldl_definition_table[index];
-	}
-	return result;
+	return 0;
 }
 
-
-// updates data_set_floats and/or data_set_strings using the current data_set_raw bytes.
-// if the flags argument is ALDL_UPDATE_STRINGS then only sets will be updated.
-// if flags is ALDL_UPDATE_FLOATS then only floats will be updated, and the data_set_strings
-// array will not be modified in any way.
-// if flags is ALDL_UPDATE_FLOATS|ALDL_UPDATE_STRINGS, then both will be updated.
-// if the aldl_settings.data_set_floats or aldl_settings.data_set_strings arrays have
-// not yet been initialized (e.g. are NULL pointers) then they will not be modified.
-void aldl_update_sets(int flags)
+// frees the memory allocated by aldl_load_definition().
+void aldl_free_data_sets()
 {
-	unsigned int i=0;
-	byte_def_t* defs = aldl_settings.definition->mode1_def;
-	byte_def_t* cur_def;
-	float converted_val;
-	char* new_data_string=NULL;
-
-	while (defs[i].label != NULL) // while not at the last defined byte
-	{
-		cur_def = defs+i;
-		// if the item is a seperator, skip it
-		if (cur_def->operation == ALDL_OP_SEPERATOR)
-		{
-			i++;
-			continue;
-		}
-
-		// convert the raw data to a float based on the byte definition
-		if (cur_def->bits==8)
-		{
-			converted_val = aldl_raw8_to_float(aldl_settings.data_set_raw[cur_def->byte_offset-1],
-											cur_def->operation, cur_def->op_factor, cur_def->op_offset);
-											
-		}
-		else if (cur_def->bits==16)
-		{
-			converted_val = aldl_raw16_to_float(aldl_settings.data_set_raw[cur_def->byte_offset-1],
-											aldl_settings.data_set_raw[cur_def->byte_offset],
-											cur_def->operation, cur_def->op_factor, cur_def->op_offset);
-		}
-		else
-		{ // other numbers of bits not supported
-			i++;
-			continue;
-		}
-
-		if ((flags & ALDL_UPDATE_FLOATS) && aldl_settings.data_set_floats != NULL)
-			aldl_settings.data_set_floats[i] = converted_val;
-
-		// convert the result to a string
-		if ((flags & ALDL_UPDATE_STRINGS) && aldl_settings.data_set_strings != NULL)
-		{
-			new_data_string=malloc(10); // allocate ten bytes for the string
-
-			snprintf(new_data_string,10,"%.1f",converted_val); // convert the floating point value to a string
-
-			// if there is currently a string registered, free it
-			if (aldl_settings.data_set_strings[i] != NULL)
-				free(aldl_settings.data_set_strings[i]);
-
-			// register the new string in the table
-			aldl_settings.data_set_strings[i] = new_data_string;
-		}
-
-		//fprintf(stderr,"Updating element %s\n",cur_def->label);
-		i++;
-	}
+	free(aldl_settings.data_set_pool);
+	aldl_settings.data_set_pool = NULL;
+	aldl_settings.data_set_strings = NULL;
+	aldl_settings.data_set_floats = NULL;
+	aldl_settings.data_set_raw = NULL;
+	aldl_settings.mode1_buffer = NULL;
+	aldl_settings.data_set_changed = NULL;
+	aldl_settings.data_set_formatted = NULL;
+	aldl_settings.data_set_seq = 0;
+	aldl_settings.num_items = 0;
+	aldl_decode_plan_free(&aldl_settings.decode_plan);
 }
 
-// converts the raw 8-bit data value val into a float by performing operation
-// using op_factor and op_offset.
-// see the documentation for the byte_def_t struct in linuxaldl.h for more information
-float aldl_raw8_to_float(unsigned char val, int operation, float op_factor, float op_offset)
+// makes the mode1 data block data the current data set, decoding only the
+// items whose bytes changed. returns the number of items that changed.
+unsigned int aldl_update_data_set(const char* data)
 {
-	float result = val;
-	if (operation == ALDL_OP_MULTIPLY)
-		result = ((float)val*op_factor)+op_offset;
-	else if (operation == ALDL_OP_DIVIDE)
-		result = (op_factor/val)+op_offset;
-	else
-	{
-		result = -999;
-		fprintf(stderr," aldl_raw_to_float8() error: undefined operation: %d",operation);
-	}
-
-	return result;
+	if (aldl_settings.data_set_raw == NULL)
+		return 0;
 
+	aldl_settings.data_set_seq++;
+	return aldl_decode_plan_update(&aldl_settings.decode_plan, aldl_settings.data_set_raw, data,
+							aldl_settings.data_set_floats, aldl_settings.data_set_changed,
+							aldl_settings.data_set_seq);
 }
 
-
-// converts the raw 16-bit data value val into a float by performing operation
-// using op_factor and op_offset.
-// see the documentation for the byte_def_t struct in linuxaldl.h for more information
-float aldl_raw16_to_float(unsigned char msb, unsigned char lsb, int operation, float op_factor, float op_offset)
+// returns the value of definition->mode1_def[i] as a string, formatting
+// it first if it changed since it was last formatted.
+const char* aldl_get_data_string(unsigned int i)
 {
-	float result = ((float)msb*256)+(float)lsb;
-	if (operation == ALDL_OP_MULTIPLY)
-		result = (result*op_factor)+op_offset;
-	else if (operation == ALDL_OP_DIVIDE)
-		result = (op_factor/result)+op_offset;
-	else
-	{
-		result = -999.0;
-		fprintf(stderr," aldl_raw_to_float16() error: undefined operation: %d",operation);
-	}
-	return result;
-
+	return aldl_format_slot(aldl_settings.data_set_floats[i], aldl_settings.data_set_changed[i],
+							aldl_settings.data_set_formatted+i, aldl_settings.data_set_strings[i]);
 }
 
 
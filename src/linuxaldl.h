@@ -22,88 +22,36 @@ LICENSING INFORMATION:
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "sts_serial.h"
+#include "linuxaldl_stream.h"
+#include "linuxaldl_core.h"
+
 // debug mode
 //#define _LINUXALDL_DEBUG
 
 #define MAX_CONNECT_ATTEMPTS 3
-#define BAUDRATE B9600
 
 // macros
 
 #define _ALDL_MESSAGE_MODE8 aldl_settings.definition->mode8_request,aldl_settings.definition->mode8_request_length
 #define _ALDL_MESSAGE_MODE9 aldl_settings.definition->mode9_request,aldl_settings.definition->mode9_request_length
 
-#define __MAX_REQUEST_SIZE 16 // maximum size (bytes) of a request message
-							  // to send to the ECM
-
-#define LINUXALDL_MODE1_END_DEF {NULL,0,0,0,0,0,NULL}
-
-
-typedef enum _ALDL_OP { ALDL_OP_MULTIPLY=0, ALDL_OP_DIVIDE=1, ALDL_OP_SEPERATOR=9} ALDL_OP_t;
-
-#define _DEF_SEP(label) {label,0,0,ALDL_OP_SEPERATOR,0,0,NULL}
-
-
-// ============================================================================
-// ALDL DEFINITION STRUCTS
-// ============================================================================
-
-// See linuxaldl_definitions.h for instructions on how to make a new definition
-
-
-// byte_def_t struct
-typedef struct _linuxaldl_byte_definition{
-	const char* label;
-	unsigned int byte_offset; // the offset from the 1st byte of the data part
-							  // of the mode1 message
-	unsigned int bits; // 8 or 16 are currently supported
-
-	unsigned int operation; // ALDL_OP_MULTIPLY: (X*factor)+offest
-							// ALDL_OP_DIVIDE: (factor/X)+offset
-							// ALDL_OP_SEPERATOR: use this for a seperator for the display,
-							//    not a data item.  with this option no other
-							//	  values matter except label.
-							//	  you can also use the _DEF_SEP(label) macro like:
-							//	  _DEF_SEP("---Basic Data---")
-
-	float op_factor; // factor for the operation
-	float op_offset; // offset for the operation
-
-
-	const char* units;
-} byte_def_t;
-
-typedef struct _linuxaldl_definition{
-	const char* name;
-	char mode1_request[__MAX_REQUEST_SIZE];  // the mode 1 request message, including the checksum
-	unsigned int mode1_request_length;  // the length of the mode 1 message including the checksum
-
-	unsigned int mode1_response_length; // the total length of the response from the ecm
-
-	unsigned int mode1_data_length; // the number of data bytes in the mode1 message response
-
-	unsigned int mode1_data_offset; // the byte offest from the start of the mode1 message response
-									// to the first byte of the data. e.g. if the data part of the
-									// message is the 4th byte onward, this should be 3. (1+3 = 4)
-
-	byte_def_t* mode1_def; // pointer to start of table of byte_def_t structs.
-							// the last element must be LINUXALDL_MODE1_END_DEF
-
-	char mode8_request[__MAX_REQUEST_SIZE];  // the mode 8 (silence) request message, incl checksum
-	unsigned int mode8_request_length;  // the length of the mode 8 message incl checksum
-
-	char mode9_request[__MAX_REQUEST_SIZE];  // the mode 9 (un-silence) request message, incl checksum
-	unsigned int mode9_request_length;  // the length of the mode 9 message including the checksum
-
-
-} aldl_definition;
-
-
-
-// looks up def_name in the aldl_definition_table until it finds the first 
-// definition in the table with the name def_name
-// if the definition is not in the table, returns NULL
-aldl_definition* aldl_get_definition(const char* defname);
+int aldl_load_definition(aldl_definition* def);
+// makes def the current definition and allocates the data sets and receive
+// buffer for it (see data_set_pool). returns 0 on success, -1 if out of memory;
+// the current definition and its data sets are kept if it fails.
+
+void aldl_free_data_sets();
+// frees the memory allocated by aldl_load_definition().
+
+#ifdef _LINUXALDL_COUNT_ALLOCS
+// when linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc (make COUNT_ALLOCS=1)
+// every heap allocation is counted here, in the counter of the thread that
+// made it. the acquisition thread checks that its own doesn't change from
+// one frame to the next (waiting, reading and parsing), and the GUI thread
+// that its own doesn't change while a frame is decoded and logged.
+extern __thread unsigned long aldl_heap_allocs;
+#endif
 
 typedef struct _linuxaldl_settings
 {
@@ -129,33 +77,86 @@ typedef struct _linuxaldl_settings
 								// this is allocated when a definition is selected
 
 	char** data_set_strings;	// pointer to array of data set in string format.
-								// allocated when a definition is selected in the GUI
+								// data_set_strings[i] points to a fixed slot of
+								// ALDL_STRING_SLOT_SIZE bytes for definition->mode1_def[i].
+								// slots are only formatted when they are read with
+								// aldl_get_data_string(), so they may be out of date.
 
 	float* data_set_floats;		// data set in float format
-								// allocated when a definition is selected in the GUI
 
 	unsigned int scan_interval; // msec between scan requests
 	unsigned int scan_timeout; // msec to timeout on scan request.
 						// note that read-sequence takes timeout in usec.
 						// usec = msec*1000
+
+	ALDL_SCAN_MODE_t scan_mode; // ALDL_SCAN_INTERVAL, ALDL_SCAN_THROUGHPUT or ALDL_SCAN_PASSIVE
+	unsigned int bus_guard_time; // msec of bus idle time between a response and
+								 // the next request in ALDL_SCAN_THROUGHPUT mode
+
+	serial_rx_t rx;		// receive engine for faldl (epoll + timerfd deadline).
+						// set up by serial_rx_open() once the port is connected.
+
+	aldl_stream_t stream; // frame parser for bytes received on faldl.
+						  // its headers are set up from the definition by
+						  // aldl_setup_stream() for the scan mode in use.
+
+	char* mode1_buffer;			// receive buffer for one complete mode1 message,
+								// or the largest of the definition's broadcast_frames
+
+	unsigned int num_items;		// number of entries in definition->mode1_def,
+								// including seperators (not the end marker)
+
+	void* data_set_pool;		// single block holding data_set_raw, data_set_strings
+								// (and the string slots), data_set_floats, the change
+								// tracking arrays and mode1_buffer.
+								// allocated by aldl_load_definition() so scanning
+								// does not allocate any memory.
+
+	int silenced;				// 1 once a mode 8 message has silenced the ECM.
+								// cleared when normal mode frames, stray bytes on
+								// ALDL_SESSION_CHATTER_POLLS requests in a row or a
+								// missing response show the ECM has resumed normal mode.
+	unsigned int chatter_polls;	// requests in a row that received stray bytes
+
+	// command line logging (see aldl_scan_and_log())
+	aldl_log_format_t log_format;	// format of the log file
+	unsigned int max_frames;		// stop after this many frames are logged. 0 for no limit.
+	unsigned int max_duration;		// stop after this many seconds. 0 for no limit.
+
+	aldl_decode_plan_t decode_plan;	// definition->mode1_def compiled for decoding.
+									// made by aldl_load_definition().
+
+	// change tracking for the data sets. every data block passed to
+	// aldl_update_data_set() gets the next sequence number.
+	unsigned long data_set_seq;		// sequence number of the current data_set_raw
+	unsigned long* data_set_changed;	// data_set_changed[i]: sequence number of the block
+										// that last changed the value of mode1_def[i].
+										// 0 for seperators and items that aren't decoded.
+	unsigned long* data_set_formatted;	// sequence number data_set_strings[i] was formatted at
+
+	// how log files are synced to the disk by the background log writer
+	aldl_fsync_policy_t fsync_policy;	// ALDL_FSYNC_NONE, ALDL_FSYNC_INTERVAL or ALDL_FSYNC_RECORDS
+	unsigned int fsync_every;			// msec or records, see aldl_log_parse_fsync()
+
+	int compact_log;	// 1 to store most frames of raw logs as delta records (-compact)
+	int compress_log;	// zlib level to compress log files with, 0 not to (-compress)
+	int columns_log;	// 1 to write a columnar log alongside the log file (-columns)
 } linuxaldl_settings;
 
 // function prototypes
 // =================================================
 
 int verifyaldl();
-// wake up / verify the ALDL interface
-
-int aldl_scan_and_log(int fd);
-// listens for aldl data and writes it to the file descriptor fd 
-// stops when terminate_scan = 1 in the global settings struct and
-// returns number of bytes written to fd.
+// wake up / verify the ALDL interface. with a definition loaded this checks
+// for a mode 1 response (or a broadcast frame in passive mode); without one
+// it only listens for chatter. returns 0 if the interface looks usable, -1 if not.
 
-char get_checksum(char* buffer, unsigned int len);
-// calculates the single-byte checksum, summing from the start of buffer
-// through len bytes. the checksum is calculated by summing the bytes,
-// dropping carried bits, then adding 1 and taking the two's complement
-// (subtract from FF) 
+int aldl_scan_and_log(const char* logfilename);
+// scans the ECM with the current definition and scan settings and logs
+// every frame to logfilename (created if it isn't there) in aldl_settings.log_format.
+// stops on SIGINT/SIGTERM, after aldl_settings.max_frames frames or after
+// aldl_settings.max_duration seconds, then sends mode 9 and flushes the log.
+// returns the number of frame bytes received, or -1 on failure.
 
 int send_aldl_message(char* msg_buf, unsigned int size);
 // sends an artibtrary aldl message contained in the buffer msg_buf.
@@ -166,11 +167,33 @@ int send_aldl_message(char* msg_buf, unsigned int size);
 // which use the mode 8 and mode 9 message definitions from the
 // current aldl definition.
 
+int aldl_silence();
+// sends a mode 8 message to stop the ECM's normal mode chatter, flushes
+// anything received before it went quiet and sets aldl_settings.silenced.
+// returns 0 on success, -1 if the message could not be sent.
+
+int aldl_unsilence();
+// sends a mode 9 message to let the ECM resume normal mode and clears
+// aldl_settings.silenced. returns 0 on success, -1 on failure.
+
+int aldl_setup_stream(ALDL_SCAN_MODE_t mode);
+// sets up the frame parser for the current definition: the mode 1 response
+// header for ALDL_SCAN_INTERVAL/ALDL_SCAN_THROUGHPUT, or the definition's
+// broadcast_frames for ALDL_SCAN_PASSIVE. returns 0 on success, -1 if the
+// definition has nothing to look for in that mode.
+
+int aldl_listen_frame(char* inbuffer, unsigned int size, aldl_frame_desc** desc, long usecs);
+// waits up to usecs microseconds for the next complete frame on the line
+// without transmitting anything. the parser must have been set up with
+// aldl_setup_stream(ALDL_SCAN_PASSIVE). *desc is set to the descriptor of
+// the frame received. returns the frame length, 0 on timeout, -1 on failure.
+
 int get_mode1_message(char* inbuffer, unsigned int size);
 // requests a mode1 message from the ECM using the currently loaded
 // aldl definition. 
 // returns 0 if the message was received successfully, -1 no response
-// or bad checksum. 
+// or bad checksum. clears aldl_settings.silenced if there was no response
+// or other traffic arrived around it.
 
 int aldl_listen_raw(char* inbuffer, unsigned int len, int timeout);
 // reads up to len bytes into inbuffer from the interface.
@@ -178,22 +201,14 @@ int aldl_listen_raw(char* inbuffer, unsigned int len, int timeout);
 // returns -1 on failure, 0 on timeout with no bytes received,
 // and otherwise returns the number of bytes received 
 
-typedef enum _ALDL_UPDATE_FLAGS { ALDL_UPDATE_STRINGS=1, ALDL_UPDATE_FLOATS=2} ALDL_UPDATE_FLAGS_t;
-void aldl_update_sets(int flags);
-// updates data_set_floats and/or data_set_strings using the current data_set_raw bytes.
-// if the flags argument is ALDL_UPDATE_STRINGS then both sets will be updated.
-// if it is ALDL_UPDATE_FLOATS then only floats will be updated, and the data_set_strings
-// array will not be modified in any way.
-
-float aldl_raw8_to_float(unsigned char val, int operation, float op_factor, float op_offset);
-// converts the raw 8-bit data value val into a float by performing operation
-// using op_factor and op_offset.
-// see the documentation for the byte_def_t struct for more information
-
+unsigned int aldl_update_data_set(const char* data);
+// makes the mode1 data block data the current data set. only the items
+// whose bytes changed since the last block are decoded into data_set_floats
+// (see data_set_changed). returns the number of items that changed.
 
-float aldl_raw16_to_float(unsigned char msb, unsigned char lsb, int operation, float op_factor, float op_offset);
-// converts the raw 16-bit data value defined by lsb and msb into a float by performing operation
-// using op_factor and op_offset.
-// see the documentation for the byte_def_t struct for more information
+const char* aldl_get_data_string(unsigned int i);
+// returns the value of definition->mode1_def[i] as a string, formatting it
+// into its data_set_strings slot first if the value changed since it was
+// last formatted. returns "" for seperators.
 
 #endif
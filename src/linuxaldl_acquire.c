@@ -0,0 +1,209 @@
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <termios.h>
+#include "linuxaldl.h"
+#include "linuxaldl_acquire.h"
+
+// global variable which holds the current definition pointer, file descriptors, etc
+extern linuxaldl_settings aldl_settings;
+
+// ============================================================================
+// FRAME RING
+// ============================================================================
+// head is only stored by the consumer and tail only by the producer. each side
+// reads the other's index with acquire ordering and publishes its own with
+// release ordering, so a record's contents are always visible before the
+// index that hands it over.
+
+#define ALDL_FRAME_RING_MASK (ALDL_FRAME_RING_SIZE-1)
+
+// producer: returns the record to fill in next, or NULL if the ring is full.
+aldl_frame_record_t* aldl_ring_write_slot(aldl_frame_ring_t* ring)
+{
+	unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	unsigned int tail = ring->tail;
+
+	if (tail - head >= ALDL_FRAME_RING_SIZE)
+		return NULL;
+	return ring->slots + (tail & ALDL_FRAME_RING_MASK);
+}
+
+// producer: publishes the record returned by aldl_ring_write_slot().
+void aldl_ring_push(aldl_frame_ring_t* ring)
+{
+	__atomic_store_n(&ring->tail, ring->tail+1, __ATOMIC_RELEASE);
+}
+
+// consumer: returns the oldest unconsumed record, or NULL if the ring is empty.
+aldl_frame_record_t* aldl_ring_peek(aldl_frame_ring_t* ring)
+{
+	unsigned int tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	unsigned int head = ring->head;
+
+	if (head == tail)
+		return NULL;
+	return ring->slots + (head & ALDL_FRAME_RING_MASK);
+}
+
+// consumer: releases the record returned by aldl_ring_peek() back to the producer.
+void aldl_ring_pop(aldl_frame_ring_t* ring)
+{
+	__atomic_store_n(&ring->head, ring->head+1, __ATOMIC_RELEASE);
+}
+
+// consumer: returns the number of records waiting to be consumed.
+unsigned int aldl_ring_count(aldl_frame_ring_t* ring)
+{
+	return __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) - ring->head;
+}
+
+// ============================================================================
+// ACQUISITION THREAD
+// ============================================================================
+
+// session sink: copies each frame the session receives into the ring. if
+// the consumer has fallen behind the frame is dropped (it is still counted
+// in the session statistics).
+static void aldl_acq_sink(aldl_session_t* s, const char* frame, unsigned int length,
+							unsigned int data_offset, const struct timeval* timestamp, void* arg)
+{
+	aldl_acquisition_t* acq = (aldl_acquisition_t*)arg;
+	aldl_frame_record_t* rec;
+
+#ifdef _LINUXALDL_COUNT_ALLOCS
+	// nothing the thread does between two frames (waiting, reading, parsing
+	// and queueing the frame) may allocate. the first frame follows the
+	// setup, which does.
+	static __thread unsigned long heap_allocs;
+	static __thread int counting = 0;
+
+	if (counting && aldl_heap_allocs != heap_allocs)
+		fprintf(stderr,"%lu heap allocations receiving a frame.\n",aldl_heap_allocs-heap_allocs);
+	counting = 1;
+	heap_allocs = aldl_heap_allocs;
+#endif
+
+	rec = aldl_ring_write_slot(&acq->ring);
+	if (rec == NULL || length > ALDL_MAX_FRAME_SIZE)
+	{
+		acq->ring.dropped++;
+		return;
+	}
+
+	memcpy(rec->data, frame, length);
+	rec->timestamp = *timestamp;
+	rec->received = s->frame_time;
+	rec->seq = s->frames;
+	rec->length = length;
+	rec->data_offset = data_offset;
+	aldl_ring_push(&acq->ring);
+}
+
+// passes changes to the scan settings in aldl_settings on to the session.
+// the mux thread reads them while it runs, so they are stored atomically.
+// each stands alone, so no ordering is needed between them.
+void aldl_acq_update_settings(aldl_acquisition_t* acq)
+{
+	__atomic_store_n(&acq->session.scan_interval, aldl_settings.scan_interval, __ATOMIC_RELAXED);
+	__atomic_store_n(&acq->session.scan_timeout, aldl_settings.scan_timeout, __ATOMIC_RELAXED);
+	__atomic_store_n(&acq->session.bus_guard_time, aldl_settings.bus_guard_time, __ATOMIC_RELAXED);
+}
+
+// starts scanning with the current definition in the global aldl_settings.
+// returns 0 on success, -1 if the thread could not be started or the
+// definition doesn't support the scan mode.
+int aldl_acq_start(aldl_acquisition_t* acq)
+{
+	if (aldl_settings.definition == NULL || aldl_settings.faldl == -1)
+		return -1;
+
+	// the parser looks for different headers when listening than when polling
+	if (aldl_settings.scan_mode == ALDL_SCAN_PASSIVE && aldl_settings.definition->broadcast_frames == NULL)
+	{
+		fprintf(stderr,"No broadcast frames are known for %s.\n",aldl_settings.definition->name);
+		return -1;
+	}
+
+	if (aldl_session_attach(&acq->session, aldl_settings.faldl, aldl_settings.definition) != 0)
+		return -1;
+	acq->session.portname = aldl_settings.aldlportname;
+	acq->session.sink = aldl_acq_sink;
+	acq->session.sink_arg = acq;
+	// the scan mode is fixed for the run: the parser was set up for it
+	acq->session.scan_mode = aldl_settings.scan_mode;
+	aldl_acq_update_settings(acq);
+	acq->passive = (aldl_settings.scan_mode == ALDL_SCAN_PASSIVE);
+
+	if (aldl_mux_init(&acq->mux) != 0)
+	{
+		fprintf(stderr,"Couldn't set up the acquisition loop: %s\n",strerror(errno));
+		aldl_session_close(&acq->session);
+		return -1;
+	}
+	if (aldl_mux_add(&acq->mux, &acq->session) != 0)
+	{
+		fprintf(stderr,"Couldn't set up the acquisition loop: %s\n",strerror(errno));
+		aldl_mux_destroy(&acq->mux);
+		aldl_session_close(&acq->session);
+		return -1;
+	}
+
+	acq->running = 1;
+	clock_gettime(CLOCK_MONOTONIC, &acq->start_time);
+
+	if (aldl_mux_start_thread(&acq->mux) != 0)
+	{
+		acq->running = 0;
+		aldl_mux_destroy(&acq->mux);
+		aldl_session_close(&acq->session);
+		return -1;
+	}
+	return 0;
+}
+
+// stops the acquisition thread and waits for it to exit.
+void aldl_acq_stop(aldl_acquisition_t* acq)
+{
+	if (!acq->running)
+		return;
+	aldl_mux_join(&acq->mux); // sends mode 9 before it returns
+	aldl_mux_destroy(&acq->mux);
+	// keeps the statistics; only the session's buffers and timer are released
+	aldl_session_close(&acq->session);
+	acq->running = 0;
+}
+
+// returns the average number of frames received per second since the thread started.
+float aldl_acq_frame_rate(aldl_acquisition_t* acq)
+{
+	struct timespec now;
+	double elapsed;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = (now.tv_sec - acq->start_time.tv_sec)
+				+ (now.tv_nsec - acq->start_time.tv_nsec)/1000000000.0;
+	if (elapsed <= 0)
+		return 0;
+	return acq->session.frames/elapsed;
+}
@@ -0,0 +1,118 @@
+#ifndef LINUXALDL_ACQUIRE_INCLUDED
+#define LINUXALDL_ACQUIRE_INCLUDED
+
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <pthread.h>
+#include <sys/time.h>
+#include "linuxaldl_session.h"
+
+// ============================================================================
+// ACQUISITION THREAD AND FRAME RING
+// ============================================================================
+// the acquisition thread runs a single aldl session (see linuxaldl_session.h)
+// for the port and definition in the global aldl_settings: the mode 1
+// request/response cycle, or in ALDL_SCAN_PASSIVE mode only listening for the
+// frames the ECM sends unprompted. every verified frame is published, with its
+// timestamp, into a lock-free single-producer/single-consumer ring. the
+// consumer (the GUI or a logger) drains the ring at its own pace, so poll
+// cadence does not depend on how long the consumer takes to redraw or write.
+
+#define ALDL_MAX_FRAME_SIZE 256 // largest frame a record can hold
+#define ALDL_FRAME_RING_SIZE 64 // number of records in the ring. must be a power of two.
+
+typedef struct _aldl_frame_record
+{
+	struct timeval timestamp;	// time the frame was received
+	struct timespec received;	// CLOCK_MONOTONIC time the frame was received
+	unsigned long seq;			// counts every frame received since the thread started
+	unsigned int length;		// number of bytes in data
+	unsigned int data_offset;	// offset of the mode1 data block in data.
+								// 0 if the frame doesn't carry one (a broadcast
+								// frame that is recognized but not decoded).
+	char data[ALDL_MAX_FRAME_SIZE]; // the complete frame, header through checksum
+} aldl_frame_record_t;
+
+typedef struct _aldl_frame_ring
+{
+	aldl_frame_record_t slots[ALDL_FRAME_RING_SIZE];
+	unsigned int head;	// free-running index of the next record to consume. written by the consumer only.
+	unsigned int tail;	// free-running index of the next record to produce. written by the producer only.
+	unsigned long dropped; // frames the producer dropped because the ring was full
+} aldl_frame_ring_t;
+
+typedef struct _aldl_acquisition
+{
+	aldl_mux_t mux;			// event loop, run on its own thread
+	aldl_session_t session;	// the port being scanned. its statistics
+							// (frames, timeouts, ...) are the thread's.
+	int running;			// 1 while the thread is scanning
+	int passive;			// 1 if the thread is only listening (ALDL_SCAN_PASSIVE)
+	aldl_frame_ring_t ring;	// frames received by the thread
+
+	struct timespec start_time; // CLOCK_MONOTONIC time the thread was started
+} aldl_acquisition_t;
+
+// function prototypes
+// =================================================
+
+// frame ring
+// ----------
+aldl_frame_record_t* aldl_ring_write_slot(aldl_frame_ring_t* ring);
+// producer: returns the record to fill in next, or NULL if the ring is full.
+// the record is not visible to the consumer until aldl_ring_push() is called.
+
+void aldl_ring_push(aldl_frame_ring_t* ring);
+// producer: publishes the record returned by aldl_ring_write_slot().
+
+aldl_frame_record_t* aldl_ring_peek(aldl_frame_ring_t* ring);
+// consumer: returns the oldest unconsumed record, or NULL if the ring is empty.
+
+void aldl_ring_pop(aldl_frame_ring_t* ring);
+// consumer: releases the record returned by aldl_ring_peek() back to the producer.
+// the record must not be used after this.
+
+unsigned int aldl_ring_count(aldl_frame_ring_t* ring);
+// consumer: returns the number of records waiting to be consumed.
+
+// acquisition thread
+// ------------------
+int aldl_acq_start(aldl_acquisition_t* acq);
+// starts scanning with the current definition in the global aldl_settings.
+// requests mode 1 messages as set by aldl_settings.scan_mode (see linuxaldl.h),
+// or only listens if it is ALDL_SCAN_PASSIVE. the scan mode can't change
+// until scanning is stopped.
+// returns 0 on success, -1 if the thread could not be started or the
+// definition doesn't support the scan mode.
+
+void aldl_acq_update_settings(aldl_acquisition_t* acq);
+// passes changes to the scan interval, timeout and bus guard time in
+// aldl_settings on to a running acquisition thread. they apply from the
+// next poll. the scan mode is not passed on.
+
+void aldl_acq_stop(aldl_acquisition_t* acq);
+// stops the acquisition thread and waits for it to exit.
+// when polling, the thread sends a single mode 9 message before it exits.
+// frames still in the ring can be consumed afterwards.
+
+float aldl_acq_frame_rate(aldl_acquisition_t* acq);
+// returns the average number of frames received per second since the thread started.
+
+#endif
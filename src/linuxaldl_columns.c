@@ -0,0 +1,1073 @@
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "linuxaldl_columns.h"
+
+static void aldl_col_put_le16(unsigned char* p, uint16_t v)
+{
+	p[0] = v; p[1] = v>>8;
+}
+
+static void aldl_col_put_le32(unsigned char* p, uint32_t v)
+{
+	p[0] = v; p[1] = v>>8; p[2] = v>>16; p[3] = v>>24;
+}
+
+static void aldl_col_put_le64(unsigned char* p, uint64_t v)
+{
+	aldl_col_put_le32(p, v);
+	aldl_col_put_le32(p+4, v>>32);
+}
+
+static uint16_t aldl_col_get_le16(const unsigned char* p)
+{
+	return p[0] | (p[1]<<8);
+}
+
+static uint32_t aldl_col_get_le32(const unsigned char* p)
+{
+	return p[0] | (p[1]<<8) | (p[2]<<16) | ((uint32_t)p[3]<<24);
+}
+
+static uint64_t aldl_col_get_le64(const unsigned char* p)
+{
+	return aldl_col_get_le32(p) | ((uint64_t)aldl_col_get_le32(p+4)<<32);
+}
+
+// floats are stored as the little-endian bytes of their IEEE 754 bits
+static void aldl_col_put_float(unsigned char* p, float f)
+{
+	uint32_t v;
+
+	memcpy(&v, &f, 4);
+	aldl_col_put_le32(p, v);
+}
+
+static float aldl_col_get_float(const unsigned char* p)
+{
+	uint32_t v = aldl_col_get_le32(p);
+	float f;
+
+	memcpy(&f, &v, 4);
+	return f;
+}
+
+// returns the bytes a value of a column of type type takes unpacked
+static unsigned int aldl_col_width(aldl_col_type_t type)
+{
+	return (type == ALDL_COL_TIME) ? 8 : ((type == ALDL_COL_U8) ? 1 : 2);
+}
+
+// returns the number of bits needed to store values up to v
+static unsigned int aldl_col_bits(uint64_t v)
+{
+	return (v == 0) ? 0 : 64 - __builtin_clzll(v);
+}
+
+// returns the bytes count values of bits bits each are packed into
+static unsigned long aldl_col_packed_size(unsigned long count, unsigned int bits)
+{
+	return (count*bits + 7)/8;
+}
+
+// packs count values of bits bits each into p, lowest bit first.
+// returns the bytes written.
+static unsigned long aldl_col_pack(unsigned char* p, const uint64_t* v, unsigned long count, unsigned int bits)
+{
+	uint64_t acc = 0;
+	unsigned int fill = 0;
+	unsigned long i, n = 0;
+
+	if (bits == 0)
+		return 0;
+	for (i=0; i<count; i++)
+	{
+		acc |= v[i] << fill;
+		if (fill + bits >= 64)
+		{
+			aldl_col_put_le64(p+n, acc);
+			n += 8;
+			// the bits of v[i] that didn't fit
+			acc = (fill != 0) ? v[i] >> (64-fill) : 0;
+			fill = fill + bits - 64;
+		}
+		else fill += bits;
+	}
+	for (; fill > 0; fill = (fill > 8) ? fill-8 : 0)
+	{
+		p[n++] = acc;
+		acc >>= 8;
+	}
+	return n;
+}
+
+// unpacks count values of bits bits each from p, which can be read 9 bytes
+// past the last packed byte.
+static void aldl_col_unpack(const unsigned char* p, uint64_t* v, unsigned long count, unsigned int bits)
+{
+	uint64_t mask = (bits == 64) ? ~(uint64_t)0 : ((uint64_t)1 << bits) - 1;
+	uint64_t pos = 0, x;
+	unsigned int shift;
+	unsigned long i;
+
+	for (i=0; i<count; i++, pos+=bits)
+	{
+		shift = pos & 7;
+		x = aldl_col_get_le64(p + (pos>>3)) >> shift;
+		if (shift + bits > 64)
+			x |= (uint64_t)p[(pos>>3) + 8] << (64-shift);
+		v[i] = x & mask;
+	}
+}
+
+// returns a malloc'd string with the name of the columnar log for logfilename
+char* aldl_col_filename(const char* logfilename)
+{
+	unsigned int len = strlen(logfilename);
+	char* name = malloc(len + strlen(ALDL_COL_SUFFIX) + 1);
+
+	if (name == NULL)
+		return NULL;
+	memcpy(name, logfilename, len+1);
+	if (len > 3 && strcmp(name+len-3, ".gz") == 0)
+		name[len -= 3] = 0;
+	if (len > 4 && strcmp(name+len-4, ".log") == 0)
+		name[len -= 4] = 0;
+	strcpy(name+len, ALDL_COL_SUFFIX);
+	return name;
+}
+
+// ============================================================================
+// BUILDING CHUNKS
+// ============================================================================
+
+// returns 1 if item can be stored as a column of a data block of data_length
+// bytes, 0 otherwise: the items aldl_decode_plan_compile() can decode.
+static int aldl_col_storable(const byte_def_t* item, unsigned int data_length)
+{
+	return (item->operation == ALDL_OP_MULTIPLY || item->operation == ALDL_OP_DIVIDE)
+			&& (item->bits == 8 || item->bits == 16)
+			&& item->byte_offset != 0 && item->byte_offset-1 + item->bits/8 <= data_length;
+}
+
+// sets up ch to build chunks of up to capacity rows of def's items.
+// returns 0 on success, -1 if out of memory.
+int aldl_col_chunk_init(aldl_col_chunk_t* ch, aldl_definition* def, unsigned int capacity)
+{
+	aldl_col_column_t* col;
+	byte_def_t* item;
+	unsigned int i, c;
+
+	memset(ch, 0, sizeof(aldl_col_chunk_t));
+	ch->definition = def;
+	ch->capacity = capacity;
+	ch->num_columns = 1;
+	for (i=0; def->mode1_def[i].label != NULL; i++)
+		if (aldl_col_storable(def->mode1_def+i, def->mode1_data_length))
+			ch->num_columns++;
+
+	ch->columns = calloc(ch->num_columns, sizeof(aldl_col_column_t));
+	ch->times = malloc(capacity*sizeof(int64_t));
+	ch->values = malloc((unsigned long)capacity*(ch->num_columns-1)*sizeof(uint16_t));
+	ch->packed = malloc(capacity*sizeof(uint64_t));
+	ch->seen = calloc(65536/32, sizeof(uint32_t));
+	ch->number = malloc(65536*sizeof(uint16_t));
+	if (ch->columns == NULL || ch->times == NULL || ch->values == NULL || ch->packed == NULL
+		|| ch->seen == NULL || ch->number == NULL)
+	{
+		aldl_col_chunk_free(ch);
+		return -1;
+	}
+
+	ch->columns[0].type = ALDL_COL_TIME;
+	ch->columns[0].item = ALDL_COL_NO_ITEM;
+	strcpy(ch->columns[0].label, "Timestamp");
+	for (i=0, c=1; def->mode1_def[i].label != NULL; i++)
+	{
+		item = def->mode1_def+i;
+		if (!aldl_col_storable(item, def->mode1_data_length))
+			continue;
+		col = &ch->columns[c++];
+		col->type = (item->bits == 8) ? ALDL_COL_U8 : ALDL_COL_U16;
+		col->operation = item->operation;
+		col->item = i;
+		col->byte_offset = item->byte_offset;
+		col->factor = item->op_factor;
+		col->offset = item->op_offset;
+		strncpy(col->label, item->label, ALDL_COL_LABEL_SIZE);
+		if (item->units != NULL)
+			strncpy(col->units, item->units, ALDL_COL_UNITS_SIZE);
+	}
+	return 0;
+}
+
+// adds a row from the data block data. returns 1 if the chunk is now full.
+int aldl_col_chunk_add(aldl_col_chunk_t* ch, const struct timeval* timestamp, const char* data)
+{
+	const unsigned char* d = (const unsigned char*)data;
+	const aldl_col_column_t* col;
+	uint16_t* v = ch->values + ch->rows;
+	unsigned int c;
+
+	if (ch->rows == ch->capacity)
+		return 1;
+	ch->times[ch->rows] = (int64_t)timestamp->tv_sec*1000000 + timestamp->tv_usec;
+	for (c=1; c<ch->num_columns; c++, v+=ch->capacity)
+	{
+		col = &ch->columns[c];
+		if (col->type == ALDL_COL_U8)
+			*v = d[col->byte_offset-1];
+		else *v = (d[col->byte_offset-1]<<8) | d[col->byte_offset];
+	}
+	ch->rows++;
+	return ch->rows == ch->capacity;
+}
+
+// adds a row for each of count data blocks, as many as fit. returns how many.
+unsigned int aldl_col_chunk_add_blocks(aldl_col_chunk_t* ch, const int64_t* times, const char* data,
+										unsigned int stride, unsigned int count)
+{
+	const aldl_col_column_t* col;
+	const unsigned char* d;
+	uint16_t* v;
+	unsigned int c, i, n = ch->capacity - ch->rows;
+
+	if (n > count)
+		n = count;
+	memcpy(ch->times + ch->rows, times, n*sizeof(int64_t));
+	// a column at a time, so each loop only reads one offset of every block
+	for (c=1; c<ch->num_columns; c++)
+	{
+		col = &ch->columns[c];
+		d = (const unsigned char*)data + col->byte_offset-1;
+		v = ch->values + (unsigned long)(c-1)*ch->capacity + ch->rows;
+		if (col->type == ALDL_COL_U8)
+			for (i=0; i<n; i++)
+				v[i] = d[(unsigned long)i*stride];
+		else for (i=0; i<n; i++)
+				v[i] = (d[(unsigned long)i*stride]<<8) | d[(unsigned long)i*stride+1];
+	}
+	ch->rows += n;
+	return n;
+}
+
+// returns the most bytes a chunk of ch can be encoded to: every column plain
+unsigned long aldl_col_chunk_max_size(const aldl_col_chunk_t* ch)
+{
+	unsigned long row = 0;
+	unsigned int c;
+
+	for (c=0; c<ch->num_columns; c++)
+		row += aldl_col_width(ch->columns[c].type);
+	return ALDL_COL_CHUNK_SIZE + ch->num_columns*ALDL_COL_ENTRY_SIZE + ch->capacity*row;
+}
+
+// returns the raw value of row i of column c of ch
+static inline int64_t aldl_col_chunk_value(const aldl_col_chunk_t* ch, unsigned int c, unsigned int i)
+{
+	if (c == 0)
+		return ch->times[i];
+	return ch->values[(unsigned long)(c-1)*ch->capacity + i];
+}
+
+// writes the count values of column c of ch from row first on into p, plain.
+// returns the bytes written.
+static unsigned long aldl_col_put_plain(const aldl_col_chunk_t* ch, unsigned int c,
+										const int64_t* values, unsigned long count, unsigned char* p)
+{
+	unsigned int width = aldl_col_width(ch->columns[c].type);
+	unsigned long i;
+
+	for (i=0; i<count; i++)
+	{
+		if (width == 8)
+			aldl_col_put_le64(p + i*8, values[i]);
+		else if (width == 2)
+			aldl_col_put_le16(p + i*2, values[i]);
+		else p[i] = values[i];
+	}
+	return count*width;
+}
+
+// encodes column c of ch into p with whichever encoding is smallest, and
+// writes its entry (but for the crc) into entry. returns the bytes written.
+static unsigned long aldl_col_encode_column(aldl_col_chunk_t* ch, unsigned int c,
+											unsigned char* entry, unsigned char* p)
+{
+	unsigned int width = aldl_col_width(ch->columns[c].type);
+	unsigned int rows = ch->rows, distinct = 0, i, v;
+	unsigned int range_bits, delta_bits, dict_bits = 0;
+	unsigned long size, best_size, n;
+	aldl_col_encoding_t best = ALDL_COL_PLAIN;
+	int64_t x, prev, min, max, dmin = 0, dmax = 0;
+	int64_t dict[ALDL_COL_DICT_MAX];
+
+	// the range of the values and of the differences, and which values there are
+	min = max = prev = aldl_col_chunk_value(ch, c, 0);
+	for (i=0; i<rows; i++)
+	{
+		x = aldl_col_chunk_value(ch, c, i);
+		if (x < min)
+			min = x;
+		if (x > max)
+			max = x;
+		if (i == 1)
+			dmin = dmax = x - prev;
+		else if (i > 1 && x - prev < dmin)
+			dmin = x - prev;
+		else if (i > 1 && x - prev > dmax)
+			dmax = x - prev;
+		prev = x;
+		if (c != 0 && !(ch->seen[x>>5] & (1u << (x&31))))
+		{
+			ch->seen[x>>5] |= 1u << (x&31);
+			distinct++;
+		}
+	}
+	range_bits = aldl_col_bits((uint64_t)max - (uint64_t)min);
+	delta_bits = aldl_col_bits((uint64_t)dmax - (uint64_t)dmin);
+
+	// the dictionary is in ascending order, as the bitmap is
+	if (distinct > ALDL_COL_DICT_MAX)
+		distinct = 0;
+	if (distinct != 0)
+	{
+		for (v=min, n=0; v<=(unsigned int)max; v++)
+			if (ch->seen[v>>5] & (1u << (v&31)))
+			{
+				ch->number[v] = n;
+				dict[n++] = v;
+			}
+		dict_bits = aldl_col_bits(distinct-1);
+	}
+	if (c != 0)
+		memset(ch->seen + (min>>5), 0, ((max>>5) - (min>>5) + 1)*sizeof(uint32_t));
+
+	// plain unless another encoding is smaller
+	best_size = (unsigned long)rows*width;
+	size = 8 + aldl_col_packed_size(rows, range_bits);
+	if (size < best_size)
+	{
+		best = ALDL_COL_BITPACK;
+		best_size = size;
+	}
+	size = 16 + aldl_col_packed_size(rows-1, delta_bits);
+	if (size < best_size)
+	{
+		best = ALDL_COL_DELTA;
+		best_size = size;
+	}
+	size = 2 + distinct*width + aldl_col_packed_size(rows, dict_bits);
+	if (distinct != 0 && size < best_size)
+	{
+		best = ALDL_COL_DICT;
+		best_size = size;
+	}
+
+	memset(entry, 0, ALDL_COL_ENTRY_SIZE);
+	entry[0] = best;
+	aldl_col_put_le16(entry+2, distinct);
+	aldl_col_put_le64(entry+16, min);
+	aldl_col_put_le64(entry+24, max);
+
+	switch (best)
+	{
+		case ALDL_COL_PLAIN:
+			for (i=0; i<rows; i++)
+				ch->packed[i] = aldl_col_chunk_value(ch, c, i);
+			size = aldl_col_put_plain(ch, c, (const int64_t*)ch->packed, rows, p);
+			break;
+		case ALDL_COL_BITPACK:
+			entry[1] = range_bits;
+			aldl_col_put_le64(p, min);
+			for (i=0; i<rows; i++)
+				ch->packed[i] = aldl_col_chunk_value(ch, c, i) - min;
+			size = 8 + aldl_col_pack(p+8, ch->packed, rows, range_bits);
+			break;
+		case ALDL_COL_DELTA:
+			entry[1] = delta_bits;
+			aldl_col_put_le64(p, aldl_col_chunk_value(ch, c, 0));
+			aldl_col_put_le64(p+8, dmin);
+			for (i=1; i<rows; i++)
+				ch->packed[i-1] = aldl_col_chunk_value(ch, c, i) - aldl_col_chunk_value(ch, c, i-1) - dmin;
+			size = 16 + aldl_col_pack(p+16, ch->packed, rows-1, delta_bits);
+			break;
+		case ALDL_COL_DICT:
+			entry[1] = dict_bits;
+			aldl_col_put_le16(p, distinct);
+			size = 2 + aldl_col_put_plain(ch, c, dict, distinct, p+2);
+			for (i=0; i<rows; i++)
+				ch->packed[i] = ch->number[aldl_col_chunk_value(ch, c, i)];
+			size += aldl_col_pack(p+size, ch->packed, rows, dict_bits);
+			break;
+	}
+	aldl_col_put_le32(entry+4, size);
+	aldl_col_put_le32(entry+8, aldl_crc32(0, p, size));
+	return size;
+}
+
+// encodes the rows in ch into buf and empties ch.
+// returns the size of the chunk, 0 if ch had no rows.
+unsigned long aldl_col_chunk_encode(aldl_col_chunk_t* ch, unsigned char* buf)
+{
+	unsigned int header = ALDL_COL_CHUNK_SIZE + ch->num_columns*ALDL_COL_ENTRY_SIZE;
+	unsigned long size = header;
+	unsigned int c;
+
+	if (ch->rows == 0)
+		return 0;
+	for (c=0; c<ch->num_columns; c++)
+		size += aldl_col_encode_column(ch, c, buf + ALDL_COL_CHUNK_SIZE + c*ALDL_COL_ENTRY_SIZE,
+										buf + size);
+
+	memset(buf, 0, ALDL_COL_CHUNK_SIZE);
+	aldl_col_put_le16(buf, ALDL_COL_CHUNK_MARK);
+	aldl_col_put_le16(buf+2, ch->num_columns);
+	aldl_col_put_le32(buf+4, ch->rows);
+	aldl_col_put_le64(buf+8, size);
+	aldl_col_put_le64(buf+16, ch->times[0]);
+	aldl_col_put_le64(buf+24, ch->times[ch->rows-1]);
+	aldl_col_put_le32(buf+32, aldl_crc32(0, buf, header));
+	ch->rows = 0;
+	return size;
+}
+
+// frees the memory allocated by aldl_col_chunk_init()
+void aldl_col_chunk_free(aldl_col_chunk_t* ch)
+{
+	free(ch->columns);
+	free(ch->times);
+	free(ch->values);
+	free(ch->packed);
+	free(ch->seen);
+	free(ch->number);
+	memset(ch, 0, sizeof(aldl_col_chunk_t));
+}
+
+// returns the size of the file header for the columns of ch
+unsigned int aldl_col_header_size(const aldl_col_chunk_t* ch)
+{
+	return ALDL_COL_HEADER_SIZE + ch->num_columns*ALDL_COL_COLUMN_SIZE;
+}
+
+// writes the file header for the columns of ch into buf
+void aldl_col_format_header(const aldl_col_chunk_t* ch, unsigned char* buf)
+{
+	const aldl_col_column_t* col;
+	unsigned char* p;
+	unsigned int c;
+
+	memset(buf, 0, aldl_col_header_size(ch));
+	memcpy(buf, ALDL_COL_MAGIC, 8);
+	aldl_col_put_le16(buf+8, ALDL_COL_VERSION);
+	aldl_col_put_le16(buf+10, ALDL_COL_HEADER_SIZE);
+	aldl_col_put_le16(buf+12, ALDL_COL_COLUMN_SIZE);
+	aldl_col_put_le16(buf+14, ALDL_COL_CHUNK_SIZE);
+	aldl_col_put_le16(buf+16, ALDL_COL_ENTRY_SIZE);
+	aldl_col_put_le16(buf+18, ch->num_columns);
+	aldl_col_put_le32(buf+20, aldl_definition_hash(ch->definition));
+	aldl_col_put_le32(buf+28, ch->capacity);
+	strncpy((char*)buf+32, ch->definition->name, ALDL_COL_NAME_SIZE);
+
+	for (c=0; c<ch->num_columns; c++)
+	{
+		col = &ch->columns[c];
+		p = buf + ALDL_COL_HEADER_SIZE + c*ALDL_COL_COLUMN_SIZE;
+		p[0] = col->type;
+		p[1] = col->operation;
+		aldl_col_put_le16(p+2, col->item);
+		aldl_col_put_float(p+4, col->factor);
+		aldl_col_put_float(p+8, col->offset);
+		aldl_col_put_le16(p+12, col->byte_offset);
+		memcpy(p+16, col->units, strlen(col->units));
+		memcpy(p+32, col->label, strlen(col->label));
+	}
+	aldl_col_put_le32(buf+24, aldl_crc32(0, buf, aldl_col_header_size(ch)));
+}
+
+// ============================================================================
+// WRITING
+// ============================================================================
+
+// writes len bytes of buf to fd at offset. returns 0 on success, -1 on failure.
+static int aldl_col_pwrite(int fd, const unsigned char* buf, unsigned long len, uint64_t offset)
+{
+	ssize_t res;
+
+	while (len > 0)
+	{
+		res = pwrite(fd, buf, len, offset);
+		if (res < 0 && errno == EINTR)
+			continue;
+		if (res <= 0)
+			return -1;
+		buf += res;
+		len -= res;
+		offset += res;
+	}
+	return 0;
+}
+
+// encodes ch and writes it after the last chunk written.
+static void aldl_col_writer_write(aldl_col_writer_t* w, aldl_col_chunk_t* ch)
+{
+	unsigned long len = aldl_col_chunk_encode(ch, w->buf);
+
+	if (len == 0)
+		return;
+	// a chunk that couldn't all be written is written over by the next one
+	if (aldl_col_pwrite(w->fd, w->buf, len, w->bytes) != 0)
+	{
+		w->errors++;
+		return;
+	}
+	w->chunks_written++;
+	w->bytes += len;
+}
+
+// the writer thread: writes each chunk that is handed to it
+static void* aldl_col_writer_thread(void* arg)
+{
+	aldl_col_writer_t* w = arg;
+
+	pthread_mutex_lock(&w->lock);
+	for (;;)
+	{
+		while (!w->full && w->running)
+			pthread_cond_wait(&w->cond, &w->lock);
+		if (!w->full)
+			break;
+		pthread_mutex_unlock(&w->lock);
+
+		// the receiving thread only fills the other chunk until full is cleared
+		aldl_col_writer_write(w, &w->chunks[1 - w->filling]);
+
+		pthread_mutex_lock(&w->lock);
+		w->full = 0;
+	}
+	pthread_mutex_unlock(&w->lock);
+	return NULL;
+}
+
+// frees everything aldl_col_writer_open() allocated and closes the file
+static void aldl_col_writer_release(aldl_col_writer_t* w)
+{
+	aldl_col_chunk_free(&w->chunks[0]);
+	aldl_col_chunk_free(&w->chunks[1]);
+	free(w->buf);
+	w->buf = NULL;
+	if (w->fd != -1)
+		close(w->fd);
+	w->fd = -1;
+}
+
+// opens (or creates) the columnar log filename to add rows of def's items to.
+// returns 0 on success, -1 on failure.
+int aldl_col_writer_open(aldl_col_writer_t* w, const char* filename, aldl_definition* def)
+{
+	aldl_col_reader_t r;
+	unsigned char* header;
+	unsigned int size;
+	struct stat st;
+
+	memset(w, 0, sizeof(aldl_col_writer_t));
+	w->fd = -1;
+	if (aldl_col_chunk_init(&w->chunks[0], def, ALDL_COL_CHUNK_ROWS) != 0
+		|| aldl_col_chunk_init(&w->chunks[1], def, ALDL_COL_CHUNK_ROWS) != 0
+		|| (w->buf = malloc(aldl_col_chunk_max_size(&w->chunks[0]))) == NULL)
+	{
+		aldl_col_writer_release(w);
+		return -1;
+	}
+	// the header goes in the chunk buffer; it is much smaller than a chunk
+	size = aldl_col_header_size(&w->chunks[0]);
+	header = w->buf + aldl_col_chunk_max_size(&w->chunks[0]) - size;
+	aldl_col_format_header(&w->chunks[0], header);
+
+	w->fd = open(filename, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+	if (w->fd == -1 || fstat(w->fd, &st) != 0)
+	{
+		fprintf(stderr,"Couldn't open the columnar log %s: %s\n",filename,strerror(errno));
+		aldl_col_writer_release(w);
+		return -1;
+	}
+	if (st.st_size == 0)
+	{
+		if (aldl_col_pwrite(w->fd, header, size, 0) != 0)
+		{
+			fprintf(stderr,"Couldn't write the columnar log %s: %s\n",filename,strerror(errno));
+			aldl_col_writer_release(w);
+			return -1;
+		}
+		w->bytes = size;
+	}
+	else
+	{
+		// rows are only added to a log with the same columns, after its
+		// last whole chunk
+		if (st.st_size < size || pread(w->fd, w->buf, size, 0) != size || memcmp(w->buf, header, size) != 0
+			|| aldl_col_reader_open(&r, filename) != 0)
+		{
+			fprintf(stderr,"%s is not a columnar log of %s. Leaving it alone.\n",filename,def->name);
+			aldl_col_writer_release(w);
+			return -1;
+		}
+		w->bytes = r.end;
+		aldl_col_reader_close(&r);
+		if (w->bytes < (uint64_t)st.st_size)
+		{
+			fprintf(stderr,"%s ends with a chunk that was cut short. Dropping it.\n",filename);
+			if (ftruncate(w->fd, w->bytes) != 0)
+			{
+				aldl_col_writer_release(w);
+				return -1;
+			}
+		}
+	}
+
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->cond, NULL);
+	w->running = 1;
+	if (pthread_create(&w->thread, NULL, aldl_col_writer_thread, w) != 0)
+	{
+		fprintf(stderr,"Couldn't start the columnar log thread.\n");
+		pthread_mutex_destroy(&w->lock);
+		pthread_cond_destroy(&w->cond);
+		aldl_col_writer_release(w);
+		return -1;
+	}
+	return 0;
+}
+
+// hands the full chunk to the thread and starts filling the other one.
+// returns 0, or -1 if the other one hasn't been written yet.
+static int aldl_col_writer_hand_off(aldl_col_writer_t* w)
+{
+	pthread_mutex_lock(&w->lock);
+	if (w->full)
+	{
+		pthread_mutex_unlock(&w->lock);
+		return -1;
+	}
+	w->filling = 1 - w->filling;
+	w->full = 1;
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+	return 0;
+}
+
+// adds a row from the data block data
+void aldl_col_writer_add(aldl_col_writer_t* w, const struct timeval* timestamp, const char* data)
+{
+	aldl_col_chunk_t* ch;
+
+	if (w->fd == -1)
+		return;
+	ch = &w->chunks[w->filling];
+	if (ch->rows == ch->capacity && aldl_col_writer_hand_off(w) != 0)
+	{
+		w->dropped++;
+		return;
+	}
+	if (aldl_col_chunk_add(&w->chunks[w->filling], timestamp, data))
+		aldl_col_writer_hand_off(w);
+	w->rows++;
+}
+
+// stops the thread, writes the last chunk and closes the file.
+// returns 0 on success, -1 if any chunk couldn't be written.
+int aldl_col_writer_close(aldl_col_writer_t* w)
+{
+	int res = 0;
+
+	if (w->fd == -1)
+		return 0;
+	pthread_mutex_lock(&w->lock);
+	w->running = 0;
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+	pthread_join(w->thread, NULL);
+	pthread_mutex_destroy(&w->lock);
+	pthread_cond_destroy(&w->cond);
+
+	aldl_col_writer_write(w, &w->chunks[w->filling]);
+	if (fsync(w->fd) != 0 || w->errors != 0)
+		res = -1;
+	aldl_col_writer_release(w);
+	return res;
+}
+
+// ============================================================================
+// READING
+// ============================================================================
+
+// reads len bytes at offset of fd into buf. returns 0 on success, -1 on failure.
+static int aldl_col_pread(int fd, unsigned char* buf, unsigned long len, uint64_t offset)
+{
+	ssize_t res;
+
+	while (len > 0)
+	{
+		res = pread(fd, buf, len, offset);
+		if (res < 0 && errno == EINTR)
+			continue;
+		if (res <= 0)
+			return -1;
+		buf += res;
+		len -= res;
+		offset += res;
+	}
+	return 0;
+}
+
+// reads the header and the column descriptors of r.
+// returns the file offset of the first chunk, or 0 if they aren't valid.
+static uint64_t aldl_col_reader_header(aldl_col_reader_t* r, unsigned int* chunk_size,
+										unsigned int* entry_size)
+{
+	unsigned char h[ALDL_COL_HEADER_SIZE];
+	unsigned char* buf;
+	unsigned int header_size, column_size, size, c;
+	aldl_col_column_t* col;
+	uint32_t crc;
+
+	if (aldl_col_pread(r->fd, h, ALDL_COL_HEADER_SIZE, 0) != 0 || memcmp(h, ALDL_COL_MAGIC, 8) != 0
+		|| aldl_col_get_le16(h+8) != ALDL_COL_VERSION)
+		return 0;
+	header_size = aldl_col_get_le16(h+10);
+	column_size = aldl_col_get_le16(h+12);
+	*chunk_size = aldl_col_get_le16(h+14);
+	*entry_size = aldl_col_get_le16(h+16);
+	r->num_columns = aldl_col_get_le16(h+18);
+	r->definition_hash = aldl_col_get_le32(h+20);
+	crc = aldl_col_get_le32(h+24);
+	r->chunk_rows = aldl_col_get_le32(h+28);
+	if (header_size < ALDL_COL_HEADER_SIZE || column_size < ALDL_COL_COLUMN_SIZE
+		|| *chunk_size < ALDL_COL_CHUNK_SIZE || *entry_size < ALDL_COL_ENTRY_SIZE
+		|| r->num_columns == 0 || r->chunk_rows == 0)
+		return 0;
+
+	size = header_size + r->num_columns*column_size;
+	buf = malloc(size);
+	r->columns = calloc(r->num_columns, sizeof(aldl_col_column_t));
+	if (buf == NULL || r->columns == NULL || aldl_col_pread(r->fd, buf, size, 0) != 0)
+	{
+		free(buf);
+		return 0;
+	}
+	memset(buf+24, 0, 4);
+	if (aldl_crc32(0, buf, size) != crc)
+	{
+		free(buf);
+		return 0;
+	}
+	memcpy(r->name, buf+32, ALDL_COL_NAME_SIZE);
+
+	for (c=0; c<r->num_columns; c++)
+	{
+		const unsigned char* p = buf + header_size + c*column_size;
+
+		col = &r->columns[c];
+		col->type = p[0];
+		col->operation = p[1];
+		col->item = aldl_col_get_le16(p+2);
+		col->factor = aldl_col_get_float(p+4);
+		col->offset = aldl_col_get_float(p+8);
+		col->byte_offset = aldl_col_get_le16(p+12);
+		memcpy(col->units, p+16, ALDL_COL_UNITS_SIZE);
+		memcpy(col->label, p+32, ALDL_COL_LABEL_SIZE);
+		// the first column holds the time, and only the first
+		if ((c == 0) != (col->type == ALDL_COL_TIME) || col->type > ALDL_COL_U16
+			|| (c != 0 && col->operation != ALDL_OP_MULTIPLY && col->operation != ALDL_OP_DIVIDE))
+		{
+			free(buf);
+			return 0;
+		}
+	}
+	free(buf);
+	return size;
+}
+
+// opens the columnar log filename and reads the header of every chunk.
+// returns 0 on success, -1 on failure.
+int aldl_col_reader_open(aldl_col_reader_t* r, const char* filename)
+{
+	unsigned int chunk_size, entry_size, header, c;
+	unsigned long allocated = 0, i;
+	unsigned char* h = NULL;
+	aldl_col_chunk_info_t* chunk;
+	aldl_col_entry_t* e;
+	struct stat st;
+	uint64_t offset, bytes, data;
+	uint32_t crc;
+	void* p;
+
+	memset(r, 0, sizeof(aldl_col_reader_t));
+	r->fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (r->fd == -1)
+	{
+		fprintf(stderr,"Couldn't open %s: %s\n",filename,strerror(errno));
+		return -1;
+	}
+	offset = aldl_col_reader_header(r, &chunk_size, &entry_size);
+	if (offset == 0 || fstat(r->fd, &st) != 0)
+	{
+		fprintf(stderr,"%s is not a columnar log, or was written by another version.\n",filename);
+		aldl_col_reader_close(r);
+		return -1;
+	}
+	r->size = st.st_size;
+
+	header = chunk_size + r->num_columns*entry_size;
+	h = malloc(header);
+	if (h == NULL)
+	{
+		aldl_col_reader_close(r);
+		return -1;
+	}
+	// every chunk header is read, but none of the data
+	while (offset + header <= r->size && aldl_col_pread(r->fd, h, header, offset) == 0)
+	{
+		bytes = aldl_col_get_le64(h+8);
+		crc = aldl_col_get_le32(h+32);
+		memset(h+32, 0, 4);
+		if (aldl_col_get_le16(h) != ALDL_COL_CHUNK_MARK || aldl_col_get_le16(h+2) != r->num_columns
+			|| aldl_crc32(0, h, header) != crc
+			|| bytes < header || bytes > r->size - offset
+			|| aldl_col_get_le32(h+4) == 0 || aldl_col_get_le32(h+4) > r->chunk_rows)
+			break;
+
+		if (r->num_chunks == allocated)
+		{
+			allocated = allocated ? allocated*2 : 64;
+			p = realloc(r->chunks, allocated*sizeof(aldl_col_chunk_info_t));
+			if (p == NULL)
+				break;
+			r->chunks = p;
+			p = realloc(r->entries, allocated*r->num_columns*sizeof(aldl_col_entry_t));
+			if (p == NULL)
+				break;
+			r->entries = p;
+		}
+		chunk = &r->chunks[r->num_chunks];
+		chunk->offset = offset;
+		chunk->rows = aldl_col_get_le32(h+4);
+		chunk->first_time = aldl_col_get_le64(h+16);
+		chunk->last_time = aldl_col_get_le64(h+24);
+
+		data = offset + header;
+		for (c=0; c<r->num_columns; c++)
+		{
+			const unsigned char* q = h + chunk_size + c*entry_size;
+
+			e = &r->entries[r->num_chunks*r->num_columns + c];
+			e->encoding = q[0];
+			e->bits = q[1];
+			e->distinct = aldl_col_get_le16(q+2);
+			e->size = aldl_col_get_le32(q+4);
+			e->crc = aldl_col_get_le32(q+8);
+			e->min = aldl_col_get_le64(q+16);
+			e->max = aldl_col_get_le64(q+24);
+			e->offset = data;
+			data += e->size;
+		}
+		if (data != offset + bytes)
+			break;
+		r->num_chunks++;
+		r->rows += chunk->rows;
+		offset += bytes;
+	}
+	free(h);
+	r->end = offset;
+
+	// the entries have stopped moving
+	for (i=0; i<r->num_chunks; i++)
+		r->chunks[i].entries = r->entries + i*r->num_columns;
+	return 0;
+}
+
+// closes the file and frees the memory allocated by aldl_col_reader_open()
+void aldl_col_reader_close(aldl_col_reader_t* r)
+{
+	if (r->fd != -1)
+		close(r->fd);
+	free(r->columns);
+	free(r->chunks);
+	free(r->entries);
+	free(r->buf);
+	free(r->raw);
+	memset(r, 0, sizeof(aldl_col_reader_t));
+	r->fd = -1;
+}
+
+// returns the number of the column labelled label, or -1
+int aldl_col_reader_find(aldl_col_reader_t* r, const char* label)
+{
+	unsigned int c;
+
+	for (c=0; c<r->num_columns; c++)
+		if (strcmp(r->columns[c].label, label) == 0)
+			return c;
+	return -1;
+}
+
+// returns the first chunk whose last row is at or after t, or -1
+long aldl_col_reader_lookup(aldl_col_reader_t* r, const struct timeval* t)
+{
+	int64_t time = (int64_t)t->tv_sec*1000000 + t->tv_usec;
+	unsigned long lo = 0, hi = r->num_chunks, mid;
+
+	while (lo < hi)
+	{
+		mid = lo + (hi-lo)/2;
+		if (r->chunks[mid].last_time < time)
+			lo = mid+1;
+		else hi = mid;
+	}
+	return (lo < r->num_chunks) ? (long)lo : -1;
+}
+
+// reads column column of chunk chunk into raw. returns the number of rows, or -1.
+long aldl_col_reader_raw(aldl_col_reader_t* r, unsigned long chunk, unsigned int column, int64_t* raw)
+{
+	const aldl_col_entry_t* e;
+	unsigned int width, count, i;
+	unsigned long rows;
+	int64_t dict[ALDL_COL_DICT_MAX];
+	uint64_t* v = (uint64_t*)raw;
+	unsigned char* p;
+	int64_t base, step;
+
+	if (chunk >= r->num_chunks || column >= r->num_columns)
+		return -1;
+	e = &r->chunks[chunk].entries[column];
+	rows = r->chunks[chunk].rows;
+	width = aldl_col_width(r->columns[column].type);
+	if (e->bits > 64)
+		return -1;
+
+	// room for the unpacking to read past the end
+	if (r->buf_size < e->size + 16)
+	{
+		p = realloc(r->buf, e->size + 16);
+		if (p == NULL)
+			return -1;
+		r->buf = p;
+		r->buf_size = e->size + 16;
+	}
+	p = r->buf;
+	memset(p + e->size, 0, 16);
+	if (aldl_col_pread(r->fd, p, e->size, e->offset) != 0)
+		return -1;
+	r->bytes_read += e->size;
+	if (aldl_crc32(0, p, e->size) != e->crc)
+		return -1;
+
+	switch (e->encoding)
+	{
+		case ALDL_COL_PLAIN:
+			if (e->size != rows*width)
+				return -1;
+			for (i=0; i<rows; i++)
+				raw[i] = (width == 8) ? (int64_t)aldl_col_get_le64(p + i*8)
+						: ((width == 2) ? aldl_col_get_le16(p + i*2) : p[i]);
+			break;
+		case ALDL_COL_BITPACK:
+			if (e->size < 8 + aldl_col_packed_size(rows, e->bits))
+				return -1;
+			base = aldl_col_get_le64(p);
+			aldl_col_unpack(p+8, v, rows, e->bits);
+			for (i=0; i<rows; i++)
+				v[i] += base;
+			break;
+		case ALDL_COL_DELTA:
+			if (e->size < 16 + aldl_col_packed_size(rows-1, e->bits))
+				return -1;
+			base = aldl_col_get_le64(p);
+			step = aldl_col_get_le64(p+8);
+			aldl_col_unpack(p+16, v+1, rows-1, e->bits);
+			v[0] = base;
+			for (i=1; i<rows; i++)
+				v[i] += v[i-1] + step;
+			break;
+		case ALDL_COL_DICT:
+			count = aldl_col_get_le16(p);
+			if (count == 0 || count > ALDL_COL_DICT_MAX || width == 8
+				|| e->size < 2 + count*width + aldl_col_packed_size(rows, e->bits))
+				return -1;
+			for (i=0; i<count; i++)
+				dict[i] = (width == 2) ? aldl_col_get_le16(p + 2 + i*2) : p[2+i];
+			aldl_col_unpack(p + 2 + count*width, v, rows, e->bits);
+			for (i=0; i<rows; i++)
+			{
+				if (v[i] >= count)
+					return -1;
+				raw[i] = dict[v[i]];
+			}
+			break;
+		default:
+			return -1;
+	}
+	return rows;
+}
+
+// returns the value of the raw value raw of an item column
+float aldl_col_decode(const aldl_col_column_t* column, int64_t raw)
+{
+	if (column->type == ALDL_COL_U8)
+		return aldl_raw8_to_float(raw, column->operation, column->factor, column->offset);
+	return aldl_raw16_to_float(raw>>8, raw&0xff, column->operation, column->factor, column->offset);
+}
+
+// reads an item column of a chunk, decoded. returns the number of rows, or -1.
+long aldl_col_reader_values(aldl_col_reader_t* r, unsigned long chunk, unsigned int column, float* values)
+{
+	const aldl_col_column_t* col;
+	long rows, i;
+
+	if (column == 0 || column >= r->num_columns)
+		return -1;
+	if (r->raw == NULL && (r->raw = malloc(r->chunk_rows*sizeof(int64_t))) == NULL)
+		return -1;
+	rows = aldl_col_reader_raw(r, chunk, column, r->raw);
+	col = &r->columns[column];
+	for (i=0; i<rows; i++)
+		values[i] = aldl_col_decode(col, r->raw[i]);
+	return rows;
+}
+
+// gets the smallest and largest decoded value of an item column of a chunk
+void aldl_col_reader_range(aldl_col_reader_t* r, unsigned long chunk, unsigned int column,
+							float* min, float* max)
+{
+	const aldl_col_entry_t* e = &r->chunks[chunk].entries[column];
+	float a = aldl_col_decode(&r->columns[column], e->min);
+	float b = aldl_col_decode(&r->columns[column], e->max);
+
+	// a negative factor, or dividing, turns the order around
+	*min = (a < b) ? a : b;
+	*max = (a < b) ? b : a;
+}
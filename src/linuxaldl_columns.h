@@ -0,0 +1,347 @@
+#ifndef LINUXALDL_COLUMNS_INCLUDED
+#define LINUXALDL_COLUMNS_INCLUDED
+
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "linuxaldl_core.h"
+
+// ============================================================================
+// COLUMNAR LOGS
+// ============================================================================
+// a columnar log holds a log the way it is analysed: one column per item of
+// the definition, plus one of timestamps, instead of one record per frame.
+// the rows are split into chunks of ALDL_COL_CHUNK_ROWS (only the last chunk
+// written by a writer can have fewer), and each chunk has a table of where
+// its columns are, how they are encoded and the smallest and largest value
+// in each. a program that wants RPM and MAP out of sixty items reads those
+// two columns of each chunk and nothing else, and skips whole chunks whose
+// statistics rule them out.
+//
+// columns are typed: an item column holds the item's raw 8 or 16 bit value
+// from the data block, with the item's operation, factor and offset in the
+// column descriptor, so values are decoded exactly as aldl_decode_item()
+// does when they are read. raw values are what compresses well: every column
+// of every chunk is stored with whichever of these encodings is smallest:
+//   plain     every value as it is
+//   bit-pack  the smallest value, then each value less it in as few bits as
+//             the largest difference needs. a column that never changes in
+//             the chunk takes 8 bytes.
+//   delta     the first value and the smallest difference from one row to
+//             the next, then each difference less that, bit-packed. made for
+//             the time column and counters.
+//   dictionary the distinct values (up to ALDL_COL_DICT_MAX), then the
+//             number of each row's value among them, bit-packed. for items
+//             with a few values spread far apart, like flags and switches.
+//
+// chunks are built with an aldl_col_chunk_t and encoded into memory.
+// an aldl_col_writer_t writes a columnar log alongside a session's log as
+// frames arrive (see aldl_logger_start_columns() in linuxaldl_log.h), and
+// linuxaldl-convert builds one from a raw log on every core. the writer
+// appends to a file that is already there, so the last chunk of each
+// session can be short, and a chunk cut short by a crash is dropped when
+// writing starts again.
+// columnar logs are read with an aldl_col_reader_t.
+//
+// columnar log file, all integers little-endian:
+//   header, ALDL_COL_HEADER_SIZE bytes:
+//     0   8  magic, ALDL_COL_MAGIC
+//     8   2  format version, ALDL_COL_VERSION
+//    10   2  header size, ALDL_COL_HEADER_SIZE
+//    12   2  column descriptor size, ALDL_COL_COLUMN_SIZE
+//    14   2  chunk header size, ALDL_COL_CHUNK_SIZE
+//    16   2  chunk column entry size, ALDL_COL_ENTRY_SIZE
+//    18   2  number of columns, the time column included
+//    20   4  aldl_definition_hash() of the definition
+//    24   4  aldl_crc32() of the header and the column descriptors, with these 4 bytes 0
+//    28   4  rows in a full chunk
+//    32  64  definition name, NUL padded (and truncated to fit)
+//   column descriptor, ALDL_COL_COLUMN_SIZE bytes, one per column:
+//     0   1  type, aldl_col_type_t
+//     1   1  operation: ALDL_OP_MULTIPLY or ALDL_OP_DIVIDE (0 for the time column)
+//     2   2  index of the item in mode1_def, ALDL_COL_NO_ITEM for the time column
+//     4   4  op_factor, as an IEEE 754 single float
+//     8   4  op_offset, likewise
+//    12   2  byte_offset of the item in the data block (1 is the first byte)
+//    14   2  reserved, 0
+//    16  16  units, NUL padded (and truncated to fit)
+//    32  32  label, NUL padded (and truncated to fit)
+//   chunk, ALDL_COL_CHUNK_SIZE bytes, then an entry per column, then the
+//   data of each column in the order of the entries:
+//     0   2  chunk mark, ALDL_COL_CHUNK_MARK
+//     2   2  number of columns
+//     4   4  number of rows
+//     8   8  bytes in the chunk, header and entries included
+//    16   8  time of the first row, microseconds since 1970
+//    24   8  ...and of the last row
+//    32   4  aldl_crc32() of the chunk header and the entries, with these 4 bytes 0
+//    36  12  reserved, 0
+//   chunk column entry, ALDL_COL_ENTRY_SIZE bytes:
+//     0   1  encoding, aldl_col_encoding_t
+//     1   1  bits per packed value (0-64)
+//     2   2  distinct values in the column, 0 if more than ALDL_COL_DICT_MAX
+//     4   4  bytes of data
+//     8   4  aldl_crc32() of the data
+//    12   4  reserved, 0
+//    16   8  smallest raw value in the column (signed)
+//    24   8  largest raw value
+//   column data. values are the raw values: microseconds since 1970 (signed
+//   64 bits) for the time column, the 8 or 16 bit value of an item, and
+//   packed values are stored in the given number of bits each, lowest bit
+//   first, with the last byte padded with 0 bits.
+//     ALDL_COL_PLAIN     each value in 8, 1 or 2 bytes as the type says
+//     ALDL_COL_BITPACK   8  smallest value, then each value less it, packed
+//     ALDL_COL_DELTA     8  first value, 8 smallest difference (value less
+//                        the previous one), then for each row after the first
+//                        its difference less the smallest, packed
+//     ALDL_COL_DICT      2  number of distinct values, then the values in
+//                        ascending order (each stored as in ALDL_COL_PLAIN),
+//                        then the number of each row's value, packed
+// the first column is always the time column, and the rest are the items of
+// the definition that aldl_decode_plan_compile() can decode, in mode1_def
+// order.
+
+#define ALDL_COL_MAGIC "ALDLCOL\n"	// 8 bytes
+#define ALDL_COL_VERSION 2
+#define ALDL_COL_HEADER_SIZE 96
+#define ALDL_COL_COLUMN_SIZE 64
+#define ALDL_COL_CHUNK_SIZE 48
+#define ALDL_COL_ENTRY_SIZE 32
+#define ALDL_COL_CHUNK_MARK 0xc01cu
+#define ALDL_COL_NAME_SIZE 64
+#define ALDL_COL_LABEL_SIZE 32
+#define ALDL_COL_UNITS_SIZE 16
+#define ALDL_COL_NO_ITEM 0xffffu
+#define ALDL_COL_CHUNK_ROWS 65536	// rows in a full chunk
+#define ALDL_COL_DICT_MAX 256		// most values a dictionary can have
+#define ALDL_COL_SUFFIX ".col"
+
+typedef enum _aldl_col_type
+{
+	ALDL_COL_TIME=0,	// microseconds since 1970
+	ALDL_COL_U8=1,		// an 8 bit item
+	ALDL_COL_U16=2		// a 16 bit item, most significant byte first in the data block
+} aldl_col_type_t;
+
+typedef enum _aldl_col_encoding
+{
+	ALDL_COL_PLAIN=0,
+	ALDL_COL_BITPACK=1,
+	ALDL_COL_DELTA=2,
+	ALDL_COL_DICT=3
+} aldl_col_encoding_t;
+
+// aldl_col_column_t: what a column holds, as in its descriptor
+typedef struct _aldl_col_column
+{
+	aldl_col_type_t type;
+	unsigned int operation;		// ALDL_OP_MULTIPLY or ALDL_OP_DIVIDE
+	unsigned int item;			// index in mode1_def, ALDL_COL_NO_ITEM for the time column
+	unsigned int byte_offset;	// as in byte_def_t
+	float factor;				// op_factor
+	float offset;				// op_offset
+	char units[ALDL_COL_UNITS_SIZE+1];
+	char label[ALDL_COL_LABEL_SIZE+1];
+} aldl_col_column_t;
+
+// aldl_col_chunk_t: the rows of a chunk while it is built
+typedef struct _aldl_col_chunk
+{
+	aldl_definition* definition;
+	unsigned int num_columns;	// the time column and one per item
+	aldl_col_column_t* columns;
+	unsigned int capacity;		// rows a full chunk has
+	unsigned int rows;			// rows in it so far
+	int64_t* times;				// the time column
+	uint16_t* values;			// the item columns: column c starts at values + (c-1)*capacity
+
+	// used while encoding
+	uint64_t* packed;			// a column's values as they are packed
+	uint32_t* seen;				// bitmap of the 16 bit values a column has
+	uint16_t* number;			// number of each value in a column's dictionary
+} aldl_col_chunk_t;
+
+// aldl_col_writer_t: writes a columnar log as frames are received. a full
+// chunk is handed to a thread of its own to be encoded and written, so that
+// receiving never waits for the disk.
+typedef struct _aldl_col_writer
+{
+	int fd;						// columnar log, -1 if not writing one
+	aldl_col_chunk_t chunks[2];	// the chunk being filled and the one being written
+	unsigned int filling;		// which one is being filled
+	unsigned char* buf;			// the chunk being written, encoded
+	pthread_t thread;
+	pthread_mutex_t lock;		// guards full and running
+	pthread_cond_t cond;		// signalled when a chunk is full or has been written
+	int full;					// 1 while the other chunk waits to be written
+	int running;				// 0 to make the thread stop
+
+	// statistics
+	unsigned long rows;			// rows added
+	unsigned long dropped;		// rows dropped because the last chunk wasn't written yet
+	unsigned long chunks_written;
+	uint64_t bytes;				// bytes written, the header included
+	unsigned long errors;		// chunks that couldn't be written
+} aldl_col_writer_t;
+
+// aldl_col_entry_t: a column of a chunk, as read from its entry
+typedef struct _aldl_col_entry
+{
+	aldl_col_encoding_t encoding;
+	unsigned int bits;
+	unsigned int distinct;
+	uint32_t size;				// bytes of data
+	uint32_t crc;
+	int64_t min;				// smallest raw value
+	int64_t max;				// largest raw value
+	uint64_t offset;			// file offset of the data
+} aldl_col_entry_t;
+
+// aldl_col_chunk_info_t: a chunk, as read from its header
+typedef struct _aldl_col_chunk_info
+{
+	uint64_t offset;			// file offset of the chunk
+	unsigned int rows;
+	int64_t first_time;			// microseconds since 1970
+	int64_t last_time;
+	aldl_col_entry_t* entries;	// one per column, in aldl_col_reader_t.entries
+} aldl_col_chunk_info_t;
+
+// aldl_col_reader_t: a columnar log opened for reading. only the headers
+// are read when it is opened; a column of a chunk is read (with pread())
+// when it is asked for.
+typedef struct _aldl_col_reader
+{
+	int fd;
+	char name[ALDL_COL_NAME_SIZE+1]; // definition name
+	uint32_t definition_hash;
+	unsigned int num_columns;
+	aldl_col_column_t* columns;
+	unsigned int chunk_rows;	// rows in a full chunk
+	aldl_col_chunk_info_t* chunks;
+	unsigned long num_chunks;
+	aldl_col_entry_t* entries;	// every chunk's entries
+	uint64_t rows;				// rows in every chunk
+	uint64_t end;				// file offset past the last whole chunk
+	uint64_t size;				// size of the file: more than end if the last chunk was cut short
+
+	unsigned char* buf;			// the data of the last column read
+	unsigned long buf_size;		// bytes allocated for buf
+	int64_t* raw;				// chunk_rows raw values, for aldl_col_reader_values()
+	uint64_t bytes_read;		// bytes of column data read so far
+} aldl_col_reader_t;
+
+// function prototypes
+// =================================================
+
+char* aldl_col_filename(const char* logfilename);
+// returns the name of the columnar log for the log logfilename (logfilename
+// with ALDL_COL_SUFFIX in place of .log, and without .gz), which the caller
+// frees, or NULL if out of memory.
+
+// building chunks
+// ---------------
+int aldl_col_chunk_init(aldl_col_chunk_t* ch, aldl_definition* def, unsigned int capacity);
+// sets up ch to build chunks of up to capacity rows of def's items.
+// returns 0 on success, -1 if out of memory.
+
+int aldl_col_chunk_add(aldl_col_chunk_t* ch, const struct timeval* timestamp, const char* data);
+// adds a row from the mode1 data block data. returns 1 if the chunk is now
+// full (encode it before adding more), 0 otherwise.
+
+unsigned int aldl_col_chunk_add_blocks(aldl_col_chunk_t* ch, const int64_t* times, const char* data,
+										unsigned int stride, unsigned int count);
+// adds a row for each of count data blocks, stride bytes apart starting at
+// data, received at times[n] (microseconds since 1970). adds as many as fit;
+// returns how many.
+
+unsigned long aldl_col_chunk_max_size(const aldl_col_chunk_t* ch);
+// returns the most bytes a chunk of ch can be encoded to.
+
+unsigned long aldl_col_chunk_encode(aldl_col_chunk_t* ch, unsigned char* buf);
+// encodes the rows in ch as a chunk into buf, which has room for
+// aldl_col_chunk_max_size() bytes, and empties ch.
+// returns the size of the chunk, 0 if ch had no rows.
+
+void aldl_col_chunk_free(aldl_col_chunk_t* ch);
+// frees the memory allocated by aldl_col_chunk_init().
+
+unsigned int aldl_col_header_size(const aldl_col_chunk_t* ch);
+// returns the size of the file header (descriptors included) for the
+// columns of ch.
+
+void aldl_col_format_header(const aldl_col_chunk_t* ch, unsigned char* buf);
+// writes the file header for the columns of ch into buf, which has room
+// for aldl_col_header_size() bytes.
+
+// writing
+// -------
+int aldl_col_writer_open(aldl_col_writer_t* w, const char* filename, aldl_definition* def);
+// opens (or creates) the columnar log filename to add rows of def's items
+// to, and starts the thread that writes it. a file written for another
+// definition (or that isn't a columnar log) is left alone.
+// returns 0 on success, -1 on failure (w->fd is -1 and adding does nothing).
+
+void aldl_col_writer_add(aldl_col_writer_t* w, const struct timeval* timestamp, const char* data);
+// adds a row from the mode1 data block data. when the chunk is full it is
+// handed to the thread; if the one before it hasn't been written yet the
+// row is dropped (and counted) instead.
+
+int aldl_col_writer_close(aldl_col_writer_t* w);
+// stops the thread, writes the last, partly filled chunk, syncs and closes
+// the file. returns 0 on success, -1 if any chunk couldn't be written.
+
+// reading
+// -------
+int aldl_col_reader_open(aldl_col_reader_t* r, const char* filename);
+// opens the columnar log filename and reads its header and the header of
+// every chunk. a chunk that fails its crc or is cut short ends the log.
+// returns 0 on success, -1 on failure (a message is printed).
+
+void aldl_col_reader_close(aldl_col_reader_t* r);
+// closes the file and frees the memory allocated by aldl_col_reader_open().
+
+int aldl_col_reader_find(aldl_col_reader_t* r, const char* label);
+// returns the number of the column with the label label, or -1 if none has it.
+
+long aldl_col_reader_lookup(aldl_col_reader_t* r, const struct timeval* t);
+// returns the number of the first chunk whose last row is at or after t,
+// found by binary search, or -1 if every row is before t.
+
+long aldl_col_reader_raw(aldl_col_reader_t* r, unsigned long chunk, unsigned int column, int64_t* raw);
+// reads the column column of chunk chunk, and nothing else, into raw, which
+// has room for the chunk's rows. returns the number of rows, or -1 if the
+// data couldn't be read or fails its crc.
+
+long aldl_col_reader_values(aldl_col_reader_t* r, unsigned long chunk, unsigned int column, float* values);
+// reads an item column of a chunk like aldl_col_reader_raw(), decoded into
+// values as aldl_decode_item() would. returns the number of rows, or -1.
+
+float aldl_col_decode(const aldl_col_column_t* column, int64_t raw);
+// returns the value of the raw value raw of an item column.
+
+void aldl_col_reader_range(aldl_col_reader_t* r, unsigned long chunk, unsigned int column,
+							float* min, float* max);
+// gets the smallest and largest decoded value of an item column of a chunk
+// from its statistics, without reading it.
+
+#endif
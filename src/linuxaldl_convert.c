@@ -0,0 +1,836 @@
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// linuxaldl-convert: converts raw logs to csv or columnar logs (see
+// linuxaldl_columns.h) after the fact, on every core. a log is split into
+// parts of a few MB that start at a record a reader can start at (a segment
+// header or a full record, see aldl_log_reader_locate()), and a pool of
+// threads decodes and formats the parts, a batch of frames at a time, while
+// the main thread writes what they made to the output in order. the output
+// is the same whatever the number of threads.
+//
+// no more than twice as many parts as there are threads are converted ahead
+// of the one being written, so the memory used doesn't grow with the log.
+//
+// a columnar log is made of chunks of ALDL_COL_CHUNK_ROWS rows, which don't
+// line up with the parts, so it takes two steps: the threads gather the data
+// blocks of each part, the main thread counts the rows of the parts in order
+// and hands out a chunk to encode each time there are enough, and the
+// threads encode those (before converting more parts) for the main thread
+// to write in order. a part is freed once every chunk with rows from it has
+// been written.
+//
+//   make linuxaldl-convert && ../bin/linuxaldl-convert -threads=8 /var/log/aldl
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "libaldl.h"
+
+#define CONVERT_PART_SIZE (8*1024*1024)	// bytes of raw log in a part...
+#define CONVERT_PART_SIZE_DELTA (1024*1024) // ...of a log with delta records, which holds more frames
+#define CONVERT_BATCH 4096				// frames decoded at once
+#define CONVERT_MAX_THREADS 256
+
+typedef enum _convert_format {
+	CONVERT_CSV=0, CONVERT_COLUMNS=1
+} convert_format_t;
+
+// a part of the log being converted
+typedef struct _convert_part
+{
+	uint64_t start;				// file offset of its first record (or segment header)
+	uint64_t end;				// ...and of the next part's
+	int done;					// 1 when out is ready to be written
+
+	unsigned char* out;			// what it converted to (the data blocks, for a columnar log)
+	unsigned long length;		// bytes in out
+	unsigned long size;			// bytes allocated for out
+	int64_t* times;				// when each data block was received, for a columnar log
+
+	unsigned long frames;		// frames converted
+	unsigned long other;		// frames without a data block of the log's definition
+	unsigned long skipped;		// bytes of corrupt data skipped
+	int error;					// 1 if memory ran out
+} convert_part_t;
+
+// a chunk of a columnar log: rows rows from row row of part part on
+typedef struct _convert_chunk
+{
+	unsigned long part;
+	unsigned long row;
+	unsigned int rows;
+	int done;					// 1 when out is ready to be written
+
+	unsigned char* out;			// the chunk encoded, aldl_col_chunk_max_size() bytes
+	unsigned long length;		// bytes in out
+	int error;					// 1 if memory ran out
+} convert_chunk_t;
+
+// a log being converted, shared by the threads
+typedef struct _convert_job
+{
+	aldl_log_reader_t* r;
+	aldl_definition* def;		// the definition of the log
+	aldl_decode_plan_t plan;
+	convert_format_t format;
+
+	convert_part_t* parts;
+	unsigned long num_parts;
+	unsigned long next;			// next part for a thread to convert
+	unsigned long written;		// parts written so far
+	unsigned long ahead;		// parts that may be converted ahead of the one being written
+
+	convert_chunk_t* chunks;	// a ring of ahead chunks, for a columnar log
+	unsigned long chunks_ready;	// chunks handed out to encode so far
+	unsigned long chunk_next;	// next chunk for a thread to encode
+	unsigned long chunks_written;
+	unsigned long released;		// parts freed so far
+	int finished;				// 1 when no more chunks will be handed out
+
+	pthread_mutex_t lock;		// guards next, written, the chunk counts, finished and every done
+	pthread_cond_t cond;		// signalled when a part is done or written
+} convert_job_t;
+
+// a thread's buffers
+typedef struct _convert_worker
+{
+	convert_job_t* job;
+	pthread_t thread;
+	char* data;					// the data blocks of a batch, data_length bytes apart
+	struct timeval* timestamps;	// their timestamps
+	float* values;				// the values decoded, a column of CONVERT_BATCH per item
+	aldl_csv_encoder_t csv;
+	aldl_col_chunk_t chunk;		// the chunk being encoded, for a columnar log
+} convert_worker_t;
+
+static void convert_usage(FILE* f)
+{
+	fprintf(f,"Usage: linuxaldl-convert [options] LOG|DIRECTORY...\n"
+			"\n"
+			"Converts raw logs (compressed or not) to csv or columnar logs, LOG.csv or\n"
+			"LOG%s (LOG without .log or .gz). a directory converts every raw log in it.\n"
+			"\n"
+			"Options:\n"
+			"  -format=csv|columns output format (default csv)\n"
+			"  -threads=N          threads converting each log (default: one per CPU)\n"
+			"  -force              overwrite output files that are already there\n",
+			ALDL_COL_SUFFIX);
+}
+
+// makes room for size more bytes in the output of part.
+// returns 0 on success, -1 if out of memory.
+static int convert_reserve(convert_part_t* part, unsigned long size)
+{
+	unsigned char* out;
+	unsigned long n = part->size ? part->size : 65536;
+
+	if (part->length + size <= part->size)
+		return 0;
+	while (part->length + size > n)
+		n *= 2;
+	out = realloc(part->out, n);
+	if (out == NULL)
+		return -1;
+	part->out = out;
+	part->size = n;
+	return 0;
+}
+
+// decodes and formats the count frames gathered by w into its csv encoder.
+// returns 0 on success, -1 if out of memory.
+static int convert_batch(convert_worker_t* w, unsigned int count)
+{
+	convert_job_t* job = w->job;
+	unsigned int n;
+
+	aldl_decode_plan_run_batch(&job->plan, w->data, job->plan.data_length, count, w->values);
+	for (n=0; n<count; n++)
+		if (aldl_csv_encoder_line(&w->csv, &w->timestamps[n], w->values+n, count) != 0)
+			return -1;
+	return 0;
+}
+
+// adds the data block and time of frame to the output of part, for a
+// columnar log. returns 0 on success, -1 if out of memory.
+static int convert_gather(convert_part_t* part, const aldl_log_frame_t* frame, unsigned int len)
+{
+	unsigned long size = part->size;
+	int64_t* times;
+
+	if (convert_reserve(part, len) != 0)
+		return -1;
+	// times has a place for every data block out has room for
+	if (part->size != size)
+	{
+		times = realloc(part->times, part->size/len*sizeof(int64_t));
+		if (times == NULL)
+			return -1;
+		part->times = times;
+	}
+	memcpy(part->out + part->length, frame->data + frame->data_offset, len);
+	part->length += len;
+	part->times[part->frames++] = (int64_t)frame->timestamp.tv_sec*1000000 + frame->timestamp.tv_usec;
+	return 0;
+}
+
+// converts the frames of part (or gathers them, for a columnar log).
+static void convert_part(convert_worker_t* w, convert_part_t* part)
+{
+	convert_job_t* job = w->job;
+	unsigned int len = job->plan.data_length;
+	unsigned int count = 0;
+	aldl_log_cursor_t c;
+	aldl_log_frame_t frame;
+
+	if (aldl_log_reader_locate(job->r, &c, part->start) != 0)
+		return;
+	while (aldl_log_reader_next(job->r, &c, &frame) && frame.offset < part->end)
+	{
+		if (c.definition != job->def || frame.data_offset == 0)
+		{
+			part->other++;
+			continue;
+		}
+		if (job->format == CONVERT_COLUMNS)
+		{
+			if (convert_gather(part, &frame, len) != 0)
+			{
+				part->error = 1;
+				return;
+			}
+			continue;
+		}
+		memcpy(w->data + count*len, frame.data + frame.data_offset, len);
+		w->timestamps[count] = frame.timestamp;
+		part->frames++;
+		if (++count == CONVERT_BATCH)
+		{
+			if (convert_batch(w, count) != 0)
+			{
+				part->error = 1;
+				return;
+			}
+			count = 0;
+		}
+	}
+	part->skipped = c.skipped;
+	if (job->format == CONVERT_COLUMNS)
+		return;
+
+	if ((count != 0 && convert_batch(w, count) != 0)
+		|| convert_reserve(part, w->csv.used) != 0)
+	{
+		part->error = 1;
+		return;
+	}
+	memcpy(part->out + part->length, w->csv.buf, w->csv.used);
+	part->length += w->csv.used;
+}
+
+// encodes chunk from the data blocks of the parts it has rows from
+static void convert_chunk(convert_worker_t* w, convert_chunk_t* chunk)
+{
+	convert_job_t* job = w->job;
+	unsigned int len = job->plan.data_length;
+	unsigned long p = chunk->part, row = chunk->row;
+	convert_part_t* part;
+
+	if (chunk->out == NULL)
+		chunk->out = malloc(aldl_col_chunk_max_size(&w->chunk));
+	if (chunk->out == NULL)
+	{
+		chunk->error = 1;
+		return;
+	}
+	while (w->chunk.rows < chunk->rows && p < job->num_parts)
+	{
+		part = &job->parts[p];
+		row += aldl_col_chunk_add_blocks(&w->chunk, part->times + row, (char*)part->out + row*len, len,
+											part->frames - row);
+		if (row == part->frames)
+		{
+			p++;
+			row = 0;
+		}
+	}
+	chunk->length = aldl_col_chunk_encode(&w->chunk, chunk->out);
+}
+
+// a converting thread: encodes chunks and converts parts until there are none left
+static void* convert_thread(void* arg)
+{
+	convert_worker_t* w = arg;
+	convert_job_t* job = w->job;
+	convert_chunk_t* chunk;
+	unsigned long i;
+
+	pthread_mutex_lock(&job->lock);
+	for (;;)
+	{
+		// chunks first: the main thread waits for them to free parts
+		if (job->chunk_next < job->chunks_ready)
+		{
+			chunk = &job->chunks[job->chunk_next++ % job->ahead];
+			pthread_mutex_unlock(&job->lock);
+
+			convert_chunk(w, chunk);
+
+			pthread_mutex_lock(&job->lock);
+			chunk->done = 1;
+			pthread_cond_broadcast(&job->cond);
+		}
+		else if (job->next < job->num_parts && job->next < job->written + job->ahead)
+		{
+			i = job->next++;
+			pthread_mutex_unlock(&job->lock);
+
+			if (job->format == CONVERT_CSV)
+				aldl_csv_encoder_clear(&w->csv);
+			convert_part(w, &job->parts[i]);
+
+			pthread_mutex_lock(&job->lock);
+			job->parts[i].done = 1;
+			pthread_cond_broadcast(&job->cond);
+		}
+		else if (job->next >= job->num_parts && job->finished)
+			break;
+		else pthread_cond_wait(&job->cond, &job->lock);
+	}
+	pthread_mutex_unlock(&job->lock);
+	return NULL;
+}
+
+// allocates the buffers of w. returns 0 on success, -1 if out of memory.
+static int convert_worker_init(convert_worker_t* w, convert_job_t* job)
+{
+	memset(w, 0, sizeof(convert_worker_t));
+	w->job = job;
+	if (job->format == CONVERT_COLUMNS)
+		return aldl_col_chunk_init(&w->chunk, job->def, ALDL_COL_CHUNK_ROWS);
+
+	w->data = malloc((unsigned long)CONVERT_BATCH*job->plan.data_length);
+	w->timestamps = malloc(CONVERT_BATCH*sizeof(struct timeval));
+	// the columns of items the plan can't decode stay 0
+	w->values = calloc((unsigned long)CONVERT_BATCH*job->plan.num_items, sizeof(float));
+	if (w->data == NULL || w->timestamps == NULL || w->values == NULL)
+		return -1;
+	return aldl_csv_encoder_init(&w->csv, job->def, -1);
+}
+
+static void convert_worker_free(convert_worker_t* w)
+{
+	free(w->data);
+	free(w->timestamps);
+	free(w->values);
+	if (w->job->format == CONVERT_CSV)
+		aldl_csv_encoder_free(&w->csv);
+	else aldl_col_chunk_free(&w->chunk);
+}
+
+// writes len bytes of buf to fd. returns 0 on success, -1 on failure.
+static int convert_write(int fd, const void* buf, unsigned long len)
+{
+	const char* p = buf;
+	ssize_t res;
+
+	while (len > 0)
+	{
+		res = write(fd, p, len);
+		if (res < 0 && errno == EINTR)
+			continue;
+		if (res <= 0)
+			return -1;
+		p += res;
+		len -= res;
+	}
+	return 0;
+}
+
+// writes the header of the output file fd. returns 0 on success, -1 on failure.
+static int convert_header(convert_job_t* job, int fd)
+{
+	aldl_csv_encoder_t e;
+	aldl_col_chunk_t ch;
+	unsigned char* buf;
+	int res;
+
+	if (job->format == CONVERT_CSV)
+	{
+		if (aldl_csv_encoder_init(&e, job->def, fd) != 0)
+			return -1;
+		res = (aldl_csv_encoder_header(&e) == 0 && aldl_csv_encoder_flush(&e) == 0) ? 0 : -1;
+		aldl_csv_encoder_free(&e);
+		return res;
+	}
+
+	// only the layout of the columns is needed
+	if (aldl_col_chunk_init(&ch, job->def, ALDL_COL_CHUNK_ROWS) != 0)
+		return -1;
+	buf = malloc(aldl_col_header_size(&ch));
+	res = -1;
+	if (buf != NULL)
+	{
+		aldl_col_format_header(&ch, buf);
+		res = convert_write(fd, buf, aldl_col_header_size(&ch));
+	}
+	free(buf);
+	aldl_col_chunk_free(&ch);
+	return res;
+}
+
+// writes the parts to fd in order as they are done, for a csv log.
+// returns 0 on success, -1 on failure.
+static int convert_write_parts(convert_job_t* job, int fd, const char* outname, uint64_t* bytes)
+{
+	convert_part_t* part;
+	unsigned long i;
+	int res = 0;
+
+	for (i=0; i<job->num_parts; i++)
+	{
+		part = &job->parts[i];
+		pthread_mutex_lock(&job->lock);
+		while (!part->done)
+			pthread_cond_wait(&job->cond, &job->lock);
+		pthread_mutex_unlock(&job->lock);
+
+		if (res == 0 && part->error)
+		{
+			fprintf(stderr,"Couldn't write %s: %s\n",outname,strerror(ENOMEM));
+			res = -1;
+		}
+		if (res == 0 && convert_write(fd, part->out, part->length) != 0)
+		{
+			fprintf(stderr,"Couldn't write %s: %s\n",outname,strerror(errno));
+			res = -1;
+		}
+		*bytes += part->length;
+		free(part->out);
+		part->out = NULL;
+
+		pthread_mutex_lock(&job->lock);
+		job->written++;
+		pthread_cond_broadcast(&job->cond);
+		pthread_mutex_unlock(&job->lock);
+	}
+	return res;
+}
+
+// writes the oldest chunk not written yet to fd once it is encoded, and frees
+// the parts no chunk after it needs (those before part, if it is the last
+// chunk handed out). returns 0 on success, -1 on failure.
+static int convert_write_chunk(convert_job_t* job, int fd, unsigned long part, uint64_t* bytes)
+{
+	convert_chunk_t* chunk = &job->chunks[job->chunks_written % job->ahead];
+	int res = 0;
+
+	pthread_mutex_lock(&job->lock);
+	while (!chunk->done)
+		pthread_cond_wait(&job->cond, &job->lock);
+	pthread_mutex_unlock(&job->lock);
+
+	if (chunk->error)
+	{
+		errno = ENOMEM;
+		res = -1;
+	}
+	else if (convert_write(fd, chunk->out, chunk->length) != 0)
+		res = -1;
+	*bytes += chunk->length;
+
+	job->chunks_written++;
+	if (job->chunks_written < job->chunks_ready)
+		part = job->chunks[job->chunks_written % job->ahead].part;
+	for (; job->released < part; job->released++)
+	{
+		free(job->parts[job->released].out);
+		free(job->parts[job->released].times);
+		job->parts[job->released].out = NULL;
+		job->parts[job->released].times = NULL;
+	}
+	return res;
+}
+
+// hands out the chunks of a columnar log to encode as the parts are done,
+// and writes them to fd in order. returns 0 on success, -1 on failure.
+static int convert_write_columns(convert_job_t* job, int fd, const char* outname, uint64_t* bytes)
+{
+	unsigned long i, n, pending = 0, part = 0, row = 0;
+	convert_chunk_t* chunk;
+	int res = 0;
+
+	for (i=0; i<job->num_parts; i++)
+	{
+		pthread_mutex_lock(&job->lock);
+		while (!job->parts[i].done)
+			pthread_cond_wait(&job->cond, &job->lock);
+		job->written++;
+		pthread_cond_broadcast(&job->cond);
+		pthread_mutex_unlock(&job->lock);
+
+		if (res == 0 && job->parts[i].error)
+		{
+			fprintf(stderr,"Couldn't write %s: %s\n",outname,strerror(ENOMEM));
+			res = -1;
+		}
+		pending += job->parts[i].frames;
+
+		// a chunk as soon as there are rows enough for one, and the rest at the end
+		while (pending >= ALDL_COL_CHUNK_ROWS || (i == job->num_parts-1 && pending != 0))
+		{
+			if (job->chunks_ready == job->chunks_written + job->ahead
+				&& convert_write_chunk(job, fd, part, bytes) != 0 && res == 0)
+			{
+				fprintf(stderr,"Couldn't write %s: %s\n",outname,strerror(errno));
+				res = -1;
+			}
+			chunk = &job->chunks[job->chunks_ready % job->ahead];
+			n = (pending < ALDL_COL_CHUNK_ROWS) ? pending : ALDL_COL_CHUNK_ROWS;
+			chunk->part = part;
+			chunk->row = row;
+			chunk->rows = n;
+			chunk->done = 0;
+			chunk->error = 0;
+			pending -= n;
+
+			// the next chunk starts after this one's rows
+			while (n != 0)
+			{
+				if (job->parts[part].frames - row > n)
+				{
+					row += n;
+					break;
+				}
+				n -= job->parts[part].frames - row;
+				part++;
+				row = 0;
+			}
+
+			pthread_mutex_lock(&job->lock);
+			job->chunks_ready++;
+			pthread_cond_broadcast(&job->cond);
+			pthread_mutex_unlock(&job->lock);
+		}
+	}
+
+	pthread_mutex_lock(&job->lock);
+	job->finished = 1;
+	pthread_cond_broadcast(&job->cond);
+	pthread_mutex_unlock(&job->lock);
+	while (job->chunks_written < job->chunks_ready)
+		if (convert_write_chunk(job, fd, job->num_parts, bytes) != 0 && res == 0)
+		{
+			fprintf(stderr,"Couldn't write %s: %s\n",outname,strerror(errno));
+			res = -1;
+		}
+	return res;
+}
+
+// splits the log r is reading into parts. returns 0 on success, -1 if out of memory.
+static int convert_split(convert_job_t* job)
+{
+	aldl_log_reader_t* r = job->r;
+	aldl_log_cursor_t c;
+	uint64_t size = (r->header.version == ALDL_RAW_VERSION_DELTA)
+					? CONVERT_PART_SIZE_DELTA : CONVERT_PART_SIZE;
+	uint64_t offset;
+
+	job->parts = calloc(r->size/size + 1, sizeof(convert_part_t));
+	if (job->parts == NULL)
+		return -1;
+	// a part starts at the first record a reader can start at, so a stretch
+	// without one (a long corrupt one) gives fewer parts
+	for (offset=0; offset<r->size; offset+=size)
+	{
+		if (aldl_log_reader_locate(r, &c, offset) != 0)
+			break;
+		if (job->num_parts != 0 && job->parts[job->num_parts-1].start == c.offset)
+			continue;
+		if (job->num_parts != 0)
+			job->parts[job->num_parts-1].end = c.offset;
+		job->parts[job->num_parts++].start = c.offset;
+	}
+	if (job->num_parts != 0)
+		job->parts[job->num_parts-1].end = r->size;
+	return 0;
+}
+
+// returns a malloc'd string with the name of the csv file for logfilename
+static char* convert_output_name(const char* logfilename)
+{
+	const char* suffix = ".csv";
+	unsigned int len = strlen(logfilename);
+	char* name = malloc(len + strlen(suffix) + 1);
+
+	if (name == NULL)
+		return NULL;
+	memcpy(name, logfilename, len+1);
+	if (len > 3 && strcmp(name+len-3, ".gz") == 0)
+		name[len -= 3] = 0;
+	if (len > 4 && strcmp(name+len-4, ".log") == 0)
+		name[len -= 4] = 0;
+	strcpy(name+len, suffix);
+	return name;
+}
+
+// returns the seconds since some time in the past
+static double convert_now()
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec/1e9;
+}
+
+// converts the raw log logfilename with nthreads threads.
+// returns 0 on success, -1 on failure.
+static int convert_log(const char* logfilename, convert_format_t format, unsigned int nthreads,
+						int force)
+{
+	static convert_worker_t workers[CONVERT_MAX_THREADS];
+	aldl_log_reader_t r;
+	convert_job_t job;
+	char* outname;
+	unsigned long i, frames = 0, other = 0, skipped = 0;
+	uint64_t bytes = 0;
+	unsigned int n, started = 0;
+	double start = convert_now(), secs;
+	int fd, res = 0;
+
+	if (aldl_log_reader_open(&r, logfilename) != 0)
+		return -1;
+	if (r.definition == NULL)
+	{
+		aldl_log_reader_close(&r);
+		return -1;
+	}
+	outname = (format == CONVERT_CSV) ? convert_output_name(logfilename) : aldl_col_filename(logfilename);
+	if (outname == NULL)
+	{
+		aldl_log_reader_close(&r);
+		return -1;
+	}
+	fd = open(outname, O_WRONLY | O_CREAT | O_CLOEXEC | (force ? O_TRUNC : O_EXCL), 0666);
+	if (fd == -1)
+	{
+		if (errno == EEXIST)
+			fprintf(stderr,"%s is already there. Use -force to overwrite it.\n",outname);
+		else fprintf(stderr,"Couldn't open %s: %s\n",outname,strerror(errno));
+		free(outname);
+		aldl_log_reader_close(&r);
+		return -1;
+	}
+
+	memset(&job, 0, sizeof(convert_job_t));
+	job.r = &r;
+	job.def = r.definition;
+	job.format = format;
+	job.ahead = 2*nthreads;
+	// only a columnar log has chunks to wait for
+	job.finished = (format == CONVERT_CSV);
+	if (format == CONVERT_COLUMNS)
+		job.chunks = calloc(job.ahead, sizeof(convert_chunk_t));
+	pthread_mutex_init(&job.lock, NULL);
+	pthread_cond_init(&job.cond, NULL);
+	if (aldl_decode_plan_compile(&job.plan, job.def) != 0 || convert_split(&job) != 0
+		|| (format == CONVERT_COLUMNS && job.chunks == NULL) || convert_header(&job, fd) != 0)
+	{
+		fprintf(stderr,"Couldn't convert %s: out of memory or couldn't write %s\n",logfilename,outname);
+		res = -1;
+		job.num_parts = 0;
+	}
+
+	for (n=0; n<nthreads && job.num_parts != 0; n++)
+	{
+		if (convert_worker_init(&workers[n], &job) != 0
+			|| pthread_create(&workers[n].thread, NULL, convert_thread, &workers[n]) != 0)
+		{
+			convert_worker_free(&workers[n]);
+			break;
+		}
+		started++;
+	}
+	if (started == 0 && job.num_parts != 0)
+	{
+		fprintf(stderr,"Couldn't start a thread to convert %s\n",logfilename);
+		res = -1;
+		job.num_parts = 0;
+	}
+
+	if (format == CONVERT_CSV && convert_write_parts(&job, fd, outname, &bytes) != 0)
+		res = -1;
+	if (format == CONVERT_COLUMNS && convert_write_columns(&job, fd, outname, &bytes) != 0)
+		res = -1;
+	for (n=0; n<started; n++)
+	{
+		pthread_join(workers[n].thread, NULL);
+		convert_worker_free(&workers[n]);
+	}
+	if (close(fd) != 0 && res == 0)
+	{
+		fprintf(stderr,"Couldn't write %s: %s\n",outname,strerror(errno));
+		res = -1;
+	}
+
+	if (res != 0)
+		unlink(outname);
+
+	for (i=0; i<job.num_parts; i++)
+	{
+		frames += job.parts[i].frames;
+		other += job.parts[i].other;
+		skipped += job.parts[i].skipped;
+		free(job.parts[i].out);
+		free(job.parts[i].times);
+	}
+	for (i=0; job.chunks != NULL && i<job.ahead; i++)
+		free(job.chunks[i].out);
+	free(job.chunks);
+
+	secs = convert_now() - start;
+	if (res == 0)
+	{
+		printf("%s -> %s: %lu frames in %lu parts, %.1f MB -> %.1f MB in %.2f s (%.0f MB/s, %.0f frames/s)\n",
+				logfilename, outname, frames, job.num_parts, r.size/1e6, bytes/1e6, secs,
+				r.size/1e6/secs, frames/secs);
+		if (other != 0 || skipped != 0)
+			printf("  %lu frames without a %s data block left out, %lu bytes of corrupt data skipped\n",
+					other, job.def->name, skipped);
+	}
+	aldl_decode_plan_free(&job.plan);
+	free(job.parts);
+	pthread_mutex_destroy(&job.lock);
+	pthread_cond_destroy(&job.cond);
+	free(outname);
+	aldl_log_reader_close(&r);
+	return res;
+}
+
+// returns 1 if filename looks like a raw log, compressed or not
+static int convert_is_log(const char* filename)
+{
+	char buf[ALDL_GZ_HEADER_SIZE];
+	int fd = open(filename, O_RDONLY | O_CLOEXEC);
+	ssize_t res;
+
+	if (fd == -1)
+		return 0;
+	res = read(fd, buf, sizeof(buf));
+	close(fd);
+	return (res >= 8 && memcmp(buf, ALDL_RAW_MAGIC, 8) == 0)
+			|| (res > 0 && aldl_gz_is_member(buf, res));
+}
+
+// converts every raw log in the directory dirname.
+// returns 0 on success, -1 if any of them couldn't be converted.
+static int convert_directory(const char* dirname, convert_format_t format, unsigned int nthreads,
+								int force)
+{
+	struct dirent** entries;
+	struct stat st;
+	char* path;
+	int i, n, res = 0;
+
+	n = scandir(dirname, &entries, NULL, alphasort);
+	if (n < 0)
+	{
+		fprintf(stderr,"Couldn't read %s: %s\n",dirname,strerror(errno));
+		return -1;
+	}
+	for (i=0; i<n; i++)
+	{
+		path = malloc(strlen(dirname) + strlen(entries[i]->d_name) + 2);
+		if (path != NULL && entries[i]->d_name[0] != '.')
+		{
+			sprintf(path, "%s/%s", dirname, entries[i]->d_name);
+			if (stat(path, &st) == 0 && S_ISREG(st.st_mode) && convert_is_log(path)
+				&& convert_log(path, format, nthreads, force) != 0)
+				res = -1;
+		}
+		free(path);
+		free(entries[i]);
+	}
+	free(entries);
+	return res;
+}
+
+int main(int argc, char* argv[])
+{
+	convert_format_t format = CONVERT_CSV;
+	long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	int force = 0;
+	int opt, res = 0;
+	struct stat st;
+
+	static const struct option convert_opts[] =
+	{
+		{ "format", required_argument, NULL, 'f' },
+		{ "threads", required_argument, NULL, 't' },
+		{ "force", no_argument, NULL, 'F' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	while ((opt = getopt_long_only(argc, argv, "", convert_opts, NULL)) != -1)
+	{
+		switch (opt)
+		{
+			case 'f':
+				if (strcmp(optarg,"columns")==0)
+					format = CONVERT_COLUMNS;
+				else if (strcmp(optarg,"csv")!=0)
+				{
+					convert_usage(stderr);
+					return 1;
+				}
+				break;
+			case 't': nthreads = atoi(optarg); break;
+			case 'F': force = 1; break;
+			case 'h': convert_usage(stdout); return 0;
+			default: convert_usage(stderr); return 1;
+		}
+	}
+	if (nthreads > CONVERT_MAX_THREADS)
+		nthreads = CONVERT_MAX_THREADS;
+	if (optind == argc || nthreads <= 0)
+	{
+		convert_usage(stderr);
+		return 1;
+	}
+
+	for (; optind<argc; optind++)
+	{
+		if (stat(argv[optind], &st) == 0 && S_ISDIR(st.st_mode))
+		{
+			if (convert_directory(argv[optind], format, nthreads, force) != 0)
+				res = 1;
+		}
+		else if (convert_log(argv[optind], format, nthreads, force) != 0)
+			res = 1;
+	}
+	return res;
+}
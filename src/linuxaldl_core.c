@@ -0,0 +1,731 @@
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "linuxaldl_core.h"
+#include "linuxaldl_definitions.h"
+
+// the AVX2 decoder is built with a target attribute and only used if the
+// CPU running the program has AVX2, so no special flags are needed
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ALDL_DECODE_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+#define ALDL_DECODE_CHUNK 64 // blocks decoded together by the scalar batch decoder
+
+// ============================================================================
+// PROTOCOL AND DECODING
+// ============================================================================
+// none of these use global state, so they can be called from any session or thread.
+
+// sets up the frame parser s to look for def's frames in the given scan mode.
+// the mode 1 response is tagged -1, its request's echo ALDL_FRAME_ECHO and
+// broadcast frames are tagged with their index in broadcast_frames.
+// returns 0 on success, -1 if there is nothing to look for in that mode.
+int aldl_definition_setup_stream(aldl_stream_t* s, aldl_definition* def, ALDL_SCAN_MODE_t mode)
+{
+	aldl_frame_desc* desc;
+	int i, added = 0;
+
+	aldl_stream_init(s);
+
+	if (mode != ALDL_SCAN_PASSIVE)
+	{
+		// form the response message start sequence
+		char seq[] = { def->mode1_request[0], 0x52+def->mode1_response_length, 0x01};
+		if (aldl_stream_add_header(s, seq, def->mode1_response_length, -1) != 0)
+			return -1;
+
+		// a single wire interface hears the request it sends. the request is a
+		// frame itself, so the echo is picked out instead of being discarded.
+		if ((unsigned char)def->mode1_request[1] == ((0x52+def->mode1_request_length) & 0xff))
+			aldl_stream_add_header(s, def->mode1_request, def->mode1_request_length, ALDL_FRAME_ECHO);
+
+		// frames the ECM only sends in normal mode. there may be more of them
+		// than the parser has room for; any left out are discarded as noise.
+		if (def->broadcast_frames != NULL)
+		{
+			for (i=0, desc=def->broadcast_frames; desc->name != NULL; i++, desc++)
+				if (memcmp(desc->header, seq, ALDL_HEADER_SIZE) != 0)
+					aldl_stream_add_header(s, desc->header, desc->length, i);
+		}
+		return 0;
+	}
+
+	if (def->broadcast_frames == NULL)
+	{
+		fprintf(stderr,"No broadcast frames are known for %s.\n",def->name);
+		return -1;
+	}
+
+	for (i=0, desc=def->broadcast_frames; desc->name != NULL; i++, desc++)
+	{
+		// a decoded frame has to hold the whole data block
+		if (desc->data_offset != 0 && desc->data_offset + def->mode1_data_length >= desc->length)
+		{
+			fprintf(stderr,"Broadcast frame %s is too short for the data block, ignoring it.\n",desc->name);
+			continue;
+		}
+		if (aldl_stream_add_header(s, desc->header, desc->length, i) != 0)
+		{
+			fprintf(stderr,"Can't listen for broadcast frame %s.\n",desc->name);
+			continue;
+		}
+		added++;
+	}
+
+	return added ? 0 : -1;
+}
+
+// returns the length of the largest frame that can be received with def,
+// whether polled or broadcast.
+unsigned int aldl_definition_max_frame(aldl_definition* def)
+{
+	unsigned int i, len = def->mode1_response_length;
+
+	if (def->broadcast_frames != NULL)
+	{
+		for (i=0; def->broadcast_frames[i].name != NULL; i++)
+			if (def->broadcast_frames[i].length > len)
+				len = def->broadcast_frames[i].length;
+	}
+	return len;
+}
+
+// returns the offset of the mode1 data block in frame, or 0 if frame isn't
+// one def decodes.
+unsigned int aldl_definition_data_offset(aldl_definition* def, const char* frame, unsigned int len)
+{
+	aldl_frame_desc* desc;
+
+	if (len < 3)
+		return 0;
+	// the same header aldl_definition_setup_stream() looks for
+	if (len == def->mode1_response_length && frame[0] == def->mode1_request[0]
+		&& (unsigned char)frame[1] == ((0x52+def->mode1_response_length) & 0xff) && frame[2] == 0x01)
+		return def->mode1_data_offset;
+
+	if (def->broadcast_frames == NULL)
+		return 0;
+	for (desc=def->broadcast_frames; desc->name != NULL; desc++)
+	{
+		if (len == desc->length && memcmp(frame, desc->header, 3) == 0
+			&& desc->data_offset + def->mode1_data_length < desc->length)
+			return desc->data_offset;
+	}
+	return 0;
+}
+
+// FNV-1a, one byte at a time
+static uint32_t aldl_fnv1a(uint32_t hash, const void* buf, unsigned long len)
+{
+	const unsigned char* p = (const unsigned char*)buf;
+
+	while (len--)
+		hash = (hash ^ *p++) * 16777619u;
+	return hash;
+}
+
+// FNV-1a of a 32 bit integer, little-endian whatever the platform
+static uint32_t aldl_fnv1a_u32(uint32_t hash, uint32_t value)
+{
+	unsigned char bytes[4] = { value, value>>8, value>>16, value>>24 };
+
+	return aldl_fnv1a(hash, bytes, 4);
+}
+
+// returns a hash of everything in def that affects how its frames are
+// decoded (not the labels or units).
+uint32_t aldl_definition_hash(aldl_definition* def)
+{
+	uint32_t hash = 2166136261u;
+	union { float f; uint32_t u; } bits;
+	unsigned int i;
+
+	hash = aldl_fnv1a(hash, def->mode1_request, def->mode1_request_length);
+	hash = aldl_fnv1a_u32(hash, def->mode1_response_length);
+	hash = aldl_fnv1a_u32(hash, def->mode1_data_length);
+	hash = aldl_fnv1a_u32(hash, def->mode1_data_offset);
+
+	for (i=0; def->mode1_def[i].label != NULL; i++)
+	{
+		if (def->mode1_def[i].operation == ALDL_OP_SEPERATOR)
+			continue;
+		hash = aldl_fnv1a_u32(hash, i);
+		hash = aldl_fnv1a_u32(hash, def->mode1_def[i].byte_offset);
+		hash = aldl_fnv1a_u32(hash, def->mode1_def[i].bits);
+		hash = aldl_fnv1a_u32(hash, def->mode1_def[i].operation);
+		bits.f = def->mode1_def[i].op_factor;
+		hash = aldl_fnv1a_u32(hash, bits.u);
+		bits.f = def->mode1_def[i].op_offset;
+		hash = aldl_fnv1a_u32(hash, bits.u);
+	}
+	return hash;
+}
+
+// CRC-32 lookup table, filled in once by aldl_crc32_init()
+static uint32_t aldl_crc32_table[256];
+static pthread_once_t aldl_crc32_once = PTHREAD_ONCE_INIT;
+
+static void aldl_crc32_init()
+{
+	uint32_t c;
+	unsigned int i, k;
+
+	for (i=0; i<256; i++)
+	{
+		c = i;
+		for (k=0; k<8; k++)
+			c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+		aldl_crc32_table[i] = c;
+	}
+}
+
+// returns the CRC-32 of len bytes at buf continued from crc.
+uint32_t aldl_crc32(uint32_t crc, const void* buf, unsigned long len)
+{
+	const unsigned char* p = (const unsigned char*)buf;
+
+	pthread_once(&aldl_crc32_once, aldl_crc32_init);
+	crc = ~crc;
+	while (len--)
+		crc = aldl_crc32_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+// calculates the single-byte checksum, summing from the start of buffer
+// through len bytes. the checksum is calculated by adding each byte
+// together and ignoring overflow, then taking the two's complement and adding 1
+char get_checksum(char* buffer, unsigned int len)
+{
+	char acc = 0x00;
+
+	unsigned int i;
+	for (i=0; i<len; i++)
+	{
+		//printf("%d,",buffer[i]);
+		//if (!(i%16)) printf("\n");
+		acc+=buffer[i];
+	}
+	
+	acc=0xFF-acc;
+	acc+=0x01;
+	//printf("Checksum: %d\n",acc);
+
+	return acc;
+}
+
+// looks up def_name in the aldl_definition_table until it finds the first 
+// definition in the table with the name def_name
+// if the definition is not in the table, returns NULL
+aldl_definition* aldl_get_definition(const char* defname)
+{
+	int index = 0;
+	aldl_definition* result = aldl_definition_table[0];
+	if (defname == NULL)
+		return NULL;
+	while(result!=NULL){
+		if (strcmp(defname,result->name)==0)
+			break;
+		index++;
+		result = aldl_definition_table[index];
+	}
+	return result;
+}
+
+// converts the item described by def from the mode1 data block raw into a
+// float and stores it in *result.
+// returns 0 on success, -1 if def is a seperator or its size isn't supported.
+int aldl_decode_item(byte_def_t* def, const char* raw, float* result)
+{
+	if (def->operation == ALDL_OP_SEPERATOR)
+		return -1;
+
+	if (def->bits==8)
+		*result = aldl_raw8_to_float(raw[def->byte_offset-1],
+									def->operation, def->op_factor, def->op_offset);
+	else if (def->bits==16)
+		*result = aldl_raw16_to_float(raw[def->byte_offset-1], raw[def->byte_offset],
+									def->operation, def->op_factor, def->op_offset);
+	else return -1; // other numbers of bits not supported
+
+	return 0;
+}
+
+// converts the raw 8-bit data value val into a float by performing operation
+// using op_factor and op_offset.
+// see the documentation for the byte_def_t struct in linuxaldl.h for more information
+float aldl_raw8_to_float(unsigned char val, int operation, float op_factor, float op_offset)
+{
+	float result = val;
+	if (operation == ALDL_OP_MULTIPLY)
+		result = ((float)val*op_factor)+op_offset;
+	else if (operation == ALDL_OP_DIVIDE)
+		result = (op_factor/val)+op_offset;
+	else
+	{
+		result = -999;
+		fprintf(stderr," aldl_raw_to_float8() error: undefined operation: %d",operation);
+	}
+
+	return result;
+
+}
+
+// converts the raw 16-bit data value val into a float by performing operation
+// using op_factor and op_offset.
+// see the documentation for the byte_def_t struct in linuxaldl.h for more information
+float aldl_raw16_to_float(unsigned char msb, unsigned char lsb, int operation, float op_factor, float op_offset)
+{
+	float result = ((float)msb*256)+(float)lsb;
+	if (operation == ALDL_OP_MULTIPLY)
+		result = (result*op_factor)+op_offset;
+	else if (operation == ALDL_OP_DIVIDE)
+		result = (op_factor/result)+op_offset;
+	else
+	{
+		result = -999.0;
+		fprintf(stderr," aldl_raw_to_float16() error: undefined operation: %d",operation);
+	}
+	return result;
+
+}
+
+// ============================================================================
+// DECODE PLANS
+// ============================================================================
+
+// returns the group of plan that item belongs in, or NULL if it is a
+// seperator or can't be decoded from a data block of data_length bytes.
+// if warn is set, says why an item that isn't a seperator can't be decoded.
+static aldl_decode_group_t* aldl_decode_plan_group(aldl_decode_plan_t* plan, byte_def_t* item,
+													unsigned int data_length, int warn)
+{
+	if (item->operation == ALDL_OP_SEPERATOR)
+		return NULL;
+
+	if (item->bits != 8 && item->bits != 16)
+	{
+		if (warn)
+			fprintf(stderr,"Warning: %s is %u bits. Only 8 and 16 are supported, ignoring it.\n",
+						item->label, item->bits);
+		return NULL;
+	}
+	if (item->byte_offset == 0 || item->byte_offset-1 + item->bits/8 > data_length)
+	{
+		if (warn)
+			fprintf(stderr,"Warning: %s is outside the %u byte data block, ignoring it.\n",
+						item->label, data_length);
+		return NULL;
+	}
+
+	if (item->operation == ALDL_OP_MULTIPLY)
+		return (item->bits == 8) ? &plan->mul8 : &plan->mul16;
+	if (item->operation == ALDL_OP_DIVIDE)
+		return (item->bits == 8) ? &plan->div8 : &plan->div16;
+
+	if (warn)
+		fprintf(stderr,"Warning: %s has undefined operation %u, ignoring it.\n",
+					item->label, item->operation);
+	return NULL;
+}
+
+// sorts the group's items by offset, then counts how many can be gathered
+static void aldl_decode_group_finish(aldl_decode_group_t* g, unsigned int data_length)
+{
+	unsigned int i, j, n, item;
+	int offset;
+	float factor, add;
+
+	// insertion sort: definitions are mostly in order already
+	for (i=1; i<g->count; i++)
+	{
+		offset = g->offset[i];
+		factor = g->factor[i];
+		add = g->add[i];
+		item = g->item[i];
+		for (j=i; j>0 && g->offset[j-1] > offset; j--)
+		{
+			g->offset[j] = g->offset[j-1];
+			g->factor[j] = g->factor[j-1];
+			g->add[j] = g->add[j-1];
+			g->item[j] = g->item[j-1];
+		}
+		g->offset[j] = offset;
+		g->factor[j] = factor;
+		g->add[j] = add;
+		g->item[j] = item;
+	}
+
+	// a gather loads 4 bytes at each offset
+	for (n=0; n<g->count && g->offset[n]+4 <= (int)data_length; n++)
+		;
+	g->gather = n;
+}
+
+// compiles def's mode1_def into plan.
+// returns 0 on success, -1 if out of memory.
+int aldl_decode_plan_compile(aldl_decode_plan_t* plan, aldl_definition* def)
+{
+	aldl_decode_group_t* groups[4];
+	aldl_decode_group_t* g;
+	byte_def_t* items = def->mode1_def;
+	unsigned int i, k, total;
+	char* pool;
+
+	memset(plan,0,sizeof(aldl_decode_plan_t));
+	plan->data_length = def->mode1_data_length;
+	groups[0] = &plan->mul8;
+	groups[1] = &plan->mul16;
+	groups[2] = &plan->div8;
+	groups[3] = &plan->div16;
+
+	// count the items in each group
+	for (i=0; items[i].label != NULL; i++)
+	{
+		g = aldl_decode_plan_group(plan, items+i, plan->data_length, 1);
+		if (g != NULL)
+			g->count++;
+	}
+	plan->num_items = i;
+
+	total = plan->mul8.count + plan->mul16.count + plan->div8.count + plan->div16.count;
+	pool = calloc(1, total*(sizeof(int)+2*sizeof(float)+sizeof(unsigned int)) + 1);
+	if (pool == NULL)
+		return -1;
+	plan->pool = pool;
+
+	// every array holds 4 byte values, so they can follow each other in the pool
+	for (k=0; k<4; k++)
+	{
+		g = groups[k];
+		g->offset = (int*)pool;
+		pool += g->count*sizeof(int);
+		g->factor = (float*)pool;
+		pool += g->count*sizeof(float);
+		g->add = (float*)pool;
+		pool += g->count*sizeof(float);
+		g->item = (unsigned int*)pool;
+		pool += g->count*sizeof(unsigned int);
+		g->count = 0; // counted again as the group is filled in
+	}
+
+	// fill in the groups
+	for (i=0; items[i].label != NULL; i++)
+	{
+		g = aldl_decode_plan_group(plan, items+i, plan->data_length, 0);
+		if (g == NULL)
+			continue;
+		g->offset[g->count] = items[i].byte_offset-1;
+		g->factor[g->count] = items[i].op_factor;
+		g->add[g->count] = items[i].op_offset;
+		g->item[g->count] = i;
+		g->count++;
+	}
+
+	for (k=0; k<4; k++)
+		aldl_decode_group_finish(groups[k], plan->data_length);
+
+#ifdef ALDL_DECODE_HAVE_AVX2
+	if (__builtin_cpu_supports("avx2"))
+		plan->simd = ALDL_DECODE_AVX2;
+#endif
+
+	return 0;
+}
+
+// frees the memory allocated by aldl_decode_plan_compile().
+void aldl_decode_plan_free(aldl_decode_plan_t* plan)
+{
+	free(plan->pool);
+	memset(plan,0,sizeof(aldl_decode_plan_t));
+}
+
+// decodes item i of g from the data block at data. bits and divide are
+// constants at every call, so each group gets its own branch-free loop.
+static inline float aldl_decode_value(const aldl_decode_group_t* g, unsigned int i,
+										const unsigned char* data, int bits, int divide)
+{
+	float x;
+
+	if (bits == 8)
+		x = (float)data[g->offset[i]];
+	else x = ((float)data[g->offset[i]]*256)+(float)data[g->offset[i]+1];
+
+	if (divide)
+		return (g->factor[i]/x)+g->add[i];
+	return (x*g->factor[i])+g->add[i];
+}
+
+// decodes every item of g for blocks first through end-1 into their columns
+// of count values
+static inline void aldl_decode_column_scalar(const aldl_decode_group_t* g, const unsigned char* data,
+									unsigned int stride, unsigned int first, unsigned int end,
+									unsigned int count, int bits, int divide, float* values)
+{
+	unsigned int i, n;
+
+	for (i=0; i<g->count; i++)
+	{
+		for (n=first; n<end; n++)
+			values[g->item[i]*count + n] = aldl_decode_value(g, i, data + n*stride, bits, divide);
+	}
+}
+
+static void aldl_decode_plan_columns_scalar(const aldl_decode_plan_t* plan, const char* data,
+									unsigned int stride, unsigned int first, unsigned int count, float* values)
+{
+	const unsigned char* blocks = (const unsigned char*)data;
+	unsigned int n, end;
+
+	// a few blocks at a time, so they are still cached for the next item
+	for (n=first; n<count; n=end)
+	{
+		end = (count-n > ALDL_DECODE_CHUNK) ? n+ALDL_DECODE_CHUNK : count;
+		aldl_decode_column_scalar(&plan->mul8, blocks, stride, n, end, count, 8, 0, values);
+		aldl_decode_column_scalar(&plan->mul16, blocks, stride, n, end, count, 16, 0, values);
+		aldl_decode_column_scalar(&plan->div8, blocks, stride, n, end, count, 8, 1, values);
+		aldl_decode_column_scalar(&plan->div16, blocks, stride, n, end, count, 16, 1, values);
+	}
+}
+
+// decodes the items of g whose bytes differ between raw and data, or every
+// item if raw is NULL. returns the number decoded.
+static inline unsigned int aldl_decode_group_update(const aldl_decode_group_t* g, const unsigned char* raw,
+									const unsigned char* data, int bits, int divide, float* values,
+									unsigned long* changed, unsigned long seq)
+{
+	unsigned int i, n = 0;
+	int o;
+
+	for (i=0; i<g->count; i++)
+	{
+		o = g->offset[i];
+		if (raw != NULL && raw[o] == data[o] && (bits == 8 || raw[o+1] == data[o+1]))
+			continue;
+		values[g->item[i]] = aldl_decode_value(g, i, data, bits, divide);
+		changed[g->item[i]] = seq;
+		n++;
+	}
+	return n;
+}
+
+#ifdef ALDL_DECODE_HAVE_AVX2
+// turns the 4 bytes gathered for each lane into the item's raw value. the
+// first byte is the item (or its most significant byte if 16 bit), the
+// second its least significant byte.
+__attribute__((target("avx2")))
+static inline __m256 aldl_decode_raw_avx2(__m256i raw, int bits)
+{
+	const __m256i low_byte = _mm256_set1_epi32(0xFF);
+	__m256i val;
+
+	if (bits == 8)
+		val = _mm256_and_si256(raw, low_byte);
+	else val = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(raw, low_byte), 8),
+								_mm256_and_si256(_mm256_srli_epi32(raw, 8), low_byte));
+	return _mm256_cvtepi32_ps(val);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 aldl_decode_op_avx2(__m256 x, __m256 factor, __m256 add, int divide)
+{
+	if (divide)
+		return _mm256_add_ps(_mm256_div_ps(factor, x), add);
+	// not a fused multiply-add: that rounds once instead of twice, which
+	// changes how some values format (Coolant Temp 9 is -27.8, not -27.9)
+	return _mm256_add_ps(_mm256_mul_ps(x, factor), add);
+}
+
+// eight frames: decodes each item of g from eight blocks at a time, which
+// fills eight consecutive entries of the item's column
+__attribute__((target("avx2")))
+static inline void aldl_decode_column_avx2(const aldl_decode_group_t* g, const unsigned char* blocks,
+										unsigned int stride, __m256i lanes, unsigned int count,
+										int bits, int divide, float* values)
+{
+	unsigned int i, n;
+	float* column;
+
+	for (i=0; i<g->count; i++)
+	{
+		column = values + g->item[i]*count;
+		if (i < g->gather)
+			_mm256_storeu_ps(column, aldl_decode_op_avx2(
+					aldl_decode_raw_avx2(_mm256_i32gather_epi32((const int*)(blocks+g->offset[i]), lanes, 1), bits),
+					_mm256_set1_ps(g->factor[i]), _mm256_set1_ps(g->add[i]), divide));
+		else for (n=0; n<ALDL_DECODE_LANES; n++)
+			column[n] = aldl_decode_value(g, i, blocks + n*stride, bits, divide);
+	}
+}
+
+__attribute__((target("avx2")))
+static void aldl_decode_plan_columns_avx2(const aldl_decode_plan_t* plan, const char* data,
+									unsigned int stride, unsigned int count, float* values)
+{
+	const unsigned char* blocks = (const unsigned char*)data;
+	__m256i lanes = _mm256_mullo_epi32(_mm256_setr_epi32(0,1,2,3,4,5,6,7), _mm256_set1_epi32(stride));
+	unsigned int n;
+
+	for (n=0; n+ALDL_DECODE_LANES <= count; n+=ALDL_DECODE_LANES)
+	{
+		aldl_decode_column_avx2(&plan->mul8, blocks + n*stride, stride, lanes, count, 8, 0, values+n);
+		aldl_decode_column_avx2(&plan->mul16, blocks + n*stride, stride, lanes, count, 16, 0, values+n);
+		aldl_decode_column_avx2(&plan->div8, blocks + n*stride, stride, lanes, count, 8, 1, values+n);
+		aldl_decode_column_avx2(&plan->div16, blocks + n*stride, stride, lanes, count, 16, 1, values+n);
+	}
+
+	aldl_decode_plan_columns_scalar(plan, data, stride, n, count, values);
+}
+#endif
+
+// decodes the items of data whose bytes differ from raw, marks them changed
+// with seq and copies data into raw. returns the number of items decoded.
+unsigned int aldl_decode_plan_update(const aldl_decode_plan_t* plan, char* raw, const char* data,
+									float* values, unsigned long* changed, unsigned long seq)
+{
+	const unsigned char* prev = (const unsigned char*)raw;
+	const unsigned char* block = (const unsigned char*)data;
+	unsigned int n;
+
+	// most blocks are the same as the last one while the engine holds still
+	if (raw != NULL && memcmp(raw, data, plan->data_length) == 0)
+		return 0;
+
+	n = aldl_decode_group_update(&plan->mul8, prev, block, 8, 0, values, changed, seq);
+	n += aldl_decode_group_update(&plan->mul16, prev, block, 16, 0, values, changed, seq);
+	n += aldl_decode_group_update(&plan->div8, prev, block, 8, 1, values, changed, seq);
+	n += aldl_decode_group_update(&plan->div16, prev, block, 16, 1, values, changed, seq);
+
+	if (raw != NULL)
+		memcpy(raw, data, plan->data_length);
+	return n;
+}
+
+// decodes count data blocks, stride bytes apart, into a column of count
+// values for each item of mode1_def.
+void aldl_decode_plan_run_batch(const aldl_decode_plan_t* plan, const char* data,
+								unsigned int stride, unsigned int count, float* values)
+{
+#ifdef ALDL_DECODE_HAVE_AVX2
+	if (plan->simd == ALDL_DECODE_AVX2)
+	{
+		aldl_decode_plan_columns_avx2(plan, data, stride, count, values);
+		return;
+	}
+#endif
+	aldl_decode_plan_columns_scalar(plan, data, stride, 0, count, values);
+}
+
+// ============================================================================
+// VALUE FORMATTING
+// ============================================================================
+
+// "00" to "99", for writing two digits at once
+static const char aldl_digit_pairs[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+// writes value with one decimal place into buf, like printf("%.1f") in the
+// C locale. returns the length of the string, or -1 if it doesn't fit.
+int aldl_format_value(float value, char* buf, unsigned int size)
+{
+	char digits[24];
+	char* p;
+	volatile double x; // kept in memory so the rounding below works on x87
+	unsigned long long tenths;
+	unsigned int n = 0, i;
+	int negative = signbit(value) != 0;
+
+	if (isnan(value))
+		return (size > 3) ? (memcpy(buf,"nan",4), 3) : -1;
+	if (isinf(value))
+	{
+		if (negative)
+			return (size > 4) ? (memcpy(buf,"-inf",5), 4) : -1;
+		return (size > 3) ? (memcpy(buf,"inf",4), 3) : -1;
+	}
+
+	// a float times 10 is exact in a double
+	x = negative ? -(double)value*10.0 : (double)value*10.0;
+	if (x >= 4503599627370496.0) // 2^52: too large to round below
+	{
+		// only a broken definition gets here. printf may write a
+		// decimal comma in some locales, so fix that up.
+		i = snprintf(buf, size, "%.1f", value);
+		if (i >= size)
+			return -1;
+		for (n=0; n<i; n++)
+			if (buf[n] == ',')
+				buf[n] = '.';
+		return i;
+	}
+
+	// adding and subtracting 2^52 rounds to an integer, half to even like
+	// printf, in the default rounding mode
+	x = x + 4503599627370496.0;
+	x = x - 4503599627370496.0;
+	tenths = (unsigned long long)x;
+
+	// the digits are written backwards from the end of digits, two at a time
+	p = digits + sizeof(digits);
+	*--p = '0' + tenths%10;
+	*--p = '.';
+	tenths /= 10;
+	while (tenths >= 100)
+	{
+		p -= 2;
+		memcpy(p, aldl_digit_pairs + (tenths%100)*2, 2);
+		tenths /= 100;
+	}
+	if (tenths >= 10)
+	{
+		p -= 2;
+		memcpy(p, aldl_digit_pairs + tenths*2, 2);
+	}
+	else *--p = '0' + tenths;
+	if (negative)
+		*--p = '-';
+
+	n = digits + sizeof(digits) - p;
+	if (n >= size)
+		return -1;
+	memcpy(buf, p, n);
+	buf[n] = '\0';
+	return n;
+}
+
+// returns slot holding value, formatting it only if it changed since the
+// slot was last formatted.
+const char* aldl_format_slot(float value, unsigned long changed, unsigned long* formatted, char* slot)
+{
+	if (*formatted != changed)
+	{
+		if (aldl_format_value(value, slot, ALDL_STRING_SLOT_SIZE) < 0)
+			strcpy(slot, "####"); // doesn't fit
+		*formatted = changed;
+	}
+	return slot;
+}
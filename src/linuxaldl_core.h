@@ -0,0 +1,286 @@
+#ifndef LINUXALDL_CORE_INCLUDED
+#define LINUXALDL_CORE_INCLUDED
+
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include "linuxaldl_stream.h"
+
+// ============================================================================
+// ALDL PROTOCOL, DEFINITIONS AND DECODING
+// ============================================================================
+// the definition format and the functions that work on it. this is the part
+// of linuxaldl that does not depend on the global settings or the GUI; it is
+// built into libaldl along with the serial, stream, session and log code.
+
+#define BAUDRATE B9600
+
+#define __MAX_REQUEST_SIZE 16 // maximum size (bytes) of a request message
+							  // to send to the ECM
+
+#define LINUXALDL_MODE1_END_DEF {NULL,0,0,0,0,0,NULL}
+#define LINUXALDL_FRAME_END_DESC {NULL,{0,0,0},0,0}
+
+
+typedef enum _ALDL_OP { ALDL_OP_MULTIPLY=0, ALDL_OP_DIVIDE=1, ALDL_OP_SEPERATOR=9} ALDL_OP_t;
+
+// scan modes
+// ALDL_SCAN_INTERVAL: one mode 1 request every scan_interval msec.
+// ALDL_SCAN_THROUGHPUT: the next request goes out bus_guard_time msec after the
+//   previous response was verified (or after scan_timeout if there was none).
+// ALDL_SCAN_PASSIVE: nothing is ever sent. frames the ECM sends on its own
+//   are picked out of the line using the definition's broadcast_frames.
+typedef enum _ALDL_SCAN_MODE { ALDL_SCAN_INTERVAL=0, ALDL_SCAN_THROUGHPUT=1, ALDL_SCAN_PASSIVE=2 } ALDL_SCAN_MODE_t;
+
+// parser tag of the echo of the mode 1 request (see aldl_definition_setup_stream())
+#define ALDL_FRAME_ECHO -2
+
+// log file formats (see linuxaldl_log.h)
+typedef enum _aldl_log_format { ALDL_LOG_RAW, ALDL_LOG_CSV } aldl_log_format_t;
+
+// when the background log writer syncs a log file (see linuxaldl_log.h)
+typedef enum _aldl_fsync_policy {
+	ALDL_FSYNC_NONE=0,		// leave it to the kernel
+	ALDL_FSYNC_INTERVAL=1,	// sync at most every fsync_every msec
+	ALDL_FSYNC_RECORDS=2	// sync after every fsync_every records
+} aldl_fsync_policy_t;
+
+#define ALDL_STRING_SLOT_SIZE 16 // bytes for a value formatted by aldl_format_value()
+
+#define _DEF_SEP(label) {label,0,0,ALDL_OP_SEPERATOR,0,0,NULL}
+
+
+// ============================================================================
+// ALDL DEFINITION STRUCTS
+// ============================================================================
+
+// See linuxaldl_definitions.h for instructions on how to make a new definition
+
+
+// byte_def_t struct
+typedef struct _linuxaldl_byte_definition{
+	const char* label;
+	unsigned int byte_offset; // the offset from the 1st byte of the data part
+							  // of the mode1 message
+	unsigned int bits; // 8 or 16 are currently supported
+
+	unsigned int operation; // ALDL_OP_MULTIPLY: (X*factor)+offest
+							// ALDL_OP_DIVIDE: (factor/X)+offset
+							// ALDL_OP_SEPERATOR: use this for a seperator for the display,
+							//    not a data item.  with this option no other
+							//	  values matter except label.
+							//	  you can also use the _DEF_SEP(label) macro like:
+							//	  _DEF_SEP("---Basic Data---")
+
+	float op_factor; // factor for the operation
+	float op_offset; // offset for the operation
+
+
+	const char* units;
+} byte_def_t;
+
+// aldl_frame_desc struct
+// describes a frame that can be seen on the line without sending a request,
+// for passive listening. the last element of a table of these must be
+// LINUXALDL_FRAME_END_DESC.
+typedef struct _linuxaldl_frame_descriptor{
+	const char* name;
+	char header[3]; // device id, 0x52 + length, mode
+	unsigned int length; // total length of the frame, including header and checksum
+	unsigned int data_offset; // if nonzero, the frame carries mode1_data_length bytes
+							  // starting at this offset laid out as described by
+							  // mode1_def, and is decoded. if 0 the frame is
+							  // recognized (so it isn't mistaken for noise) but ignored.
+} aldl_frame_desc;
+
+typedef struct _linuxaldl_definition{
+	const char* name;
+	char mode1_request[__MAX_REQUEST_SIZE];  // the mode 1 request message, including the checksum
+	unsigned int mode1_request_length;  // the length of the mode 1 message including the checksum
+
+	unsigned int mode1_response_length; // the total length of the response from the ecm
+
+	unsigned int mode1_data_length; // the number of data bytes in the mode1 message response
+
+	unsigned int mode1_data_offset; // the byte offest from the start of the mode1 message response
+									// to the first byte of the data. e.g. if the data part of the
+									// message is the 4th byte onward, this should be 3. (1+3 = 4)
+
+	byte_def_t* mode1_def; // pointer to start of table of byte_def_t structs.
+							// the last element must be LINUXALDL_MODE1_END_DEF
+
+	char mode8_request[__MAX_REQUEST_SIZE];  // the mode 8 (silence) request message, incl checksum
+	unsigned int mode8_request_length;  // the length of the mode 8 message incl checksum
+
+	char mode9_request[__MAX_REQUEST_SIZE];  // the mode 9 (un-silence) request message, incl checksum
+	unsigned int mode9_request_length;  // the length of the mode 9 message including the checksum
+
+	aldl_frame_desc* broadcast_frames; // frames the ECM sends on its own. looked for when
+									   // listening passively; when polling they show the
+									   // ECM has resumed normal mode.
+									   // (ALDL_SCAN_PASSIVE). NULL if none are known.
+
+} aldl_definition;
+
+
+
+// ============================================================================
+// DECODE PLANS
+// ============================================================================
+// a decode plan is a definition's mode1_def compiled once, when the
+// definition is loaded, into a form that is fast to decode: seperators and
+// items that can't be decoded are left out, every remaining item has been
+// bounds checked against mode1_data_length, and the items are split into
+// four groups by size and operation. each group keeps its byte offsets,
+// factors and offsets in their own arrays, so a whole group is decoded with
+// the same few instructions and no branches per item.
+//
+// on x86 CPUs with AVX2 (checked at run time) a batch is decoded eight values
+// at a time, one item of eight frames loaded with one gather; elsewhere the
+// same loops run one value at a time. every path multiplies and adds with
+// the same rounding as aldl_decode_item(), so the floats are the same
+// whichever code decoded them.
+
+#define ALDL_DECODE_LANES 8 // items decoded together by the AVX2 code
+
+typedef enum _aldl_decode_simd { ALDL_DECODE_SCALAR=0, ALDL_DECODE_AVX2=1 } aldl_decode_simd_t;
+
+// aldl_decode_group_t: the items of a plan with the same size and operation
+typedef struct _aldl_decode_group
+{
+	unsigned int count;		// number of items in the group
+	unsigned int gather;	// the first gather items can be loaded 4 bytes at a time
+							// without reading past the end of the data block.
+							// the rest are always decoded singly.
+	int* offset;			// byte offset of each item in the data block, ascending
+	float* factor;			// op_factor of each item
+	float* add;				// op_offset of each item
+	unsigned int* item;		// index of each item in mode1_def (and in the values array)
+} aldl_decode_group_t;
+
+typedef struct _aldl_decode_plan
+{
+	unsigned int num_items;		// entries in mode1_def: the size of a values array
+	unsigned int data_length;	// mode1_data_length
+	aldl_decode_simd_t simd;	// code used to decode
+
+	aldl_decode_group_t mul8;	// 8 bit, ALDL_OP_MULTIPLY
+	aldl_decode_group_t mul16;	// 16 bit, ALDL_OP_MULTIPLY
+	aldl_decode_group_t div8;	// 8 bit, ALDL_OP_DIVIDE
+	aldl_decode_group_t div16;	// 16 bit, ALDL_OP_DIVIDE
+
+	void* pool;					// single block holding every group's arrays
+} aldl_decode_plan_t;
+
+extern aldl_definition* aldl_definition_table[]; // see linuxaldl_definitions.h. the last entry is NULL.
+
+// looks up def_name in the aldl_definition_table until it finds the first 
+// definition in the table with the name def_name
+// if the definition is not in the table, returns NULL
+aldl_definition* aldl_get_definition(const char* defname);
+
+// function prototypes
+// =================================================
+
+char get_checksum(char* buffer, unsigned int len);
+// calculates the single-byte checksum, summing from the start of buffer
+// through len bytes. the checksum is calculated by summing the bytes,
+// dropping carried bits, then adding 1 and taking the two's complement
+// (subtract from FF) 
+
+int aldl_definition_setup_stream(aldl_stream_t* s, aldl_definition* def, ALDL_SCAN_MODE_t mode);
+// sets up the frame parser s for def: the mode 1 response header for
+// ALDL_SCAN_INTERVAL/ALDL_SCAN_THROUGHPUT, or def's broadcast_frames for
+// ALDL_SCAN_PASSIVE. the mode 1 response is tagged -1 and broadcast frames are
+// tagged with their index in def->broadcast_frames. when polling, the echo
+// of the mode 1 request (heard on single wire interfaces) is also looked for,
+// tagged ALDL_FRAME_ECHO, and so are the broadcast frames, as normal mode chatter.
+// returns 0 on success, -1 if def has nothing to look for in that mode.
+
+unsigned int aldl_definition_max_frame(aldl_definition* def);
+// returns the length of the largest frame that can be received with def,
+// whether polled or broadcast.
+
+unsigned int aldl_definition_data_offset(aldl_definition* def, const char* frame, unsigned int len);
+// returns the offset of the mode1 data block in frame, which has len bytes:
+// def->mode1_data_offset for a mode 1 response, the data_offset of a
+// matching broadcast frame, or 0 if frame isn't one def decodes.
+
+uint32_t aldl_definition_hash(aldl_definition* def);
+// returns a hash of everything in def that affects how its frames are
+// decoded (not the labels or units), so a log can be matched to the
+// definition it was recorded with.
+
+uint32_t aldl_crc32(uint32_t crc, const void* buf, unsigned long len);
+// returns the CRC-32 (the one used by zlib and ethernet) of len bytes at buf
+// continued from crc. use 0 for the first block.
+
+int aldl_decode_item(byte_def_t* def, const char* raw, float* result);
+// converts the item described by def from the mode1 data block raw into a
+// float and stores it in *result.
+// returns 0 on success, -1 if def is a seperator or its size isn't supported.
+
+int aldl_decode_plan_compile(aldl_decode_plan_t* plan, aldl_definition* def);
+// compiles def's mode1_def into plan. items that are not 8 or 16 bits, have
+// an unknown operation or lie outside the data block are left out with a
+// warning. returns 0 on success, -1 if out of memory.
+
+void aldl_decode_plan_free(aldl_decode_plan_t* plan);
+// frees the memory allocated by aldl_decode_plan_compile().
+
+void aldl_decode_plan_run_batch(const aldl_decode_plan_t* plan, const char* data,
+								unsigned int stride, unsigned int count, float* values);
+// decodes count data blocks, stride bytes apart starting at data (stride is
+// at least plan->data_length), for offline decoding of logs. values holds
+// plan->num_items columns of count floats: the value of item i in block n is
+// values[i*count + n]. columns for seperators are not written.
+
+unsigned int aldl_decode_plan_update(const aldl_decode_plan_t* plan, char* raw, const char* data,
+									float* values, unsigned long* changed, unsigned long seq);
+// decodes the mode1 data block data into values, which has plan->num_items
+// entries indexed like mode1_def (seperators are not written), but only the
+// items whose bytes differ from raw, the block values were last decoded
+// from. changed has plan->num_items entries; changed[i] is set to seq
+// for every item decoded. data is then copied into raw.
+// if raw is NULL every item is decoded (use this for the first block).
+// returns the number of items decoded.
+
+int aldl_format_value(float value, char* buf, unsigned int size);
+// writes value with one decimal place into buf, like printf("%.1f") in the
+// C locale regardless of the current locale, and without using stdio.
+// returns the length of the string, or -1 if it doesn't fit in size bytes.
+
+const char* aldl_format_slot(float value, unsigned long changed, unsigned long* formatted, char* slot);
+// returns slot, an ALDL_STRING_SLOT_SIZE byte string holding value. value is
+// only formatted (with aldl_format_value()) if changed, the sequence number
+// of its last change, differs from *formatted, which is then set to changed.
+// a slot that has never been formatted is "".
+
+float aldl_raw8_to_float(unsigned char val, int operation, float op_factor, float op_offset);
+// converts the raw 8-bit data value val into a float by performing operation
+// using op_factor and op_offset.
+// see the documentation for the byte_def_t struct for more information
+
+float aldl_raw16_to_float(unsigned char msb, unsigned char lsb, int operation, float op_factor, float op_offset);
+// converts the raw 16-bit data value defined by lsb and msb into a float by performing operation
+// using op_factor and op_offset.
+// see the documentation for the byte_def_t struct for more information
+
+#endif
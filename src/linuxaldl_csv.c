@@ -0,0 +1,306 @@
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "linuxaldl_csv.h"
+
+// writes the seconds of a timestamp and the "+0." after them into buf.
+// returns the length.
+static int aldl_csv_format_seconds(char* buf, long sec)
+{
+	char digits[24]; // written backwards
+	unsigned long s = sec;
+	int n = 0, i = 0;
+
+	if (sec < 0)
+		return snprintf(buf, 24, "%ld+0.", sec);
+	do
+	{
+		digits[i++] = '0' + s%10;
+		s /= 10;
+	} while (s != 0);
+	while (i > 0)
+		buf[n++] = digits[--i];
+	memcpy(buf+n, "+0.", 3);
+	return n+3;
+}
+
+// writes the six digits of the microseconds usec into buf
+static void aldl_csv_format_usec(char* buf, long usec)
+{
+	unsigned long u = (unsigned long)usec % 1000000;
+	int i;
+
+	for (i=5; i>=0; i--)
+	{
+		buf[i] = '0' + u%10;
+		u /= 10;
+	}
+}
+
+// writes timestamp as seconds+fraction into buf. returns the length.
+int aldl_csv_format_time(char* buf, const struct timeval* timestamp)
+{
+	int n = aldl_csv_format_seconds(buf, timestamp->tv_sec);
+
+	aldl_csv_format_usec(buf+n, timestamp->tv_usec);
+	return n+6;
+}
+
+// returns 1 if field has to be quoted in a csv file, 0 otherwise
+static int aldl_csv_needs_quotes(const char* field)
+{
+	return strpbrk(field, ",\"\r\n") != NULL;
+}
+
+// writes field into buf, quoted if it has to be.
+// returns the length, or -1 if it doesn't fit.
+int aldl_csv_format_field(char* buf, unsigned int size, const char* field)
+{
+	unsigned int n = 0;
+
+	if (!aldl_csv_needs_quotes(field))
+	{
+		n = strlen(field);
+		if (n >= size)
+			return -1;
+		memcpy(buf, field, n+1);
+		return n;
+	}
+
+	buf[n++] = '"';
+	for (; *field != 0; field++)
+	{
+		if (n+3 >= size)
+			return -1;
+		if (*field == '"')
+			buf[n++] = '"';
+		buf[n++] = *field;
+	}
+	buf[n++] = '"';
+	buf[n] = 0;
+	return n;
+}
+
+// writes field to f, quoted if it has to be.
+void aldl_csv_write_field(FILE* f, const char* field)
+{
+	if (!aldl_csv_needs_quotes(field))
+	{
+		fputs(field, f);
+		return;
+	}
+	putc('"', f);
+	for (; *field != 0; field++)
+	{
+		if (*field == '"')
+			putc('"', f);
+		putc(*field, f);
+	}
+	putc('"', f);
+}
+
+// ============================================================================
+// ENCODER
+// ============================================================================
+
+// sets up e to format lines for def, writing them to fd (or keeping them if
+// it is -1). returns 0 on success, -1 on failure.
+int aldl_csv_encoder_init(aldl_csv_encoder_t* e, aldl_definition* def, int fd)
+{
+	memset(e, 0, sizeof(aldl_csv_encoder_t));
+	e->definition = def;
+	e->fd = fd;
+	for (e->num_items=0; def->mode1_def[e->num_items].label != NULL; e->num_items++)
+		;
+	e->max_line = ALDL_CSV_TIME_SIZE + e->num_items*(1 + ALDL_STRING_SLOT_SIZE) + 1;
+
+	// one block for the last values, their text and its length
+	e->last = malloc(e->num_items*(sizeof(uint32_t) + ALDL_STRING_SLOT_SIZE + 1) + 1);
+	e->size = ALDL_CSV_BUFSIZE;
+	if (e->size < e->max_line)
+		e->size = e->max_line;
+	e->buf = malloc(e->size);
+	if (e->last == NULL || e->buf == NULL)
+	{
+		aldl_csv_encoder_free(e);
+		return -1;
+	}
+	e->text = (char*)(e->last + e->num_items);
+	e->length = (unsigned char*)(e->text + e->num_items*ALDL_STRING_SLOT_SIZE);
+	memset(e->length, 0, e->num_items);
+	return 0;
+}
+
+// makes room for len more bytes in the buffer: by writing it out, or
+// without a file by making it larger. returns 0 on success, -1 on failure.
+static int aldl_csv_encoder_room(aldl_csv_encoder_t* e, unsigned long len)
+{
+	unsigned long size;
+	char* buf;
+
+	if (e->size - e->used >= len)
+		return 0;
+	if (e->fd != -1 && aldl_csv_encoder_flush(e) != 0)
+		return -1;
+	if (e->size - e->used >= len)
+		return 0;
+
+	size = e->size*2;
+	if (size < e->used + len)
+		size = e->used + len;
+	buf = realloc(e->buf, size);
+	if (buf == NULL)
+		return -1;
+	e->buf = buf;
+	e->size = size;
+	return 0;
+}
+
+// adds the header line. returns 0, or -1 if it couldn't be written.
+int aldl_csv_encoder_header(aldl_csv_encoder_t* e)
+{
+	byte_def_t* items = e->definition->mode1_def;
+	unsigned long need = 16;
+	unsigned int i;
+	int len;
+
+	// every label quoted, with every character a quote, at the worst
+	for (i=0; i<e->num_items; i++)
+		need += 2*strlen(items[i].label) + 4;
+	if (aldl_csv_encoder_room(e, need) != 0)
+		return -1;
+
+	memcpy(e->buf + e->used, "Timestamp", 9);
+	e->used += 9;
+	for (i=0; i<e->num_items; i++)
+	{
+		if (items[i].operation == ALDL_OP_SEPERATOR)
+			continue;
+		e->buf[e->used++] = ',';
+		len = aldl_csv_format_field(e->buf + e->used, e->size - e->used, items[i].label);
+		e->used += len;
+	}
+	e->buf[e->used++] = '\n';
+	return 0;
+}
+
+// adds a data line with the value of def->mode1_def[i] at values[i*stride].
+// returns 0, or -1 if it couldn't be written.
+int aldl_csv_encoder_line(aldl_csv_encoder_t* e, const struct timeval* timestamp,
+							const float* values, unsigned long stride)
+{
+	byte_def_t* items = e->definition->mode1_def;
+	char* text;
+	char* p;
+	uint32_t bits;
+	unsigned int i;
+	int len;
+
+	if (aldl_csv_encoder_room(e, e->max_line) != 0)
+		return -1;
+	p = e->buf + e->used;
+
+	// the seconds only change every so many lines
+	if (e->sec_length == 0 || timestamp->tv_sec != e->last_sec)
+	{
+		e->sec_length = aldl_csv_format_seconds(e->sec_text, timestamp->tv_sec);
+		e->last_sec = timestamp->tv_sec;
+	}
+	memcpy(p, e->sec_text, e->sec_length);
+	p += e->sec_length;
+	aldl_csv_format_usec(p, timestamp->tv_usec);
+	p += 6;
+
+	for (i=0; i<e->num_items; i++)
+	{
+		if (items[i].operation == ALDL_OP_SEPERATOR)
+			continue;
+		*p++ = ',';
+		// a value is formatted again only when its bits change
+		text = e->text + i*ALDL_STRING_SLOT_SIZE;
+		memcpy(&bits, values + i*stride, sizeof(bits));
+		if (e->length[i] == 0 || bits != e->last[i])
+		{
+			len = aldl_format_value(values[i*stride], text, ALDL_STRING_SLOT_SIZE);
+			if (len < 0)
+			{
+				memcpy(text, "####", 4); // doesn't fit
+				len = 4;
+			}
+			e->length[i] = len;
+			e->last[i] = bits;
+		}
+		memcpy(p, text, e->length[i]);
+		p += e->length[i];
+	}
+	*p++ = '\n';
+
+	e->used = p - e->buf;
+	e->lines++;
+	return 0;
+}
+
+// writes everything in the buffer to the file.
+// returns 0 on success, -1 if it couldn't all be written.
+int aldl_csv_encoder_flush(aldl_csv_encoder_t* e)
+{
+	unsigned long done;
+	ssize_t res;
+
+	if (e->fd == -1)
+		return 0;
+	for (done=0; done<e->used; done+=res)
+	{
+		res = write(e->fd, e->buf+done, e->used-done);
+		if (res < 0 && errno == EINTR)
+			res = 0;
+		else if (res <= 0)
+		{
+			// the lines are given up on, so the next ones still have room
+			e->errors++;
+			e->used = 0;
+			return -1;
+		}
+	}
+	e->bytes += e->used;
+	e->used = 0;
+	return 0;
+}
+
+// empties the buffer of an encoder without a file.
+void aldl_csv_encoder_clear(aldl_csv_encoder_t* e)
+{
+	e->used = 0;
+}
+
+// releases e.
+void aldl_csv_encoder_free(aldl_csv_encoder_t* e)
+{
+	free(e->last);
+	free(e->buf);
+	e->last = NULL;
+	e->buf = NULL;
+	e->text = NULL;
+	e->length = NULL;
+}
@@ -0,0 +1,117 @@
+#ifndef LINUXALDL_CSV_INCLUDED
+#define LINUXALDL_CSV_INCLUDED
+
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include "linuxaldl_core.h"
+
+// ============================================================================
+// CSV ENCODER
+// ============================================================================
+// an aldl_csv_encoder_t turns decoded frames into the lines of a csv log (see
+// linuxaldl_log.h) as fast as it can, for converting whole raw logs: every
+// line is formatted straight into one large buffer, without stdio, and
+// the buffer is written to the file with one write() whenever it is nearly
+// full. the text of each item's last value is kept, so a value that didn't
+// change since the line before is copied instead of formatted again, and
+// so is the whole seconds part of the timestamp.
+//
+// the values of a line can come from a session's data_set_floats or from a
+// column of what aldl_decode_plan_run_batch() decoded (see
+// aldl_csv_encoder_line()).
+// an encoder without a file keeps every line in its buffer instead, so that
+// chunks of a log can be formatted in parallel and written in order.
+//
+// fields are quoted as RFC4180 says only when they have to be: a label with
+// a comma, quote or line break in it. values and timestamps never need it.
+
+#define ALDL_CSV_BUFSIZE (256*1024)	// bytes an encoder with a file buffers before writing them
+#define ALDL_CSV_TIME_SIZE 32		// bytes a formatted timestamp can take
+
+// aldl_csv_encoder_t: formats csv lines for a definition into a buffer
+typedef struct _aldl_csv_encoder
+{
+	aldl_definition* definition;
+	unsigned int num_items;		// entries in definition->mode1_def
+	int fd;						// file the lines are written to, -1 to keep them in buf
+	char* buf;					// the lines not written yet
+	unsigned long size;			// bytes allocated for buf
+	unsigned long used;			// bytes in it
+	unsigned long max_line;		// the longest a data line can be
+
+	// the last value of each item and its text
+	uint32_t* last;				// bits of the float the text is for
+	char* text;					// ALDL_STRING_SLOT_SIZE bytes per item, not terminated
+	unsigned char* length;		// length of each text, 0 if it hasn't been formatted
+	long last_sec;				// the seconds of the last timestamp
+	char sec_text[24];			// ...formatted, with "+0." after them
+	unsigned int sec_length;	// 0 if none yet
+
+	// statistics
+	unsigned long lines;		// data lines formatted
+	uint64_t bytes;				// bytes written to fd
+	unsigned long errors;		// writes that failed
+} aldl_csv_encoder_t;
+
+// function prototypes
+// =================================================
+
+int aldl_csv_encoder_init(aldl_csv_encoder_t* e, aldl_definition* def, int fd);
+// sets up e to format lines for def, writing them to the open file fd, or
+// keeping them in e->buf if fd is -1. returns 0 on success, -1 on failure.
+
+int aldl_csv_encoder_header(aldl_csv_encoder_t* e);
+// adds the header line. returns 0, or -1 if it couldn't be written.
+
+int aldl_csv_encoder_line(aldl_csv_encoder_t* e, const struct timeval* timestamp,
+							const float* values, unsigned long stride);
+// adds a data line with the values of every item: the value of
+// def->mode1_def[i] is values[i*stride] (seperators are skipped). stride is 1
+// for a session's data_set_floats, or the count aldl_decode_plan_run_batch()
+// was given for the columns it decoded. returns 0, or -1 if it couldn't be
+// written (or, without a file, memory ran out).
+
+int aldl_csv_encoder_flush(aldl_csv_encoder_t* e);
+// writes everything in the buffer to the file. does nothing without a file.
+// returns 0 on success, -1 if it couldn't all be written.
+
+void aldl_csv_encoder_clear(aldl_csv_encoder_t* e);
+// empties the buffer of an encoder without a file, once the lines in it
+// have been used. the values kept for the next line stay.
+
+void aldl_csv_encoder_free(aldl_csv_encoder_t* e);
+// releases e. anything not flushed is lost.
+
+int aldl_csv_format_time(char* buf, const struct timeval* timestamp);
+// writes timestamp the way csv logs have it, as seconds+fraction, into buf,
+// which has room for ALDL_CSV_TIME_SIZE bytes. returns the length.
+
+int aldl_csv_format_field(char* buf, unsigned int size, const char* field);
+// writes field into buf, which has size bytes, in quotes (and with its
+// quotes doubled) if it has a comma, quote or line break in it.
+// returns the length, or -1 if it doesn't fit.
+
+void aldl_csv_write_field(FILE* f, const char* field);
+// writes field to f, quoted like aldl_csv_format_field() does.
+
+#endif
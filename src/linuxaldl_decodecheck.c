@@ -0,0 +1,185 @@
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// decodecheck: checks that every way of decoding gives the same floats,
+// bit for bit. for each definition, data blocks holding every 16 bit
+// pattern at every item are decoded by aldl_decode_plan_run_batch() with
+// the code the plan picked (AVX2 where the CPU has it), by the same call
+// with the scalar code, by aldl_decode_plan_update() (block after block, so
+// only the items that changed) and by aldl_decode_item(), and each value is
+// compared with one worked out here with the multiply (or divide) and the
+// add rounded separately. a fused
+// multiply-add anywhere (the AVX2 code, or -ffp-contract left on for a CPU
+// with FMA) rounds once and shows up as a difference.
+//
+// prints the values that differ and exits with 1 if any do.
+//
+//   make check, or: make decodecheck && ../bin/decodecheck
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libaldl.h"
+
+#define DECODECHECK_BLOCKS (65536+5)	// every 16 bit pattern, and a few more so the
+										// batch doesn't end on a whole number of lanes
+#define DECODECHECK_SHOWN 10			// differences printed for each definition
+
+static unsigned long decodecheck_values, decodecheck_differ;
+
+// returns the value of item, which is in group g, in the data block block
+// with the multiply (or divide) and the add rounded separately
+static float decodecheck_expected(const aldl_decode_group_t* g, unsigned int i, int bits, int divide,
+									const unsigned char* block)
+{
+	volatile float x, y;
+
+	if (bits == 8)
+		x = block[g->offset[i]];
+	else x = (float)block[g->offset[i]]*256 + (float)block[g->offset[i]+1];
+	// stored to memory, so nothing fuses it with the add
+	y = divide ? g->factor[i]/x : x*g->factor[i];
+	return y + g->add[i];
+}
+
+// compares got with expected bit for bit, printing the first few that differ
+static void decodecheck_compare(aldl_definition* def, unsigned int item, const char* how, unsigned long n,
+								float got, float expected)
+{
+	decodecheck_values++;
+	if (memcmp(&got, &expected, sizeof(float)) == 0)
+		return;
+	if (decodecheck_differ++ < DECODECHECK_SHOWN)
+		printf("DIFFERS: %s, %s block %lu: %s gave %a, not %a\n", def->name, def->mode1_def[item].label,
+				n, how, got, expected);
+}
+
+// decodes the blocks with every path and compares the values of group g
+static void decodecheck_group(aldl_definition* def, const aldl_decode_group_t* g, int bits, int divide,
+								const unsigned char* blocks, unsigned int stride, const float* batch,
+								const float* scalar, const float* updated, unsigned int num_items)
+{
+	unsigned int i, item;
+	unsigned long n;
+	float expected, single;
+
+	for (i=0; i<g->count; i++)
+	{
+		item = g->item[i];
+		for (n=0; n<DECODECHECK_BLOCKS; n++)
+		{
+			expected = decodecheck_expected(g, i, bits, divide, blocks + n*stride);
+			decodecheck_compare(def, item, "the batch code", n, batch[item*DECODECHECK_BLOCKS + n], expected);
+			decodecheck_compare(def, item, "the scalar batch code", n, scalar[item*DECODECHECK_BLOCKS + n], expected);
+			decodecheck_compare(def, item, "aldl_decode_plan_update()", n, updated[n*num_items + item], expected);
+			aldl_decode_item(def->mode1_def + item, (const char*)blocks + n*stride, &single);
+			decodecheck_compare(def, item, "aldl_decode_item()", n, single, expected);
+		}
+	}
+}
+
+// checks the decoding of def. returns 0 on success, -1 if out of memory.
+static int decodecheck_definition(aldl_definition* def)
+{
+	aldl_decode_plan_t plan, scalar_plan;
+	unsigned char* blocks;
+	float* batch;
+	float* scalar;
+	float* updated;
+	float* values;
+	unsigned long* changed;
+	char* raw;
+	unsigned int stride, j;
+	unsigned long n, differ = decodecheck_differ;
+	int res = -1;
+
+	if (aldl_decode_plan_compile(&plan, def) != 0)
+		return -1;
+	// one spare byte after each block, so the blocks aren't packed
+	stride = plan.data_length + 1;
+	blocks = malloc((size_t)DECODECHECK_BLOCKS*stride);
+	batch = malloc((size_t)plan.num_items*DECODECHECK_BLOCKS*sizeof(float));
+	scalar = malloc((size_t)plan.num_items*DECODECHECK_BLOCKS*sizeof(float));
+	updated = malloc((size_t)plan.num_items*DECODECHECK_BLOCKS*sizeof(float));
+	values = malloc(plan.num_items*sizeof(float));
+	changed = malloc(plan.num_items*sizeof(unsigned long));
+	raw = malloc(plan.data_length);
+	if (blocks == NULL || batch == NULL || scalar == NULL || updated == NULL || values == NULL
+		|| changed == NULL || raw == NULL)
+		goto out;
+
+	// block n holds n (mod 65536) at every pair of bytes, high byte first, so
+	// every item at an even offset sees every pattern, and every one at an
+	// odd offset sees them all too, byte swapped
+	for (n=0; n<DECODECHECK_BLOCKS; n++)
+	{
+		for (j=0; j<plan.data_length; j++)
+			blocks[n*stride + j] = (j%2 == 0) ? (n >> 8) & 0xff : n & 0xff;
+		blocks[n*stride + plan.data_length] = 0xee;
+	}
+
+	aldl_decode_plan_run_batch(&plan, (const char*)blocks, stride, DECODECHECK_BLOCKS, batch);
+	scalar_plan = plan;
+	scalar_plan.simd = ALDL_DECODE_SCALAR;
+	aldl_decode_plan_run_batch(&scalar_plan, (const char*)blocks, stride, DECODECHECK_BLOCKS, scalar);
+	for (n=0; n<DECODECHECK_BLOCKS; n++)
+	{
+		aldl_decode_plan_update(&plan, (n == 0) ? NULL : raw, (const char*)blocks + n*stride,
+								values, changed, n);
+		if (n == 0)
+			memcpy(raw, blocks, plan.data_length);
+		memcpy(updated + n*plan.num_items, values, plan.num_items*sizeof(float));
+	}
+
+	decodecheck_group(def, &plan.mul8, 8, 0, blocks, stride, batch, scalar, updated, plan.num_items);
+	decodecheck_group(def, &plan.mul16, 16, 0, blocks, stride, batch, scalar, updated, plan.num_items);
+	decodecheck_group(def, &plan.div8, 8, 1, blocks, stride, batch, scalar, updated, plan.num_items);
+	decodecheck_group(def, &plan.div16, 16, 1, blocks, stride, batch, scalar, updated, plan.num_items);
+	printf("%s: %u items, %s batch code, %lu values differ\n", def->name,
+			plan.mul8.count + plan.mul16.count + plan.div8.count + plan.div16.count,
+			(plan.simd == ALDL_DECODE_AVX2) ? "AVX2" : "scalar", decodecheck_differ - differ);
+	res = 0;
+
+out:
+	free(raw);
+	free(changed);
+	free(values);
+	free(updated);
+	free(scalar);
+	free(batch);
+	free(blocks);
+	aldl_decode_plan_free(&plan);
+	return res;
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned int i;
+	int res = 0;
+
+	for (i=0; aldl_definition_table[i] != NULL; i++)
+		if (decodecheck_definition(aldl_definition_table[i]) != 0)
+		{
+			fprintf(stderr,"decodecheck: out of memory.\n");
+			res = 1;
+		}
+
+	printf("decodecheck: %lu values checked, %lu differ.\n", decodecheck_values, decodecheck_differ);
+	return (res != 0 || decodecheck_differ != 0) ? 1 : 0;
+}
@@ -21,7 +21,7 @@ LICENSING INFORMATION:
 */
 
 #include <string.h>
-#include "linuxaldl.h"
+#include "linuxaldl_core.h"
 // ===================================================================
 //		WRITING A DEFINITION FOR LINUXALDL
 // ===================================================================
@@ -39,6 +39,14 @@ LICENSING INFORMATION:
 // The last element of the mode1_def[] array must be LINUXALDL_MODE1_END_DEF
 // (which is a byte_def_t with label and units NULL and all other values 0).
 
+// broadcast_frames is optional (NULL if unknown). it lists the frames that can
+// be picked up for passive listening, where nothing is sent to the ECM. each
+// entry gives the 3 header bytes (device id, 0x52 + frame length, mode) and the
+// total length. frames with a nonzero data offset carry a mode1-layout data
+// block at that offset and are decoded; the others are only recognized so the
+// parser doesn't treat them as noise. The last element must be
+// LINUXALDL_FRAME_END_DESC.
+
 // ===================================================================
 
 // see the DF definition below for a complete example of a definition
@@ -95,10 +103,20 @@ byte_def_t aldl_DF_mode1[]=
 	};
 
 
+// the normal mode chatter of this ECM hasn't been captured, so only the mode 1
+// response is listed: passive listening logs nothing unless another tool on
+// the bus is polling the ECM.
+aldl_frame_desc aldl_DF_broadcast[]=
+	{
+			{"Mode 1 Data",	{0xF4, 0x95, 0x01},	67,	3},
+			LINUXALDL_FRAME_END_DESC
+	};
+
 aldl_definition aldl_DF = { "91-93 3.4 DOHC LQ1 ($DF)",
 							{0xF4, 0x57, 0x01, 0x00, 0xB4}, 5, 67, 63, 3, aldl_DF_mode1,
 							{0xF4, 0x56, 0x08, 0xAE}, 4,
-							{0xF4, 0x56, 0x09, 0xAD}, 4
+							{0xF4, 0x56, 0x09, 0xAD}, 4,
+							aldl_DF_broadcast
 						};
 
 // ===========================================
@@ -24,11 +24,13 @@ LICENSING INFORMATION:
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <gtk/gtk.h>
 #include <termios.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sys/signal.h>
 #include <string.h> // for memcpy
 #include "linuxaldl_gui.h"
@@ -68,6 +70,8 @@ int linuxaldl_gui(int argc, char* argv[])
 	GtkWidget *optionsw; // options/settings window
 	GtkWidget *choosedefw; // definition selection dialogue
 	GtkWidget *datareadoutw; // datareadout window
+	GtkWidget *plotw; // plot window
+	GtkWidget *vbox_data_control;
 	char* logfilename;
 	
 	gtk_init(&argc, &argv);
@@ -123,18 +127,26 @@ int linuxaldl_gui(int argc, char* argv[])
 	// stop the window from being destroyed when the X is clicked at the top right
 	g_signal_connect(G_OBJECT(sfilew),"delete_event", G_CALLBACK (hide_on_delete), NULL);
 	
+	aldl_gui_settings.log_index.fd = -1; // no raw log, no index
+
 	// Choose Definition dialogue
 	// ========================================================================
 	choosedefw = linuxaldl_gui_choosedef_new();
 
 	// Options window
 	// ========================================================================
+	aldl_gui_settings.display_rate = LINUXALDL_GUI_DEFAULT_DISPLAY_RATE;
+	aldl_gui_settings.plot_memory = LINUXALDL_GUI_DEFAULT_PLOT_MEMORY;
 	optionsw = linuxaldl_gui_options_new();
 
 	// Data Readout window
 	// ========================================================================
 	datareadoutw = linuxaldl_gui_datareadout_new();
 
+	// Plot window
+	// ========================================================================
+	plotw = linuxaldl_gui_plot_new();
+
 	// Commands buttons (scan, stop, options, quit)
 	// ========================================================================
 		
@@ -215,11 +227,22 @@ int linuxaldl_gui(int argc, char* argv[])
 	gtk_box_pack_start(GTK_BOX(vbox_settings), frame_data_control, FALSE, FALSE, 0);
 	gtk_widget_show(frame_data_control);
 
+	vbox_data_control = gtk_vbox_new(FALSE,0);
+	gtk_container_add(GTK_CONTAINER (frame_data_control), vbox_data_control);
+	gtk_widget_show(vbox_data_control);
+
 	// select definition
 	button = gtk_button_new_with_label("Show Data Readout");
 	g_signal_connect(G_OBJECT(button), "clicked",
 					G_CALLBACK(linuxaldl_gui_datareadout_show), (gpointer) datareadoutw);
-	gtk_container_add(GTK_CONTAINER (frame_data_control), button);
+	gtk_box_pack_start(GTK_BOX (vbox_data_control), button, FALSE, FALSE, 0);
+	gtk_widget_show(button);
+
+	// strip charts
+	button = gtk_button_new_with_label("Show Plot");
+	g_signal_connect(G_OBJECT(button), "clicked",
+					G_CALLBACK(linuxaldl_gui_plot_show), (gpointer) plotw);
+	gtk_box_pack_start(GTK_BOX (vbox_data_control), button, FALSE, FALSE, 0);
 	gtk_widget_show(button);
 
 	// -------------------------------------------------------------------------
@@ -259,10 +282,19 @@ static void linuxaldl_gui_widgethide(GtkWidget *widget, gpointer data)
 static gboolean linuxaldl_gui_quit( GtkWidget *widget, GdkEvent *event, gpointer data)
 {
 	gtk_main_quit();
+	aldl_settings.scanning = 0;
+	aldl_acq_stop(&aldl_gui_settings.acq);
+	linuxaldl_gui_load_stop();
+	// the writer thread writes the last index entry after its records
+	aldl_index_writer_finish(&aldl_gui_settings.log_index);
+	if (aldl_log_writer_stop(&aldl_gui_settings.log_writer) != 0)
+		g_warning("Some records couldn't be written to the log file.\n");
+	aldl_index_writer_close(&aldl_gui_settings.log_index);
+	g_free(aldl_gui_settings.log_record);
 	g_free(aldl_gui_settings.data_readout_labels);
-	g_free(aldl_settings.data_set_raw);
-	g_free(aldl_settings.data_set_strings); // XXX need to free each string too, not just the pointer array!!
-	g_free(aldl_settings.data_set_floats);
+	aldl_readout_free(aldl_gui_settings.readout);
+	aldl_plot_free(aldl_gui_settings.plot);
+	aldl_free_data_sets();
 	return FALSE;
 }
 
@@ -278,9 +310,9 @@ static gboolean hide_on_delete( GtkWidget *widget, GdkEvent *event, gpointer dat
 
 
 // callback for change in the adjustment for the aldl_settings.scan_interval field.
-// if scanning is not taking place, does nothing except store the new values and enforce
-// timeout/ scan interval constraints (interval must be at least 20msec more than timeout).
-// otherwise it reassigns the scan interval to the new value immediately.
+// stores the new value and enforces timeout/ scan interval constraints (interval
+// must be at least 20msec more than timeout). the acquisition thread picks up
+// the new interval on its next scan.
 // adj must point to the GtkAdjustment for the scan interval.
 static void linuxaldl_gui_scan_interval_changed( GtkAdjustment *adj, gpointer data)
 {
@@ -293,16 +325,7 @@ static void linuxaldl_gui_scan_interval_changed( GtkAdjustment *adj, gpointer da
 	}
 
 	aldl_settings.scan_interval = new_interval;
-
-
-	if (aldl_settings.scanning == 1)
-	{
-		g_source_remove(aldl_gui_settings.scanning_tag);
-
-		aldl_gui_settings.scanning_tag = g_timeout_add(aldl_settings.scan_interval,
-															linuxaldl_gui_scan_on_interval,
-															NULL);
-	}
+	aldl_acq_update_settings(&aldl_gui_settings.acq);
 }
 
 // callback for change in the adjustment for the aldl_settings.scan_timeout field.
@@ -319,119 +342,180 @@ static void linuxaldl_gui_scan_timeout_changed( GtkAdjustment *adj, gpointer dat
 	}
 	
 	aldl_settings.scan_timeout = new_timeout;
+	aldl_acq_update_settings(&aldl_gui_settings.acq);
 }
 
-// callback for g_timeout interval timer. if aldl_settings.scanning == 1 
-// then this function will call linuxaldl_gui_scan
-gint linuxaldl_gui_scan_on_interval(gpointer data)
+// callback for the scan mode radio buttons. data is the ALDL_SCAN_MODE_t of
+// the button. the scan interval is not used in throughput or passive mode.
+static void linuxaldl_gui_scan_mode_toggled( GtkWidget *widget, gpointer data)
 {
- 	if (aldl_settings.scanning == 0)
+	if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget)))
 	{
-		send_aldl_message(_ALDL_MESSAGE_MODE9); // send a mode 9 message to allow the ecm to resume normal mode
-		return 0; // returning 0 tells GTK to turn off the interval timer for this function
+		aldl_settings.scan_mode = GPOINTER_TO_INT(data);
 	}
-	linuxaldl_gui_scan(NULL, NULL); // perform a scan operation
-	return 1;
 }
 
-// perform a single scan operation: attempt to get one mode1 message,
-// save the data to the log and update the current data array
-static void linuxaldl_gui_scan( GtkWidget *widget, gpointer data)
+// makes the scan mode radio buttons sensitive or not. they are insensitive
+// while scanning, since the running session can't change its mode.
+static void linuxaldl_gui_scan_mode_sensitive(gboolean sensitive)
 {
-	int res;
-	char* inbuffer;
-	unsigned int buf_size;	
-	buf_size = aldl_settings.definition->mode1_response_length;
+	int i;
 
-	inbuffer = g_malloc(buf_size);
-	
-	// send a mode 8 message to silence the ecm
-	send_aldl_message(_ALDL_MESSAGE_MODE8);
-	tcflush(aldl_settings.faldl,TCIOFLUSH); // flush send and receive buffers
-
-	// request a mode 1 message
-	res = get_mode1_message(inbuffer, buf_size);
-#ifdef _LINXUALDL_DEBUG
-	if (res==-1)
-	{
-		// bad checksum
-		fprintf(stderr,"c");
-	}
-	else if (res==0)
+	for (i=ALDL_SCAN_INTERVAL; i<=ALDL_SCAN_PASSIVE; i++)
+		if (aldl_gui_settings.scan_mode_radios[i] != NULL)
+			gtk_widget_set_sensitive(aldl_gui_settings.scan_mode_radios[i], sensitive);
+}
+
+// callback for change in the adjustment for the aldl_settings.bus_guard_time field.
+static void linuxaldl_gui_bus_guard_time_changed( GtkAdjustment *adj, gpointer data)
+{
+	aldl_settings.bus_guard_time = gtk_adjustment_get_value(GTK_ADJUSTMENT(adj));
+	aldl_acq_update_settings(&aldl_gui_settings.acq);
+}
+
+// callback for change in the adjustment for the aldl_gui_settings.display_rate field.
+static void linuxaldl_gui_display_rate_changed( GtkAdjustment *adj, gpointer data)
+{
+	aldl_gui_settings.display_rate = gtk_adjustment_get_value(GTK_ADJUSTMENT(adj));
+}
+
+// callback for change in the adjustment for the aldl_gui_settings.plot_memory field.
+// the plot's history is made again at the new size, so its samples are lost.
+static void linuxaldl_gui_plot_memory_changed( GtkAdjustment *adj, gpointer data)
+{
+	aldl_gui_settings.plot_memory = gtk_adjustment_get_value(GTK_ADJUSTMENT(adj));
+
+	if (aldl_gui_settings.plot != NULL
+		&& aldl_plot_set_memory(aldl_gui_settings.plot, (unsigned long)aldl_gui_settings.plot_memory<<20) != 0)
+		g_warning("Couldn't allocate %u MB for the plot. The plot keeps its old size.\n",
+					aldl_gui_settings.plot_memory);
+}
+
+// callback for the Data Readout style radio buttons. data is the
+// LINUXALDL_READOUT_STYLE_t of the button. an already built Data Readout
+// is rebuilt in the new style.
+static void linuxaldl_gui_readout_style_toggled(GtkWidget* widget, gpointer data)
+{
+	GtkWidget* dataw;
+
+	if (!gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget)))
+		return;
+	aldl_gui_settings.readout_style = GPOINTER_TO_INT(data);
+
+	if (aldl_gui_settings.readout_box == NULL)
+		return; // built in the new style when it is first shown
+	dataw = aldl_gui_settings.readout_box->parent;
+	linuxaldl_gui_datareadout_clear();
+	if (GTK_WIDGET_VISIBLE(dataw))
+		linuxaldl_gui_datareadout_show(NULL, dataw);
+}
+
+// callback for the g_timeout drain timer. consumes every frame the acquisition
+// thread has received since the last call, then updates the Data Readout
+// using the newest frame, at most aldl_gui_settings.display_rate times a second.
+// a change that arrives too soon after the last refresh is shown by a later
+// call. when aldl_settings.scanning == 0 it turns the timer off.
+gint linuxaldl_gui_scan_on_interval(gpointer data)
+{
+	aldl_frame_record_t* rec;
+	struct timespec now;
+	long elapsed;
+
+	while ((rec = aldl_ring_peek(&aldl_gui_settings.acq.ring)) != NULL)
 	{
-		// timeout/partial response
-		fprintf(stderr,"t");
+		// only the newest frame needs the data sets updated for display
+		linuxaldl_gui_scan(rec, aldl_ring_count(&aldl_gui_settings.acq.ring) == 1);
+		aldl_ring_pop(&aldl_gui_settings.acq.ring);
 	}
-#endif
 
-	if (res>0)
+	// update the Data Readout and Plot if the last refresh is old enough
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = (now.tv_sec - aldl_gui_settings.readout_time.tv_sec)*1000
+				+ (now.tv_nsec - aldl_gui_settings.readout_time.tv_nsec)/1000000;
+	if (aldl_gui_settings.display_rate == 0
+		|| elapsed >= 1000/aldl_gui_settings.display_rate)
 	{
-#ifdef _LINXUALDL_DEBUG
-		// got full mode1 message
-		fprintf(stderr,"+");
-#endif
-		// update the timestamp
-		gettimeofday(&aldl_gui_settings.data_timestamp, NULL);
-
-
-		// check to see if a data set for the display has been allocated
-		if (aldl_settings.data_set_raw == NULL)
+		if (aldl_settings.data_set_raw != NULL
+			&& aldl_settings.data_set_seq != aldl_gui_settings.readout_seq)
 		{
-			g_warning("Data set labels not initialized. Display and .csv log files will not be updated. \n");
+			linuxaldl_gui_datareadout_update(NULL,NULL);
+			aldl_gui_settings.readout_time = now;
 		}
-		else
+		if (aldl_gui_settings.plot != NULL)
 		{
-			// copy the data to the current data set
-			memcpy(	  aldl_settings.data_set_raw,
-					  inbuffer + aldl_settings.definition->mode1_data_offset,
-					  aldl_settings.definition->mode1_data_length);
-
-			// update string and float representations
-			aldl_update_sets(ALDL_UPDATE_FLOATS|ALDL_UPDATE_STRINGS);
-
-			// update the Data Readout
-			linuxaldl_gui_datareadout_update(NULL,NULL);
+			aldl_plot_refresh(aldl_gui_settings.plot);
+			aldl_gui_settings.readout_time = now;
 		}
+	}
 
-		// if a log file has been selected
-		if (aldl_settings.flogfile!=1)
-		{
-			// ALDL_LOG_RAW
-			// ============
-			// raw format just dumps the timestamp and entire mode1 message to a file
-			if (aldl_gui_settings.log_format == ALDL_LOG_RAW)
-			{
-				// note: this writes the integer timestamp using the endianness of the platform this
-				// process is running on. this means if the log file is read back using a platform
-				// with a different endianness, the timestamps will be incorrect.
-				// x86 platforms are little-endian.
+ 	if (aldl_settings.scanning == 0)
+		return 0; // returning 0 tells GTK to turn off the interval timer for this function
+	return 1;
+}
 
-				// write the seconds to the file
-				write(aldl_settings.flogfile,(char*)(&aldl_gui_settings.data_timestamp.tv_sec),sizeof(time_t));
+// processes a single frame received by the acquisition thread: copies it into
+// the data set and writes it to the log. the string and float sets are updated
+// if update_sets is nonzero or the log format needs them.
+static void linuxaldl_gui_scan(aldl_frame_record_t* rec, int update_sets)
+{
+	char* inbuffer = rec->data;
+	int res = rec->length;
 
-				// write the microseconds to the file
-				write(aldl_settings.flogfile,(char*)(&aldl_gui_settings.data_timestamp.tv_usec),sizeof(suseconds_t));
+#ifdef _LINUXALDL_COUNT_ALLOCS
+	// decoding and logging a frame must not allocate. the counter is the GUI
+	// thread's own, so the acquisition thread can't set it off.
+	unsigned long heap_allocs = aldl_heap_allocs;
+#endif
 
-				// write the data to the file
-				write(aldl_settings.flogfile,inbuffer,res);
-				//g_print("%d bytes written to file/output.",res);
-			}
-			// ALDL_LOG_CSV
-			// ============
-			// CSV format conforming to RFC4180 http://tools.ietf.org/html/rfc4180
-			else if (aldl_gui_settings.log_format == ALDL_LOG_CSV)
-				linuxaldl_gui_write_csv_line();
-		}
+	// update the timestamp
+	aldl_gui_settings.data_timestamp = rec->timestamp;
 
+	// check to see if a data set for the display has been allocated
+	if (aldl_settings.data_set_raw == NULL)
+	{
+		g_warning("Data set labels not initialized. Display and .csv log files will not be updated. \n");
 	}
-	g_free(inbuffer);
+	else if (rec->data_offset != 0) // broadcast frames without a data block are only logged raw
+	{
+		// make it the current data set. only the values whose bytes changed
+		// are decoded; strings are formatted later, when they are read.
+		if (update_sets || aldl_gui_settings.log_format == ALDL_LOG_CSV
+			|| aldl_gui_settings.plot != NULL || aldl_gui_settings.log_index.fd != -1)
+			aldl_update_data_set(inbuffer + rec->data_offset);
+
+		// every frame goes in the plot's history
+		if (aldl_gui_settings.plot != NULL)
+			aldl_plot_append(aldl_gui_settings.plot, &rec->timestamp, aldl_settings.data_set_floats);
+	}
+
+	// if a log file has been selected
+	if (aldl_settings.flogfile!=1)
+	{
+		// ALDL_LOG_RAW
+		// ============
+		// raw format writes the receive time, sequence number and entire frame
+		// as one record (see linuxaldl_log.h)
+		if (aldl_gui_settings.log_format == ALDL_LOG_RAW)
+			linuxaldl_gui_write_raw_record(rec);
+		// ALDL_LOG_CSV
+		// ============
+		// CSV format conforming to RFC4180 http://tools.ietf.org/html/rfc4180
+		else if (aldl_gui_settings.log_format == ALDL_LOG_CSV && rec->data_offset != 0)
+			linuxaldl_gui_write_csv_line();
+	}
+
+#ifdef _LINUXALDL_COUNT_ALLOCS
+	if (aldl_heap_allocs != heap_allocs)
+		g_warning("%lu heap allocations while decoding and logging a frame.\n",
+													aldl_heap_allocs-heap_allocs);
+#endif
 	return;
 }
 
 // this function is called when the scan button is toggled
 static void linuxaldl_gui_scan_toggle( GtkWidget *widget, gpointer data)
 {
-	struct itimerval timer_value;
+	unsigned int length;
 
 	// if the button is down
     if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget))) 
@@ -446,18 +530,64 @@ static void linuxaldl_gui_scan_toggle( GtkWidget *widget, gpointer data)
 		if (aldl_settings.scanning == 0)
 		{
 			g_print("Starting scan.\n");
-			aldl_gui_settings.scanning_tag = g_timeout_add(aldl_settings.scan_interval,
+			linuxaldl_gui_load_stop(); // a log being loaded would mix with the live data
+			if (aldl_acq_start(&aldl_gui_settings.acq)!=0)
+			{
+				gtk_toggle_button_set_active( GTK_TOGGLE_BUTTON(widget),FALSE);
+				return;
+			}
+			aldl_settings.scanning = 1;
+			linuxaldl_gui_scan_mode_sensitive(FALSE); // the session was set up for this mode
+			// every scan starts a new segment in a raw log file
+			if (aldl_settings.flogfile != 1)
+			{
+				aldl_raw_log_init(&aldl_gui_settings.raw_log, aldl_settings.flogfile,
+									aldl_settings.definition);
+				aldl_gui_settings.raw_log.delta = aldl_settings.compact_log;
+			}
+			// the index of a raw log is opened by the first scan into it, when
+			// the definition is known and the file holds everything logged so far
+			if (aldl_settings.flogfile != 1 && aldl_gui_settings.log_format == ALDL_LOG_RAW
+				&& !aldl_gui_settings.log_indexed)
+			{
+				aldl_gui_settings.log_indexed = 1;
+				if (aldl_index_writer_open(&aldl_gui_settings.log_index, aldl_settings.logfilename,
+											aldl_settings.definition) != 0)
+					g_warning("Couldn't open an index for the log file. Logging without one.\n");
+				// its entries are written by the log writer, after their records
+				else aldl_log_writer_index(&aldl_gui_settings.log_writer, &aldl_gui_settings.log_index);
+			}
+			// room for the longest raw record or csv line of the definition
+			length = ALDL_RAW_HEADER_SIZE + ALDL_RAW_RECORD_HEADER_SIZE
+						+ aldl_definition_max_frame(aldl_settings.definition);
+			if (length < 32 + aldl_settings.num_items*ALDL_STRING_SLOT_SIZE)
+				length = 32 + aldl_settings.num_items*ALDL_STRING_SLOT_SIZE;
+			aldl_gui_settings.log_record = g_realloc(aldl_gui_settings.log_record, length);
+			aldl_gui_settings.log_record_size = length;
+			aldl_gui_settings.scanning_tag = g_timeout_add(LINUXALDL_GUI_DRAIN_INTERVAL,
 															linuxaldl_gui_scan_on_interval,
 															NULL);
-			aldl_settings.scanning = 1;
-
-			linuxaldl_gui_scan(NULL,NULL); // perform initial scan
 		}
     } 
 	else 	{
 		// button is up (turned off)
+		if (aldl_settings.scanning == 0)
+			return;
 		g_print("Stopping scan.\n");
 		aldl_settings.scanning = 0; // reset scan flag	
+		aldl_acq_stop(&aldl_gui_settings.acq); // sends mode 9 before it returns
+		linuxaldl_gui_scan_mode_sensitive(TRUE);
+		g_print(" %lu frames received (%.1f/sec), %lu timeouts, %lu bad checksums, %lu dropped.\n",
+					aldl_gui_settings.acq.session.frames, aldl_acq_frame_rate(&aldl_gui_settings.acq),
+					aldl_gui_settings.acq.session.timeouts, aldl_gui_settings.acq.session.bad_checksums,
+					aldl_gui_settings.acq.ring.dropped);
+		if (aldl_gui_settings.acq.passive)
+			g_print(" %lu frames carried no data.\n",aldl_gui_settings.acq.session.undecoded);
+		else g_print(" ECM silenced %lu times.\n",aldl_gui_settings.acq.session.silence_requests);
+		if (aldl_gui_settings.log_writer.queue != NULL)
+			g_print(" log writer: %lu records, %lu dropped, %lu KB queued at most.\n",
+						aldl_gui_settings.log_writer.records, aldl_gui_settings.log_writer.dropped,
+						aldl_gui_settings.log_writer.peak/1024);
 		return;
 	}
 }
@@ -467,11 +597,131 @@ static void linuxaldl_gui_scan_toggle( GtkWidget *widget, gpointer data)
 // ===================================
 
 // this function is called as the result of the "ok" button being
-// selected in the load log file selection dialogue.
-// XXX not implemented
+// selected in the load log file selection dialogue. the raw log is mapped
+// (opening doesn't depend on its size) and its frames are played into the
+// Data Readout and Plot a chunk at a time from an idle callback, so the
+// window stays responsive however long the log is.
 static void linuxaldl_gui_load( GtkWidget *widget, GtkFileSelection *fs){
-	g_warning("Log viewing module is not yet implemented.\n");
-	return;
+	const char* logfilename = gtk_file_selection_get_filename(fs);
+	aldl_log_reader_t* r = &aldl_gui_settings.log_reader;
+	gchar* message;
+	time_t start;
+
+	if (aldl_settings.scanning)
+	{
+		quick_alert("Stop scanning before loading a log file.");
+		return;
+	}
+	linuxaldl_gui_load_stop();
+
+	if (aldl_log_reader_open(r, logfilename) != 0)
+	{
+		quick_alert("Couldn't load the log file.\nOnly raw format log files can be loaded.");
+		return;
+	}
+	if (r->definition == NULL)
+	{
+		message = g_strdup_printf("The log was recorded with definition \"%s\",\n"
+									"which isn't known or has changed since.", r->header.name);
+		quick_alert(message);
+		g_free(message);
+		aldl_log_reader_close(r);
+		return;
+	}
+
+	// the log's definition becomes the current one if none is selected yet
+	if (aldl_settings.definition == NULL)
+	{
+		if (aldl_load_definition(r->definition)!=0)
+		{
+			g_warning("Couldn't allocate memory for the data set.\n");
+			aldl_log_reader_close(r);
+			return;
+		}
+		aldl_settings.aldldefname = r->definition->name;
+		g_print("Definition \"%s\" selected for the log file.\n",aldl_settings.definition->name);
+	}
+	else if (aldl_settings.definition != r->definition)
+	{
+		message = g_strdup_printf("The log was recorded with definition \"%s\".\n"
+									"Restart the program to select it.", r->header.name);
+		quick_alert(message);
+		g_free(message);
+		aldl_log_reader_close(r);
+		return;
+	}
+
+	start = r->header.start.tv_sec;
+	g_print("Loading %s (%s), recorded %s",logfilename,r->header.name,ctime(&start));
+	aldl_log_reader_rewind(r, &aldl_gui_settings.log_cursor);
+	aldl_gui_settings.loaded = 0;
+	aldl_gui_settings.loading_tag = g_idle_add(linuxaldl_gui_load_on_idle, NULL);
+}
+
+// idle callback: feeds the next LINUXALDL_GUI_LOAD_CHUNK frames of the log
+// into the data set and the Plot's history, then refreshes the Data Readout
+// and Plot. without a Plot only the last frame of the chunk is decoded.
+// returns FALSE, removing itself, at the end of the log.
+static gboolean linuxaldl_gui_load_on_idle(gpointer data)
+{
+	aldl_log_reader_t* r = &aldl_gui_settings.log_reader;
+	aldl_log_cursor_t* c = &aldl_gui_settings.log_cursor;
+	aldl_log_frame_t frame;
+	const char* newest = NULL;
+	unsigned int n;
+	int more = 1;
+
+	for (n=0; n<LINUXALDL_GUI_LOAD_CHUNK; n++)
+	{
+		if (!aldl_log_reader_next(r, c, &frame))
+		{
+			more = 0;
+			break;
+		}
+		// segments recorded with another definition are left out
+		if (frame.data_offset == 0 || c->definition != aldl_settings.definition)
+			continue;
+
+		// frames point into the mapping (or the cursor, for a compressed log), so
+		// nothing is copied until it is decoded
+		newest = frame.data + frame.data_offset;
+		aldl_gui_settings.data_timestamp = frame.timestamp;
+		aldl_gui_settings.loaded++;
+		if (aldl_gui_settings.plot != NULL)
+		{
+			aldl_update_data_set(newest);
+			aldl_plot_append(aldl_gui_settings.plot, &frame.timestamp, aldl_settings.data_set_floats);
+		}
+	}
+
+	if (newest != NULL)
+	{
+		if (aldl_gui_settings.plot == NULL)
+			aldl_update_data_set(newest);
+		else aldl_plot_refresh(aldl_gui_settings.plot);
+		if (aldl_settings.data_set_seq != aldl_gui_settings.readout_seq)
+			linuxaldl_gui_datareadout_update(NULL,NULL);
+	}
+
+	if (more)
+		return TRUE;
+
+	g_print(" %lu frames loaded from %u segments.\n",aldl_gui_settings.loaded,c->segment);
+	if (c->skipped != 0)
+		g_print(" %lu bytes of damaged records were skipped.\n",c->skipped);
+	aldl_gui_settings.loading_tag = 0; // the source is removed by returning FALSE
+	linuxaldl_gui_load_stop();
+	return FALSE;
+}
+
+// stops loading a log file and unmaps it.
+static void linuxaldl_gui_load_stop()
+{
+	if (aldl_gui_settings.loading_tag != 0)
+		g_source_remove(aldl_gui_settings.loading_tag);
+	aldl_gui_settings.loading_tag = 0;
+	if (aldl_gui_settings.log_reader.map != NULL)
+		aldl_log_reader_close(&aldl_gui_settings.log_reader);
 }
 
 // ===================================
@@ -489,13 +739,31 @@ static void linuxaldl_gui_save( GtkWidget *widget, GtkFileSelection *fs){
 
 	// Open the .log file for write, create if it doesnt exist
 	// ------------------------------------------------------------
-	aldl_settings.flogfile = open(logfilename,O_RDWR | O_CREAT, 0666);
+	aldl_settings.flogfile = open(logfilename,O_RDWR | O_CREAT | O_APPEND, 0666);
 	if (aldl_settings.flogfile == -1)
 	{
 		g_print("Unable to open/create %s for writing.\n",logfilename);
 		return;	}
 	
 	g_print("Log file %s opened. ALDL data will be written to this file as it is received.\n",logfilename);
+	aldl_raw_log_init(&aldl_gui_settings.raw_log, aldl_settings.flogfile, aldl_settings.definition);
+
+	// the file is written by the log writer thread. a log file chosen
+	// before this one gets everything that was queued for it first.
+	aldl_index_writer_finish(&aldl_gui_settings.log_index);
+	if (aldl_log_writer_stop(&aldl_gui_settings.log_writer) != 0)
+		g_warning("Some records couldn't be written to the previous log file.\n");
+	aldl_index_writer_close(&aldl_gui_settings.log_index);
+	aldl_gui_settings.log_indexed = 0;
+	if (aldl_log_writer_start(&aldl_gui_settings.log_writer, aldl_settings.flogfile,
+								aldl_settings.fsync_policy, aldl_settings.fsync_every,
+								aldl_settings.compress_log) != 0)
+	{
+		g_warning("Couldn't start the log writer thread.\n");
+		close(aldl_settings.flogfile);
+		aldl_settings.flogfile = 1;
+		return;
+	}
 
 
 	// Get the file extension to determine what format to use
@@ -514,7 +782,9 @@ static void linuxaldl_gui_save( GtkWidget *widget, GtkFileSelection *fs){
 		return;
 	}
 
-	// get the extension
+	// get the extension, under any .gz
+	if (length>=8 && (0 == strncmp(".gz",logfilename+length-3,3) || 0 == strncmp(".GZ",logfilename+length-3,3)))
+		length -= 3;
 	memcpy(extension,logfilename+length-4,4);
 
 	// .csv or .CSV extension
@@ -546,7 +816,9 @@ static void linuxaldl_gui_save( GtkWidget *widget, GtkFileSelection *fs){
 // write the header line to the csv file
 static void linuxaldl_gui_write_csv_header()
 {
-	int i;
+	char* line = NULL;
+	size_t length = 0;
+	FILE* f;
 
 	if (aldl_gui_settings.slogfile==NULL)
 	{
@@ -559,25 +831,27 @@ static void linuxaldl_gui_write_csv_header()
 		return;
 	}
 
-	byte_def_t* def = aldl_settings.definition->mode1_def;
-
-	// print the timestamp label
-	fprintf(aldl_gui_settings.slogfile,"Timestamp");
-
-	// until at the end of the items in the definition
-	for (i=0; def[i].label!=NULL; i++)
+	// the data lines are queued for the log writer, so the header is
+	// queued too, to reach the file (compressed, maybe) before them
+	f = open_memstream(&line, &length);
+	if (f == NULL)
 	{
-		if (def[i].operation!=ALDL_OP_SEPERATOR)
-			fprintf(aldl_gui_settings.slogfile,",%s",def[i].label);
+		g_warning("Couldn't write the .CSV header line.\n");
+		return;
 	}
-	fprintf(aldl_gui_settings.slogfile,"\n");
+	aldl_log_write_csv_header(f, aldl_settings.definition);
+	fclose(f);
+	if (aldl_log_writer_put(&aldl_gui_settings.log_writer, line, length) != 0)
+		g_warning("Couldn't write the .CSV header line.\n");
+	free(line);
 }
 
 
 // write a data line for the csv file
 static void linuxaldl_gui_write_csv_line()
 {
-	int i;
+	unsigned int i;
+	int length;
 
 	if (aldl_gui_settings.log_format != ALDL_LOG_CSV)
 	{
@@ -594,23 +868,49 @@ static void linuxaldl_gui_write_csv_line()
 		g_warning("Definition file not selected. .CSV data line could not be written.\n");
 		return;
 	}
-	else if (aldl_settings.data_set_strings!= NULL)
+	else if (aldl_settings.data_set_strings != NULL)
 	{
-		byte_def_t* def = aldl_settings.definition->mode1_def;
+		// format the values that changed since the last line
+		for (i=0; i<aldl_settings.num_items; i++)
+			aldl_get_data_string(i);
+		length = aldl_log_format_csv_line(aldl_gui_settings.log_record, aldl_gui_settings.log_record_size,
+								aldl_settings.definition, &aldl_gui_settings.data_timestamp,
+								aldl_settings.data_set_strings[0]);
+		if (length < 0)
+			g_warning("A .CSV data line was too long to be written.\n");
+		// a full queue is counted in log_writer.dropped
+		else aldl_log_writer_put(&aldl_gui_settings.log_writer, aldl_gui_settings.log_record, length);
+	}
+}
 
-		// write the timestamp
-		fprintf(aldl_gui_settings.slogfile,"%d+%f", (int)aldl_gui_settings.data_timestamp.tv_sec,
-											(float)aldl_gui_settings.data_timestamp.tv_usec/1000000.0);
+// =======================
+//	 RAW FORMAT LOGGING
+// =======================
 
-		// until at the end of the items in the definition...
-		for (i=0; def[i].label!=NULL; i++)
-		{
-			// if the item is not a seperator, write the string
-			if (def[i].operation != ALDL_OP_SEPERATOR)
-				fprintf(aldl_gui_settings.slogfile,",%s",aldl_settings.data_set_strings[i]);
-		}
-		fprintf(aldl_gui_settings.slogfile,"\n"); // end the line
+// queue the record for a received frame for the log writer
+static void linuxaldl_gui_write_raw_record(aldl_frame_record_t* rec)
+{
+	unsigned int length;
+
+	length = aldl_raw_log_encode(&aldl_gui_settings.raw_log, rec->seq, &rec->received,
+									rec->data, rec->length, aldl_gui_settings.log_record);
+	if (length == 0)
+	{
+		g_warning("Couldn't write a frame to the log file.\n");
+		return;
+	}
+	// if the queue is full the record is dropped (and counted in
+	// log_writer.dropped)
+	if (aldl_log_writer_put(&aldl_gui_settings.log_writer, aldl_gui_settings.log_record, length) != 0)
+	{
+		aldl_raw_log_dropped(&aldl_gui_settings.raw_log);
+		return;
 	}
+	// the data set was updated from this frame if it has a data block
+	aldl_index_writer_add(&aldl_gui_settings.log_index, length, aldl_gui_settings.raw_log.last_header,
+							aldl_gui_settings.raw_log.last_key, rec->seq,
+							aldl_raw_log_time(&aldl_gui_settings.raw_log),
+							(rec->data_offset != 0) ? aldl_settings.data_set_floats : NULL);
 }
 
 
@@ -676,12 +976,95 @@ GtkWidget* linuxaldl_gui_options_new()
 	gtk_box_pack_start(GTK_BOX(vbox_options),timeout_adj,FALSE,FALSE,0);
 	gtk_widget_show(timeout_adj);
 
+	// scan mode: poll every scan interval, poll again as soon as a response
+	// is verified (max throughput), or only listen to what the ECM sends
+	GtkWidget* interval_radio = gtk_radio_button_new_with_label(NULL, "Poll every scan interval");
+	GtkWidget* throughput_radio = gtk_radio_button_new_with_label_from_widget(
+									GTK_RADIO_BUTTON(interval_radio),
+									"Max throughput (ignore scan interval)");
+	GtkWidget* passive_radio = gtk_radio_button_new_with_label_from_widget(
+									GTK_RADIO_BUTTON(interval_radio),
+									"Passive listening (never transmit)");
+
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(throughput_radio),
+									aldl_settings.scan_mode == ALDL_SCAN_THROUGHPUT);
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(passive_radio),
+									aldl_settings.scan_mode == ALDL_SCAN_PASSIVE);
+
+	g_signal_connect(G_OBJECT(interval_radio), "toggled",
+						G_CALLBACK(linuxaldl_gui_scan_mode_toggled), GINT_TO_POINTER(ALDL_SCAN_INTERVAL));
+	g_signal_connect(G_OBJECT(throughput_radio), "toggled",
+						G_CALLBACK(linuxaldl_gui_scan_mode_toggled), GINT_TO_POINTER(ALDL_SCAN_THROUGHPUT));
+	g_signal_connect(G_OBJECT(passive_radio), "toggled",
+						G_CALLBACK(linuxaldl_gui_scan_mode_toggled), GINT_TO_POINTER(ALDL_SCAN_PASSIVE));
+
+	aldl_gui_settings.scan_mode_radios[ALDL_SCAN_INTERVAL] = interval_radio;
+	aldl_gui_settings.scan_mode_radios[ALDL_SCAN_THROUGHPUT] = throughput_radio;
+	aldl_gui_settings.scan_mode_radios[ALDL_SCAN_PASSIVE] = passive_radio;
+
+	gtk_box_pack_start(GTK_BOX(vbox_options),interval_radio,FALSE,FALSE,0);
+	gtk_box_pack_start(GTK_BOX(vbox_options),throughput_radio,FALSE,FALSE,0);
+	gtk_box_pack_start(GTK_BOX(vbox_options),passive_radio,FALSE,FALSE,0);
+	gtk_widget_show(interval_radio);
+	gtk_widget_show(throughput_radio);
+	gtk_widget_show(passive_radio);
+
+	// bus guard time adjustment (for max throughput mode)
+	GtkWidget* guard_adj = hscale_new_with_label(aldl_settings.bus_guard_time,
+													0.0, 50.0, 1.0,
+									G_CALLBACK(linuxaldl_gui_bus_guard_time_changed),
+									"Bus Guard Time (msec)");
+
+	gtk_box_pack_start(GTK_BOX(vbox_options),guard_adj,FALSE,FALSE,0);
+	gtk_widget_show(guard_adj);
+
+	// Data Readout refresh rate
+	GtkWidget* rate_adj = hscale_new_with_label(aldl_gui_settings.display_rate,
+													1.0, 50.0, 1.0,
+									G_CALLBACK(linuxaldl_gui_display_rate_changed),
+									"Display Rate (refreshes/sec)");
+
+	gtk_box_pack_start(GTK_BOX(vbox_options),rate_adj,FALSE,FALSE,0);
+	gtk_widget_show(rate_adj);
+
+	// memory for the Plot window's samples
+	GtkWidget* plot_memory_adj = hscale_new_with_label(aldl_gui_settings.plot_memory,
+													1.0, 256.0, 1.0,
+									G_CALLBACK(linuxaldl_gui_plot_memory_changed),
+									"Plot History (MB)");
+
+	gtk_box_pack_start(GTK_BOX(vbox_options),plot_memory_adj,FALSE,FALSE,0);
+	gtk_widget_show(plot_memory_adj);
+
 	// 'settings' frame
 	// ----------------
 	GtkWidget* frame_settings = gtk_frame_new("Settings");
 	gtk_box_pack_start(GTK_BOX(vbox_main),frame_settings, FALSE, FALSE, 0);
 	gtk_widget_show(frame_settings);
 
+	GtkWidget* vbox_settings = gtk_vbox_new(FALSE,0);
+	gtk_container_add(GTK_CONTAINER(frame_settings), vbox_settings);
+	gtk_widget_show(vbox_settings);
+
+	// Data Readout style: one drawn widget, or a label for every field
+	GtkWidget* drawn_radio = gtk_radio_button_new_with_label(NULL, "Draw the Data Readout");
+	GtkWidget* labels_radio = gtk_radio_button_new_with_label_from_widget(
+									GTK_RADIO_BUTTON(drawn_radio),
+									"Data Readout with a label for every field");
+
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(labels_radio),
+									aldl_gui_settings.readout_style == LINUXALDL_READOUT_LABELS);
+
+	g_signal_connect(G_OBJECT(drawn_radio), "toggled",
+						G_CALLBACK(linuxaldl_gui_readout_style_toggled), GINT_TO_POINTER(LINUXALDL_READOUT_DRAWN));
+	g_signal_connect(G_OBJECT(labels_radio), "toggled",
+						G_CALLBACK(linuxaldl_gui_readout_style_toggled), GINT_TO_POINTER(LINUXALDL_READOUT_LABELS));
+
+	gtk_box_pack_start(GTK_BOX(vbox_settings),drawn_radio,FALSE,FALSE,0);
+	gtk_box_pack_start(GTK_BOX(vbox_settings),labels_radio,FALSE,FALSE,0);
+	gtk_widget_show(drawn_radio);
+	gtk_widget_show(labels_radio);
+
 	return optionsw;
 }
 
@@ -709,32 +1092,42 @@ GtkWidget* linuxaldl_gui_datareadout_new()
 
 
 // updates the Data Readout window, refreshing it with the current data values.
+// only the labels of values whose text changed since the last update are set.
 // this function will check if aldl_settings.data_readout_labels
 // has been allocated yet before it tries to update the values.
 // if it has not yet been allocated, it returns doing nothing.
-// .csv log file updating is also done here.
 static void linuxaldl_gui_datareadout_update(GtkWidget* widget, gpointer data)
 {
-	if (aldl_gui_settings.data_readout_labels == NULL)
+	if (aldl_gui_settings.readout_box == NULL)
 		return;
 
 	unsigned int i=0;
 	byte_def_t* defs = aldl_settings.definition->mode1_def;
-	byte_def_t* cur_def;
-	float converted_val;
-	char new_label_string[10];
-
+	const char* text;
+	GtkLabel* label;
 
 	for (i=0; defs[i].label != NULL; i++) // while not at the last defined byte
 	{
-		cur_def = defs+i;
-		// if the item is a seperator, skip it
-		if (cur_def->operation == ALDL_OP_SEPERATOR)
+		// skip seperators and values the labels already show
+		if (defs[i].operation == ALDL_OP_SEPERATOR
+			|| aldl_settings.data_set_changed[i] <= aldl_gui_settings.readout_seq)
 			continue;
 
-		// assign the new label
-		gtk_label_set_text(GTK_LABEL(aldl_gui_settings.data_readout_labels[i]), aldl_settings.data_set_strings[i]);
+		text = aldl_get_data_string(i);
+		if (aldl_gui_settings.readout != NULL)
+		{
+			// only redraws the cell if the text changed
+			aldl_readout_set_text(aldl_gui_settings.readout, i, text);
+			continue;
+		}
+
+		// a value can change without its text changing (e.g. in the second
+		// decimal place); setting the same text would still relayout the label
+		label = GTK_LABEL(aldl_gui_settings.data_readout_labels[i]);
+		if (strcmp(gtk_label_get_text(label), text) != 0)
+			gtk_label_set_text(label, text);
 	}
+	aldl_gui_settings.readout_seq = aldl_settings.data_set_seq;
 }
 
 // shows the Data Readout window, setting it up for the current definition.
@@ -748,8 +1141,8 @@ static void linuxaldl_gui_datareadout_show(GtkWidget* widget, gpointer data)
 			g_print("No definition selected. Cannot show data readout. Choose a definition first.\n");
 			return;
 		}
-		// if the Data Readout labels have been defined, no need to generate, just show the window
-		if (aldl_gui_settings.data_readout_labels != NULL)
+		// if the Data Readout has been built, no need to generate, just show the window
+		if (aldl_gui_settings.readout_box != NULL)
 		{
 			linuxaldl_gui_widgetshow(widget,data);
 			return;
@@ -763,9 +1156,26 @@ static void linuxaldl_gui_datareadout_show(GtkWidget* widget, gpointer data)
 
 		vbox = gtk_vbox_new(FALSE,0);
 		gtk_container_add(GTK_CONTAINER(data), vbox);
+		aldl_gui_settings.readout_box = vbox;
+		aldl_gui_settings.readout_seq = 0; // the new readout shows nothing yet
 		frame_main = gtk_frame_new("ALDL Data");		
 		gtk_box_pack_start(GTK_BOX (vbox), frame_main, FALSE, FALSE, 0);
 
+		if (aldl_gui_settings.readout_style == LINUXALDL_READOUT_DRAWN)
+		{
+			// the whole readout is one widget
+			aldl_gui_settings.readout = aldl_readout_new(aldl_settings.definition);
+			gtk_container_add(GTK_CONTAINER(frame_main), aldl_gui_settings.readout->area);
+			gtk_widget_show(aldl_gui_settings.readout->area);
+			gtk_widget_show(vbox);
+			gtk_widget_show(frame_main);
+
+			if (aldl_settings.data_set_raw != NULL)
+				linuxaldl_gui_datareadout_update(NULL,NULL);
+			linuxaldl_gui_widgetshow(widget,data);
+			return;
+		}
+
 		// the frame for each data seperator go in databox
 		databox = gtk_vbox_new(FALSE,0);
 		gtk_container_add(GTK_CONTAINER(frame_main), databox);
@@ -863,9 +1273,71 @@ static void linuxaldl_gui_datareadout_show(GtkWidget* widget, gpointer data)
 			}
 		}
 
+		if (aldl_settings.data_set_raw != NULL)
+			linuxaldl_gui_datareadout_update(NULL,NULL);
 		linuxaldl_gui_widgetshow(widget,data);
 }
 
+// destroys the contents of the Data Readout window and frees the readout or
+// labels, so the next linuxaldl_gui_datareadout_show builds it again.
+static void linuxaldl_gui_datareadout_clear()
+{
+	if (aldl_gui_settings.readout_box == NULL)
+		return;
+	gtk_widget_destroy(aldl_gui_settings.readout_box); // destroys the drawing area or labels too
+	aldl_gui_settings.readout_box = NULL;
+	aldl_readout_free(aldl_gui_settings.readout);
+	aldl_gui_settings.readout = NULL;
+	g_free(aldl_gui_settings.data_readout_labels);
+	aldl_gui_settings.data_readout_labels = NULL;
+}
+
+// ==================================
+//    Plot window
+// ==================================
+
+// returns a GtkWidget pointer to an empty plot window
+GtkWidget* linuxaldl_gui_plot_new()
+{
+	GtkWidget* plotw;
+
+	plotw = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+	gtk_window_set_title(GTK_WINDOW (plotw), "linuxaldl - Plot");
+	gtk_window_set_position(GTK_WINDOW (plotw), GTK_WIN_POS_CENTER);
+
+	// stop the window from being destroyed when the X is clicked at the top right
+	g_signal_connect(G_OBJECT(plotw),"delete_event", G_CALLBACK (hide_on_delete), NULL);
+
+	return plotw;
+}
+
+// shows the plot window, making aldl_gui_settings.plot for the current
+// definition the first time. data must point to the plot window object
+// generated by the linuxaldl_gui_plot_new function.
+static void linuxaldl_gui_plot_show(GtkWidget* widget, gpointer data)
+{
+	if (aldl_settings.definition == NULL)
+	{
+		g_print("No definition selected. Cannot show the plot. Choose a definition first.\n");
+		return;
+	}
+
+	if (aldl_gui_settings.plot == NULL)
+	{
+		aldl_gui_settings.plot = aldl_plot_new(aldl_settings.definition,
+											(unsigned long)aldl_gui_settings.plot_memory<<20);
+		if (aldl_gui_settings.plot == NULL)
+		{
+			quick_alert("Couldn't allocate memory for the plot.\nTry a smaller Plot History in Options.");
+			return;
+		}
+		gtk_container_add(GTK_CONTAINER(data), aldl_gui_settings.plot->box);
+		gtk_widget_show(aldl_gui_settings.plot->box);
+	}
+
+	linuxaldl_gui_widgetshow(widget,data);
+}
+
 // ==================================
 //    Definition selection dialog
 // ==================================
@@ -971,30 +1443,35 @@ GtkWidget* linuxaldl_gui_choosedef_new()
 
 static void linuxaldl_gui_load_definition( GtkWidget *widget, gpointer data)
 {
-	aldl_settings.aldldefname = gtk_entry_get_text (GTK_ENTRY (data));
+	const gchar* name = gtk_entry_get_text (GTK_ENTRY (data));
+	aldl_definition* def;
 
 	// get the aldl definition address
-	aldl_settings.definition = aldl_get_definition(aldl_settings.aldldefname);
+	def = aldl_get_definition(name);
 
-	// if no definition by that name exists, definition will be NULL
-	if (aldl_settings.definition == NULL)
+	// if no definition by that name exists, def will be NULL and the
+	// current definition is kept
+	if (def == NULL)
 	{
-		g_print("No definition with name \"%s\" found.\n",aldl_settings.aldldefname);
+		g_print("No definition with name \"%s\" found.\n",name);
 		return;
 	}
 
-	g_print("Definition \"%s\" selected:\n",aldl_settings.definition->name);
-	g_print(" Mode 1 message has %d data bytes.\n",aldl_settings.definition->mode1_data_length);
+	g_print("Definition \"%s\" selected:\n",def->name);
+	g_print(" Mode 1 message has %d data bytes.\n",def->mode1_data_length);
 	
 
 
 
-	// allocate memory for the raw data array and zero it out
-	aldl_settings.data_set_raw = g_malloc0(aldl_settings.definition->mode1_data_length);
-	// allocate memory for the float array
-	aldl_settings.data_set_floats = g_malloc0(aldl_settings.definition->mode1_data_length*sizeof(float));
-	// allocate memory for the string pointers array
-	aldl_settings.data_set_strings = g_malloc0(aldl_settings.definition->mode1_data_length*sizeof(char*));
+	// allocate the data sets and receive buffer for the definition.
+	// this is the only allocation for scanning; the scan path reuses these buffers.
+	// aldl_settings.definition only changes if this succeeds.
+	if (aldl_load_definition(def)!=0)
+	{
+		g_warning("Couldn't allocate memory for the data set.\n");
+		return;
+	}
+	aldl_settings.aldldefname = name;
 
 	// if the log format is already set to CSV but we are just now loading a definition,
 	// then the labels were not ready when we started. write the header line now.
@@ -22,9 +22,23 @@ LICENSING INFORMATION:
 
 #include <gtk/gtk.h>
 #include "linuxaldl.h"
+#include "linuxaldl_acquire.h"
+#include "linuxaldl_log.h"
+#include "linuxaldl_reader.h"
+#include "linuxaldl_readout.h"
+#include "linuxaldl_plot.h"
 #include <stdio.h>
 
-typedef enum _aldl_log_format { ALDL_LOG_RAW, ALDL_LOG_CSV } aldl_log_format_t;
+#define LINUXALDL_GUI_DRAIN_INTERVAL 20 // msec between checks for frames from the acquisition thread
+#define LINUXALDL_GUI_DEFAULT_DISPLAY_RATE 30 // max Data Readout and Plot refreshes per second
+#define LINUXALDL_GUI_DEFAULT_PLOT_MEMORY 16 // MB of samples kept for the Plot window
+#define LINUXALDL_GUI_LOAD_CHUNK 20000 // frames of a loaded log read per idle callback
+
+// how the Data Readout window shows the values
+typedef enum _LINUXALDL_READOUT_STYLE {
+	LINUXALDL_READOUT_DRAWN=0,	// one drawn widget for the whole readout (linuxaldl_readout.h)
+	LINUXALDL_READOUT_LABELS=1	// a GtkLabel for each name, value and units
+} LINUXALDL_READOUT_STYLE_t;
 
 //  linuxaldl GUI-specific settings/data struct
 // ============================================
@@ -44,7 +58,44 @@ typedef struct _linuxaldl_gui_settings
 
 	FILE* slogfile; // log file stream for CSV format. not used for raw log file format.
 
-	int scanning_tag; // the tag returned by gtk_timeout_add for the interval scan
+	int scanning_tag; // the tag returned by g_timeout_add for draining received frames
+	GtkWidget* scan_mode_radios[3]; // the scan mode radio buttons, indexed by ALDL_SCAN_MODE_t.
+									// insensitive while scanning.
+
+	aldl_acquisition_t acq; // acquisition thread, runs while scanning
+
+	unsigned long readout_seq; // aldl_settings.data_set_seq the Data Readout labels show
+
+	unsigned int display_rate; // max Data Readout and Plot refreshes per second. frames that
+							   // arrive faster are coalesced; the readout shows the newest one.
+	struct timespec readout_time; // CLOCK_MONOTONIC time of the last Data Readout or Plot refresh
+
+	LINUXALDL_READOUT_STYLE_t readout_style; // style the Data Readout is built in
+	GtkWidget* readout_box;		// contents of the Data Readout window, NULL until it is built
+	aldl_readout_t* readout;	// the drawn readout, NULL unless readout_style is
+								// LINUXALDL_READOUT_DRAWN and the readout is built.
+								// data_readout_labels is NULL when this is set.
+
+	aldl_plot_t* plot;			// contents of the Plot window, NULL until it is first shown.
+								// every frame received is added to its history.
+	unsigned int plot_memory;	// MB of samples the plot keeps
+
+	aldl_raw_log_t raw_log;		// writer for raw format log files
+
+	aldl_log_writer_t log_writer;	// writes the log file from a thread of its own. started
+									// when a log file is chosen, so the disk never holds up
+									// the GTK main loop.
+	char* log_record;			// a raw record or csv line being encoded for log_writer.
+								// allocated when scanning starts.
+	unsigned int log_record_size; // size of log_record
+	aldl_index_writer_t log_index;	// builds the index of a raw log file (fd -1 if none).
+									// log_writer writes its entries.
+	int log_indexed;			// 1 once the index of the log file has been opened (or tried)
+
+	aldl_log_reader_t log_reader;	// the log file being loaded (mapped, not read in)
+	aldl_log_cursor_t log_cursor;	// how far loading has got
+	guint loading_tag;			// the tag returned by g_idle_add for loading, 0 if not loading
+	unsigned long loaded;		// frames with a data block loaded so far
 } linuxaldl_gui_settings;
 
 //  linuxaldl GUI function prototypes 
@@ -79,22 +130,54 @@ static gboolean hide_on_delete( GtkWidget *widget, GdkEvent *event, gpointer dat
 
 static void linuxaldl_gui_scan_interval_changed( GtkAdjustment *adj, gpointer data);
 // callback for change in the adjustment for the aldl_settings.scan_interval field.
-// if scanning is not taking place, does nothing except store the new values and enforce
-// timeout/ scan interval constraints (interval must be at least 20msec more than timeout).
-// otherwise it reassigns the scan interval to the new value immediately.
+// stores the new value and enforces timeout/ scan interval constraints (interval
+// must be at least 20msec more than timeout). the acquisition thread picks up
+// the new interval on its next scan.
 // adj must point to the GtkAdjustment for the scan interval.
 
 
+static void linuxaldl_gui_scan_timeout_changed( GtkAdjustment *adj, gpointer data);
+// callback for change in the adjustment for the aldl_settings.scan_timeout field.
+// stores the new value and enforces timeout/ scan interval constraints.
+
+static void linuxaldl_gui_scan_mode_toggled( GtkWidget *widget, gpointer data);
+// callback for the scan mode radio buttons. data is the ALDL_SCAN_MODE_t of
+// the button. sets aldl_settings.scan_mode when the button becomes active.
+// the buttons are insensitive while scanning, so the mode only changes
+// between scans.
+
+static void linuxaldl_gui_scan_mode_sensitive(gboolean sensitive);
+// makes the scan mode radio buttons sensitive or not.
+
+static void linuxaldl_gui_bus_guard_time_changed( GtkAdjustment *adj, gpointer data);
+// callback for change in the adjustment for the aldl_settings.bus_guard_time field.
+
+static void linuxaldl_gui_display_rate_changed( GtkAdjustment *adj, gpointer data);
+// callback for change in the adjustment for the aldl_gui_settings.display_rate field.
+
+static void linuxaldl_gui_plot_memory_changed( GtkAdjustment *adj, gpointer data);
+// callback for change in the adjustment for the aldl_gui_settings.plot_memory field.
+// the plot's history is made again at the new size, so its samples are lost.
+
+static void linuxaldl_gui_readout_style_toggled(GtkWidget* widget, gpointer data);
+// callback for the Data Readout style radio buttons. data is the
+// LINUXALDL_READOUT_STYLE_t of the button. an already built Data Readout
+// is rebuilt in the new style.
+
+
 gint linuxaldl_gui_scan_on_interval(gpointer data);
-// callback for gtk_timeout interval timer. if aldl_settings.scanning == 1 
-// then this function will call linuxaldl_gui_scan
+// callback for the g_timeout drain timer. consumes every frame the acquisition
+// thread has received since the last call, then updates the Data Readout once.
+// when aldl_settings.scanning == 0 it turns the timer off.
 
 static void linuxaldl_gui_scan_toggle( GtkWidget *widget, gpointer data);
 // starts/stops scanning. output is written to the log file if one was specified
 // otherwise it is written to stdout.
 
-static void linuxaldl_gui_scan(GtkWidget *widget, gpointer data);
-// performs a single scan operation (one mode1 message, updates/logs data)
+static void linuxaldl_gui_scan(aldl_frame_record_t* rec, int update_sets);
+// processes a single frame received by the acquisition thread: copies it into
+// the data set and writes it to the log. the string and float sets are updated
+// if update_sets is nonzero or the log format needs them.
 
 
 static void linuxaldl_gui_stop( GtkWidget *widget, gpointer data);
@@ -127,24 +210,48 @@ static void linuxaldl_gui_datareadout_show(GtkWidget* widget, gpointer data);
 // shows the data display window, setting it up for the current definition.
 // data must point to the data display window object generated by
 // the linuxaldl_gui_datareadout_new function.
-// this function builds the data display window,
-// and allocates aldl_settings.data_readout_labels
+// this function builds the data display window in aldl_gui_settings.readout_style,
+// and allocates aldl_gui_settings.readout or aldl_gui_settings.data_readout_labels
+
+static void linuxaldl_gui_datareadout_clear();
+// destroys the contents of the data display window and frees
+// aldl_gui_settings.readout and aldl_gui_settings.data_readout_labels,
+// so the next linuxaldl_gui_datareadout_show builds it again.
 
 
 static void linuxaldl_gui_datareadout_update(GtkWidget* widget, gpointer data);
 // updates the data display window, refreshing it with the current data values.
-// this function will check if aldl_settings.data_readout_labels
-// has been allocated yet before it tries to update the values.
+// this function will check if the data display window
+// has been built yet before it tries to update the values.
 // if it has not yet been allocated, it returns doing nothing.
 // .csv log file updating is also done here.
 
 
+// ==================================
+//    Plot window
+// ==================================
+
+GtkWidget* linuxaldl_gui_plot_new();
+// returns a GtkWidget pointer to an empty plot window
+
+static void linuxaldl_gui_plot_show(GtkWidget* widget, gpointer data);
+// shows the plot window, making aldl_gui_settings.plot for the current
+// definition the first time. data must point to the plot window object
+// generated by the linuxaldl_gui_plot_new function.
+
+
 // ===================================
 //    LOAD .LOG FILE SELECTION
 // ===================================
 
 static void linuxaldl_gui_load( GtkWidget *widget, GtkFileSelection *fs);
-// load a log file to view/playback. XXX NOT YET IMPLEMENTED.
+// load a raw log file to view. its frames go to the Data Readout and Plot.
+
+static gboolean linuxaldl_gui_load_on_idle(gpointer data);
+// idle callback that loads the next LINUXALDL_GUI_LOAD_CHUNK frames of the log.
+
+static void linuxaldl_gui_load_stop();
+// stops loading a log file and unmaps it.
 
 // ===================================
 //    SAVE .LOG FILE SELECTION
@@ -163,6 +270,12 @@ static void linuxaldl_gui_write_csv_header();
 static void linuxaldl_gui_write_csv_line();
 // write a data line for the csv file
 
+// =======================
+//	 RAW FORMAT LOGGING
+// =======================
+static void linuxaldl_gui_write_raw_record(aldl_frame_record_t* rec);
+// queue the record for a received frame for the log writer
+
 static void linuxaldl_gui_widgetshow(GtkWidget *widget, gpointer data);
 // calls gtk_widget_show on the widget specified in the data argument 
 
@@ -0,0 +1,354 @@
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "linuxaldl_gz.h"
+
+static void aldl_gz_put_le16(unsigned char* p, uint16_t v)
+{
+	p[0] = v; p[1] = v>>8;
+}
+
+static void aldl_gz_put_le32(unsigned char* p, uint32_t v)
+{
+	p[0] = v; p[1] = v>>8; p[2] = v>>16; p[3] = v>>24;
+}
+
+static void aldl_gz_put_le64(unsigned char* p, uint64_t v)
+{
+	aldl_gz_put_le32(p, v);
+	aldl_gz_put_le32(p+4, v>>32);
+}
+
+static uint32_t aldl_gz_get_le32(const unsigned char* p)
+{
+	return p[0] | (p[1]<<8) | (p[2]<<16) | ((uint32_t)p[3]<<24);
+}
+
+static uint64_t aldl_gz_get_le64(const unsigned char* p)
+{
+	return aldl_gz_get_le32(p) | ((uint64_t)aldl_gz_get_le32(p+4)<<32);
+}
+
+// returns the cpu time the calling thread has used, in nanoseconds
+static uint64_t aldl_gz_cpu_ns()
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	return (uint64_t)t.tv_sec*1000000000 + t.tv_nsec;
+}
+
+// ============================================================================
+// WRITER
+// ============================================================================
+
+// points the deflate output at the data of an empty member
+static void aldl_gz_writer_reset(aldl_gz_writer_t* g)
+{
+	g->z.next_out = g->member + ALDL_GZ_HEADER_SIZE;
+	g->z.avail_out = g->member_size - ALDL_GZ_HEADER_SIZE - ALDL_GZ_TRAILER_SIZE;
+	g->length = 0;
+	g->crc = crc32(0, NULL, 0);
+}
+
+// sets up g to compress a log with zlib level level, starting at log offset offset.
+// returns 0 on success, -1 on failure.
+int aldl_gz_writer_init(aldl_gz_writer_t* g, int level, uint64_t offset)
+{
+	memset(g, 0, sizeof(aldl_gz_writer_t));
+	if (level < 1 || level > 9)
+		return -1;
+	// negative window bits: raw deflate data, the gzip header and trailer are written here
+	if (deflateInit2(&g->z, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return -1;
+
+	// a member always fits, however badly its bytes compress
+	g->member_size = ALDL_GZ_HEADER_SIZE + deflateBound(&g->z, ALDL_GZ_MEMBER_SIZE) + ALDL_GZ_TRAILER_SIZE;
+	g->member = malloc(g->member_size);
+	if (g->member == NULL)
+	{
+		deflateEnd(&g->z);
+		return -1;
+	}
+	g->level = level;
+	g->offset = offset;
+	aldl_gz_writer_reset(g);
+	return 0;
+}
+
+// compresses len more bytes of the log, writing each member to fd as it fills.
+// returns 0 on success, -1 if a member couldn't be written completely.
+int aldl_gz_writer_add(aldl_gz_writer_t* g, int fd, const void* data, unsigned long len)
+{
+	const unsigned char* p = data;
+	unsigned long n;
+	uint64_t start;
+	int res = 0;
+
+	while (len > 0)
+	{
+		n = ALDL_GZ_MEMBER_SIZE - g->length;
+		if (n > len)
+			n = len;
+
+		// there is always room for the output, so deflate takes all of it
+		start = aldl_gz_cpu_ns();
+		g->z.next_in = (unsigned char*)p;
+		g->z.avail_in = n;
+		deflate(&g->z, Z_NO_FLUSH);
+		g->crc = crc32(g->crc, p, n);
+		g->cpu_ns += aldl_gz_cpu_ns() - start;
+
+		g->length += n;
+		g->bytes_in += n;
+		p += n;
+		len -= n;
+		if (g->length == ALDL_GZ_MEMBER_SIZE && aldl_gz_writer_flush(g, fd) != 0)
+			res = -1;
+	}
+	return res;
+}
+
+// completes the member being compressed and writes it to fd.
+// returns 0 on success, -1 if it couldn't be written completely.
+int aldl_gz_writer_flush(aldl_gz_writer_t* g, int fd)
+{
+	unsigned char* p = g->member;
+	unsigned long size, done;
+	uint64_t start;
+	ssize_t res;
+
+	if (g->length == 0)
+		return 0;
+
+	start = aldl_gz_cpu_ns();
+	deflate(&g->z, Z_FINISH);
+	size = ALDL_GZ_HEADER_SIZE + g->z.total_out + ALDL_GZ_TRAILER_SIZE;
+	g->cpu_ns += aldl_gz_cpu_ns() - start;
+
+	p[0] = 0x1f; p[1] = 0x8b; p[2] = 8; p[3] = 4; // deflate, FEXTRA
+	memset(p+4, 0, 4);		// no mtime
+	p[8] = 0; p[9] = 3;		// unix
+	aldl_gz_put_le16(p+10, 16);
+	memcpy(p+12, ALDL_GZ_SUBFIELD, 2);
+	aldl_gz_put_le16(p+14, 12);
+	aldl_gz_put_le32(p+16, size);
+	aldl_gz_put_le64(p+20, g->offset);
+	aldl_gz_put_le32(p+size-8, g->crc);
+	aldl_gz_put_le32(p+size-4, g->length);
+
+	// the member's log bytes are given up on if it can't be written
+	g->offset += g->length;
+	deflateReset(&g->z);
+	aldl_gz_writer_reset(g);
+
+	for (done=0; done<size; done+=res)
+	{
+		res = write(fd, p+done, size-done);
+		if (res < 0 && errno == EINTR)
+			res = 0;
+		else if (res <= 0)
+			return -1;
+	}
+	g->bytes_out += size;
+	g->members++;
+	return 0;
+}
+
+// releases g.
+void aldl_gz_writer_free(aldl_gz_writer_t* g)
+{
+	if (g->level == 0)
+		return;
+	deflateEnd(&g->z);
+	free(g->member);
+	g->member = NULL;
+	g->level = 0;
+}
+
+// ============================================================================
+// READER
+// ============================================================================
+
+// returns 1 if buf starts with the header of a member, 0 otherwise.
+int aldl_gz_is_member(const void* buf, unsigned long len)
+{
+	const unsigned char* p = buf;
+
+	return len >= ALDL_GZ_HEADER_SIZE && p[0] == 0x1f && p[1] == 0x8b && p[2] == 8 && p[3] == 4
+		&& p[10] == 16 && p[11] == 0 && memcmp(p+12, ALDL_GZ_SUBFIELD, 2) == 0
+		&& p[14] == 12 && p[15] == 0;
+}
+
+// returns the size of the valid member at p, which is len bytes from the end
+// of the data, or 0 if there isn't one. a member only counts if the end of
+// the data or another member header follows it, so one cut short by a crash
+// isn't taken for whole.
+static unsigned long aldl_gz_member_size(const unsigned char* p, uint64_t len)
+{
+	uint32_t size;
+
+	if (!aldl_gz_is_member(p, len))
+		return 0;
+	size = aldl_gz_get_le32(p+16);
+	if (size < ALDL_GZ_HEADER_SIZE + ALDL_GZ_TRAILER_SIZE || size > len
+		|| aldl_gz_get_le32(p+size-4) > ALDL_GZ_MEMBER_SIZE)
+		return 0;
+	if (size != len && !aldl_gz_is_member(p+size, len-size))
+		return 0;
+	return size;
+}
+
+// finds the members of the compressed log at data.
+// returns 0 on success, -1 if there is no valid member or memory runs out.
+int aldl_gz_file_scan(aldl_gz_file_t* z, const void* data, uint64_t size)
+{
+	const unsigned char* next;
+	aldl_gz_member_t* m;
+	unsigned long allocated = 0, len;
+	uint64_t pos = 0;
+
+	memset(z, 0, sizeof(aldl_gz_file_t));
+	z->data = data;
+	z->size = size;
+
+	while (pos < size)
+	{
+		len = aldl_gz_member_size(z->data+pos, size-pos);
+		if (len == 0)
+		{
+			// damage: search for the next member header
+			next = memchr(z->data+pos+1, 0x1f, size-pos-1);
+			len = (next != NULL) ? (unsigned long)(next - (z->data+pos)) : size-pos;
+			z->skipped += len;
+			pos += len;
+			continue;
+		}
+
+		if (z->num_members == allocated)
+		{
+			allocated = allocated ? allocated*2 : 64;
+			m = realloc(z->members, allocated*sizeof(aldl_gz_member_t));
+			if (m == NULL)
+			{
+				aldl_gz_file_free(z);
+				return -1;
+			}
+			z->members = m;
+		}
+		m = z->members + z->num_members++;
+		m->offset = aldl_gz_get_le64(z->data+pos+20);
+		m->file_offset = pos;
+		m->size = len;
+		m->length = aldl_gz_get_le32(z->data+pos+len-4);
+		if (m->offset + m->length > z->length)
+			z->length = m->offset + m->length;
+		pos += len;
+	}
+
+	if (z->num_members == 0)
+	{
+		aldl_gz_file_free(z);
+		return -1;
+	}
+	return 0;
+}
+
+// releases what aldl_gz_file_scan() allocated.
+void aldl_gz_file_free(aldl_gz_file_t* z)
+{
+	free(z->members);
+	z->members = NULL;
+	z->num_members = 0;
+}
+
+// returns the first member holding offset or starting after it, or -1 if
+// none does. the members of a log are in the order of their offsets.
+long aldl_gz_file_find(aldl_gz_file_t* z, uint64_t offset)
+{
+	unsigned long lo = 0, hi = z->num_members, mid;
+
+	while (lo < hi)
+	{
+		mid = lo + (hi-lo)/2;
+		if (z->members[mid].offset + z->members[mid].length <= offset)
+			lo = mid+1;
+		else hi = mid;
+	}
+	return (lo < z->num_members) ? (long)lo : -1;
+}
+
+// decompresses member into buf.
+// returns 0 on success, -1 if the member is corrupt.
+int aldl_gz_file_inflate(aldl_gz_file_t* z, unsigned long member, char* buf)
+{
+	aldl_gz_member_t* m = z->members + member;
+	const unsigned char* p = z->data + m->file_offset;
+	z_stream s;
+	int res;
+
+	memset(&s, 0, sizeof(s));
+	if (inflateInit2(&s, -15) != Z_OK)
+		return -1;
+	s.next_in = (unsigned char*)p + ALDL_GZ_HEADER_SIZE;
+	s.avail_in = m->size - ALDL_GZ_HEADER_SIZE - ALDL_GZ_TRAILER_SIZE;
+	s.next_out = (unsigned char*)buf;
+	s.avail_out = m->length;
+	res = inflate(&s, Z_FINISH);
+	inflateEnd(&s);
+
+	if (res != Z_STREAM_END || s.total_out != m->length
+		|| crc32(crc32(0, NULL, 0), (unsigned char*)buf, m->length) != aldl_gz_get_le32(p+m->size-8))
+		return -1;
+	return 0;
+}
+
+// returns the size of the log compressed in the file fd: 0 if the file is
+// empty, -1 if it isn't a compressed log.
+int64_t aldl_gz_length(int fd)
+{
+	aldl_gz_file_t z;
+	struct stat st;
+	void* map;
+	int64_t length = -1;
+
+	if (fstat(fd, &st) != 0)
+		return -1;
+	if (st.st_size == 0)
+		return 0;
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		return -1;
+	// anything else (an uncompressed log, say) isn't searched for members
+	if (aldl_gz_is_member(map, st.st_size) && aldl_gz_file_scan(&z, map, st.st_size) == 0)
+	{
+		length = z.length;
+		aldl_gz_file_free(&z);
+	}
+	munmap(map, st.st_size);
+	return length;
+}
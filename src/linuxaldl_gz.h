@@ -0,0 +1,141 @@
+#ifndef LINUXALDL_GZ_INCLUDED
+#define LINUXALDL_GZ_INCLUDED
+
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <zlib.h>
+
+// ============================================================================
+// SEEKABLE GZIP
+// ============================================================================
+// a log file of either format can be compressed as it is written (see
+// aldl_log_writer_start()). the compressed file is a series of gzip members
+// (RFC1952), each holding at most ALDL_GZ_MEMBER_SIZE bytes of the log and
+// compressed on its own, so gzip -d and zcat read it like any other .gz file.
+// every member carries an extra field with its own size and its place in
+// the log, so a reader can find the member holding any log offset by
+// hopping from header to header, and decompress just that member.
+//
+// member, all integers little-endian:
+//     0  10  gzip header: 1f 8b 08, flags FEXTRA, mtime 0, xfl 0, os 3
+//    10   2  extra field length, 16
+//    12   2  subfield id, ALDL_GZ_SUBFIELD
+//    14   2  subfield length, 12
+//    16   4  size of the whole member, trailer included
+//    20   8  offset in the log of the member's first byte
+//    28  ..  raw deflate data
+//         4  crc32 of the member's log bytes
+//         4  number of the member's log bytes
+//
+// a member is written with a single write() once it is complete: when it
+// is full, when the writer syncs the file, and when the writer stops. so a
+// crash loses at most the log bytes of one member, and a member cut short
+// (or any other damage) is skipped by searching forward for the next member
+// header. a reader skips the log bytes of a lost member like any other damage.
+
+#define ALDL_GZ_MEMBER_SIZE 65536	// log bytes per member, at most
+#define ALDL_GZ_HEADER_SIZE 28
+#define ALDL_GZ_TRAILER_SIZE 8
+#define ALDL_GZ_SUBFIELD "AL"		// 2 bytes
+#define ALDL_GZ_DEFAULT_LEVEL 6		// zlib compression level, 1 (fastest) to 9 (smallest)
+
+// aldl_gz_writer_t: compresses a log into members
+typedef struct _aldl_gz_writer
+{
+	z_stream z;
+	int level;					// compression level, 0 before aldl_gz_writer_init()
+	unsigned char* member;		// the member being compressed
+	unsigned long member_size;	// bytes allocated for it: the largest a member can be
+	uint64_t offset;			// log offset of its first byte
+	unsigned long length;		// log bytes compressed into it so far
+	uint32_t crc;				// and their crc32
+
+	// statistics
+	uint64_t bytes_in;			// log bytes compressed
+	uint64_t bytes_out;			// bytes written to the file
+	uint64_t cpu_ns;			// thread cpu time spent compressing
+	unsigned long members;		// members written
+} aldl_gz_writer_t;
+
+// aldl_gz_member_t: where a member is
+typedef struct _aldl_gz_member
+{
+	uint64_t offset;			// log offset of its first byte
+	uint64_t file_offset;		// where the member starts in the compressed file
+	unsigned int size;			// size of the whole member
+	unsigned int length;		// log bytes it holds
+} aldl_gz_member_t;
+
+// aldl_gz_file_t: the members of a compressed log
+typedef struct _aldl_gz_file
+{
+	const unsigned char* data;	// the compressed file, in memory
+	uint64_t size;				// its size
+	aldl_gz_member_t* members;	// in file order
+	unsigned long num_members;
+	uint64_t length;			// size of the log: the end of the member that ends last
+	unsigned long skipped;		// bytes of the file that aren't in a valid member
+} aldl_gz_file_t;
+
+// function prototypes
+// =================================================
+
+int aldl_gz_writer_init(aldl_gz_writer_t* g, int level, uint64_t offset);
+// sets up g to compress a log with zlib level level (1-9). the first byte
+// added is at log offset offset (see aldl_gz_length()).
+// returns 0 on success, -1 on failure.
+
+int aldl_gz_writer_add(aldl_gz_writer_t* g, int fd, const void* data, unsigned long len);
+// compresses len more bytes of the log, writing each member to fd as it fills.
+// returns 0 on success, -1 if a member couldn't be written completely.
+
+int aldl_gz_writer_flush(aldl_gz_writer_t* g, int fd);
+// completes the member being compressed, if it holds anything, and writes it to fd.
+// returns 0 on success, -1 if it couldn't be written completely.
+
+void aldl_gz_writer_free(aldl_gz_writer_t* g);
+// releases g. anything not flushed is lost.
+
+int aldl_gz_is_member(const void* buf, unsigned long len);
+// returns 1 if buf starts with the header of a member, 0 otherwise.
+
+int aldl_gz_file_scan(aldl_gz_file_t* z, const void* data, uint64_t size);
+// finds the members of the compressed log at data, which has size bytes.
+// only the member headers are read; the data must stay in place until
+// aldl_gz_file_free(). returns 0 on success, -1 if there isn't a single
+// valid member or memory runs out.
+
+void aldl_gz_file_free(aldl_gz_file_t* z);
+// releases what aldl_gz_file_scan() allocated.
+
+long aldl_gz_file_find(aldl_gz_file_t* z, uint64_t offset);
+// returns the number of the first member holding log offset offset or
+// starting after it, or -1 if no member does.
+
+int aldl_gz_file_inflate(aldl_gz_file_t* z, unsigned long member, char* buf);
+// decompresses member into buf, which has room for members[member].length bytes.
+// returns 0 on success, -1 if the member is corrupt (bad data or crc).
+
+int64_t aldl_gz_length(int fd);
+// returns the size of the log compressed in the file fd, which must be open
+// for reading: 0 if the file is empty, -1 if it isn't a compressed log.
+
+#endif
@@ -0,0 +1,209 @@
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// linuxaldl-headless: the command line logger of linuxaldl, linked only
+// against libaldl. it takes the same options as "linuxaldl ... logfile" but
+// needs neither GTK nor popt, for loggers without a desktop.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <getopt.h>
+#include "libaldl.h"
+
+static void headless_usage(FILE* f)
+{
+	fprintf(f,"Usage: linuxaldl-headless -serial=/dev/ttyUSB0 -mask=DEF [options] logfile\n"
+			"\n"
+			"Options:\n"
+			"  -format=raw|csv   log format. the default is csv for .csv files, raw otherwise\n"
+			"  -interval=MSEC    time between mode 1 requests (default %d)\n"
+			"  -timeout=MSEC     time to wait for a response (default %d)\n"
+			"  -throughput       request the next message as soon as the ECM answers\n"
+			"  -guard=MSEC       bus idle time between requests with -throughput (default %d)\n"
+			"  -passive          never transmit; only log frames seen on the line (for $DF only\n"
+			"                    mode 1 responses, so another tool has to be polling the ECM)\n"
+			"  -duration=SECS    stop after this many seconds\n"
+			"  -frames=COUNT     stop after this many frames\n"
+			"  -fsync=POLICY     sync the log every Nms, every N records, or none (default %dms)\n"
+			"  -logio=BACKEND    how the log is written: thread (a writer thread, the default),\n"
+			"                    or uring (io_uring batches, no extra thread, if the kernel allows)\n"
+			"  -noindex          don't build an index (logfile.idx) of a raw log\n"
+			"  -compact          store most frames of a raw log as the bytes that changed\n"
+			"  -compress[=LEVEL] gzip the log as it is written, in the writer thread (level 1-9,\n"
+			"                    default %d). needs -logio=thread\n"
+			"  -columns          write a columnar log (logfile without .log, plus %s) as well\n",
+			ALDL_SESSION_DEFAULT_INTERVAL, ALDL_SESSION_DEFAULT_TIMEOUT,
+			ALDL_SESSION_DEFAULT_GUARD_TIME, ALDL_LOG_DEFAULT_FSYNC_EVERY, ALDL_GZ_DEFAULT_LEVEL,
+			ALDL_COL_SUFFIX);
+}
+
+int main(int argc, char* argv[])
+{
+	aldl_session_t session;
+	aldl_log_options_t opts;
+	aldl_definition* def;
+	const char* portname = NULL;
+	const char* defname = NULL;
+	const char* logformat = NULL;
+	const char* logio = "thread";
+	aldl_fsync_policy_t fsync = ALDL_LOG_DEFAULT_FSYNC;
+	unsigned int fsync_every = ALDL_LOG_DEFAULT_FSYNC_EVERY;
+	int interval = ALDL_SESSION_DEFAULT_INTERVAL;
+	int timeout = ALDL_SESSION_DEFAULT_TIMEOUT;
+	int guard = ALDL_SESSION_DEFAULT_GUARD_TIME;
+	int throughput = 0, passive = 0, noindex = 0, compact = 0, compress = 0, columns = 0;
+	int duration = 0, frames = 0;
+	int opt;
+	long res;
+	unsigned int length;
+
+	// getopt_long_only accepts the single dash long options linuxaldl uses
+	static const struct option headless_opts[] =
+	{
+		{ "serial", required_argument, NULL, 's' },
+		{ "mask", required_argument, NULL, 'm' },
+		{ "interval", required_argument, NULL, 'i' },
+		{ "timeout", required_argument, NULL, 't' },
+		{ "throughput", no_argument, NULL, 'T' },
+		{ "guard", required_argument, NULL, 'g' },
+		{ "passive", no_argument, NULL, 'p' },
+		{ "duration", required_argument, NULL, 'd' },
+		{ "frames", required_argument, NULL, 'n' },
+		{ "format", required_argument, NULL, 'f' },
+		{ "fsync", required_argument, NULL, 'y' },
+		{ "logio", required_argument, NULL, 'l' },
+		{ "noindex", no_argument, NULL, 'x' },
+		{ "compact", no_argument, NULL, 'c' },
+		{ "compress", optional_argument, NULL, 'z' },
+		{ "columns", no_argument, NULL, 'C' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	while ((opt = getopt_long_only(argc, argv, "", headless_opts, NULL)) != -1)
+	{
+		switch (opt)
+		{
+			case 's': portname = optarg; break;
+			case 'm': defname = optarg; break;
+			case 'i': interval = atoi(optarg); break;
+			case 't': timeout = atoi(optarg); break;
+			case 'T': throughput = 1; break;
+			case 'g': guard = atoi(optarg); break;
+			case 'p': passive = 1; break;
+			case 'd': duration = atoi(optarg); break;
+			case 'n': frames = atoi(optarg); break;
+			case 'f': logformat = optarg; break;
+			case 'y':
+				if (aldl_log_parse_fsync(optarg, &fsync, &fsync_every) != 0)
+				{
+					headless_usage(stderr);
+					return 1;
+				}
+				break;
+			case 'l': logio = optarg; break;
+			case 'x': noindex = 1; break;
+			case 'c': compact = 1; break;
+			case 'z': compress = (optarg != NULL) ? atoi(optarg) : ALDL_GZ_DEFAULT_LEVEL; break;
+			case 'C': columns = 1; break;
+			case 'h': headless_usage(stdout); return 0;
+			default: headless_usage(stderr); return 1;
+		}
+	}
+
+	if (portname == NULL || defname == NULL || optind != argc-1
+		|| (strcmp(logio,"thread")!=0 && strcmp(logio,"uring")!=0)
+		|| interval <= 0 || timeout <= 0 || guard < 0 || duration < 0 || frames < 0
+		|| compress < 0 || compress > 9)
+	{
+		headless_usage(stderr);
+		return 1;
+	}
+	if (compress != 0 && strcmp(logio,"thread")!=0)
+	{
+		fprintf(stderr,"Error: -compress needs -logio=thread.\n");
+		return 1;
+	}
+
+	def = aldl_get_definition(defname);
+	if (def == NULL)
+	{
+		fprintf(stderr,"Error: No definition with name \"%s\" found.",defname);
+		fprintf(stderr,"Consult the documentation.\n");
+		fprintf(stderr," Note: definition names are case sensitive.\n");
+		return 1;
+	}
+	if (passive && def->broadcast_frames == NULL)
+	{
+		fprintf(stderr,"No broadcast frames are known for %s.\n",def->name);
+		return 1;
+	}
+
+	memset(&opts,0,sizeof(opts));
+	opts.filename = argv[optind];
+	opts.backend = strcmp(logio,"thread")==0 ? ALDL_LOG_THREAD : ALDL_LOG_URING;
+	opts.fsync_policy = fsync;
+	opts.fsync_every = fsync_every;
+	opts.index = !noindex;
+	opts.compact = compact;
+	opts.compress = compress;
+	opts.columns = columns;
+	opts.max_frames = frames;
+	opts.max_duration = duration;
+
+	// log format: -format, or from the file extension (under any .gz)
+	length = strlen(opts.filename);
+	if (length>=3 && strcasecmp(opts.filename+length-3,".gz")==0)
+		length -= 3;
+	if (logformat != NULL)
+	{
+		if (strcmp(logformat,"csv")==0)
+			opts.format = ALDL_LOG_CSV;
+		else if (strcmp(logformat,"raw")==0)
+			opts.format = ALDL_LOG_RAW;
+		else
+		{
+			fprintf(stderr,"Error: unknown log format \"%s\". Use raw or csv.\n",logformat);
+			return 1;
+		}
+	}
+	else if (length>=4 && strncasecmp(opts.filename+length-4,".csv",4)==0)
+		opts.format = ALDL_LOG_CSV;
+	else opts.format = ALDL_LOG_RAW;
+
+	printf("Connecting to ALDL interface on %s...\n",portname);
+	if (aldl_session_open(&session, portname, def) != 0)
+	{
+		fprintf(stderr,"Error: couldn't open %s.\n",portname);
+		return 1;
+	}
+	session.scan_mode = passive ? ALDL_SCAN_PASSIVE
+						: (throughput ? ALDL_SCAN_THROUGHPUT : ALDL_SCAN_INTERVAL);
+	session.scan_interval = interval;
+	session.scan_timeout = timeout;
+	session.bus_guard_time = guard;
+
+	// the log file is only opened (or created) once the port is
+	res = aldl_log_run(&session, &opts);
+	aldl_session_close(&session);
+
+	return (res<0) ? 1 : 0;
+}
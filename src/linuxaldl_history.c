@@ -0,0 +1,222 @@
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "linuxaldl_history.h"
+
+// returns the number of samples of num_items values each a history can keep
+// in bytes of memory, or 0 if bytes isn't enough for a useful history.
+unsigned int aldl_history_capacity(unsigned int num_items, unsigned long bytes)
+{
+	// a timestamp and a value per item for each sample, plus the min and max
+	// of the levels' buckets: less than 2/(ALDL_HISTORY_FANOUT-1) values
+	// per item per sample
+	double per_sample = sizeof(double) + num_items*sizeof(float)*(1.0 + 2.0/(ALDL_HISTORY_FANOUT-1));
+	double capacity = bytes/per_sample;
+
+	if (capacity < ALDL_HISTORY_FANOUT*ALDL_HISTORY_MIN_BUCKETS)
+		return 0;
+	if (capacity > (double)(1u<<31))
+		return 1u<<31;
+	return capacity;
+}
+
+// sets up an empty history keeping capacity samples of num_items values.
+// returns 0 on success, -1 if capacity is too small or out of memory.
+int aldl_history_init(aldl_history_t* h, unsigned int num_items, unsigned int capacity)
+{
+	unsigned long span = 1, size;
+	unsigned int l;
+	char* pool;
+
+	memset(h, 0, sizeof(aldl_history_t));
+	if (num_items == 0 || capacity < ALDL_HISTORY_FANOUT*ALDL_HISTORY_MIN_BUCKETS)
+		return -1;
+
+	// as many levels as keep at least ALDL_HISTORY_MIN_BUCKETS buckets each
+	while (h->num_levels < ALDL_HISTORY_MAX_LEVELS
+			&& capacity/(span*ALDL_HISTORY_FANOUT) >= ALDL_HISTORY_MIN_BUCKETS)
+	{
+		span *= ALDL_HISTORY_FANOUT;
+		h->levels[h->num_levels++].span = span;
+	}
+
+	// whole top level buckets only, so a bucket's slot is only reused once
+	// every sample it covers has been replaced
+	capacity -= capacity % span;
+	h->num_items = num_items;
+	h->capacity = capacity;
+
+	size = capacity*sizeof(double) + (unsigned long)num_items*capacity*sizeof(float);
+	for (l=0; l<h->num_levels; l++)
+	{
+		h->levels[l].capacity = capacity/h->levels[l].span;
+		size += 2ul*num_items*h->levels[l].capacity*sizeof(float);
+	}
+
+	pool = malloc(size);
+	if (pool == NULL)
+		return -1;
+	h->pool = pool;
+
+	// timestamps first, so the floats after them stay aligned
+	h->times = (double*)pool;
+	pool += capacity*sizeof(double);
+	h->samples = (float*)pool;
+	pool += (unsigned long)num_items*capacity*sizeof(float);
+	for (l=0; l<h->num_levels; l++)
+	{
+		h->levels[l].min = (float*)pool;
+		pool += (unsigned long)num_items*h->levels[l].capacity*sizeof(float);
+		h->levels[l].max = (float*)pool;
+		pool += (unsigned long)num_items*h->levels[l].capacity*sizeof(float);
+	}
+	return 0;
+}
+
+// frees the memory allocated by aldl_history_init().
+void aldl_history_free(aldl_history_t* h)
+{
+	free(h->pool);
+	memset(h, 0, sizeof(aldl_history_t));
+}
+
+// forgets every sample, keeping the memory.
+void aldl_history_clear(aldl_history_t* h)
+{
+	h->count = 0;
+}
+
+// adds a sample taken at time. values has num_items entries.
+void aldl_history_append(aldl_history_t* h, double time, const float* values)
+{
+	unsigned int slot = h->count % h->capacity;
+	unsigned int i, l, bucket;
+	aldl_history_level_t* level;
+	float* min;
+	float* max;
+
+	h->times[slot] = time;
+	for (i=0; i<h->num_items; i++)
+		h->samples[(unsigned long)i*h->capacity + slot] = values[i];
+
+	// the sample is in one bucket of every level
+	for (l=0; l<h->num_levels; l++)
+	{
+		level = &h->levels[l];
+		bucket = (h->count/level->span) % level->capacity;
+		min = level->min + bucket;
+		max = level->max + bucket;
+
+		if (h->count % level->span == 0) // the first sample of the bucket
+		{
+			for (i=0; i<h->num_items; i++, min += level->capacity, max += level->capacity)
+				*min = *max = values[i];
+		}
+		else
+		{
+			for (i=0; i<h->num_items; i++, min += level->capacity, max += level->capacity)
+			{
+				if (values[i] < *min)
+					*min = values[i];
+				if (values[i] > *max)
+					*max = values[i];
+			}
+		}
+	}
+	h->count++;
+}
+
+// returns the number of the oldest sample still kept.
+unsigned long aldl_history_oldest(const aldl_history_t* h)
+{
+	return (h->count > h->capacity) ? h->count - h->capacity : 0;
+}
+
+// returns the number of the first kept sample taken at or after time,
+// h->count if there is none.
+unsigned long aldl_history_find(const aldl_history_t* h, double time)
+{
+	unsigned long low = aldl_history_oldest(h), high = h->count, mid;
+
+	// binary search: the times are in order
+	while (low < high)
+	{
+		mid = low + (high-low)/2;
+		if (h->times[mid % h->capacity] < time)
+			low = mid+1;
+		else high = mid;
+	}
+	return low;
+}
+
+// finds the min and max of item's values in samples first to end-1.
+// returns 0 on success, -1 if the range holds no kept sample.
+int aldl_history_minmax(const aldl_history_t* h, unsigned int item,
+						unsigned long first, unsigned long end, float* min, float* max)
+{
+	const aldl_history_level_t* level;
+	unsigned long oldest = aldl_history_oldest(h);
+	float low, high, value;
+	int l;
+
+	if (first < oldest)
+		first = oldest;
+	if (end > h->count)
+		end = h->count;
+	if (first >= end)
+		return -1;
+
+	low = high = h->samples[(unsigned long)item*h->capacity + first % h->capacity];
+	while (first < end)
+	{
+		// the biggest bucket that starts at first and ends by end. its slot
+		// hasn't been reused, since first is still kept.
+		for (l=h->num_levels-1; l>=0; l--)
+		{
+			level = &h->levels[l];
+			if (first % level->span == 0 && first + level->span <= end)
+				break;
+		}
+
+		if (l < 0) // no bucket fits; take the sample itself
+		{
+			value = h->samples[(unsigned long)item*h->capacity + first % h->capacity];
+			if (value < low)
+				low = value;
+			if (value > high)
+				high = value;
+			first++;
+			continue;
+		}
+
+		value = level->min[(unsigned long)item*level->capacity + (first/level->span) % level->capacity];
+		if (value < low)
+			low = value;
+		value = level->max[(unsigned long)item*level->capacity + (first/level->span) % level->capacity];
+		if (value > high)
+			high = value;
+		first += level->span;
+	}
+
+	*min = low;
+	*max = high;
+	return 0;
+}
@@ -0,0 +1,106 @@
+#ifndef LINUXALDL_HISTORY_INCLUDED
+#define LINUXALDL_HISTORY_INCLUDED
+
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// ============================================================================
+// SAMPLE HISTORY
+// ============================================================================
+// a fixed size ring of decoded samples for every item of a definition, with
+// a timestamp for each sample, kept for plotting trends. the memory used is
+// set when the history is made and never grows: once the ring is full each
+// new sample replaces the oldest.
+//
+// next to the samples the history keeps min/max decimation levels. a bucket
+// of level 1 holds the min and max of ALDL_HISTORY_FANOUT samples, a bucket
+// of level 2 the min and max of ALDL_HISTORY_FANOUT level 1 buckets, and so
+// on. they are updated as samples are appended, so the min and max of any
+// range of samples is found from a handful of buckets
+// (aldl_history_minmax()), however many samples the range covers. a strip
+// chart needs one such query per pixel column, so drawing a 30 minute window
+// costs the same as drawing a 30 second one.
+//
+// samples are numbered from 0 in the order they were appended. a history is
+// not locked: append and read it from the same thread.
+
+#define ALDL_HISTORY_FANOUT 8		// samples per level 1 bucket, and buckets per bucket of the next level
+#define ALDL_HISTORY_MAX_LEVELS 8	// max number of decimation levels
+#define ALDL_HISTORY_MIN_BUCKETS 4	// the top level has at least this many buckets
+
+typedef struct _aldl_history_level
+{
+	unsigned long span;			// samples covered by one bucket
+	unsigned int capacity;		// buckets kept per item
+	float* min;					// min of each bucket, capacity per item:
+								// bucket n of item i is min[i*capacity + n%capacity]
+	float* max;					// max of each bucket, laid out like min
+} aldl_history_level_t;
+
+typedef struct _aldl_history
+{
+	unsigned int num_items;		// values per sample (seperators included, like mode1_def)
+	unsigned int capacity;		// samples kept. a multiple of the top level's span.
+	unsigned long count;		// samples appended so far; the number of the next sample
+	double* times;				// time of each sample in seconds, capacity entries:
+								// sample n is times[n%capacity]
+	float* samples;				// the values, capacity per item:
+								// sample n of item i is samples[i*capacity + n%capacity]
+	unsigned int num_levels;	// decimation levels in levels
+	aldl_history_level_t levels[ALDL_HISTORY_MAX_LEVELS];
+	void* pool;					// everything above is allocated in one block
+} aldl_history_t;
+
+// function prototypes
+// =================================================
+
+unsigned int aldl_history_capacity(unsigned int num_items, unsigned long bytes);
+// returns the number of samples of num_items values each a history can keep
+// in bytes of memory, or 0 if bytes isn't enough for a useful history.
+
+int aldl_history_init(aldl_history_t* h, unsigned int num_items, unsigned int capacity);
+// sets up an empty history keeping capacity samples of num_items values.
+// capacity is rounded down to a multiple of the top level's span.
+// returns 0 on success, -1 if capacity is too small or out of memory.
+
+void aldl_history_free(aldl_history_t* h);
+// frees the memory allocated by aldl_history_init().
+
+void aldl_history_clear(aldl_history_t* h);
+// forgets every sample, keeping the memory.
+
+void aldl_history_append(aldl_history_t* h, double time, const float* values);
+// adds a sample taken at time (seconds, not before the previous sample's
+// time). values has num_items entries.
+
+unsigned long aldl_history_oldest(const aldl_history_t* h);
+// returns the number of the oldest sample still kept. equal to h->count if
+// the history is empty.
+
+unsigned long aldl_history_find(const aldl_history_t* h, double time);
+// returns the number of the first kept sample taken at or after time,
+// h->count if there is none.
+
+int aldl_history_minmax(const aldl_history_t* h, unsigned int item,
+						unsigned long first, unsigned long end, float* min, float* max);
+// finds the min and max of item's values in samples first to end-1.
+// samples that are no longer kept are skipped.
+// returns 0 on success, -1 if the range holds no kept sample.
+
+#endif
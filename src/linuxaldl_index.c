@@ -0,0 +1,534 @@
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "linuxaldl_log.h"
+#include "linuxaldl_index.h"
+
+static void aldl_index_put_le16(unsigned char* p, uint16_t v)
+{
+	p[0] = v; p[1] = v>>8;
+}
+
+static void aldl_index_put_le32(unsigned char* p, uint32_t v)
+{
+	p[0] = v; p[1] = v>>8; p[2] = v>>16; p[3] = v>>24;
+}
+
+static void aldl_index_put_le64(unsigned char* p, uint64_t v)
+{
+	aldl_index_put_le32(p, v);
+	aldl_index_put_le32(p+4, v>>32);
+}
+
+static uint16_t aldl_index_get_le16(const unsigned char* p)
+{
+	return p[0] | (p[1]<<8);
+}
+
+static uint32_t aldl_index_get_le32(const unsigned char* p)
+{
+	return p[0] | (p[1]<<8) | (p[2]<<16) | ((uint32_t)p[3]<<24);
+}
+
+static uint64_t aldl_index_get_le64(const unsigned char* p)
+{
+	return aldl_index_get_le32(p) | ((uint64_t)aldl_index_get_le32(p+4)<<32);
+}
+
+// floats are stored as the little-endian bytes of their IEEE 754 bits
+static void aldl_index_put_float(unsigned char* p, float f)
+{
+	uint32_t v;
+
+	memcpy(&v, &f, 4);
+	aldl_index_put_le32(p, v);
+}
+
+static float aldl_index_get_float(const unsigned char* p)
+{
+	uint32_t v = aldl_index_get_le32(p);
+	float f;
+
+	memcpy(&f, &v, 4);
+	return f;
+}
+
+// returns a malloc'd string with the name of the index of logfilename
+static char* aldl_index_filename(const char* logfilename)
+{
+	unsigned int length = strlen(logfilename);
+	char* name = malloc(length + sizeof(ALDL_INDEX_SUFFIX));
+
+	if (name != NULL)
+	{
+		memcpy(name, logfilename, length);
+		memcpy(name+length, ALDL_INDEX_SUFFIX, sizeof(ALDL_INDEX_SUFFIX));
+	}
+	return name;
+}
+
+// ============================================================================
+// WRITING
+// ============================================================================
+
+// empties the zone map of the block being built
+static void aldl_index_writer_reset(aldl_index_writer_t* w)
+{
+	unsigned int i;
+
+	w->records = 0;
+	for (i=0; i<w->num_items; i++)
+	{
+		w->min[i] = INFINITY;
+		w->max[i] = -INFINITY;
+	}
+}
+
+// opens (or creates) the index of the raw log logfilename.
+// returns 0 on success, -1 on failure.
+int aldl_index_writer_open(aldl_index_writer_t* w, const char* logfilename, aldl_definition* def)
+{
+	unsigned char header[ALDL_INDEX_HEADER_SIZE];
+	char* filename;
+	struct stat st;
+	int64_t length;
+	ssize_t res;
+	int fd;
+
+	memset(w, 0, sizeof(aldl_index_writer_t));
+	w->fd = -1;
+	w->definition = def;
+	w->definition_hash = aldl_definition_hash(def);
+	for (w->num_items=0; def->mode1_def[w->num_items].label != NULL; w->num_items++)
+		;
+	w->block_records = ALDL_INDEX_BLOCK_RECORDS;
+
+	// the log is only ever appended to, so records go after what is there
+	// now. the offsets of a compressed log are those of the log inside it.
+	if (stat(logfilename, &st) != 0 || !S_ISREG(st.st_mode))
+		return -1;
+	w->log_offset = st.st_size;
+	fd = open(logfilename, O_RDONLY | O_CLOEXEC);
+	if (fd != -1)
+	{
+		length = aldl_gz_length(fd);
+		if (length >= 0)
+			w->log_offset = length;
+		close(fd);
+	}
+	w->log_segment = ALDL_INDEX_NO_SEGMENT;
+
+	// one block for the queue and the zone map the entries are made from
+	w->entry_size = ALDL_INDEX_ENTRY_SIZE + w->num_items*8;
+	w->queue = malloc(ALDL_INDEX_QUEUE_ENTRIES*w->entry_size + w->num_items*2*sizeof(float));
+	filename = aldl_index_filename(logfilename);
+	if (w->queue == NULL || filename == NULL)
+	{
+		free(w->queue);
+		free(filename);
+		w->queue = NULL;
+		return -1;
+	}
+	w->min = (float*)(w->queue + ALDL_INDEX_QUEUE_ENTRIES*w->entry_size);
+	w->max = w->min + w->num_items;
+	aldl_index_writer_reset(w);
+
+	w->fd = open(filename, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+	if (w->fd == -1)
+	{
+		fprintf(stderr,"Couldn't open the index %s: %s\n",filename,strerror(errno));
+		free(filename);
+		free(w->queue);
+		w->queue = NULL;
+		return -1;
+	}
+
+	// entries are added to an index that is already there. anything else
+	// in the file is thrown away; the index can only point into the log.
+	// an empty log starts a new index too, in case one was left by a log
+	// of the same name that has been deleted
+	res = pread(w->fd, header, ALDL_INDEX_HEADER_SIZE, 0);
+	if (w->log_offset == 0 || res != ALDL_INDEX_HEADER_SIZE || memcmp(header, ALDL_INDEX_MAGIC, 8) != 0
+		|| aldl_index_get_le16(header+8) != ALDL_INDEX_VERSION)
+	{
+		if (w->log_offset != 0 && fstat(w->fd, &st) == 0 && st.st_size != 0)
+			fprintf(stderr,"%s is not a log index. Starting it again.\n",filename);
+		memset(header, 0, ALDL_INDEX_HEADER_SIZE);
+		memcpy(header, ALDL_INDEX_MAGIC, 8);
+		aldl_index_put_le16(header+8, ALDL_INDEX_VERSION);
+		aldl_index_put_le16(header+10, ALDL_INDEX_HEADER_SIZE);
+		aldl_index_put_le16(header+12, ALDL_INDEX_ENTRY_SIZE);
+		if (ftruncate(w->fd, 0) != 0 || write(w->fd, header, ALDL_INDEX_HEADER_SIZE) != ALDL_INDEX_HEADER_SIZE)
+		{
+			fprintf(stderr,"Couldn't write the index %s: %s\n",filename,strerror(errno));
+			close(w->fd);
+			w->fd = -1;
+			free(filename);
+			free(w->queue);
+			w->queue = NULL;
+			return -1;
+		}
+	}
+	free(filename);
+	return 0;
+}
+
+// queues the entry of the block being built, if it has any records, and starts the next one.
+static void aldl_index_writer_flush(aldl_index_writer_t* w)
+{
+	unsigned char* e;
+	unsigned long tail = w->queue_tail;
+	unsigned int i;
+
+	if (w->records == 0)
+		return;
+	// an index with a block missing would send readers past records, so
+	// when the backend falls this far behind the index just ends
+	if (w->dropped != 0 || tail - __atomic_load_n(&w->queue_head, __ATOMIC_ACQUIRE) == ALDL_INDEX_QUEUE_ENTRIES)
+	{
+		w->dropped++;
+		aldl_index_writer_reset(w);
+		return;
+	}
+	e = w->queue + (tail % ALDL_INDEX_QUEUE_ENTRIES)*w->entry_size;
+
+	memset(e, 0, ALDL_INDEX_ENTRY_SIZE);
+	aldl_index_put_le16(e, ALDL_INDEX_ENTRY_MARK);
+	aldl_index_put_le16(e+2, w->num_items);
+	aldl_index_put_le32(e+4, w->records);
+	aldl_index_put_le32(e+8, w->definition_hash);
+	aldl_index_put_le32(e+12, w->first_seq);
+	aldl_index_put_le64(e+16, w->segment_offset);
+	aldl_index_put_le64(e+24, w->offset);
+	aldl_index_put_le64(e+32, w->log_offset);
+	aldl_index_put_le64(e+40, w->first_time);
+	aldl_index_put_le64(e+48, w->last_time);
+	for (i=0; i<w->num_items; i++)
+	{
+		aldl_index_put_float(e + ALDL_INDEX_ENTRY_SIZE + i*8, w->min[i]);
+		aldl_index_put_float(e + ALDL_INDEX_ENTRY_SIZE + i*8 + 4, w->max[i]);
+	}
+	aldl_index_put_le32(e+56, aldl_crc32(0, e, w->entry_size));
+
+	w->queue_end[tail % ALDL_INDEX_QUEUE_ENTRIES] = w->log_offset;
+	__atomic_store_n(&w->queue_tail, tail+1, __ATOMIC_RELEASE);
+	aldl_index_writer_reset(w);
+}
+
+// adds the next record written to the log: length bytes, the segment
+// header written with it included if header is 1, key 1 if it is a full record.
+void aldl_index_writer_add(aldl_index_writer_t* w, unsigned int length, int header, int key,
+							uint32_t seq, int64_t time, const float* values)
+{
+	unsigned int i;
+
+	if (w->fd == -1)
+		return;
+
+	// a complete block ends where the next one can start: at a full record
+	if (key && w->records >= w->block_records)
+		aldl_index_writer_flush(w);
+
+	// a block belongs to one segment
+	if (header)
+	{
+		aldl_index_writer_flush(w);
+		w->log_segment = w->log_offset;
+		w->log_offset += ALDL_RAW_HEADER_SIZE;
+		length -= ALDL_RAW_HEADER_SIZE;
+	}
+	// records of a segment that started before the index was opened can't be placed
+	else if (w->log_segment == ALDL_INDEX_NO_SEGMENT)
+	{
+		w->log_offset += length;
+		return;
+	}
+
+	if (w->records == 0)
+	{
+		w->first_seq = seq;
+		w->segment_offset = w->log_segment;
+		w->offset = w->log_offset;
+		w->first_time = time;
+	}
+	w->records++;
+	w->log_offset += length;
+	w->last_time = time;
+
+	if (values != NULL)
+	{
+		for (i=0; i<w->num_items; i++)
+		{
+			if (w->definition->mode1_def[i].operation == ALDL_OP_SEPERATOR)
+				continue;
+			if (values[i] < w->min[i])
+				w->min[i] = values[i];
+			if (values[i] > w->max[i])
+				w->max[i] = values[i];
+		}
+	}
+
+}
+
+// queues the entry of the last, partly filled block.
+void aldl_index_writer_finish(aldl_index_writer_t* w)
+{
+	if (w->fd != -1)
+		aldl_index_writer_flush(w);
+}
+
+// returns the oldest queued entry if the log has been written up to the
+// end of its block, or NULL.
+const unsigned char* aldl_index_writer_next(aldl_index_writer_t* w, uint64_t written)
+{
+	unsigned long head = w->queue_head;
+
+	if (w->fd == -1)
+		return NULL;
+	// after a failure the rest are only taken off the queue
+	while (w->broken && head != __atomic_load_n(&w->queue_tail, __ATOMIC_ACQUIRE))
+	{
+		w->errors++;
+		__atomic_store_n(&w->queue_head, ++head, __ATOMIC_RELEASE);
+	}
+	if (w->broken || head == __atomic_load_n(&w->queue_tail, __ATOMIC_ACQUIRE)
+		|| w->queue_end[head % ALDL_INDEX_QUEUE_ENTRIES] > written)
+		return NULL;
+	return w->queue + (head % ALDL_INDEX_QUEUE_ENTRIES)*w->entry_size;
+}
+
+// takes the entry returned by aldl_index_writer_next() off the queue.
+void aldl_index_writer_done(aldl_index_writer_t* w, int ok)
+{
+	if (ok)
+		w->blocks++;
+	else
+	{
+		w->errors++;
+		w->broken = 1;
+	}
+	__atomic_store_n(&w->queue_head, w->queue_head+1, __ATOMIC_RELEASE);
+}
+
+// the log couldn't be written: no more entries are.
+void aldl_index_writer_fail(aldl_index_writer_t* w)
+{
+	w->broken = 1;
+}
+
+// writes every entry whose records are in the log, with write().
+void aldl_index_writer_write(aldl_index_writer_t* w, uint64_t written)
+{
+	const unsigned char* e;
+
+	// one write per block, so an entry is either there or fails its crc
+	while ((e = aldl_index_writer_next(w, written)) != NULL)
+		aldl_index_writer_done(w, write(w->fd, e, w->entry_size) == (ssize_t)w->entry_size);
+}
+
+// queues the entry of the last block, writes what is left and closes the index.
+// returns 0 on success, -1 if any entry couldn't be written.
+int aldl_index_writer_close(aldl_index_writer_t* w)
+{
+	if (w->fd == -1)
+		return 0;
+	aldl_index_writer_flush(w);
+	aldl_index_writer_write(w, w->log_offset);
+	close(w->fd);
+	w->fd = -1;
+	free(w->queue);
+	w->queue = NULL;
+	return (w->errors != 0 || w->dropped != 0) ? -1 : 0;
+}
+
+// ============================================================================
+// READING
+// ============================================================================
+
+// reads the index of the raw log logfilename into memory.
+// returns 0 on success, -1 if there is no index or it can't be read.
+int aldl_log_index_open(aldl_log_index_t* x, const char* logfilename)
+{
+	char* filename = aldl_index_filename(logfilename);
+	unsigned char* buf = NULL;
+	const unsigned char* e;
+	aldl_index_block_t* b;
+	unsigned long size = 0, offset, num_values = 0, max_blocks = 0;
+	unsigned int header_size, entry_size, num_items, i;
+	uint32_t crc;
+	float* v;
+	struct stat st;
+	int fd;
+
+	memset(x, 0, sizeof(aldl_log_index_t));
+	if (filename == NULL)
+		return -1;
+	fd = open(filename, O_RDONLY | O_CLOEXEC);
+	free(filename);
+	if (fd == -1)
+		return -1;
+
+	// the index is small next to the log, and is read in whole
+	if (fstat(fd, &st) == 0 && st.st_size >= ALDL_INDEX_HEADER_SIZE)
+	{
+		size = st.st_size;
+		buf = malloc(size);
+		if (buf != NULL && pread(fd, buf, size, 0) != (ssize_t)size)
+		{
+			free(buf);
+			buf = NULL;
+		}
+	}
+	close(fd);
+	if (buf == NULL || memcmp(buf, ALDL_INDEX_MAGIC, 8) != 0
+		|| aldl_index_get_le16(buf+8) != ALDL_INDEX_VERSION)
+	{
+		free(buf);
+		return -1;
+	}
+	header_size = aldl_index_get_le16(buf+10);
+	entry_size = aldl_index_get_le16(buf+12);
+	if (header_size < ALDL_INDEX_HEADER_SIZE || entry_size < ALDL_INDEX_ENTRY_SIZE)
+	{
+		free(buf);
+		return -1;
+	}
+
+	// first pass: how many blocks and zone map values there are, at most
+	for (offset=header_size; offset+entry_size <= size; offset += entry_size + num_items*8)
+	{
+		num_items = aldl_index_get_le16(buf+offset+2);
+		max_blocks++;
+		num_values += num_items*2;
+	}
+	x->blocks = malloc(max_blocks*sizeof(aldl_index_block_t) + 1);
+	x->values = malloc(num_values*sizeof(float) + 1);
+	if (x->blocks == NULL || x->values == NULL)
+	{
+		free(buf);
+		aldl_log_index_close(x);
+		return -1;
+	}
+
+	v = x->values;
+	for (offset=header_size; offset+entry_size <= size; offset += entry_size + num_items*8)
+	{
+		e = buf + offset;
+		num_items = aldl_index_get_le16(e+2);
+		if (offset + entry_size + num_items*8 > size) // cut short
+			break;
+		crc = aldl_index_get_le32(e+56);
+		memset(buf+offset+56, 0, 4);
+		if (aldl_index_get_le16(e) != ALDL_INDEX_ENTRY_MARK
+			|| aldl_crc32(0, e, entry_size + num_items*8) != crc)
+			continue;
+
+		b = x->blocks + x->num_blocks++;
+		b->records = aldl_index_get_le32(e+4);
+		b->definition_hash = aldl_index_get_le32(e+8);
+		b->first_seq = aldl_index_get_le32(e+12);
+		b->segment_offset = aldl_index_get_le64(e+16);
+		b->offset = aldl_index_get_le64(e+24);
+		b->end = aldl_index_get_le64(e+32);
+		b->first_time = aldl_index_get_le64(e+40);
+		b->last_time = aldl_index_get_le64(e+48);
+		b->num_items = num_items;
+		b->min = v;
+		b->max = v + num_items;
+		for (i=0; i<num_items; i++)
+		{
+			v[i] = aldl_index_get_float(e + entry_size + i*8);
+			v[num_items+i] = aldl_index_get_float(e + entry_size + i*8 + 4);
+		}
+		v += num_items*2;
+	}
+	free(buf);
+	return 0;
+}
+
+// frees the memory allocated by aldl_log_index_open().
+void aldl_log_index_close(aldl_log_index_t* x)
+{
+	free(x->blocks);
+	free(x->values);
+	x->blocks = NULL;
+	x->values = NULL;
+	x->num_blocks = 0;
+}
+
+// returns the number of the block that holds the first record at or after t,
+// or -1 if t is before the first block.
+long aldl_log_index_lookup(aldl_log_index_t* x, const struct timeval* t)
+{
+	int64_t usec = (int64_t)t->tv_sec*1000000 + t->tv_usec;
+	unsigned long lo = 0, hi = x->num_blocks, mid;
+
+	if (x->num_blocks == 0 || usec < x->blocks[0].first_time)
+		return -1;
+
+	// the last block that starts at or before t...
+	while (hi - lo > 1)
+	{
+		mid = lo + (hi-lo)/2;
+		if (x->blocks[mid].first_time <= usec)
+			lo = mid;
+		else hi = mid;
+	}
+	// ...unless it ends before t, when the record is the next block's first
+	if (x->blocks[lo].last_time < usec && lo+1 < x->num_blocks)
+		lo++;
+	return lo;
+}
+
+// returns the number of the first block from block from on that may hold a
+// record whose item compares to value as op says, or -1 if there is none.
+long aldl_log_index_find(aldl_log_index_t* x, unsigned long from, aldl_definition* def,
+							unsigned int item, aldl_index_op_t op, float value)
+{
+	uint32_t hash = aldl_definition_hash(def);
+	const aldl_index_block_t* b;
+	int match;
+
+	for (; from < x->num_blocks; from++)
+	{
+		b = x->blocks + from;
+		if (b->definition_hash != hash || item >= b->num_items)
+			continue;
+		// an empty zone map (min > max) matches nothing
+		switch (op)
+		{
+			case ALDL_INDEX_GT: match = (b->max[item] > value); break;
+			case ALDL_INDEX_GE: match = (b->max[item] >= value); break;
+			case ALDL_INDEX_LT: match = (b->min[item] < value); break;
+			case ALDL_INDEX_LE: match = (b->min[item] <= value); break;
+			default: match = (b->min[item] <= value && b->max[item] >= value); break;
+		}
+		if (match && b->min[item] <= b->max[item])
+			return from;
+	}
+	return -1;
+}
@@ -0,0 +1,233 @@
+#ifndef LINUXALDL_INDEX_INCLUDED
+#define LINUXALDL_INDEX_INCLUDED
+
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <sys/time.h>
+#include "linuxaldl_core.h"
+
+// ============================================================================
+// RAW LOG INDEX
+// ============================================================================
+// a raw log file LOG can have a sidecar index, LOG.idx, that lets a reader
+// seek to a time and skip the parts of the log that can't hold the values it
+// is looking for. the index is built while the log is written: the records
+// are grouped into blocks of ALDL_INDEX_BLOCK_RECORDS (more if a block has
+// to wait for a full record to end it), and when a block is
+// complete one entry goes to the index with the block's place in the log,
+// its first and last timestamps, and the smallest and largest value of each
+// item of the definition (a zone map). a block never spans two segments.
+//
+// the entry of a complete block waits in the index writer until the backend
+// writing the log (the writer thread, io_uring, or the sink itself) has
+// written the block's records, and is then written by that backend
+// (aldl_index_writer_next()), so the index never points past the end of
+// the log. once the log can't be written, no more entries are.
+//
+// seeking to a time is a binary search over the entries, and a query such as
+// "RPM above 5000" only has to read (and decode) the blocks whose zone map
+// allows it (aldl_log_index_seek() and aldl_log_index_position() in
+// linuxaldl_reader.h). the log itself is never changed, so a log without an index (or
+// with a stale one) can still be read from the start.
+// the offsets of a compressed log (see linuxaldl_gz.h) are offsets in the
+// log it holds, not in the file.
+//
+// index file, all integers little-endian:
+//   header, ALDL_INDEX_HEADER_SIZE bytes:
+//     0   8  magic, ALDL_INDEX_MAGIC
+//     8   2  format version, ALDL_INDEX_VERSION
+//    10   2  header size, ALDL_INDEX_HEADER_SIZE
+//    12   2  block entry header size, ALDL_INDEX_ENTRY_SIZE
+//    14   2  reserved, 0
+//   block entry, ALDL_INDEX_ENTRY_SIZE bytes followed by the zone map:
+//     0   2  entry mark, ALDL_INDEX_ENTRY_MARK
+//     2   2  number of items in the zone map: entries in mode1_def
+//     4   4  number of records in the block
+//     8   4  aldl_definition_hash() of the segment's definition
+//    12   4  sequence number of the first record
+//    16   8  log file offset of the segment header the block belongs to
+//    24   8  log file offset of the block's first record
+//    32   8  log file offset just past the block's last record
+//    40   8  wall clock time of the first record, microseconds since 1970
+//    48   8  ...and of the last record
+//    56   4  aldl_crc32() of the whole entry, zone map included, with these 4 bytes 0
+//    60   4  reserved, 0
+//     then, for each item, the smallest and the largest value in the block
+//     as IEEE 754 single floats. seperators, and items that no frame in the
+//     block carried, have a smallest value above the largest (+inf, -inf).
+
+#define ALDL_INDEX_MAGIC "ALDLIDX\n"	// 8 bytes
+#define ALDL_INDEX_VERSION 1
+#define ALDL_INDEX_HEADER_SIZE 16
+#define ALDL_INDEX_ENTRY_MARK 0x1dd1u
+#define ALDL_INDEX_ENTRY_SIZE 64
+#define ALDL_INDEX_SUFFIX ".idx"
+#define ALDL_INDEX_BLOCK_RECORDS 256 // records per block
+#define ALDL_INDEX_NO_SEGMENT (~(uint64_t)0) // log_segment before a segment header is written
+#define ALDL_INDEX_QUEUE_ENTRIES 64	// complete entries that can wait for their records
+
+// aldl_index_writer_t: builds the index of a raw log as it is written
+typedef struct _aldl_index_writer
+{
+	int fd;						// index file, -1 if not indexing
+	aldl_definition* definition;
+	uint32_t definition_hash;
+	unsigned int num_items;		// entries in mode1_def
+	unsigned int block_records;	// records per block
+	unsigned int entry_size;	// bytes in an entry, zone map included
+	float* min;					// zone map of the block being built
+	float* max;
+
+	uint64_t log_offset;		// log file offset the next record is written at
+	uint64_t log_segment;		// ...and of the current segment's header
+
+	// the block being built
+	unsigned int records;		// records in it so far, 0 if none
+	uint32_t first_seq;
+	uint64_t segment_offset;
+	uint64_t offset;
+	int64_t first_time;
+	int64_t last_time;
+
+	// complete entries waiting for their records to be written. like the
+	// frame ring, each side reads the other's offset with acquire ordering
+	// and publishes its own with release ordering.
+	unsigned char* queue;		// ALDL_INDEX_QUEUE_ENTRIES entries of entry_size bytes, then min and max
+	uint64_t queue_end[ALDL_INDEX_QUEUE_ENTRIES]; // log offset past the block of each
+	unsigned long queue_head;	// free running: the next entry to write. only stored by the backend.
+	unsigned long queue_tail;	// the next entry to queue. only stored by aldl_index_writer_add().
+	int broken;					// set by the backend once an entry or the log couldn't be written
+
+	// statistics
+	unsigned long blocks;		// entries written
+	unsigned long errors;		// entries that couldn't be written, or were left out after a failure
+	unsigned long dropped;		// entries the queue had no room for. the index stops at the first.
+} aldl_index_writer_t;
+
+// aldl_index_block_t: a block of the log, as read from its index entry
+typedef struct _aldl_index_block
+{
+	unsigned int records;
+	uint32_t definition_hash;
+	uint32_t first_seq;
+	uint64_t segment_offset;
+	uint64_t offset;
+	uint64_t end;
+	int64_t first_time;			// microseconds since 1970
+	int64_t last_time;
+	unsigned int num_items;		// entries in min and max
+	const float* min;			// zone map, in aldl_log_index_t.values
+	const float* max;
+} aldl_index_block_t;
+
+// aldl_log_index_t: the index of a raw log file, read into memory
+typedef struct _aldl_log_index
+{
+	aldl_index_block_t* blocks;	// in the order they were logged
+	unsigned long num_blocks;
+	float* values;				// every block's zone map
+} aldl_log_index_t;
+
+// comparisons for aldl_log_index_find()
+typedef enum _aldl_index_op
+{
+	ALDL_INDEX_GT=0,	// above value
+	ALDL_INDEX_GE=1,	// at or above
+	ALDL_INDEX_LT=2,	// below
+	ALDL_INDEX_LE=3,	// at or below
+	ALDL_INDEX_EQ=4		// equal
+} aldl_index_op_t;
+
+// function prototypes
+// =================================================
+
+// writing
+// -------
+int aldl_index_writer_open(aldl_index_writer_t* w, const char* logfilename, aldl_definition* def);
+// opens (or creates) the index of the raw log logfilename, to add the blocks
+// of records written with def from the current end of the log on. a file
+// that isn't an index is started again.
+// returns 0 on success, -1 on failure (w->fd is -1 and adding does nothing).
+
+void aldl_index_writer_add(aldl_index_writer_t* w, unsigned int length, int header, int key,
+							uint32_t seq, int64_t time, const float* values);
+// adds the next record written to the log: length bytes, the segment header
+// written with it included if header is 1. key is 1 for a full record, 0
+// for a delta record (see linuxaldl_log.h); blocks only start at full
+// records, so a reader can start at any block. time is the record's wall
+// clock time in microseconds (see aldl_raw_log_time()), values its decoded
+// items (mode1_def entries) or NULL if the frame carries no data block.
+// the entry is queued when the block is complete or a new segment starts.
+// records that never reach the log (dropped) must not be added.
+
+void aldl_index_writer_finish(aldl_index_writer_t* w);
+// queues the entry of the last, partly filled block. call it from the
+// thread that adds records, before the backend writing the log is stopped,
+// so the backend writes that entry too.
+
+const unsigned char* aldl_index_writer_next(aldl_index_writer_t* w, uint64_t written);
+// for the backend writing the log: returns the oldest queued entry
+// (w->entry_size bytes, for w->fd) if the log has been written up to the
+// end of its block (written is the log offset the file holds up to), or
+// NULL. it stays queued until aldl_index_writer_done().
+
+void aldl_index_writer_done(aldl_index_writer_t* w, int ok);
+// takes the entry returned by aldl_index_writer_next() off the queue,
+// once it has been written (ok 1) or couldn't be (ok 0). after a failure
+// no more entries are written.
+
+void aldl_index_writer_fail(aldl_index_writer_t* w);
+// for the backend writing the log: records couldn't be written, so no more
+// entries are (they could point past the end of the log).
+
+void aldl_index_writer_write(aldl_index_writer_t* w, uint64_t written);
+// writes every entry aldl_index_writer_next() returns, with write(). for
+// backends that may block: the writer thread, or a sink writing the log itself.
+
+int aldl_index_writer_close(aldl_index_writer_t* w);
+// queues the entry of the last block, writes what the backend has left
+// (call after it has stopped) and closes the index.
+// returns 0 on success, -1 if any entry couldn't be written.
+
+// reading
+// -------
+int aldl_log_index_open(aldl_log_index_t* x, const char* logfilename);
+// reads the index of the raw log logfilename into memory. entries that fail
+// their crc are left out (their blocks can only be found by reading the log).
+// returns 0 on success, -1 if there is no index or it can't be read.
+
+void aldl_log_index_close(aldl_log_index_t* x);
+// frees the memory allocated by aldl_log_index_open().
+
+long aldl_log_index_lookup(aldl_log_index_t* x, const struct timeval* t);
+// returns the number of the block that holds the first record at or after
+// t, found by binary search, or -1 if t is before the first block.
+
+long aldl_log_index_find(aldl_log_index_t* x, unsigned long from, aldl_definition* def,
+							unsigned int item, aldl_index_op_t op, float value);
+// returns the number of the first block from block from on, recorded with
+// def, whose zone map shows it may hold a record whose item (its index in
+// def->mode1_def) compares to value as op says, or -1 if there is none.
+// nothing in the log is read: blocks that are returned still have to be
+// read to find the records that match (see aldl_log_index_position() in
+// linuxaldl_reader.h).
+
+#endif
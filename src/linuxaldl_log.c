@@ -0,0 +1,1370 @@
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include "linuxaldl_log.h"
+#include "linuxaldl_csv.h"
+
+// ============================================================================
+// FORMAT WRITERS
+// ============================================================================
+
+// little-endian stores and loads for the raw format
+static void aldl_put_le16(unsigned char* p, uint16_t v)
+{
+	p[0] = v; p[1] = v>>8;
+}
+
+static void aldl_put_le32(unsigned char* p, uint32_t v)
+{
+	p[0] = v; p[1] = v>>8; p[2] = v>>16; p[3] = v>>24;
+}
+
+static void aldl_put_le64(unsigned char* p, uint64_t v)
+{
+	aldl_put_le32(p, v);
+	aldl_put_le32(p+4, v>>32);
+}
+
+static uint16_t aldl_get_le16(const unsigned char* p)
+{
+	return p[0] | (p[1]<<8);
+}
+
+static uint32_t aldl_get_le32(const unsigned char* p)
+{
+	return p[0] | (p[1]<<8) | (p[2]<<16) | ((uint32_t)p[3]<<24);
+}
+
+static uint64_t aldl_get_le64(const unsigned char* p)
+{
+	return aldl_get_le32(p) | ((uint64_t)aldl_get_le32(p+4)<<32);
+}
+
+// starts a new raw format segment on the open file fd for frames of def.
+// nothing is written until the first record.
+void aldl_raw_log_init(aldl_raw_log_t* raw, int fd, aldl_definition* def)
+{
+	memset(raw, 0, sizeof(aldl_raw_log_t));
+	raw->fd = fd;
+	raw->definition = def;
+}
+
+// fills in a segment header for raw whose time 0 is the monotonic time start
+static void aldl_raw_make_header(aldl_raw_log_t* raw, const struct timespec* start, unsigned char* header)
+{
+	struct timespec mono, real;
+	int64_t ns;
+
+	// the wall clock time of start: now, less the time since start
+	clock_gettime(CLOCK_REALTIME, &real);
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	ns = (int64_t)real.tv_sec*1000000000 + real.tv_nsec
+		- ((int64_t)(mono.tv_sec - start->tv_sec)*1000000000 + (mono.tv_nsec - start->tv_nsec));
+
+	memset(header, 0, ALDL_RAW_HEADER_SIZE);
+	memcpy(header, ALDL_RAW_MAGIC, 8);
+	aldl_put_le16(header+8, raw->delta ? ALDL_RAW_VERSION_DELTA : ALDL_RAW_VERSION);
+	aldl_put_le16(header+10, ALDL_RAW_HEADER_SIZE);
+	aldl_put_le32(header+12, ALDL_RAW_BYTE_ORDER);
+	aldl_put_le32(header+16, aldl_definition_hash(raw->definition));
+	aldl_put_le16(header+20, raw->definition->mode1_data_length);
+	aldl_put_le16(header+22, ALDL_RAW_RECORD_HEADER_SIZE);
+	aldl_put_le64(header+24, ns/1000000000);
+	aldl_put_le32(header+32, (ns%1000000000)/1000);
+	raw->start_time.tv_sec = ns/1000000000;
+	raw->start_time.tv_usec = (ns%1000000000)/1000;
+	strncpy((char*)header+40, raw->definition->name, ALDL_RAW_NAME_SIZE);
+	aldl_put_le32(header+36, aldl_crc32(0, header, ALDL_RAW_HEADER_SIZE));
+}
+
+// returns the nanoseconds from raw's time 0 to the monotonic time received
+static uint64_t aldl_raw_record_time(aldl_raw_log_t* raw, const struct timespec* received)
+{
+	int64_t ns;
+
+	ns = (int64_t)(received->tv_sec - raw->start.tv_sec)*1000000000
+			+ (received->tv_nsec - raw->start.tv_nsec);
+	return (ns < 0) ? 0 : ns;
+}
+
+// fills in the header of the record for a frame received ns after time 0
+static void aldl_raw_make_record(unsigned long seq, uint64_t ns, const char* frame, unsigned int len,
+						unsigned char* rec)
+{
+	aldl_put_le16(rec, ALDL_RAW_RECORD_MARK);
+	aldl_put_le16(rec+2, len);
+	aldl_put_le32(rec+4, seq);
+	aldl_put_le64(rec+8, ns);
+	aldl_put_le32(rec+16, aldl_crc32(aldl_crc32(0, rec, 16), frame, len));
+}
+
+// stores v as a varint at p. returns the number of bytes stored.
+static unsigned int aldl_put_varint(unsigned char* p, uint64_t v)
+{
+	unsigned int n = 0;
+
+	while (v >= 0x80)
+	{
+		p[n++] = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	p[n++] = v;
+	return n;
+}
+
+// reads a varint of at most max bytes from the len bytes at p into *v.
+// returns the number of bytes read, 0 if len ends first, or -1 if it is too long.
+static int aldl_get_varint(const unsigned char* p, unsigned long len, unsigned int max, uint64_t* v)
+{
+	unsigned int n;
+
+	*v = 0;
+	for (n=0; n<max; n++)
+	{
+		if (n >= len)
+			return 0;
+		*v |= (uint64_t)(p[n] & 0x7f) << (7*n);
+		if (!(p[n] & 0x80))
+			return n+1;
+	}
+	return -1;
+}
+
+// stores the delta record of frame, which has the length of raw->prev, in
+// rec. returns the record's size.
+static unsigned int aldl_raw_make_delta(aldl_raw_log_t* raw, unsigned long seq, uint64_t ns,
+						const char* frame, unsigned int len, unsigned char* rec)
+{
+	unsigned char masks[ALDL_RAW_DELTA_MAX_FRAME/8];
+	unsigned int groups = (len+7)/8, gbytes = (groups+7)/8;
+	unsigned int n, i, g;
+	uint64_t usec = (ns - raw->prev_time)/1000;
+
+	rec[0] = ALDL_RAW_DELTA_TAG;
+	n = 1;
+	n += aldl_put_varint(rec+n, usec);
+	n += aldl_put_varint(rec+n, (uint32_t)(seq - raw->prev_seq));
+
+	// which bytes changed, then the group mask and the masks of those groups
+	memset(masks, 0, groups);
+	for (i=0; i<len; i++)
+		if (frame[i] != raw->prev[i])
+			masks[i/8] |= 1 << (i%8);
+	memset(rec+n, 0, gbytes);
+	for (g=0; g<groups; g++)
+		if (masks[g] != 0)
+			rec[n + g/8] |= 1 << (g%8);
+	n += gbytes;
+	for (g=0; g<groups; g++)
+		if (masks[g] != 0)
+			rec[n++] = masks[g];
+	for (i=0; i<len; i++)
+		if (frame[i] != raw->prev[i])
+			rec[n++] = frame[i] ^ raw->prev[i];
+
+	aldl_put_le16(rec+n, aldl_crc32(aldl_crc32(0, rec, n), frame, len) & 0xffff);
+
+	// the reader's times are whole microseconds apart
+	raw->prev_time += usec*1000;
+	return n+2;
+}
+
+// writes one raw format record with a single system call.
+// returns 0 on success, -1 if the record couldn't be written completely.
+int aldl_raw_log_write(aldl_raw_log_t* raw, unsigned long seq, const struct timespec* received,
+						const char* frame, unsigned int len)
+{
+	unsigned char header[ALDL_RAW_HEADER_SIZE];
+	unsigned char rec[ALDL_RAW_RECORD_HEADER_SIZE];
+	char buf[ALDL_RAW_HEADER_SIZE + ALDL_RAW_RECORD_HEADER_SIZE + ALDL_RAW_DELTA_MAX_FRAME];
+	struct iovec iov[3];
+	int n = 0;
+	ssize_t size = 0;
+
+	if (raw->definition == NULL || len > 0xffff)
+		return -1;
+
+	// frames that can be delta encoded are small enough to encode on the stack
+	if (raw->delta && len <= ALDL_RAW_DELTA_MAX_FRAME)
+	{
+		size = aldl_raw_log_encode(raw, seq, received, frame, len, buf);
+		if (write(raw->fd, buf, size) != size)
+		{
+			aldl_raw_log_dropped(raw);
+			return -1;
+		}
+		return 0;
+	}
+
+	// the segment header goes out with the first record, which is time 0
+	raw->last_header = !raw->started;
+	if (!raw->started)
+	{
+		raw->start = *received;
+		aldl_raw_make_header(raw, received, header);
+		iov[n].iov_base = header;
+		iov[n++].iov_len = ALDL_RAW_HEADER_SIZE;
+		size += ALDL_RAW_HEADER_SIZE;
+	}
+
+	raw->prev_time = aldl_raw_record_time(raw, received);
+	aldl_raw_make_record(seq, raw->prev_time, frame, len, rec);
+	iov[n].iov_base = rec;
+	iov[n++].iov_len = ALDL_RAW_RECORD_HEADER_SIZE;
+	iov[n].iov_base = (char*)frame;
+	iov[n++].iov_len = len;
+	size += ALDL_RAW_RECORD_HEADER_SIZE + len;
+
+	if (writev(raw->fd, iov, n) != size)
+		return -1;
+	raw->started = 1;
+	raw->last_key = 1;
+	raw->last_size = size;
+	raw->prev_length = 0; // no delta can follow a frame this long
+	return 0;
+}
+
+// stores what aldl_raw_log_write() would write in buf.
+// returns the number of bytes stored, or 0 if the frame is too long.
+unsigned int aldl_raw_log_encode(aldl_raw_log_t* raw, unsigned long seq, const struct timespec* received,
+						const char* frame, unsigned int len, char* buf)
+{
+	unsigned int n = 0;
+	uint64_t ns;
+
+	if (raw->definition == NULL || len > 0xffff)
+		return 0;
+
+	raw->last_header = !raw->started;
+	if (!raw->started)
+	{
+		raw->start = *received;
+		aldl_raw_make_header(raw, received, (unsigned char*)buf);
+		n = ALDL_RAW_HEADER_SIZE;
+		raw->started = 1;
+	}
+	ns = aldl_raw_record_time(raw, received);
+
+	// a delta needs a frame of the same length before it in this segment,
+	// and a sequence number that goes forward
+	raw->last_key = !raw->delta || raw->last_header || len != raw->prev_length
+					|| raw->since_key >= ALDL_RAW_KEYFRAME_INTERVAL
+					|| ns < raw->prev_time || (uint32_t)(seq - raw->prev_seq) > 0x7fffffff;
+	if (raw->last_key)
+	{
+		aldl_raw_make_record(seq, ns, frame, len, (unsigned char*)buf+n);
+		memcpy(buf + n + ALDL_RAW_RECORD_HEADER_SIZE, frame, len);
+		n += ALDL_RAW_RECORD_HEADER_SIZE + len;
+		raw->since_key = 1;
+		raw->prev_time = ns;
+	}
+	else
+	{
+		n += aldl_raw_make_delta(raw, seq, ns, frame, len, (unsigned char*)buf+n);
+		raw->since_key++;
+	}
+
+	raw->prev_seq = seq;
+	raw->prev_length = (raw->delta && len <= ALDL_RAW_DELTA_MAX_FRAME) ? len : 0;
+	if (raw->prev_length != 0)
+		memcpy(raw->prev, frame, len);
+	raw->last_size = n;
+	return n;
+}
+
+// tells raw the record last encoded never reached the file.
+void aldl_raw_log_dropped(aldl_raw_log_t* raw)
+{
+	// the next record has to start the segment instead
+	if (raw->last_header)
+		raw->started = 0;
+	// and can't be a delta from a frame that isn't in the file
+	raw->prev_length = 0;
+}
+
+// returns the wall clock time in microseconds a reader of the log will give
+// the record last encoded or written.
+int64_t aldl_raw_log_time(const aldl_raw_log_t* raw)
+{
+	// the same sum aldl_log_reader_next() makes from the record's nanoseconds
+	return (int64_t)raw->start_time.tv_sec*1000000 + raw->start_time.tv_usec + raw->prev_time/1000;
+}
+
+// returns 1 if buf starts with a segment header's magic, 0 otherwise.
+int aldl_raw_is_header(const char* buf, unsigned long len)
+{
+	return len >= 8 && memcmp(buf, ALDL_RAW_MAGIC, 8) == 0;
+}
+
+// reads the segment header at buf into h. returns the header's size, 0 if
+// len is too short to hold it, or -1 if it isn't a valid header.
+long aldl_raw_parse_header(const char* buf, unsigned long len, aldl_raw_header_t* h)
+{
+	const unsigned char* p = (const unsigned char*)buf;
+	unsigned char copy[ALDL_RAW_HEADER_SIZE];
+	unsigned int size;
+
+	if (len < 12)
+		return 0;
+	if (!aldl_raw_is_header(buf, len)
+		|| (aldl_get_le16(p+8) != ALDL_RAW_VERSION && aldl_get_le16(p+8) != ALDL_RAW_VERSION_DELTA))
+		return -1;
+	size = aldl_get_le16(p+10);
+	if (size != ALDL_RAW_HEADER_SIZE)
+		return -1;
+	if (len < size)
+		return 0;
+
+	// the crc is of the header with the crc field 0
+	memcpy(copy, p, ALDL_RAW_HEADER_SIZE);
+	memset(copy+36, 0, 4);
+	if (aldl_get_le32(p+12) != ALDL_RAW_BYTE_ORDER
+		|| aldl_crc32(0, copy, ALDL_RAW_HEADER_SIZE) != aldl_get_le32(p+36))
+		return -1;
+
+	h->version = aldl_get_le16(p+8);
+	h->header_size = size;
+	h->definition_hash = aldl_get_le32(p+16);
+	h->data_length = aldl_get_le16(p+20);
+	h->record_header_size = aldl_get_le16(p+22);
+	h->start.tv_sec = (int64_t)aldl_get_le64(p+24);
+	h->start.tv_usec = aldl_get_le32(p+32);
+	memcpy(h->name, p+40, ALDL_RAW_NAME_SIZE);
+	h->name[ALDL_RAW_NAME_SIZE] = 0;
+
+	if (h->record_header_size != ALDL_RAW_RECORD_HEADER_SIZE)
+		return -1;
+	return size;
+}
+
+// reads the record at buf into rec. returns the record's size, 0 if buf
+// ends before the record does, or -1 if it isn't a valid record.
+long aldl_raw_parse_record(const char* buf, unsigned long len, aldl_raw_record_t* rec)
+{
+	const unsigned char* p = (const unsigned char*)buf;
+	unsigned int length;
+
+	if (len >= 2 && aldl_get_le16(p) != ALDL_RAW_RECORD_MARK)
+		return -1;
+	if (len < ALDL_RAW_RECORD_HEADER_SIZE)
+		return 0;
+	length = aldl_get_le16(p+2);
+	if (len < ALDL_RAW_RECORD_HEADER_SIZE + length)
+		return 0;
+	if (aldl_crc32(aldl_crc32(0, p, 16), p + ALDL_RAW_RECORD_HEADER_SIZE, length) != aldl_get_le32(p+16))
+		return -1;
+
+	rec->length = length;
+	rec->seq = aldl_get_le32(p+4);
+	rec->time = aldl_get_le64(p+8);
+	rec->frame = buf + ALDL_RAW_RECORD_HEADER_SIZE;
+	return ALDL_RAW_RECORD_HEADER_SIZE + length;
+}
+
+// reads the delta record at buf, which follows the record prev, into rec
+// and rebuilds the frame in frame. returns the record's size, 0 if buf ends
+// before the record does, or -1 if it isn't a valid delta record.
+long aldl_raw_parse_delta(const char* buf, unsigned long len, const aldl_raw_record_t* prev,
+							char* frame, aldl_raw_record_t* rec)
+{
+	const unsigned char* p = (const unsigned char*)buf;
+	const unsigned char* groupmask;
+	const unsigned char* masks;
+	const unsigned char* xor;
+	unsigned int groups = (prev->length+7)/8, gbytes = (groups+7)/8;
+	unsigned int nmasks = 0, changed = 0, i, g, k;
+	uint64_t usec, seq;
+	unsigned long n = 1;
+	int res;
+
+	if (len >= 1 && p[0] != ALDL_RAW_DELTA_TAG)
+		return -1;
+	if (prev->length == 0 || prev->length > ALDL_RAW_DELTA_MAX_FRAME)
+		return -1;
+	if (len < 1)
+		return 0;
+	res = aldl_get_varint(p+n, len-n, 10, &usec);
+	if (res <= 0)
+		return res;
+	n += res;
+	res = aldl_get_varint(p+n, len-n, 5, &seq);
+	if (res <= 0)
+		return res;
+	n += res;
+
+	// the masks say how many bytes follow. none may point past the frame.
+	groupmask = p + n;
+	if (n + gbytes > len)
+		return 0;
+	for (g=0; g<gbytes*8; g++)
+		if (groupmask[g/8] & (1 << (g%8)))
+		{
+			if (g >= groups)
+				return -1;
+			nmasks++;
+		}
+	masks = groupmask + gbytes;
+	n += gbytes + nmasks;
+	if (n > len)
+		return 0;
+	for (g=0, k=0; g<groups; g++)
+		if (groupmask[g/8] & (1 << (g%8)))
+		{
+			if (masks[k] == 0 || (prev->length - g*8 < 8 && (masks[k] >> (prev->length - g*8)) != 0))
+				return -1;
+			changed += __builtin_popcount(masks[k++]);
+		}
+	xor = masks + nmasks;
+	n += changed;
+	if (n + 2 > len)
+		return 0;
+
+	// rebuild the frame. xor again puts it back if the crc doesn't match.
+	if (frame != prev->frame)
+		memcpy(frame, prev->frame, prev->length);
+	for (res=0; res<2; res++)
+	{
+		for (g=0, k=0, changed=0; g<groups; g++)
+			if (groupmask[g/8] & (1 << (g%8)))
+			{
+				for (i=0; i<8; i++)
+					if (masks[k] & (1 << i))
+						frame[g*8 + i] ^= xor[changed++];
+				k++;
+			}
+		if (res == 0 && (aldl_crc32(aldl_crc32(0, p, n), frame, prev->length) & 0xffff) == aldl_get_le16(p+n))
+		{
+			rec->length = prev->length;
+			rec->seq = prev->seq + (uint32_t)seq;
+			rec->time = prev->time + usec*1000;
+			rec->frame = frame;
+			return n+2;
+		}
+	}
+	return -1;
+}
+
+// writes the csv header line for def.
+void aldl_log_write_csv_header(FILE* f, aldl_definition* def)
+{
+	byte_def_t* items = def->mode1_def;
+	int i;
+
+	// print the timestamp label
+	fprintf(f,"Timestamp");
+
+	// until at the end of the items in the definition
+	for (i=0; items[i].label!=NULL; i++)
+	{
+		if (items[i].operation!=ALDL_OP_SEPERATOR)
+		{
+			putc(',',f);
+			aldl_csv_write_field(f, items[i].label);
+		}
+	}
+	putc('\n',f);
+}
+
+// writes one csv data line from the formatted value of each item.
+void aldl_log_write_csv_line(FILE* f, aldl_definition* def, const struct timeval* timestamp, const char* slots)
+{
+	byte_def_t* items = def->mode1_def;
+	char time[ALDL_CSV_TIME_SIZE];
+	int i;
+
+	// write the timestamp
+	fwrite(time, 1, aldl_csv_format_time(time, timestamp), f);
+
+	// until at the end of the items in the definition...
+	for (i=0; items[i].label!=NULL; i++)
+	{
+		// if the item is not a seperator, write the value
+		if (items[i].operation != ALDL_OP_SEPERATOR)
+		{
+			putc(',',f);
+			fputs(slots + i*ALDL_STRING_SLOT_SIZE, f);
+		}
+	}
+	putc('\n',f); // end the line
+}
+
+// stores one csv data line in buf, which has size bytes.
+// returns the length of the line, or -1 if it doesn't fit.
+int aldl_log_format_csv_line(char* buf, unsigned int size, aldl_definition* def,
+						const struct timeval* timestamp, const char* slots)
+{
+	byte_def_t* items = def->mode1_def;
+	unsigned int n, len;
+	int i;
+
+	if (size < ALDL_CSV_TIME_SIZE)
+		return -1;
+	n = aldl_csv_format_time(buf, timestamp);
+
+	for (i=0; items[i].label!=NULL; i++)
+	{
+		if (items[i].operation != ALDL_OP_SEPERATOR)
+		{
+			len = strlen(slots + i*ALDL_STRING_SLOT_SIZE);
+			if (n + 1 + len >= size)
+				return -1;
+			buf[n++] = ',';
+			memcpy(buf+n, slots + i*ALDL_STRING_SLOT_SIZE, len);
+			n += len;
+		}
+	}
+	buf[n++] = '\n';
+	return n;
+}
+
+// ============================================================================
+// BACKGROUND WRITER
+// ============================================================================
+// the producer only stores tail and the writer thread only stores head, both
+// under lock. the writer copies the two offsets, lets go of the lock and
+// writes the bytes between them; the space is only handed back (by storing
+// head) once they are on their way to the disk, so no system call is ever
+// made with the lock held.
+
+// returns the number of msec from a to b
+static long aldl_log_msec_between(const struct timespec* a, const struct timespec* b)
+{
+	return (b->tv_sec - a->tv_sec)*1000 + (b->tv_nsec - a->tv_nsec)/1000000;
+}
+
+// returns nonzero if the writer thread has something to do before its timeout.
+// call with w->lock held.
+static int aldl_log_writer_ready(aldl_log_writer_t* w)
+{
+	return !w->running || w->tail - w->head >= ALDL_LOG_BATCH_SIZE
+		|| (w->fsync_policy == ALDL_FSYNC_RECORDS && w->pending >= w->fsync_every);
+}
+
+// writes the queued bytes from offset head up to tail, using two iovecs
+// when they wrap around the end of the queue. a compressed file gets them
+// compressed instead, a member at a time.
+// returns 0 on success, -1 if they couldn't all be written.
+static int aldl_log_writer_write(aldl_log_writer_t* w, unsigned long head, unsigned long tail)
+{
+	struct iovec iov[2];
+	unsigned long offset = head % ALDL_LOG_QUEUE_SIZE;
+	unsigned long len = tail - head;
+	ssize_t res;
+	int n;
+
+	if (w->gz.level != 0)
+	{
+		n = (len < ALDL_LOG_QUEUE_SIZE - offset) ? len : ALDL_LOG_QUEUE_SIZE - offset;
+		res = aldl_gz_writer_add(&w->gz, w->fd, w->queue + offset, n);
+		if (aldl_gz_writer_add(&w->gz, w->fd, w->queue, len - n) != 0)
+			res = -1;
+		return res;
+	}
+
+	while (len > 0)
+	{
+		iov[0].iov_base = w->queue + offset;
+		iov[0].iov_len = (len < ALDL_LOG_QUEUE_SIZE - offset) ? len : ALDL_LOG_QUEUE_SIZE - offset;
+		n = 1;
+		if (iov[0].iov_len < len)
+		{
+			iov[1].iov_base = w->queue;
+			iov[1].iov_len = len - iov[0].iov_len;
+			n = 2;
+		}
+		res = writev(w->fd, iov, n);
+		w->writes++;
+		if (res < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		offset = (offset + res) % ALDL_LOG_QUEUE_SIZE;
+		len -= res;
+	}
+	return 0;
+}
+
+// writes the index entries whose records are in the file now, and syncs
+// the index along with the log when sync is 1
+static void aldl_log_writer_write_index(aldl_log_writer_t* w, aldl_index_writer_t* index, int sync)
+{
+	unsigned long blocks = index->blocks;
+
+	aldl_index_writer_write(index, w->written);
+	if (sync && index->blocks != blocks && fdatasync(index->fd) != 0)
+		w->errors++;
+}
+
+// the writer thread: waits for a batch, the flush interval or
+// aldl_log_writer_stop(), writes everything queued and syncs the file
+// when the policy says to. every record queued while a sync is in
+// progress goes out together in the next batch. index entries go out
+// after the records of their blocks.
+static void* aldl_log_writer_thread(void* arg)
+{
+	aldl_log_writer_t* w = (aldl_log_writer_t*)arg;
+	aldl_index_writer_t* index;
+	struct timespec now, deadline, synced;
+	unsigned long head, tail, records = 0, unsynced = 0;
+	unsigned int interval = ALDL_LOG_FLUSH_INTERVAL;
+	int running, sync;
+
+	if (w->fsync_policy == ALDL_FSYNC_INTERVAL && w->fsync_every < interval)
+		interval = w->fsync_every;
+	clock_gettime(CLOCK_MONOTONIC, &synced);
+
+	pthread_mutex_lock(&w->lock);
+	for (;;)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += interval/1000;
+		deadline.tv_nsec += (long)(interval%1000)*1000000;
+		if (deadline.tv_nsec >= 1000000000)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+		while (!aldl_log_writer_ready(w)
+				&& pthread_cond_timedwait(&w->wake, &w->lock, &deadline) != ETIMEDOUT)
+			;
+
+		head = w->head;
+		tail = w->tail;
+		records += w->pending;
+		w->pending = 0;
+		running = w->running;
+		index = w->index;
+		pthread_mutex_unlock(&w->lock);
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		switch (w->fsync_policy)
+		{
+			case ALDL_FSYNC_INTERVAL:
+				sync = !running || aldl_log_msec_between(&synced, &now) >= (long)w->fsync_every;
+				break;
+			case ALDL_FSYNC_RECORDS:
+				sync = !running || records >= w->fsync_every;
+				break;
+			default:
+				sync = 0;
+		}
+
+		if (tail != head)
+		{
+			if (aldl_log_writer_write(w, head, tail) != 0)
+			{
+				w->errors++;
+				if (index != NULL)
+					aldl_index_writer_fail(index);
+			}
+			unsynced += tail - head;
+			w->written += tail - head;
+		}
+		// only whole members reach a compressed file, so what is synced
+		// (or left when the writer stops) has to be completed first
+		if (w->gz.level != 0 && (sync || !running) && aldl_gz_writer_flush(&w->gz, w->fd) != 0)
+		{
+			w->errors++;
+			if (index != NULL)
+				aldl_index_writer_fail(index);
+		}
+		// the log offset the file holds up to: only the members
+		// written, for a compressed file
+		if (w->gz.level != 0)
+			w->written = w->gz.offset;
+
+		if (sync && unsynced != 0)
+		{
+			// a pipe or terminal can't be synced, and doesn't need to be
+			if (fdatasync(w->fd) != 0 && errno != EINVAL)
+				w->errors++;
+			w->syncs++;
+			unsynced = 0;
+			records = 0;
+			synced = now;
+		}
+		if (index != NULL)
+			aldl_log_writer_write_index(w, index, sync);
+
+		pthread_mutex_lock(&w->lock);
+		w->head = tail;
+		if (!running && w->head == w->tail)
+			break;
+	}
+	pthread_mutex_unlock(&w->lock);
+	return NULL;
+}
+
+// sets up an empty queue for the open file fd and starts the writer
+// thread, compressing the file with zlib level compress unless it is 0.
+// returns 0 on success, -1 on failure.
+int aldl_log_writer_start(aldl_log_writer_t* w, int fd, aldl_fsync_policy_t policy, unsigned int every,
+							int compress)
+{
+	pthread_condattr_t attr;
+	void* queue;
+	int64_t length;
+
+	memset(w, 0, sizeof(aldl_log_writer_t));
+	w->fd = fd;
+	w->fsync_policy = policy;
+	w->fsync_every = every;
+	// the index counts from the end of the file as well
+	length = lseek(fd, 0, SEEK_END);
+	w->written = (length > 0) ? length : 0;
+
+	// members added to a compressed log carry on from where it ends
+	if (compress != 0)
+	{
+		length = aldl_gz_length(fd);
+		if (length < 0)
+		{
+			fprintf(stderr,"The log file isn't empty or a compressed log, so it can't be compressed.\n");
+			return -1;
+		}
+		if (aldl_gz_writer_init(&w->gz, compress, length) != 0)
+			return -1;
+		w->written = length;
+	}
+
+	if (posix_memalign(&queue, ALDL_LOG_PAGE_SIZE, ALDL_LOG_QUEUE_SIZE) != 0)
+	{
+		aldl_gz_writer_free(&w->gz);
+		return -1;
+	}
+	w->queue = queue;
+
+	// the timeouts are measured on the monotonic clock, like everything else
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&w->wake, &attr);
+	pthread_condattr_destroy(&attr);
+	pthread_mutex_init(&w->lock, NULL);
+
+	w->running = 1;
+	if (pthread_create(&w->thread, NULL, aldl_log_writer_thread, w) != 0)
+	{
+		w->running = 0;
+		pthread_cond_destroy(&w->wake);
+		pthread_mutex_destroy(&w->lock);
+		free(w->queue);
+		w->queue = NULL;
+		aldl_gz_writer_free(&w->gz);
+		return -1;
+	}
+	return 0;
+}
+
+// queues one record of len bytes. never waits for the disk.
+// returns 0, or -1 if the queue is full and the record was dropped.
+int aldl_log_writer_put(aldl_log_writer_t* w, const void* data, unsigned long len)
+{
+	unsigned long offset, first, queued;
+
+	pthread_mutex_lock(&w->lock);
+	queued = w->tail - w->head + len;
+	if (queued > ALDL_LOG_QUEUE_SIZE)
+	{
+		w->dropped++;
+		pthread_mutex_unlock(&w->lock);
+		return -1;
+	}
+
+	offset = w->tail % ALDL_LOG_QUEUE_SIZE;
+	first = (len < ALDL_LOG_QUEUE_SIZE - offset) ? len : ALDL_LOG_QUEUE_SIZE - offset;
+	memcpy(w->queue + offset, data, first);
+	memcpy(w->queue, (const char*)data + first, len - first);
+	w->tail += len;
+	w->pending++;
+	w->records++;
+	if (queued > w->peak)
+		w->peak = queued;
+
+	if (aldl_log_writer_ready(w))
+		pthread_cond_signal(&w->wake);
+	pthread_mutex_unlock(&w->lock);
+	return 0;
+}
+
+// has the writer thread write index's entries after their records.
+void aldl_log_writer_index(aldl_log_writer_t* w, aldl_index_writer_t* index)
+{
+	pthread_mutex_lock(&w->lock);
+	w->index = index;
+	pthread_mutex_unlock(&w->lock);
+}
+
+// writes everything still queued, syncs the file, stops the thread and frees the queue.
+// returns 0 on success, -1 if any record was dropped or couldn't be written.
+int aldl_log_writer_stop(aldl_log_writer_t* w)
+{
+	if (w->queue == NULL)
+		return 0;
+
+	pthread_mutex_lock(&w->lock);
+	w->running = 0;
+	pthread_cond_signal(&w->wake);
+	pthread_mutex_unlock(&w->lock);
+	pthread_join(w->thread, NULL);
+
+	pthread_cond_destroy(&w->wake);
+	pthread_mutex_destroy(&w->lock);
+	free(w->queue);
+	w->queue = NULL;
+	aldl_gz_writer_free(&w->gz);
+	return (w->errors != 0 || w->dropped != 0) ? -1 : 0;
+}
+
+// reads an fsync policy: "none", "<N>ms" or "<N>" (records).
+// returns 0 on success, -1 if str isn't one of those.
+int aldl_log_parse_fsync(const char* str, aldl_fsync_policy_t* policy, unsigned int* every)
+{
+	char* end;
+	unsigned long n;
+
+	if (strcmp(str,"none")==0)
+	{
+		*policy = ALDL_FSYNC_NONE;
+		*every = 0;
+		return 0;
+	}
+
+	n = strtoul(str, &end, 10);
+	if (end == str || n == 0 || n > 3600000 || str[0] == '-')
+		return -1;
+	if (strcmp(end,"ms")==0)
+		*policy = ALDL_FSYNC_INTERVAL;
+	else if (*end == 0)
+		*policy = ALDL_FSYNC_RECORDS;
+	else
+		return -1;
+	*every = n;
+	return 0;
+}
+
+// ============================================================================
+// SESSION LOGGER
+// ============================================================================
+
+// hands one encoded record to the logger's backend. now is the monotonic time.
+// returns 0, or -1 if the record was dropped.
+static int aldl_logger_queue(aldl_logger_t* log, const char* record, unsigned int len,
+								const struct timespec* now)
+{
+	if (log->backend == ALDL_LOG_URING)
+		return aldl_log_uring_put(&log->file, record, len, now);
+	return aldl_log_writer_put(&log->writer, record, len);
+}
+
+// writes the csv header line if it hasn't been written yet, through the
+// backend if there is one. returns 0, or -1 if it couldn't be written.
+static int aldl_logger_header(aldl_logger_t* log)
+{
+	struct timespec now;
+	char* line = NULL;
+	size_t len = 0;
+	FILE* f;
+	int res;
+
+	if (!log->header)
+		return 0;
+	log->header = 0;
+	if (log->backend == ALDL_LOG_DIRECT)
+	{
+		aldl_log_write_csv_header(log->stream, log->raw.definition);
+		return 0;
+	}
+
+	// a backend gets it as a record like any other
+	f = open_memstream(&line, &len);
+	if (f == NULL)
+		return -1;
+	aldl_log_write_csv_header(f, log->raw.definition);
+	if (fclose(f) != 0)
+	{
+		free(line);
+		return -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	res = aldl_logger_queue(log, line, len, &now);
+	free(line);
+	return res;
+}
+
+// adds the record of a frame just written (or queued) to the log's index.
+// the entries are written by the backend once their records are, or here
+// when the sink writes the log itself.
+static void aldl_logger_index(aldl_logger_t* log, aldl_session_t* s, unsigned int data_offset)
+{
+	const float* values = NULL;
+
+	if (log->index.fd == -1)
+		return;
+	// the zone maps need the values, which are only decoded where they changed
+	if (data_offset != 0)
+	{
+		aldl_session_update_floats(s);
+		values = s->data_set_floats;
+	}
+	aldl_index_writer_add(&log->index, log->raw.last_size, log->raw.last_header, log->raw.last_key,
+							s->frames, aldl_raw_log_time(&log->raw), values);
+	if (log->backend == ALDL_LOG_DIRECT)
+		aldl_index_writer_write(&log->index, log->index.log_offset);
+}
+
+// session sink: writes each frame to the log
+static void aldl_logger_sink(aldl_session_t* s, const char* frame, unsigned int length,
+							unsigned int data_offset, const struct timeval* timestamp, void* arg)
+{
+	aldl_logger_t* log = (aldl_logger_t*)arg;
+	unsigned int i;
+	int len;
+
+	log->bytes += length;
+	if (data_offset != 0)
+		aldl_col_writer_add(&log->columns, timestamp, frame + data_offset);
+
+	if (log->format == ALDL_LOG_RAW && log->backend != ALDL_LOG_DIRECT)
+	{
+		len = aldl_raw_log_encode(&log->raw, s->frames, &s->frame_time, frame, length, log->record);
+		if (len == 0)
+		{
+			log->errors++;
+			return;
+		}
+		if (aldl_logger_queue(log, log->record, len, &s->frame_time) != 0)
+		{
+			aldl_raw_log_dropped(&log->raw);
+			return;
+		}
+		aldl_logger_index(log, s, data_offset);
+	}
+	else if (log->format == ALDL_LOG_RAW)
+	{
+		if (aldl_raw_log_write(&log->raw, s->frames, &s->frame_time, frame, length) != 0)
+		{
+			log->errors++;
+			return;
+		}
+		aldl_logger_index(log, s, data_offset);
+	}
+	else
+	{
+		// only frames with a data block have values to write
+		if (data_offset == 0)
+			return;
+		if (log->header && aldl_logger_header(log) != 0)
+			log->errors++;
+		aldl_session_update_floats(s);
+		for (i=0; i<s->num_items; i++)
+			aldl_format_slot(s->data_set_floats[i], s->data_set_changed[i], log->formatted+i,
+								log->slots + i*ALDL_STRING_SLOT_SIZE);
+		if (log->backend != ALDL_LOG_DIRECT)
+		{
+			len = aldl_log_format_csv_line(log->record, log->record_size, s->definition,
+											timestamp, log->slots);
+			if (len < 0)
+			{
+				log->errors++;
+				return;
+			}
+			if (aldl_logger_queue(log, log->record, len, &s->frame_time) != 0)
+				return;
+		}
+		else aldl_log_write_csv_line(log->stream, s->definition, timestamp, log->slots);
+	}
+
+	log->frames++;
+	if (log->max_frames != 0 && log->frames >= log->max_frames && log->mux != NULL)
+		aldl_mux_stop(log->mux);
+}
+
+// sets up a logger writing to the open file fd.
+// returns 0 on success, -1 on failure.
+int aldl_logger_open(aldl_logger_t* log, int fd, aldl_log_format_t format, aldl_definition* def)
+{
+	unsigned int num_items;
+
+	memset(log,0,sizeof(aldl_logger_t));
+	log->format = format;
+	log->fd = fd;
+	log->index.fd = -1;
+	log->columns.fd = -1;
+	aldl_raw_log_init(&log->raw, fd, def);
+
+	if (format == ALDL_LOG_CSV)
+	{
+		for (num_items=0; def->mode1_def[num_items].label != NULL; num_items++)
+			;
+
+		// fdopen closes fd when the stream is closed, so use a copy
+		log->stream = fdopen(dup(fd),"a");
+		// one block for the stream buffer, the sequence numbers and the slots
+		log->stream_buf = calloc(1, ALDL_LOG_CSV_BUFSIZE
+								+ num_items*(sizeof(unsigned long) + ALDL_STRING_SLOT_SIZE));
+		if (log->stream == NULL || log->stream_buf == NULL)
+		{
+			if (log->stream != NULL)
+				fclose(log->stream);
+			free(log->stream_buf);
+			return -1;
+		}
+		log->formatted = (unsigned long*)(log->stream_buf + ALDL_LOG_CSV_BUFSIZE);
+		log->slots = (char*)(log->formatted + num_items);
+		setvbuf(log->stream, log->stream_buf, _IOFBF, ALDL_LOG_CSV_BUFSIZE);
+		// written once it is known where to, see aldl_logger_header()
+		log->header = 1;
+	}
+	return 0;
+}
+
+// allocates log->record and writes out any csv lines written so far, so
+// that records can be handed to a backend. returns 0 on success, -1 on failure.
+static int aldl_logger_prepare(aldl_logger_t* log)
+{
+	aldl_definition* def = log->raw.definition;
+	unsigned int num_items;
+
+	// room for the longest record: a raw segment header and the largest
+	// frame, or a csv line with every slot full
+	for (num_items=0; def->mode1_def[num_items].label != NULL; num_items++)
+		;
+	log->record_size = ALDL_RAW_HEADER_SIZE + ALDL_RAW_RECORD_HEADER_SIZE + aldl_definition_max_frame(def);
+	if (log->record_size < 32 + num_items*ALDL_STRING_SLOT_SIZE)
+		log->record_size = 32 + num_items*ALDL_STRING_SLOT_SIZE;
+	log->record = malloc(log->record_size);
+	if (log->record == NULL)
+		return -1;
+
+	// lines written directly go out before any record
+	if (log->stream != NULL && fflush(log->stream) != 0)
+	{
+		free(log->record);
+		log->record = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+// hands everything log writes from now on to a background writer thread.
+// returns 0 on success, -1 on failure (log keeps writing directly).
+int aldl_logger_start_writer(aldl_logger_t* log, aldl_fsync_policy_t policy, unsigned int every)
+{
+	if (log->backend != ALDL_LOG_DIRECT || aldl_logger_prepare(log) != 0)
+		return -1;
+	if (aldl_log_writer_start(&log->writer, log->fd, policy, every, log->compress) != 0)
+	{
+		free(log->record);
+		log->record = NULL;
+		return -1;
+	}
+	log->backend = ALDL_LOG_THREAD;
+	if (log->index.fd != -1)
+		aldl_log_writer_index(&log->writer, &log->index);
+	if (aldl_logger_header(log) != 0)
+		log->errors++;
+	return 0;
+}
+
+// writes everything log writes from now on through u.
+// returns 0 on success, -1 on failure (log keeps writing directly).
+int aldl_logger_start_uring(aldl_logger_t* log, aldl_log_uring_t* u,
+							aldl_fsync_policy_t policy, unsigned int every)
+{
+	if (log->backend != ALDL_LOG_DIRECT || aldl_logger_prepare(log) != 0)
+		return -1;
+	if (aldl_log_uring_open(&log->file, u, log->fd, policy, every) != 0)
+	{
+		free(log->record);
+		log->record = NULL;
+		return -1;
+	}
+	log->backend = ALDL_LOG_URING;
+	if (log->index.fd != -1)
+		log->file.index = &log->index;
+	if (aldl_logger_header(log) != 0)
+		log->errors++;
+	return 0;
+}
+
+// builds an index of the raw log as it is written. logfilename is the name
+// of the file log writes. returns 0 on success, -1 on failure.
+int aldl_logger_start_index(aldl_logger_t* log, const char* logfilename)
+{
+	if (log->format != ALDL_LOG_RAW || log->index.fd != -1
+		|| aldl_index_writer_open(&log->index, logfilename, log->raw.definition) != 0)
+		return -1;
+	// the backend writes the entries, once it has written their records
+	if (log->backend == ALDL_LOG_THREAD)
+		aldl_log_writer_index(&log->writer, &log->index);
+	else if (log->backend == ALDL_LOG_URING)
+		log->file.index = &log->index;
+	return 0;
+}
+
+// writes every frame with a data block to the columnar log filename as well.
+// returns 0 on success, -1 on failure.
+int aldl_logger_start_columns(aldl_logger_t* log, const char* filename)
+{
+	if (log->columns.fd != -1)
+		return -1;
+	return aldl_col_writer_open(&log->columns, filename, log->raw.definition);
+}
+
+// makes log the sink for every frame s receives.
+void aldl_logger_attach(aldl_logger_t* log, aldl_session_t* s)
+{
+	s->sink = aldl_logger_sink;
+	s->sink_arg = log;
+}
+
+// flushes everything written so far to the disk. fd is left open.
+// returns 0 on success, -1 if anything couldn't be written.
+int aldl_logger_close(aldl_logger_t* log)
+{
+	int res = 0;
+
+	// a csv log without a single line still gets its header
+	if (aldl_logger_header(log) != 0)
+		res = -1;
+	// the backend writes the last index entry, after the records it points at
+	aldl_index_writer_finish(&log->index);
+	if (log->backend == ALDL_LOG_THREAD && aldl_log_writer_stop(&log->writer) != 0)
+		res = -1;
+	if (log->backend == ALDL_LOG_URING && aldl_log_uring_close(&log->file) != 0)
+		res = -1;
+	log->backend = ALDL_LOG_DIRECT;
+	free(log->record);
+	log->record = NULL;
+	if (aldl_index_writer_close(&log->index) != 0)
+		res = -1;
+	if (aldl_col_writer_close(&log->columns) != 0)
+		res = -1;
+
+	if (log->stream != NULL)
+	{
+		if (fclose(log->stream) != 0)
+			res = -1;
+		log->stream = NULL;
+		free(log->stream_buf);
+		log->stream_buf = NULL;
+		log->slots = NULL;
+		log->formatted = NULL;
+	}
+	// a pipe or terminal can't be synced, and doesn't need to be
+	if (fsync(log->fd) != 0 && errno != EINVAL)
+		res = -1;
+	if (log->errors != 0)
+		res = -1;
+	return res;
+}
+
+// ============================================================================
+// COMMAND LINE LOGGING
+// ============================================================================
+
+// mux handler for the signalfd and the duration timer of aldl_log_run()
+static void aldl_log_run_stop(aldl_mux_t* mux, int fd, void* arg)
+{
+	struct signalfd_siginfo info; // big enough for a timerfd's count too
+
+	if (read(fd, &info, sizeof(info)) < 0)
+	{ /* already read */ }
+	aldl_mux_stop(mux);
+}
+
+// prints what was logged, and how
+static void aldl_log_run_report(aldl_session_t* s, aldl_logger_t* log, aldl_log_uring_t* uring,
+								const char* colfilename)
+{
+	printf(" %lu frames received, %lu logged, %lu timeouts, %lu bad checksums.\n",
+				s->frames, log->frames, s->timeouts, s->bad_checksums);
+	if (log->writer.records != 0 || log->writer.dropped != 0)
+		printf(" log writer: %lu dropped, %lu KB queued at most, %lu writes, %lu syncs.\n",
+					log->writer.dropped, log->writer.peak/1024, log->writer.writes, log->writer.syncs);
+	if (log->writer.gz.members != 0)
+		printf(" compression: %lu KB of log in %lu KB (%.2f:1), %lu members, %.2f usec of cpu per frame.\n",
+					(unsigned long)(log->writer.gz.bytes_in/1024), (unsigned long)(log->writer.gz.bytes_out/1024),
+					(double)log->writer.gz.bytes_in/log->writer.gz.bytes_out, log->writer.gz.members,
+					log->writer.records ? log->writer.gz.cpu_ns/1000.0/log->writer.records : 0.0);
+	if (uring->buffers != NULL)
+		printf(" log io_uring: %lu dropped, %lu buffers written, %lu syncs, %lu system calls.\n",
+					log->file.dropped, uring->writes, uring->syncs, uring->syscalls);
+	if (log->index.blocks != 0)
+		printf(" index: %lu blocks of up to %u records.\n",log->index.blocks,log->index.block_records);
+	if (log->index.errors != 0 || log->index.dropped != 0)
+		printf(" index: %lu entries not written. it ends early.\n",log->index.errors + log->index.dropped);
+	if (log->columns.chunks_written != 0 || log->columns.dropped != 0)
+		printf(" columns: %lu rows in %lu chunks, %lu dropped. %s is %lu KB.\n",
+					log->columns.rows, log->columns.chunks_written, log->columns.dropped,
+					colfilename, (unsigned long)(log->columns.bytes/1024));
+}
+
+// logs every frame s receives to opts->filename until SIGINT or SIGTERM
+// arrives or a limit in opts is reached.
+// returns the number of frame bytes received, or -1 on failure.
+long aldl_log_run(aldl_session_t* s, const aldl_log_options_t* opts)
+{
+	aldl_logger_t log;
+	aldl_log_uring_t uring;
+	aldl_mux_t mux;
+	sigset_t stop_signals, old_mask;
+	struct timespec no_wait = { 0, 0 };
+	struct itimerspec its;
+	struct stat st;
+	char* colfilename = NULL;
+	int fd, sigfd = -1, timerfd = -1, created;
+	long res = 0;
+
+	uring.buffers = NULL;
+	if (aldl_mux_init(&mux) != 0)
+	{
+		fprintf(stderr,"Couldn't set up the acquisition loop: %s\n",strerror(errno));
+		return -1;
+	}
+	if (aldl_mux_add(&mux, s) != 0)
+	{
+		fprintf(stderr,"Couldn't set up the acquisition loop: %s\n",strerror(errno));
+		aldl_mux_destroy(&mux);
+		return -1;
+	}
+
+	// stop cleanly on ctrl-c, kill, or when the duration runs out. the
+	// signals are blocked before any thread is started, so they all leave
+	// them to the signalfd.
+	sigemptyset(&stop_signals);
+	sigaddset(&stop_signals, SIGINT);
+	sigaddset(&stop_signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &stop_signals, &old_mask);
+	sigfd = signalfd(-1, &stop_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (sigfd == -1 || aldl_mux_watch(&mux, sigfd, aldl_log_run_stop, NULL) != 0)
+	{
+		fprintf(stderr,"Couldn't watch for signals: %s\n",strerror(errno));
+		res = -1;
+		goto done;
+	}
+	if (opts->max_duration != 0)
+	{
+		memset(&its, 0, sizeof(its));
+		its.it_value.tv_sec = opts->max_duration;
+		timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (timerfd == -1 || timerfd_settime(timerfd, 0, &its, NULL) != 0
+			|| aldl_mux_watch(&mux, timerfd, aldl_log_run_stop, NULL) != 0)
+		{
+			fprintf(stderr,"Couldn't set up the duration timer: %s\n",strerror(errno));
+			res = -1;
+			goto done;
+		}
+	}
+
+	// read too, to carry on a compressed log
+	created = (stat(opts->filename, &st) != 0 && errno == ENOENT);
+	fd = open(opts->filename, O_RDWR | O_CREAT | O_APPEND, 0666);
+	if (fd == -1)
+	{
+		fprintf(stderr,"Error: couldn't open log file %s: %s\n",opts->filename,strerror(errno));
+		res = -1;
+		goto done;
+	}
+	if (aldl_logger_open(&log, fd, opts->format, s->definition) != 0)
+	{
+		fprintf(stderr,"Couldn't set up the log file.\n");
+		close(fd);
+		if (created)
+			unlink(opts->filename);
+		res = -1;
+		goto done;
+	}
+	log.max_frames = opts->max_frames;
+	log.mux = &mux;
+	log.raw.delta = opts->compact;
+	log.compress = opts->compress;
+	aldl_logger_attach(&log, s);
+	// a raw log can be searched by time and value with its index
+	if (opts->format == ALDL_LOG_RAW && opts->index && aldl_logger_start_index(&log, opts->filename) != 0)
+		fprintf(stderr,"Couldn't open an index for %s. Logging without one.\n",opts->filename);
+	if (opts->columns)
+	{
+		colfilename = aldl_col_filename(opts->filename);
+		if (colfilename == NULL || aldl_logger_start_columns(&log, colfilename) != 0)
+			fprintf(stderr,"Couldn't open a columnar log for %s. Logging without one.\n",opts->filename);
+	}
+	// the disk is written from a thread of its own or through io_uring,
+	// so it can't delay polling. without io_uring the writer thread does it.
+	if (opts->backend == ALDL_LOG_URING)
+	{
+		if (aldl_log_uring_init(&uring) != 0)
+			fprintf(stderr,"io_uring isn't available (%s). Using the log writer thread.\n",strerror(errno));
+		else if (aldl_log_uring_watch(&uring, &mux) != 0
+				|| aldl_logger_start_uring(&log, &uring, opts->fsync_policy, opts->fsync_every) != 0)
+			fprintf(stderr,"Couldn't set up io_uring for the log file. Using the log writer thread.\n");
+	}
+	if (log.backend == ALDL_LOG_DIRECT
+		&& aldl_logger_start_writer(&log, opts->fsync_policy, opts->fsync_every) != 0)
+		fprintf(stderr,"Couldn't start the log writer thread. Writing directly.\n");
+
+	printf("Logging to %s. Press Ctrl-C to stop.\n",opts->filename);
+	if (aldl_mux_run(&mux) != 0) // sends mode 9 before it returns
+		res = -1;
+
+	if (aldl_logger_close(&log) != 0)
+	{
+		fprintf(stderr,"Error: some records couldn't be written to the log file.\n");
+		res = -1;
+	}
+	aldl_log_run_report(s, &log, &uring, colfilename);
+	if (uring.buffers != NULL)
+		aldl_log_uring_destroy(&uring);
+	free(colfilename);
+	close(fd);
+	if (s->state == ALDL_SESSION_FAILED)
+	{
+		fprintf(stderr,"Error: %s failed: %s\n",s->portname,strerror(s->error));
+		res = -1;
+	}
+	if (res == 0)
+		res = log.bytes;
+
+done:
+	aldl_mux_destroy(&mux);
+	if (timerfd != -1)
+		close(timerfd);
+	if (sigfd != -1)
+		close(sigfd);
+	// a second ctrl-c that came in while the log was closed is taken here
+	// rather than when the signals are unblocked
+	while (sigtimedwait(&stop_signals, NULL, &no_wait) > 0)
+		;
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+	return res;
+}
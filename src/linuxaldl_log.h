@@ -0,0 +1,404 @@
+#ifndef LINUXALDL_LOG_INCLUDED
+#define LINUXALDL_LOG_INCLUDED
+
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "linuxaldl_session.h"
+#include "linuxaldl_uring.h"
+#include "linuxaldl_index.h"
+#include "linuxaldl_gz.h"
+#include "linuxaldl_columns.h"
+
+// ============================================================================
+// LOG FILE WRITERS
+// ============================================================================
+// the log formats shared by the GUI and the command line logger.
+//
+// raw (version 2): every integer is little-endian, whatever the platform.
+//   the file is one or more segments: each time logging starts a segment
+//   header is written, followed by one record per frame.
+//   segment header, ALDL_RAW_HEADER_SIZE bytes:
+//     0   8  magic, ALDL_RAW_MAGIC
+//     8   2  format version, ALDL_RAW_VERSION
+//    10   2  header size, ALDL_RAW_HEADER_SIZE
+//    12   4  byte order mark, ALDL_RAW_BYTE_ORDER (reads as 0x04030201 on a big-endian machine)
+//    16   4  aldl_definition_hash() of the definition
+//    20   2  mode1 data length of the definition
+//    22   2  record header size, ALDL_RAW_RECORD_HEADER_SIZE
+//    24   8  wall clock time of the segment's time 0: seconds since 1970 (signed)
+//    32   4  ...and microseconds
+//    36   4  aldl_crc32() of the whole header with these 4 bytes 0
+//    40  64  definition name, NUL padded (and truncated to fit)
+//   104  24  reserved, 0
+//   record, ALDL_RAW_RECORD_HEADER_SIZE bytes followed by the frame:
+//     0   2  record mark, ALDL_RAW_RECORD_MARK
+//     2   2  frame length
+//     4   4  sequence number: the frame's number among those the session
+//            received, so a gap means frames that weren't logged
+//     8   8  nanoseconds from the segment's time 0 to when the frame was
+//            received, from CLOCK_MONOTONIC: never goes backwards
+//    16   4  aldl_crc32() of bytes 0-15 of the record and then the frame
+//     the whole frame follows, header through checksum.
+//   each record is written with a single writev(), so records from one
+//   writer never interleave. a record cut short (by a crash or a full disk)
+//   is found by its length or crc.
+// raw with delta records (version 3): the same segment header with format
+//   version ALDL_RAW_VERSION_DELTA, and the same (full) records, but between
+//   them most frames are stored as the difference from the frame before:
+//     0   1  ALDL_RAW_DELTA_TAG
+//        ..  microseconds since the previous record, as a varint
+//        ..  sequence number less the previous record's, as a varint
+//        ..  group mask: one bit (lowest first) for each 8 bytes of the frame,
+//            set if any of them changed; (length+7)/8 bits rounded up to bytes
+//        ..  for each set group bit, a byte with a bit for each byte of the
+//            group that changed
+//        ..  for each changed byte, the new value xor the previous one
+//         2  low 16 bits of the aldl_crc32() of the record so far and then
+//            the rebuilt frame
+//   a varint is 7 bits per byte, lowest first, with the top bit set on every
+//   byte but the last. the frame has the previous frame's length. a full
+//   record (a keyframe) is written at least every ALDL_RAW_KEYFRAME_INTERVAL
+//   records, whenever the length changes, and after a record is dropped, so
+//   reading can start at any full record and a damaged record only loses
+//   the frames up to the next one. a $DF frame where a few bytes changed
+//   takes around 10 bytes instead of 87.
+// csv: RFC4180 (http://tools.ietf.org/html/rfc4180). a header line with
+//   "Timestamp" and the label of every item in the definition, then one line
+//   per decoded frame with the timestamp as seconds+fraction and each value
+//   with one decimal place. a value is only formatted again when its bytes
+//   change. a label is quoted if it has a comma, quote or line break in it.
+//   whole logs are best written with an aldl_csv_encoder_t (linuxaldl_csv.h).
+//
+// background writer: an aldl_log_writer_t takes encoded records from the
+// thread receiving frames through a bounded queue, and a thread of its own
+// writes them to the file in large batches and syncs the file as its
+// aldl_fsync_policy_t says. queueing a record never waits for the disk: if
+// the queue is full the record is dropped and counted instead, so a slow
+// card or stick can't hold up the next poll. the same thread writes the
+// entries of the log's index (see aldl_log_writer_index()) once the records
+// of their blocks are in the file.
+//
+// aldl_log_run() puts all of it together for a command line logger: it logs
+// one session to a file, with an index, a columnar log and compression as
+// asked, until it is interrupted or a limit is reached.
+
+#define ALDL_LOG_CSV_BUFSIZE 65536 // stdio buffer for csv log files
+
+#define ALDL_LOG_QUEUE_SIZE (1024*1024) // bytes the background writer can hold. a multiple of ALDL_LOG_PAGE_SIZE.
+#define ALDL_LOG_PAGE_SIZE 4096		// alignment of the writer's queue
+#define ALDL_LOG_BATCH_SIZE 65536	// the writer wakes when this many bytes are queued...
+#define ALDL_LOG_FLUSH_INTERVAL 250	// ...or this many msec after it last wrote
+#define ALDL_LOG_DEFAULT_FSYNC ALDL_FSYNC_INTERVAL
+#define ALDL_LOG_DEFAULT_FSYNC_EVERY 1000 // msec
+
+#define ALDL_RAW_MAGIC "ALDLRAW\n"	// 8 bytes
+#define ALDL_RAW_VERSION 2
+#define ALDL_RAW_HEADER_SIZE 128
+#define ALDL_RAW_BYTE_ORDER 0x01020304u
+#define ALDL_RAW_NAME_SIZE 64
+#define ALDL_RAW_RECORD_MARK 0xd1a1u
+#define ALDL_RAW_RECORD_HEADER_SIZE 20
+#define ALDL_RAW_VERSION_DELTA 3	// format version of segments with delta records
+#define ALDL_RAW_DELTA_TAG 0xd5
+#define ALDL_RAW_KEYFRAME_INTERVAL 256 // records from one full record to the next, at most.
+									// the same as ALDL_INDEX_BLOCK_RECORDS, so index blocks
+									// start at full records.
+#define ALDL_RAW_DELTA_MAX_FRAME 256 // longer frames are always stored in full records
+
+// aldl_log_writer_t: a queue of bytes for a file and the thread that writes them
+typedef struct _aldl_log_writer
+{
+	int fd;
+	char* queue;				// ALDL_LOG_QUEUE_SIZE bytes, ALDL_LOG_PAGE_SIZE aligned
+	unsigned long head;			// free running offset of the next byte to write. only stored by the writer thread.
+	unsigned long tail;			// free running offset of the next byte to queue. only stored by the producer.
+	unsigned long pending;		// records queued since the last sync
+	pthread_mutex_t lock;		// protects head, tail, pending and running
+	pthread_cond_t wake;		// signals the writer thread (CLOCK_MONOTONIC)
+	pthread_t thread;
+	int running;				// cleared by aldl_log_writer_stop()
+	aldl_index_writer_t* index;	// the log's index, NULL if none. set under lock.
+	uint64_t written;			// log offset the file holds up to. only used by the writer thread.
+
+	aldl_fsync_policy_t fsync_policy;
+	unsigned int fsync_every;	// msec for ALDL_FSYNC_INTERVAL, records for ALDL_FSYNC_RECORDS
+
+	// statistics
+	unsigned long records;		// records queued
+	unsigned long dropped;		// records dropped because the queue was full
+	unsigned long peak;			// most bytes ever waiting in the queue
+	unsigned long writes;		// write system calls
+	unsigned long syncs;		// fdatasync calls
+	unsigned long errors;		// batches that couldn't be written or synced
+
+	aldl_gz_writer_t gz;		// compresses the file, if gz.level isn't 0. for a compressed
+								// file writes stays 0, and gz has the statistics.
+} aldl_log_writer_t;
+
+// how an aldl_logger_t gets records to its file
+typedef enum _aldl_log_backend {
+	ALDL_LOG_DIRECT=0,	// written by the sink itself
+	ALDL_LOG_THREAD=1,	// queued for an aldl_log_writer_t
+	ALDL_LOG_URING=2	// batched through an aldl_log_uring_t (linuxaldl_uring.h)
+} aldl_log_backend_t;
+
+// aldl_raw_log_t: writes raw format records to a file
+typedef struct _aldl_raw_log
+{
+	int fd;
+	aldl_definition* definition;
+	int started;				// 1 once the segment header has been written
+	struct timespec start;		// CLOCK_MONOTONIC time 0 of the segment
+	struct timeval start_time;	// its wall clock time, as written in the segment header
+
+	// delta records. set delta before the first frame is written.
+	int delta;					// 1 to write delta records between full ones (version 3)
+	unsigned int since_key;		// records since the last full record
+	uint32_t prev_seq;			// the last record: its sequence number,
+	uint64_t prev_time;			// time from time 0 (ns) as a reader rebuilds it,
+	unsigned int prev_length;	// length (0 if a delta can't follow it)
+	char prev[ALDL_RAW_DELTA_MAX_FRAME]; // and frame
+
+	// the last record encoded or written
+	int last_header;			// 1 if the segment header went out with it
+	int last_key;				// 1 if it was a full record
+	unsigned int last_size;		// its size, segment header included
+} aldl_raw_log_t;
+
+// a raw format segment header, as read by aldl_raw_parse_header()
+typedef struct _aldl_raw_header
+{
+	unsigned int version;
+	unsigned int header_size;
+	unsigned int record_header_size;
+	uint32_t definition_hash;
+	unsigned int data_length;	// mode1 data length of the definition
+	struct timeval start;		// wall clock time of time 0
+	char name[ALDL_RAW_NAME_SIZE+1]; // definition name
+} aldl_raw_header_t;
+
+// a raw format record, as read by aldl_raw_parse_record()
+typedef struct _aldl_raw_record
+{
+	uint32_t seq;				// sequence number
+	uint64_t time;				// nanoseconds from the segment's time 0
+	unsigned int length;		// frame length
+	const char* frame;			// the frame, in the buffer that was parsed
+} aldl_raw_record_t;
+
+// aldl_logger_t: writes the frames received by a session to a log file
+typedef struct _aldl_logger
+{
+	aldl_log_format_t format;
+	int fd;					// log file
+	aldl_raw_log_t raw;		// writer for the raw format
+	FILE* stream;			// buffered stream on fd for the csv format
+	char* stream_buf;		// its buffer
+	char* slots;			// csv: the formatted value of each item, ALDL_STRING_SLOT_SIZE bytes each
+	unsigned long* formatted; // csv: the session's data_set_seq each slot was formatted at
+	aldl_log_backend_t backend;	// set by aldl_logger_start_writer() or aldl_logger_start_uring()
+	aldl_log_writer_t writer;	// ALDL_LOG_THREAD: the writer. its statistics are kept after closing.
+	aldl_log_uring_file_t file;	// ALDL_LOG_URING: the file's buffers on the shared aldl_log_uring_t
+	char* record;			// a record being encoded for the writer
+	unsigned int record_size;	// size of record
+	aldl_index_writer_t index;	// raw: builds the log's index. see aldl_logger_start_index().
+
+	unsigned long max_frames;	// stop the session's mux after this many frames. 0 for no limit.
+	aldl_mux_t* mux;			// mux to stop when max_frames is reached
+
+	// statistics
+	unsigned long frames;	// frames written
+	unsigned long bytes;	// frame bytes received (not counting timestamps)
+	unsigned long errors;	// records that couldn't be written
+
+	int compress;			// zlib level for aldl_logger_start_writer() to compress the
+							// file with, 0 not to. set after aldl_logger_open().
+	int header;				// csv: 1 until the header line has been written
+	aldl_col_writer_t columns;	// writes a columnar log too. see aldl_logger_start_columns().
+} aldl_logger_t;
+
+// aldl_log_options_t: what aldl_log_run() logs, and how
+typedef struct _aldl_log_options
+{
+	const char* filename;		// the log file, created if it isn't there. the index
+								// and columnar log are named after it.
+	aldl_log_format_t format;
+	aldl_log_backend_t backend;	// ALDL_LOG_THREAD, or ALDL_LOG_URING (the thread if io_uring
+								// isn't available)
+	aldl_fsync_policy_t fsync_policy;
+	unsigned int fsync_every;
+	int index;					// 1 to build an index of a raw log
+	int compact;				// 1 to write a raw log with delta records
+	int compress;				// zlib level to compress the log with, 0 not to
+	int columns;				// 1 to write a columnar log as well
+	unsigned long max_frames;	// stop after this many frames are logged, 0 for no limit
+	unsigned int max_duration;	// stop after this many seconds, 0 for no limit
+} aldl_log_options_t;
+
+// function prototypes
+// =================================================
+
+void aldl_raw_log_init(aldl_raw_log_t* raw, int fd, aldl_definition* def);
+// starts a new raw format segment on the open file fd for frames of def.
+// nothing is written until the first record.
+
+int aldl_raw_log_write(aldl_raw_log_t* raw, unsigned long seq, const struct timespec* received,
+						const char* frame, unsigned int len);
+// writes one raw format record with a single system call (the first record
+// of a segment goes out together with the segment header). received is the
+// CLOCK_MONOTONIC time the frame was received, seq its sequence number.
+// returns 0 on success, -1 if the record couldn't be written completely.
+
+unsigned int aldl_raw_log_encode(aldl_raw_log_t* raw, unsigned long seq, const struct timespec* received,
+						const char* frame, unsigned int len, char* buf);
+// like aldl_raw_log_write(), but stores the bytes in buf instead: up to
+// ALDL_RAW_HEADER_SIZE + ALDL_RAW_RECORD_HEADER_SIZE + len of them.
+// returns the number of bytes stored, or 0 if the frame is too long. if they
+// never reach the file, call aldl_raw_log_dropped().
+
+void aldl_raw_log_dropped(aldl_raw_log_t* raw);
+// tells raw the record last encoded never reached the file (a full queue),
+// so the next one is written whole, and starts the segment if that one did.
+
+int64_t aldl_raw_log_time(const aldl_raw_log_t* raw);
+// returns the wall clock time, in microseconds since 1970, that a reader of
+// the log will give the record raw last encoded or wrote.
+
+int aldl_raw_is_header(const char* buf, unsigned long len);
+// returns 1 if buf starts with a segment header's magic, 0 otherwise.
+
+long aldl_raw_parse_header(const char* buf, unsigned long len, aldl_raw_header_t* h);
+// reads the segment header at buf, which has len bytes, into h.
+// returns the header's size, 0 if len is too short to hold it, or -1 if it
+// isn't a valid header (wrong magic, version or crc).
+
+long aldl_raw_parse_record(const char* buf, unsigned long len, aldl_raw_record_t* rec);
+// reads the record at buf, which has len bytes, into rec. rec->frame
+// points into buf. returns the record's size, 0 if buf ends before the
+// record does (a torn last record), or -1 if it isn't a valid record
+// (wrong mark or crc).
+
+long aldl_raw_parse_delta(const char* buf, unsigned long len, const aldl_raw_record_t* prev,
+							char* frame, aldl_raw_record_t* rec);
+// reads the delta record at buf, which has len bytes and follows the record
+// prev, into rec. the frame is rebuilt in frame (prev->length bytes), which
+// may be prev->frame itself; rec->frame points to it. returns the record's
+// size, 0 if buf ends before the record does, or -1 if it isn't a valid
+// delta record (frame is then unchanged).
+
+void aldl_log_write_csv_header(FILE* f, aldl_definition* def);
+// writes the csv header line for def.
+
+void aldl_log_write_csv_line(FILE* f, aldl_definition* def, const struct timeval* timestamp, const char* slots);
+// writes one csv data line. the value of def->mode1_def[i] is the string at
+// slots + i*ALDL_STRING_SLOT_SIZE, as formatted by aldl_format_slot()
+// (seperators are skipped). nothing depends on the locale.
+
+int aldl_log_format_csv_line(char* buf, unsigned int size, aldl_definition* def,
+						const struct timeval* timestamp, const char* slots);
+// stores the line aldl_log_write_csv_line() would write in buf, which has size bytes.
+// returns the length of the line, or -1 if it doesn't fit.
+
+int aldl_log_writer_start(aldl_log_writer_t* w, int fd, aldl_fsync_policy_t policy, unsigned int every,
+							int compress);
+// sets up an empty queue for the open file fd and starts the writer thread.
+// with compress a zlib level (1-9) the file is written as a compressed log
+// (see linuxaldl_gz.h): fd has to be open for reading too, and be empty or
+// hold a compressed log already. with compress 0 the bytes are written as
+// they are. returns 0 on success, -1 on failure.
+
+int aldl_log_writer_put(aldl_log_writer_t* w, const void* data, unsigned long len);
+// queues one record of len bytes. never waits for the disk.
+// returns 0, or -1 if the queue is full and the record was dropped.
+
+void aldl_log_writer_index(aldl_log_writer_t* w, aldl_index_writer_t* index);
+// has the writer thread write the entries of index, the index of the log
+// (open, and added to by the thread queueing records), each once the records
+// of its block have been written. before w is stopped, call
+// aldl_index_writer_finish() so the last entry is written too.
+
+int aldl_log_writer_stop(aldl_log_writer_t* w);
+// writes everything still queued (and the index entries it can), syncs
+// the file unless the policy is ALDL_FSYNC_NONE, stops the thread and frees
+// the queue. fd is left open.
+// returns 0 on success, -1 if any record was dropped or couldn't be written.
+
+int aldl_log_parse_fsync(const char* str, aldl_fsync_policy_t* policy, unsigned int* every);
+// reads an fsync policy: "none", "<N>ms" to sync every N msec, or "<N>" to
+// sync every N records. returns 0 on success, -1 if str isn't one of those.
+
+int aldl_logger_open(aldl_logger_t* log, int fd, aldl_log_format_t format, aldl_definition* def);
+// sets up a logger writing to the open file fd. for csv the header line is
+// written with the first line, or when the logger is started or closed
+// before that; for raw a new segment starts with the first frame.
+// returns 0 on success, -1 on failure.
+
+int aldl_logger_start_writer(aldl_logger_t* log, aldl_fsync_policy_t policy, unsigned int every);
+// hands everything log writes from now on to a background writer thread
+// (see aldl_log_writer_t), which compresses it if log->compress is set.
+// call after aldl_logger_open(). records the queue
+// has no room for are dropped and counted in log->writer.dropped.
+// returns 0 on success, -1 on failure (log keeps writing directly).
+
+int aldl_logger_start_uring(aldl_logger_t* log, aldl_log_uring_t* u,
+							aldl_fsync_policy_t policy, unsigned int every);
+// writes everything log writes from now on through u, which may be shared
+// by the loggers of every session on one mux (u must only be used by one
+// thread). call after aldl_logger_open(), and have that thread watch u's
+// timer (aldl_log_uring_watch()). records that find every buffer in use
+// are dropped and counted in log->file.dropped.
+// returns 0 on success, -1 on failure (log keeps writing directly).
+
+int aldl_logger_start_index(aldl_logger_t* log, const char* logfilename);
+// builds an index of the raw log (see linuxaldl_index.h) as it is written.
+// logfilename is the name of the file log writes; call before the first
+// frame. every frame with a data block is decoded for the zone maps.
+// returns 0 on success, -1 if the log isn't raw or the index can't be opened.
+
+int aldl_logger_start_columns(aldl_logger_t* log, const char* filename);
+// writes every frame with a data block to the columnar log filename (see
+// linuxaldl_columns.h) as well, whatever the format of the log. chunks are
+// encoded and written by a thread of their own; log->columns has the
+// statistics. returns 0 on success, -1 if the columnar log can't be opened.
+
+void aldl_logger_attach(aldl_logger_t* log, aldl_session_t* s);
+// makes log the sink for every frame s receives.
+
+int aldl_logger_close(aldl_logger_t* log);
+// flushes everything written so far to the disk and stops the writer
+// thread or waits for the io_uring writes in progress. fd is left open.
+// returns 0 on success, -1 if anything couldn't be written.
+
+long aldl_log_run(aldl_session_t* s, const aldl_log_options_t* opts);
+// logs every frame s receives to opts->filename, running s on a mux of its
+// own in the calling thread until SIGINT or SIGTERM arrives or one of the
+// limits in opts is reached. polling sessions send a mode 9 message and the
+// log is flushed before this returns; statistics are printed to stdout.
+// SIGINT and SIGTERM are blocked while it runs (in any thread it starts too)
+// and taken from a signalfd. a log file this call created is removed if
+// logging can't be set up.
+// returns the number of frame bytes received, or -1 on failure.
+
+#endif
@@ -0,0 +1,317 @@
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// logbench: compares what logging a frame costs with each log backend.
+// every backend logs the same made-up mode 1 responses for a number of
+// sessions (one file each, interleaved the way a mux delivers them), and
+// the system calls, CPU time and bytes of log file per frame are printed.
+// no ECM is needed.
+//
+// the system calls counted are the ones the backends make to write and
+// sync: one writev() per record for direct, the writer thread's writes and
+// syncs, io_uring_enter() calls for uring, and the
+// fsync() of each file when its logger is closed. the futex calls that wake
+// the writer thread aren't counted; its context switches show them instead.
+//
+// with -compress the writer thread is run once more compressing the files
+// (gzip), and the compression ratio and the writer thread's CPU time spent
+// compressing each frame are printed too.
+//
+//   make logbench && ../bin/logbench -sessions=8 -frames=20000 /tmp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include "libaldl.h"
+
+#define LOGBENCH_MAX_SESSIONS 64
+
+typedef enum _logbench_backend {
+	LOGBENCH_DIRECT=0, LOGBENCH_THREAD=1, LOGBENCH_URING=2, LOGBENCH_GZ=3
+} logbench_backend_t;
+
+static const char* logbench_names[] = { "direct", "thread", "uring", "gzip" };
+
+static void logbench_usage(FILE* f)
+{
+	fprintf(f,"Usage: logbench [options] [directory]\n"
+			"\n"
+			"Logs made-up frames to files in directory (default .) with each log backend.\n"
+			"\n"
+			"Options:\n"
+			"  -sessions=N       number of sessions, each with its own file (default 8, max %d)\n"
+			"  -frames=N         frames logged per session (default 20000)\n"
+			"  -format=raw|csv   log format (default raw)\n"
+			"  -fsync=POLICY     Nms, N (records) or none (default none)\n"
+			"  -index            build an index of each raw log as it is written\n"
+			"  -compact          write raw logs with delta records\n"
+			"  -compress[=LEVEL] also run the writer thread compressing the logs (level 1-9, default %d)\n"
+			"  -mask=DEF         definition the frames are made for (default: the first one)\n",
+			LOGBENCH_MAX_SESSIONS, ALDL_GZ_DEFAULT_LEVEL);
+}
+
+// returns the user plus system CPU time in usec used by the whole process so far
+static double logbench_cpu_time()
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec)*1000000.0
+			+ ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+// returns the number of context switches of the whole process so far
+static long logbench_switches()
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_nvcsw + ru.ru_nivcsw;
+}
+
+// logs frames frames for each of nsessions sessions with backend.
+// returns 0 on success, -1 on failure.
+static int logbench_run(logbench_backend_t backend, aldl_definition* def, const char* dir,
+						unsigned int nsessions, unsigned int frames, aldl_log_format_t format,
+						aldl_fsync_policy_t fsync, unsigned int fsync_every, int index, int compact,
+						int compress)
+{
+	static aldl_session_t sessions[LOGBENCH_MAX_SESSIONS];
+	static aldl_logger_t logs[LOGBENCH_MAX_SESSIONS];
+	int fds[LOGBENCH_MAX_SESSIONS];
+	aldl_log_uring_t uring;
+	aldl_session_t* s;
+	struct timeval timestamp;
+	struct timespec start, end;
+	char filename[4096];
+	unsigned int i, n, length;
+	unsigned long logged = 0, dropped = 0, syscalls = 0, bytes = 0;
+	uint64_t gz_in = 0, gz_out = 0, gz_cpu = 0;
+	struct stat st;
+	double cpu, wall;
+	long switches;
+	int res = 0;
+
+	uring.buffers = NULL;
+	if (backend == LOGBENCH_URING && aldl_log_uring_init(&uring) != 0)
+	{
+		printf("%-8s io_uring isn't available here (%s).\n",logbench_names[backend],strerror(errno));
+		return 0;
+	}
+
+	length = def->mode1_response_length;
+	for (i=0; i<nsessions; i++)
+	{
+		snprintf(filename, sizeof(filename), "%s/logbench-%s-%u.%s%s", dir, logbench_names[backend], i,
+					(format == ALDL_LOG_CSV) ? "csv" : "log", (backend == LOGBENCH_GZ) ? ".gz" : "");
+		fds[i] = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+		if (fds[i] == -1)
+		{
+			fprintf(stderr,"Couldn't open %s: %s\n",filename,strerror(errno));
+			return -1;
+		}
+		if (aldl_session_attach(&sessions[i], -1, def) != 0
+			|| aldl_logger_open(&logs[i], fds[i], format, def) != 0)
+			return -1;
+		aldl_logger_attach(&logs[i], &sessions[i]);
+		logs[i].raw.delta = compact;
+		logs[i].compress = (backend == LOGBENCH_GZ) ? compress : 0;
+		if (index && format == ALDL_LOG_RAW && aldl_logger_start_index(&logs[i], filename) != 0)
+			return -1;
+
+		if (backend == LOGBENCH_THREAD || backend == LOGBENCH_GZ)
+			res = aldl_logger_start_writer(&logs[i], fsync, fsync_every);
+		else if (backend != LOGBENCH_DIRECT)
+			res = aldl_logger_start_uring(&logs[i], &uring, fsync, fsync_every);
+		if (res != 0)
+		{
+			fprintf(stderr,"%s: couldn't start the backend.\n",logbench_names[backend]);
+			return -1;
+		}
+	}
+
+	cpu = logbench_cpu_time();
+	switches = logbench_switches();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// deliver the frames the way aldl_session_deliver() does
+	for (n=0; n<frames; n++)
+	{
+		for (i=0; i<nsessions; i++)
+		{
+			s = sessions + i;
+			// a mode 1 response, so the frames can be decoded when read back.
+			// like a steady running engine, only a few bytes change each time.
+			memset(s->frame, i, length);
+			s->frame[0] = def->mode1_request[0];
+			s->frame[1] = 0x52 + length;
+			s->frame[2] = 0x01;
+			s->frame[def->mode1_data_offset] = n;
+			s->frame[def->mode1_data_offset+1] = n/16;
+			s->frame[def->mode1_data_offset+2] = n/256;
+			s->frame[length-1] = get_checksum(s->frame, length-1);
+			gettimeofday(&timestamp, NULL);
+			clock_gettime(CLOCK_MONOTONIC, &s->frame_time);
+			s->frames++;
+			memcpy(s->data_set_raw, s->frame + def->mode1_data_offset, def->mode1_data_length);
+			s->sink(s, s->frame, length, def->mode1_data_offset, &timestamp, s->sink_arg);
+		}
+	}
+
+	// closing waits for everything to reach the file
+	for (i=0; i<nsessions; i++)
+	{
+		if (aldl_logger_close(&logs[i]) != 0)
+			res = -1;
+		logged += logs[i].frames;
+		syscalls++; // the fsync() in aldl_logger_close()
+		if (backend != LOGBENCH_URING) // io_uring writes the entries too
+			syscalls += logs[i].index.blocks;
+		if (backend == LOGBENCH_DIRECT)
+			syscalls += logs[i].frames;
+		else if (backend == LOGBENCH_THREAD || backend == LOGBENCH_GZ)
+		{
+			syscalls += logs[i].writer.writes + logs[i].writer.gz.members + logs[i].writer.syncs;
+			dropped += logs[i].writer.dropped;
+			gz_in += logs[i].writer.gz.bytes_in;
+			gz_out += logs[i].writer.gz.bytes_out;
+			gz_cpu += logs[i].writer.gz.cpu_ns;
+		}
+		else dropped += logs[i].file.dropped;
+	}
+	if (uring.buffers != NULL)
+	{
+		aldl_log_uring_destroy(&uring);
+		syscalls += uring.syscalls;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	cpu = logbench_cpu_time() - cpu;
+	switches = logbench_switches() - switches;
+	wall = (end.tv_sec - start.tv_sec)*1000.0 + (end.tv_nsec - start.tv_nsec)/1000000.0;
+
+	for (i=0; i<nsessions; i++)
+	{
+		if (fstat(fds[i], &st) == 0)
+			bytes += st.st_size;
+		aldl_session_close(&sessions[i]);
+		close(fds[i]);
+	}
+
+	printf("%-8s %10lu %10lu %12.4f %12.3f %10ld %10.1f %10.1f%s\n", logbench_names[backend], logged, dropped,
+			(double)syscalls/logged, cpu/logged, switches, wall, (double)bytes/logged,
+			(res != 0) ? "  (errors)" : "");
+	if (gz_out != 0)
+		printf("%-8s %.2f:1 at level %d, %.3f usec of writer thread cpu per frame compressing\n", "",
+				(double)gz_in/gz_out, compress, gz_cpu/1000.0/logged);
+	return res;
+}
+
+int main(int argc, char* argv[])
+{
+	aldl_definition* def = aldl_definition_table[0];
+	aldl_log_format_t format = ALDL_LOG_RAW;
+	aldl_fsync_policy_t fsync = ALDL_FSYNC_NONE;
+	unsigned int fsync_every = 0;
+	int sessions = 8, frames = 20000;
+	const char* dir = ".";
+	int index = 0, compact = 0, compress = 0;
+	int opt, res = 0;
+	logbench_backend_t backend;
+
+	static const struct option logbench_opts[] =
+	{
+		{ "sessions", required_argument, NULL, 's' },
+		{ "frames", required_argument, NULL, 'n' },
+		{ "format", required_argument, NULL, 'f' },
+		{ "fsync", required_argument, NULL, 'y' },
+		{ "mask", required_argument, NULL, 'm' },
+		{ "index", no_argument, NULL, 'x' },
+		{ "compact", no_argument, NULL, 'c' },
+		{ "compress", optional_argument, NULL, 'z' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	while ((opt = getopt_long_only(argc, argv, "", logbench_opts, NULL)) != -1)
+	{
+		switch (opt)
+		{
+			case 's': sessions = atoi(optarg); break;
+			case 'n': frames = atoi(optarg); break;
+			case 'f':
+				if (strcmp(optarg,"csv")==0)
+					format = ALDL_LOG_CSV;
+				else if (strcmp(optarg,"raw")!=0)
+				{
+					logbench_usage(stderr);
+					return 1;
+				}
+				break;
+			case 'y':
+				if (aldl_log_parse_fsync(optarg, &fsync, &fsync_every) != 0)
+				{
+					logbench_usage(stderr);
+					return 1;
+				}
+				break;
+			case 'm':
+				def = aldl_get_definition(optarg);
+				if (def == NULL)
+				{
+					fprintf(stderr,"Error: No definition with name \"%s\" found.\n",optarg);
+					return 1;
+				}
+				break;
+			case 'x': index = 1; break;
+			case 'c': compact = 1; break;
+			case 'z': compress = (optarg != NULL) ? atoi(optarg) : ALDL_GZ_DEFAULT_LEVEL; break;
+			case 'h': logbench_usage(stdout); return 0;
+			default: logbench_usage(stderr); return 1;
+		}
+	}
+	if (optind < argc)
+		dir = argv[optind++];
+	if (optind != argc || sessions <= 0 || sessions > LOGBENCH_MAX_SESSIONS || frames <= 0
+		|| compress < 0 || compress > 9)
+	{
+		logbench_usage(stderr);
+		return 1;
+	}
+
+	printf("%s, %d sessions, %d frames each, %s%s\n\n", def->name, sessions, frames,
+			(format == ALDL_LOG_CSV) ? "csv" : (compact ? "raw with delta records" : "raw"),
+			(index && format == ALDL_LOG_RAW) ? ", with an index" : "");
+	printf("%-8s %10s %10s %12s %12s %10s %10s %10s\n", "backend", "frames", "dropped",
+			"syscalls/fr", "cpu usec/fr", "switches", "wall ms", "bytes/fr");
+	for (backend=LOGBENCH_DIRECT; backend<=(compress ? LOGBENCH_GZ : LOGBENCH_URING); backend++)
+	{
+		if (logbench_run(backend, def, dir, sessions, frames, format, fsync, fsync_every, index, compact,
+							compress) != 0)
+			res = 1;
+	}
+	return res;
+}
@@ -0,0 +1,535 @@
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// logcheck: checks that raw logs read back the way they were written. the
+// record parsers and the delta records are checked on their own first.
+// then the same made-up frames are logged with each backend (direct, the
+// writer thread, io_uring, and the writer thread compressing), with and
+// without delta records, and each file is read back with
+// aldl_log_reader_next() and compared frame by frame, sought with its index,
+// and read again with bytes damaged and cut off the end, which the reader
+// has to skip without handing out a frame that wasn't logged.
+//
+// no ECM is needed. prints what failed and exits with 1 if anything did.
+//
+//   make check, or: make logcheck && ../bin/logcheck /tmp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "libaldl.h"
+
+#define LOGCHECK_FRAMES 20000		// frames logged with each backend
+#define LOGCHECK_INTERVAL 12500000	// ns between frames
+#define LOGCHECK_SEEKS 16			// times sought in each log
+
+typedef enum _logcheck_backend {
+	LOGCHECK_DIRECT=0, LOGCHECK_THREAD=1, LOGCHECK_URING=2, LOGCHECK_GZ=3
+} logcheck_backend_t;
+
+static const char* logcheck_names[] = { "direct", "thread", "uring", "gzip" };
+
+static unsigned long logcheck_checks, logcheck_failed;
+
+// the frames logged, by sequence number (from 1)
+static char* logcheck_frames;
+static unsigned int logcheck_lengths[LOGCHECK_FRAMES+1];
+static unsigned int logcheck_frame_size;
+
+// counts a check, printing what failed if ok is 0
+static void logcheck(int ok, const char* fmt, ...)
+{
+	va_list ap;
+
+	logcheck_checks++;
+	if (ok)
+		return;
+	logcheck_failed++;
+	printf("FAIL: ");
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	printf("\n");
+}
+
+// returns the next number of a fixed sequence of made-up ones
+static uint32_t logcheck_random()
+{
+	static uint32_t x = 2463534242u;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x;
+}
+
+// makes up the frames logged: mode 1 responses of which only a few bytes
+// change from one to the next, with now and then one that changes all over
+// (a full record even in a compact log) or a shorter frame without a data
+// block (which a delta record can't follow either).
+static void logcheck_make_frames(aldl_definition* def)
+{
+	unsigned int length = def->mode1_response_length;
+	char* frame;
+	char* prev;
+	unsigned long n;
+	unsigned int i;
+
+	for (n=1; n<=LOGCHECK_FRAMES; n++)
+	{
+		frame = logcheck_frames + n*logcheck_frame_size;
+		prev = frame - logcheck_frame_size;
+		logcheck_lengths[n] = length;
+		if (n == 1 || n%97 == 0)
+		{
+			for (i=0; i<length; i++)
+				frame[i] = logcheck_random();
+		}
+		else
+		{
+			memcpy(frame, prev, length);
+			for (i=logcheck_random()%4; i>0; i--)
+				frame[def->mode1_data_offset + logcheck_random()%def->mode1_data_length] = logcheck_random();
+		}
+		if (n%211 == 0)
+			logcheck_lengths[n] = length - 3;
+		else
+		{
+			frame[0] = def->mode1_request[0];
+			frame[1] = 0x52 + length;
+			frame[2] = 0x01;
+			frame[length-1] = get_checksum(frame, length-1);
+		}
+	}
+}
+
+// returns 1 if frame is the frame logged with sequence number seq, 0 if not
+static int logcheck_frame_is(const aldl_log_frame_t* frame, uint32_t seq)
+{
+	return seq >= 1 && seq <= LOGCHECK_FRAMES && frame->length == logcheck_lengths[seq]
+		&& memcmp(frame->data, logcheck_frames + seq*logcheck_frame_size, frame->length) == 0;
+}
+
+// checks the parsers and delta records on records encoded in memory
+static void logcheck_records(aldl_definition* def)
+{
+	aldl_raw_log_t raw;
+	aldl_raw_header_t h;
+	aldl_raw_record_t rec, prev;
+	struct timespec t;
+	char buf[ALDL_RAW_HEADER_SIZE + ALDL_RAW_RECORD_HEADER_SIZE + 1024];
+	char rebuilt[ALDL_RAW_DELTA_MAX_FRAME];
+	char* frame;
+	unsigned int len, n, keys = 0, deltas = 0;
+	long res;
+
+	aldl_raw_log_init(&raw, -1, def);
+	raw.delta = 1;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	// the first record goes out with the segment header
+	frame = logcheck_frames + logcheck_frame_size;
+	len = aldl_raw_log_encode(&raw, 1, &t, frame, logcheck_lengths[1], buf);
+	logcheck(len == ALDL_RAW_HEADER_SIZE + ALDL_RAW_RECORD_HEADER_SIZE + logcheck_lengths[1],
+				"first record: %u bytes encoded", len);
+	logcheck(aldl_raw_is_header(buf, len), "first record: no segment header");
+	res = aldl_raw_parse_header(buf, len, &h);
+	logcheck(res == ALDL_RAW_HEADER_SIZE && h.version == ALDL_RAW_VERSION_DELTA
+				&& h.definition_hash == aldl_definition_hash(def) && strcmp(h.name, def->name) == 0,
+				"segment header: parsed %ld", res);
+	logcheck(aldl_raw_parse_header(buf, ALDL_RAW_HEADER_SIZE-1, &h) == 0, "segment header: cut short");
+	buf[30] ^= 0x10;
+	logcheck(aldl_raw_parse_header(buf, len, &h) == -1, "segment header: damage not found");
+	buf[30] ^= 0x10;
+
+	res = aldl_raw_parse_record(buf + ALDL_RAW_HEADER_SIZE, len - ALDL_RAW_HEADER_SIZE, &rec);
+	logcheck(res == (long)(len - ALDL_RAW_HEADER_SIZE) && rec.seq == 1 && rec.time == 0
+				&& rec.length == logcheck_lengths[1] && memcmp(rec.frame, frame, rec.length) == 0,
+				"full record: parsed %ld", res);
+	logcheck(aldl_raw_parse_record(buf + ALDL_RAW_HEADER_SIZE, len - ALDL_RAW_HEADER_SIZE - 1, &rec) == 0,
+				"full record: cut short");
+	buf[len-1] ^= 1;
+	logcheck(aldl_raw_parse_record(buf + ALDL_RAW_HEADER_SIZE, len - ALDL_RAW_HEADER_SIZE, &rec) == -1,
+				"full record: damage not found");
+	buf[len-1] ^= 1;
+	prev.length = logcheck_lengths[1];
+	prev.seq = 1;
+	prev.time = 0;
+	prev.frame = rebuilt;
+	memcpy(rebuilt, frame, prev.length);
+
+	// the rest are delta records where they can be, rebuilt from the one before
+	for (n=2; n<=LOGCHECK_FRAMES; n++)
+	{
+		frame = logcheck_frames + n*logcheck_frame_size;
+		t.tv_nsec += LOGCHECK_INTERVAL;
+		if (t.tv_nsec >= 1000000000)
+		{
+			t.tv_sec++;
+			t.tv_nsec -= 1000000000;
+		}
+		len = aldl_raw_log_encode(&raw, n, &t, frame, logcheck_lengths[n], buf);
+		if ((unsigned char)buf[0] == ALDL_RAW_DELTA_TAG)
+		{
+			deltas++;
+			logcheck(prev.length == logcheck_lengths[n], "frame %u: delta record after a frame of another length", n);
+			logcheck(aldl_raw_parse_delta(buf, len-1, &prev, rebuilt, &rec) == 0, "frame %u: delta record cut short", n);
+			buf[len-1] ^= 1;
+			logcheck(aldl_raw_parse_delta(buf, len, &prev, rebuilt, &rec) == -1
+						&& memcmp(rebuilt, logcheck_frames + (n-1)*logcheck_frame_size, prev.length) == 0,
+						"frame %u: damaged delta record not found, or the frame was changed", n);
+			buf[len-1] ^= 1;
+			res = aldl_raw_parse_delta(buf, len, &prev, rebuilt, &rec);
+		}
+		else
+		{
+			keys++;
+			res = aldl_raw_parse_record(buf, len, &rec);
+			if (res > 0 && rec.length <= ALDL_RAW_DELTA_MAX_FRAME)
+				memcpy(rebuilt, rec.frame, rec.length);
+		}
+		logcheck(res == (long)len && rec.seq == n && rec.time == (uint64_t)(n-1)*LOGCHECK_INTERVAL
+					&& rec.length == logcheck_lengths[n] && memcmp(rec.frame, frame, rec.length) == 0,
+					"frame %u: %s record parsed %ld of %u bytes", n,
+					((unsigned char)buf[0] == ALDL_RAW_DELTA_TAG) ? "delta" : "full", res, len);
+		logcheck(raw.since_key < ALDL_RAW_KEYFRAME_INTERVAL, "frame %u: %u records since a full one", n, raw.since_key);
+		prev.length = rec.length;
+		prev.seq = rec.seq;
+		prev.time = rec.time;
+	}
+	logcheck(deltas > keys, "only %u of %u records were delta records", deltas, deltas+keys);
+
+	// a delta record can't follow a frame of another length
+	prev.length = 0;
+	logcheck(aldl_raw_parse_delta(buf, len, &prev, rebuilt, &rec) == -1, "delta record after no frame");
+}
+
+// waits until the writer thread has room for a batch. frames come far
+// faster here than from an ECM, faster than they can be compressed.
+static void logcheck_wait(aldl_log_writer_t* w)
+{
+	unsigned long queued;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&w->lock);
+		queued = w->tail - w->head;
+		pthread_mutex_unlock(&w->lock);
+		if (queued + ALDL_LOG_BATCH_SIZE <= ALDL_LOG_QUEUE_SIZE)
+			return;
+		usleep(1000);
+	}
+}
+
+// logs the frames to filename with backend.
+// returns 0 on success, 1 if the backend isn't available, -1 on failure.
+static int logcheck_write(logcheck_backend_t backend, aldl_definition* def, const char* filename, int compact)
+{
+	aldl_session_t s;
+	aldl_logger_t log;
+	aldl_log_uring_t uring;
+	struct timeval timestamp;
+	struct timespec t;
+	unsigned long dropped;
+	unsigned int n;
+	int fd, res = 0;
+
+	uring.buffers = NULL;
+	if (backend == LOGCHECK_URING && aldl_log_uring_init(&uring) != 0)
+		return 1;
+
+	fd = open(filename, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644);
+	if (fd == -1)
+	{
+		fprintf(stderr,"Couldn't open %s: %s\n",filename,strerror(errno));
+		return -1;
+	}
+	if (aldl_session_attach(&s, -1, def) != 0 || aldl_logger_open(&log, fd, ALDL_LOG_RAW, def) != 0)
+		return -1;
+	aldl_logger_attach(&log, &s);
+	log.raw.delta = compact;
+	log.compress = (backend == LOGCHECK_GZ) ? ALDL_GZ_DEFAULT_LEVEL : 0;
+	if (aldl_logger_start_index(&log, filename) != 0)
+		res = -1;
+	else if (backend == LOGCHECK_THREAD || backend == LOGCHECK_GZ)
+		res = aldl_logger_start_writer(&log, ALDL_FSYNC_NONE, 0);
+	else if (backend == LOGCHECK_URING)
+		res = aldl_logger_start_uring(&log, &uring, ALDL_FSYNC_NONE, 0);
+
+	// deliver the frames the way aldl_session_deliver() does, a steady
+	// LOGCHECK_INTERVAL apart
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	for (n=1; n<=LOGCHECK_FRAMES && res == 0; n++)
+	{
+		if (log.backend == ALDL_LOG_THREAD)
+			logcheck_wait(&log.writer);
+		memcpy(s.frame, logcheck_frames + n*logcheck_frame_size, logcheck_lengths[n]);
+		gettimeofday(&timestamp, NULL);
+		s.frame_time = t;
+		s.frames++;
+		if (logcheck_lengths[n] == def->mode1_response_length)
+			memcpy(s.data_set_raw, s.frame + def->mode1_data_offset, def->mode1_data_length);
+		s.sink(&s, s.frame, logcheck_lengths[n],
+				(logcheck_lengths[n] == def->mode1_response_length) ? def->mode1_data_offset : 0,
+				&timestamp, s.sink_arg);
+		t.tv_nsec += LOGCHECK_INTERVAL;
+		if (t.tv_nsec >= 1000000000)
+		{
+			t.tv_sec++;
+			t.tv_nsec -= 1000000000;
+		}
+	}
+
+	if (aldl_logger_close(&log) != 0)
+		res = -1;
+	dropped = log.writer.dropped + log.file.dropped;
+	if (uring.buffers != NULL)
+		aldl_log_uring_destroy(&uring);
+	aldl_session_close(&s);
+	close(fd);
+	logcheck(res == 0 && log.frames == LOGCHECK_FRAMES && dropped == 0 && log.errors == 0,
+				"%s: %lu frames logged, %lu dropped, %lu errors", filename, log.frames, dropped, log.errors);
+	return res;
+}
+
+// reads filename back. every frame read has to be one that was logged, in
+// order, at least least of them have to be read, and the last one has to be
+// frame end (if end isn't 0). stores the sequence number and time of each
+// frame read in seqs and times, if they aren't NULL.
+// returns the number of frames read.
+static unsigned long logcheck_read(const char* filename, const char* what, unsigned long least,
+									uint32_t end, uint32_t* seqs, struct timeval* times)
+{
+	aldl_log_reader_t r;
+	aldl_log_cursor_t* c = malloc(sizeof(aldl_log_cursor_t));
+	aldl_log_frame_t frame;
+	unsigned long count = 0, bad = 0;
+	uint32_t last = 0;
+
+	if (c == NULL || aldl_log_reader_open(&r, filename) != 0)
+	{
+		logcheck(0, "%s %s: can't be opened", filename, what);
+		free(c);
+		return 0;
+	}
+	aldl_log_reader_rewind(&r, c);
+	while (aldl_log_reader_next(&r, c, &frame))
+	{
+		if (frame.seq <= last || !logcheck_frame_is(&frame, frame.seq))
+			bad++;
+		else if (seqs != NULL)
+		{
+			seqs[count] = frame.seq;
+			times[count] = frame.timestamp;
+		}
+		last = frame.seq;
+		count++;
+	}
+	logcheck(bad == 0 && count >= least && (end == 0 || last == end),
+				"%s %s: %lu frames read (at least %lu), %lu wrong, the last %u, %lu bytes skipped",
+				filename, what, count, least, bad, last, c->skipped);
+	logcheck(least == LOGCHECK_FRAMES || c->skipped != 0, "%s %s: no damage found", filename, what);
+	aldl_log_reader_close(&r);
+	free(c);
+	return count;
+}
+
+// seeks times in filename, with its index and without. each time has to
+// find the first frame read at or after it.
+static void logcheck_seek(const char* filename, const uint32_t* seqs, const struct timeval* times,
+							unsigned long count)
+{
+	aldl_log_reader_t r;
+	aldl_log_index_t x;
+	aldl_log_cursor_t* c = malloc(sizeof(aldl_log_cursor_t));
+	aldl_log_frame_t frame;
+	struct timeval t;
+	unsigned long i, k;
+	int indexed;
+
+	if (c == NULL || aldl_log_reader_open(&r, filename) != 0)
+	{
+		free(c);
+		return;
+	}
+	indexed = (aldl_log_index_open(&x, filename) == 0);
+	// a block of a compact log waits for a full record to end it
+	logcheck(indexed && x.num_blocks >= count/(2*ALDL_INDEX_BLOCK_RECORDS),
+				"%s: no index, or too few blocks in it", filename);
+
+	for (k=0; k<LOGCHECK_SEEKS; k++)
+	{
+		// between two frames, then right on one
+		i = (count-1)*k/(LOGCHECK_SEEKS-1);
+		t = times[i];
+		if (k%2 == 0 && i > 0)
+		{
+			t.tv_usec -= 1;
+			if (t.tv_usec < 0)
+			{
+				t.tv_sec--;
+				t.tv_usec += 1000000;
+			}
+		}
+		logcheck(aldl_log_index_seek(indexed ? &x : NULL, &r, c, &t) == 0
+					&& aldl_log_reader_next(&r, c, &frame) && frame.seq == seqs[i]
+					&& logcheck_frame_is(&frame, frame.seq),
+					"%s: seeking frame %u with the index found another", filename, seqs[i]);
+		if (k%4 == 0)
+			logcheck(aldl_log_index_seek(NULL, &r, c, &t) == 0
+						&& aldl_log_reader_next(&r, c, &frame) && frame.seq == seqs[i]
+						&& logcheck_frame_is(&frame, frame.seq),
+						"%s: seeking frame %u without the index found another", filename, seqs[i]);
+	}
+
+	if (indexed)
+		aldl_log_index_close(&x);
+	aldl_log_reader_close(&r);
+	free(c);
+}
+
+// copies the file from to to, changing a byte at each of the offsets
+// (fractions of the file size) and leaving off cut bytes at the end.
+// returns 0 on success, -1 on failure.
+static int logcheck_damage(const char* from, const char* to, const double* offsets, unsigned int num_offsets,
+							unsigned int cut)
+{
+	struct stat st;
+	char* buf;
+	unsigned int i;
+	int fd, res = -1;
+
+	fd = open(from, O_RDONLY);
+	if (fd == -1 || fstat(fd, &st) != 0 || (buf = malloc(st.st_size)) == NULL)
+		return -1;
+	if (read(fd, buf, st.st_size) == st.st_size)
+		res = 0;
+	close(fd);
+	for (i=0; i<num_offsets; i++)
+		buf[(size_t)(st.st_size*offsets[i])] ^= 0x5a;
+	fd = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1 || write(fd, buf, st.st_size - cut) != (ssize_t)(st.st_size - cut))
+		res = -1;
+	if (fd != -1)
+		close(fd);
+	free(buf);
+	return res;
+}
+
+// returns the size of the log in filename: of the file, or of the log it
+// holds if it is compressed. 0 if it can't be read.
+static uint64_t logcheck_length(const char* filename, int compressed)
+{
+	struct stat st;
+	int64_t length;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd == -1)
+		return 0;
+	if (compressed)
+		length = aldl_gz_length(fd);
+	else length = (fstat(fd, &st) == 0) ? st.st_size : 0;
+	close(fd);
+	return (length > 0) ? length : 0;
+}
+
+// logs the frames with backend, and reads them back whole, sought and damaged
+static void logcheck_backend(logcheck_backend_t backend, aldl_definition* def, const char* dir, int compact)
+{
+	static uint32_t seqs[LOGCHECK_FRAMES];
+	static struct timeval times[LOGCHECK_FRAMES];
+	static const double offsets[] = { 0.25, 0.5, 0.75 };
+	char filename[4096], damaged[4096];
+	unsigned long count, lost;
+	uint64_t length;
+	int res;
+
+	snprintf(filename, sizeof(filename), "%s/logcheck-%s%s.log%s", dir, logcheck_names[backend],
+				compact ? "-compact" : "", (backend == LOGCHECK_GZ) ? ".gz" : "");
+	snprintf(damaged, sizeof(damaged), "%s/logcheck-damaged.log%s", dir, (backend == LOGCHECK_GZ) ? ".gz" : "");
+	res = logcheck_write(backend, def, filename, compact);
+	if (res == 1)
+	{
+		printf("%s: io_uring isn't available here, not checked.\n", logcheck_names[backend]);
+		return;
+	}
+	if (res != 0)
+		return;
+
+	count = logcheck_read(filename, "as written", LOGCHECK_FRAMES, LOGCHECK_FRAMES, seqs, times);
+	if (count == LOGCHECK_FRAMES)
+		logcheck_seek(filename, seqs, times, count);
+
+	// a damaged byte loses the record it is in, and a delta record the rest
+	// up to the next full one. in a compressed log it loses its member, and
+	// the one before if it is in a member header.
+	lost = compact ? ALDL_RAW_KEYFRAME_INTERVAL : 2;
+	length = logcheck_length(filename, backend == LOGCHECK_GZ);
+	if (backend == LOGCHECK_GZ && length != 0)
+		lost += 2*(LOGCHECK_FRAMES*(uint64_t)ALDL_GZ_MEMBER_SIZE/length + 1);
+	if (logcheck_damage(filename, damaged, offsets, 3, 0) == 0)
+		logcheck_read(damaged, "damaged", (3*lost < LOGCHECK_FRAMES) ? LOGCHECK_FRAMES - 3*lost : 0,
+						LOGCHECK_FRAMES, NULL, NULL);
+	else logcheck(0, "%s: couldn't make a damaged copy", filename);
+
+	// a record cut short at the end is skipped, with the member it is in
+	if (logcheck_damage(filename, damaged, offsets+1, 1, 5) == 0)
+		logcheck_read(damaged, "damaged and cut short", (2*lost < LOGCHECK_FRAMES) ? LOGCHECK_FRAMES - 2*lost : 0,
+						(backend == LOGCHECK_GZ) ? 0 : LOGCHECK_FRAMES-1, NULL, NULL);
+	else logcheck(0, "%s: couldn't make a damaged copy", filename);
+
+	unlink(damaged);
+	unlink(filename);
+	strcat(filename, ".idx");
+	unlink(filename);
+}
+
+int main(int argc, char* argv[])
+{
+	aldl_definition* def = aldl_definition_table[0];
+	const char* dir = (argc > 1) ? argv[1] : ".";
+	logcheck_backend_t backend;
+	int compact;
+
+	if (argc > 2)
+	{
+		fprintf(stderr,"Usage: logcheck [directory]\n");
+		return 1;
+	}
+	logcheck_frame_size = def->mode1_response_length;
+	logcheck_frames = malloc((LOGCHECK_FRAMES+1)*logcheck_frame_size);
+	if (logcheck_frames == NULL)
+		return 1;
+	logcheck_make_frames(def);
+
+	logcheck_records(def);
+	for (compact=0; compact<=1; compact++)
+		for (backend=LOGCHECK_DIRECT; backend<=LOGCHECK_GZ; backend++)
+			logcheck_backend(backend, def, dir, compact);
+
+	printf("logcheck: %lu checks, %lu failed.\n", logcheck_checks, logcheck_failed);
+	free(logcheck_frames);
+	return (logcheck_failed != 0) ? 1 : 0;
+}
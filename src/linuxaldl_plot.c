@@ -0,0 +1,344 @@
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <math.h>
+#include <gtk/gtk.h>
+#include "linuxaldl_plot.h"
+
+static void aldl_plot_channel_toggled(GtkWidget* widget, gpointer data);
+static gboolean aldl_plot_expose(GtkWidget* widget, GdkEventExpose* event, gpointer data);
+static gboolean aldl_plot_button_press(GtkWidget* widget, GdkEventButton* event, gpointer data);
+static gboolean aldl_plot_motion(GtkWidget* widget, GdkEventMotion* event, gpointer data);
+static gboolean aldl_plot_scroll(GtkWidget* widget, GdkEventScroll* event, gpointer data);
+
+// makes a plot for def with nothing selected, keeping as many samples as
+// fit in memory bytes. returns NULL if there isn't enough memory.
+aldl_plot_t* aldl_plot_new(aldl_definition* def, unsigned long memory)
+{
+	aldl_plot_t* p;
+	byte_def_t* defs = def->mode1_def;
+	GtkWidget *scroll, *list, *check;
+	unsigned int i;
+
+	p = g_malloc0(sizeof(aldl_plot_t));
+	p->definition = def;
+	while (defs[p->num_items].label != NULL)
+		p->num_items++;
+	if (aldl_history_init(&p->history, p->num_items, aldl_history_capacity(p->num_items, memory)) != 0)
+	{
+		g_free(p);
+		return NULL;
+	}
+	p->selected = g_malloc0(p->num_items);
+	p->span = ALDL_PLOT_DEFAULT_SPAN;
+
+	p->box = gtk_hbox_new(FALSE,0);
+
+	// the channel list: a check button for every item that has a value
+	scroll = gtk_scrolled_window_new(NULL,NULL);
+	gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scroll), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+	gtk_box_pack_start(GTK_BOX(p->box), scroll, FALSE, FALSE, 0);
+	gtk_widget_show(scroll);
+
+	list = gtk_vbox_new(FALSE,0);
+	gtk_scrolled_window_add_with_viewport(GTK_SCROLLED_WINDOW(scroll), list);
+	gtk_widget_show(list);
+
+	for (i=0; i<p->num_items; i++)
+	{
+		if (defs[i].operation == ALDL_OP_SEPERATOR)
+			continue;
+		check = gtk_check_button_new_with_label(defs[i].label);
+		g_object_set_data(G_OBJECT(check), "aldl-item", GINT_TO_POINTER(i));
+		g_signal_connect(G_OBJECT(check), "toggled", G_CALLBACK(aldl_plot_channel_toggled), p);
+		gtk_box_pack_start(GTK_BOX(list), check, FALSE, FALSE, 0);
+		gtk_widget_show(check);
+	}
+
+	// the charts
+	p->area = gtk_drawing_area_new();
+	gtk_widget_set_size_request(p->area, 500, 300);
+	gtk_widget_add_events(p->area, GDK_BUTTON_PRESS_MASK | GDK_BUTTON1_MOTION_MASK | GDK_SCROLL_MASK);
+	g_signal_connect(G_OBJECT(p->area), "expose_event", G_CALLBACK(aldl_plot_expose), p);
+	g_signal_connect(G_OBJECT(p->area), "button_press_event", G_CALLBACK(aldl_plot_button_press), p);
+	g_signal_connect(G_OBJECT(p->area), "motion_notify_event", G_CALLBACK(aldl_plot_motion), p);
+	g_signal_connect(G_OBJECT(p->area), "scroll_event", G_CALLBACK(aldl_plot_scroll), p);
+	gtk_box_pack_start(GTK_BOX(p->box), p->area, TRUE, TRUE, 0);
+	gtk_widget_show(p->area);
+	p->layout = gtk_widget_create_pango_layout(p->area, NULL);
+
+	return p;
+}
+
+// frees p. p->box must already have been destroyed.
+void aldl_plot_free(aldl_plot_t* p)
+{
+	if (p == NULL)
+		return;
+	g_object_unref(p->layout);
+	aldl_history_free(&p->history);
+	g_free(p->selected);
+	g_free(p->bounds);
+	g_free(p->column_min);
+	g_free(p->column_max);
+	g_free(p);
+}
+
+// makes a new history that keeps as many samples as fit in memory bytes.
+// returns 0 on success, -1 if out of memory (the old history is kept).
+int aldl_plot_set_memory(aldl_plot_t* p, unsigned long memory)
+{
+	aldl_history_t history;
+
+	if (aldl_history_init(&history, p->num_items, aldl_history_capacity(p->num_items, memory)) != 0)
+		return -1;
+	aldl_history_free(&p->history);
+	p->history = history;
+	p->end = 0;
+	gtk_widget_queue_draw(p->area);
+	return 0;
+}
+
+// adds a sample received at timestamp.
+void aldl_plot_append(aldl_plot_t* p, const struct timeval* timestamp, const float* values)
+{
+	aldl_history_append(&p->history, timestamp->tv_sec + timestamp->tv_usec/1000000.0, values);
+}
+
+// queues the charts to be redrawn if samples were added since they were last drawn.
+void aldl_plot_refresh(aldl_plot_t* p)
+{
+	if (p->history.count != p->drawn_count && p->num_selected != 0)
+		gtk_widget_queue_draw(p->area);
+}
+
+// callback for the channel check buttons. data is the plot.
+static void aldl_plot_channel_toggled(GtkWidget* widget, gpointer data)
+{
+	aldl_plot_t* p = (aldl_plot_t*)data;
+	unsigned int i = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(widget), "aldl-item"));
+
+	p->selected[i] = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget));
+	p->num_selected += p->selected[i] ? 1 : -1;
+	gtk_widget_queue_draw(p->area);
+}
+
+// returns the time of the newest sample. the history must not be empty.
+static double aldl_plot_newest(aldl_plot_t* p)
+{
+	return p->history.times[(p->history.count-1) % p->history.capacity];
+}
+
+// keeps the time axis within the samples the history holds.
+static void aldl_plot_clamp(aldl_plot_t* p)
+{
+	aldl_history_t* h = &p->history;
+	double newest, oldest;
+
+	if (h->count == 0)
+		return;
+	newest = aldl_plot_newest(p);
+	oldest = h->times[aldl_history_oldest(h) % h->capacity];
+
+	if (p->span > MAX(newest - oldest, ALDL_PLOT_DEFAULT_SPAN))
+		p->span = MAX(newest - oldest, ALDL_PLOT_DEFAULT_SPAN);
+	if (p->span < ALDL_PLOT_MIN_SPAN)
+		p->span = ALDL_PLOT_MIN_SPAN;
+
+	if (p->end >= newest)
+		p->end = 0; // back to following the live data
+	else if (p->end != 0 && p->end < oldest + p->span)
+		p->end = MIN(oldest + p->span, newest);
+}
+
+// draws text with its top left corner at x,y.
+static void aldl_plot_draw_text(aldl_plot_t* p, cairo_t* cr, const char* text, double x, double y)
+{
+	cairo_move_to(cr, x, y);
+	pango_layout_set_text(p->layout, text, -1);
+	pango_cairo_show_layout(cr, p->layout);
+}
+
+// "expose_event" handler: draws a strip chart for every selected item.
+static gboolean aldl_plot_expose(GtkWidget* widget, GdkEventExpose* event, gpointer data)
+{
+	aldl_plot_t* p = (aldl_plot_t*)data;
+	aldl_history_t* h = &p->history;
+	byte_def_t* defs = p->definition->mode1_def;
+	int width = widget->allocation.width - 2*ALDL_PLOT_PAD;
+	int strip, top, chart_height, text_width, text_height, drawing;
+	unsigned int columns, x, i, plotted;
+	double start, end, scale, y_max, y_min;
+	float low = 0, high = 0;
+	char text[128];
+	cairo_t* cr;
+
+	cr = gdk_cairo_create(widget->window);
+	gdk_cairo_region(cr, event->region);
+	cairo_clip(cr);
+	gdk_cairo_set_source_color(cr, &widget->style->bg[GTK_STATE_NORMAL]);
+	cairo_paint(cr);
+	gdk_cairo_set_source_color(cr, &widget->style->fg[GTK_STATE_NORMAL]);
+	cairo_set_line_width(cr, 1.0);
+	p->drawn_count = h->count;
+
+	if (p->num_selected == 0 || h->count == 0 || width <= 0)
+	{
+		aldl_plot_draw_text(p, cr, (p->num_selected == 0) ? "Select the items to plot."
+											: "No data received yet.",
+							ALDL_PLOT_PAD, ALDL_PLOT_PAD);
+		cairo_destroy(cr);
+		return TRUE;
+	}
+
+	// one column per pixel. the scratch space only grows with the window.
+	columns = width;
+	if (columns > p->max_columns)
+	{
+		p->bounds = g_realloc(p->bounds, (columns+1)*sizeof(unsigned long));
+		p->column_min = g_realloc(p->column_min, columns*sizeof(float));
+		p->column_max = g_realloc(p->column_max, columns*sizeof(float));
+		p->max_columns = columns;
+	}
+
+	// the samples in each column: one binary search per column, however
+	// many samples the span covers
+	aldl_plot_clamp(p);
+	end = (p->end == 0) ? aldl_plot_newest(p) : p->end;
+	start = end - p->span;
+	for (x=0; x<columns; x++)
+		p->bounds[x] = aldl_history_find(h, start + p->span*x/columns);
+	p->bounds[columns] = (p->end == 0) ? h->count : aldl_history_find(h, end);
+
+	strip = (widget->allocation.height - ALDL_PLOT_PAD)/p->num_selected;
+	chart_height = strip - ALDL_PLOT_PAD;
+	top = ALDL_PLOT_PAD;
+	for (i=0; i<p->num_items; i++)
+	{
+		if (!p->selected[i])
+			continue;
+
+		// the min and max of each column, and of the whole chart for the scale
+		plotted = 0;
+		for (x=0; x<columns; x++)
+		{
+			if (aldl_history_minmax(h, i, p->bounds[x], p->bounds[x+1],
+									&p->column_min[x], &p->column_max[x]) != 0)
+			{
+				p->column_min[x] = NAN;
+				continue;
+			}
+			if (plotted++ == 0)
+			{
+				low = p->column_min[x];
+				high = p->column_max[x];
+			}
+			low = MIN(low, p->column_min[x]);
+			high = MAX(high, p->column_max[x]);
+		}
+
+		cairo_rectangle(cr, ALDL_PLOT_PAD+0.5, top+0.5, width-1, chart_height-1);
+		cairo_stroke(cr);
+
+		if (plotted != 0)
+		{
+			scale = (chart_height - 2*ALDL_PLOT_PAD)/((high > low) ? high - low : 1.0);
+
+			// a vertical line from the max to the min of every column,
+			// joined to the next column
+			drawing = 0;
+			for (x=0; x<columns; x++)
+			{
+				if (isnan(p->column_min[x]))
+				{
+					drawing = 0;
+					continue;
+				}
+				y_max = top + ALDL_PLOT_PAD + ((high > low) ? (high - p->column_max[x])*scale
+															: (chart_height - 2*ALDL_PLOT_PAD)/2);
+				y_min = y_max + (p->column_max[x] - p->column_min[x])*scale;
+				if (drawing)
+					cairo_line_to(cr, ALDL_PLOT_PAD + x + 0.5, y_max);
+				else cairo_move_to(cr, ALDL_PLOT_PAD + x + 0.5, y_max);
+				cairo_line_to(cr, ALDL_PLOT_PAD + x + 0.5, y_min + 0.5);
+				drawing = 1;
+			}
+			cairo_stroke(cr);
+			snprintf(text, sizeof(text), "%s: %.1f to %.1f %s", defs[i].label, low, high, defs[i].units);
+		}
+		else snprintf(text, sizeof(text), "%s: no data", defs[i].label);
+		aldl_plot_draw_text(p, cr, text, 2*ALDL_PLOT_PAD, top + 1);
+
+		top += strip;
+	}
+
+	// the time axis, in the top right corner
+	if (p->end == 0)
+		snprintf(text, sizeof(text), "last %.1f s", p->span);
+	else snprintf(text, sizeof(text), "%.1f s, ending %.1f s ago", p->span, aldl_plot_newest(p) - p->end);
+	pango_layout_set_text(p->layout, text, -1);
+	pango_layout_get_pixel_size(p->layout, &text_width, &text_height);
+	aldl_plot_draw_text(p, cr, text, ALDL_PLOT_PAD + width - ALDL_PLOT_PAD - text_width, ALDL_PLOT_PAD + 1);
+
+	cairo_destroy(cr);
+	return TRUE;
+}
+
+// "button_press_event" handler: starts panning the time axis.
+static gboolean aldl_plot_button_press(GtkWidget* widget, GdkEventButton* event, gpointer data)
+{
+	aldl_plot_t* p = (aldl_plot_t*)data;
+
+	if (event->button != 1 || p->history.count == 0)
+		return FALSE;
+	p->drag_x = event->x;
+	p->drag_end = (p->end == 0) ? aldl_plot_newest(p) : p->end;
+	return TRUE;
+}
+
+// "motion_notify_event" handler: pans the time axis while button 1 is held.
+static gboolean aldl_plot_motion(GtkWidget* widget, GdkEventMotion* event, gpointer data)
+{
+	aldl_plot_t* p = (aldl_plot_t*)data;
+	int width = widget->allocation.width - 2*ALDL_PLOT_PAD;
+
+	if (p->history.count == 0 || width <= 0)
+		return FALSE;
+	// dragging right moves the chart right, to older samples
+	p->end = p->drag_end - (event->x - p->drag_x)*p->span/width;
+	aldl_plot_clamp(p);
+	gtk_widget_queue_draw(widget);
+	return TRUE;
+}
+
+// "scroll_event" handler: zooms the time axis in or out.
+static gboolean aldl_plot_scroll(GtkWidget* widget, GdkEventScroll* event, gpointer data)
+{
+	aldl_plot_t* p = (aldl_plot_t*)data;
+
+	if (event->direction == GDK_SCROLL_UP)
+		p->span /= ALDL_PLOT_ZOOM;
+	else if (event->direction == GDK_SCROLL_DOWN)
+		p->span *= ALDL_PLOT_ZOOM;
+	else return FALSE;
+	aldl_plot_clamp(p);
+	gtk_widget_queue_draw(widget);
+	return TRUE;
+}
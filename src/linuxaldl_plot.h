@@ -0,0 +1,92 @@
+#ifndef LINUXALDL_PLOT_INCLUDED
+#define LINUXALDL_PLOT_INCLUDED
+
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <sys/time.h>
+#include <gtk/gtk.h>
+#include "linuxaldl_core.h"
+#include "linuxaldl_history.h"
+
+// ============================================================================
+// STRIP CHART PLOT
+// ============================================================================
+// the contents of the Plot window: a list of the definition's items to pick
+// channels from, and a strip chart for each picked channel drawn from an
+// aldl_history_t. every pixel column of a chart shows the min and max of the
+// samples it covers, so the cost of drawing depends on the width of the
+// chart, not on how long a time it spans.
+//
+// the scroll wheel zooms the time axis. dragging the chart pans it back in
+// time; dragging it back to the newest sample follows the live data again.
+
+#define ALDL_PLOT_PAD 6				// pixels around and between the charts
+#define ALDL_PLOT_DEFAULT_SPAN 30.0	// seconds across the chart when it is made
+#define ALDL_PLOT_MIN_SPAN 1.0		// seconds across the chart when zoomed in all the way
+#define ALDL_PLOT_ZOOM 1.25			// zoom factor of one scroll wheel step
+
+typedef struct _aldl_plot
+{
+	GtkWidget* box;				// the plot: channel list and charts. put it in a container to show it.
+	GtkWidget* area;			// the charts
+	aldl_definition* definition;
+	aldl_history_t history;		// samples appended by the program, see aldl_plot_append()
+	unsigned int num_items;		// entries in definition->mode1_def (seperators included)
+	char* selected;				// 1 for each item that is plotted, num_items entries
+	unsigned int num_selected;
+	PangoLayout* layout;		// draws the chart labels
+
+	// the time axis
+	double span;				// seconds across the chart
+	double end;					// time at the right edge of the chart, 0 to follow the newest sample
+	double drag_x;				// pointer x where a drag started
+	double drag_end;			// end when the drag started
+	unsigned long drawn_count;	// history.count when the charts were last drawn
+
+	// per pixel column scratch space for drawing, sized to the widest chart drawn
+	unsigned int max_columns;
+	unsigned long* bounds;		// number of the first sample of each column, and of the sample after the last
+	float* column_min;
+	float* column_max;
+} aldl_plot_t;
+
+// function prototypes
+// =================================================
+
+aldl_plot_t* aldl_plot_new(aldl_definition* def, unsigned long memory);
+// makes a plot for def with nothing selected, keeping as many samples as
+// fit in memory bytes. returns NULL if there isn't enough memory.
+
+void aldl_plot_free(aldl_plot_t* p);
+// frees p. p->box must already have been destroyed (destroying its container does that).
+
+int aldl_plot_set_memory(aldl_plot_t* p, unsigned long memory);
+// makes a new history that keeps as many samples as fit in memory bytes.
+// the samples already kept are lost.
+// returns 0 on success, -1 if out of memory (the old history is kept).
+
+void aldl_plot_append(aldl_plot_t* p, const struct timeval* timestamp, const float* values);
+// adds a sample received at timestamp. values has an entry for every item
+// of the definition, indexed like mode1_def.
+
+void aldl_plot_refresh(aldl_plot_t* p);
+// queues the charts to be redrawn if samples were added since they were last drawn.
+
+#endif
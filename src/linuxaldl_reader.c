@@ -0,0 +1,475 @@
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "linuxaldl_reader.h"
+
+// returns the definition named in h, or NULL if there is none or it has
+// changed since the log was recorded
+static aldl_definition* aldl_log_reader_definition(const aldl_raw_header_t* h)
+{
+	aldl_definition* def = aldl_get_definition(h->name);
+
+	if (def == NULL || aldl_definition_hash(def) != h->definition_hash)
+		return NULL;
+	return def;
+}
+
+// decompresses the member holding log offset offset into c's window, with
+// the member after it if that follows on. returns 0 on success, or -1 if no
+// member holds offset (it is in a hole) and sets left to the bytes up to the
+// next member.
+static int aldl_log_reader_load(aldl_log_reader_t* r, aldl_log_cursor_t* c,
+								uint64_t offset, uint64_t* left)
+{
+	aldl_log_window_t* w = &c->window;
+	aldl_gz_member_t* m;
+	long i;
+
+	// offset is before the end of the log, which the last member ends at
+	i = aldl_gz_file_find(&r->gz, offset);
+	m = r->gz.members + i;
+	if (m->offset > offset)
+	{
+		*left = m->offset - offset;
+		return -1;
+	}
+
+	// reading on into the next member: it is already in the window
+	if (w->member >= 0 && !w->damaged && i == w->member+1 && w->length > w->first)
+	{
+		memmove(w->buf, w->buf + w->first, w->length - w->first);
+		w->length -= w->first;
+	}
+	else
+	{
+		w->damaged = (aldl_gz_file_inflate(&r->gz, i, w->buf) != 0);
+		w->length = w->damaged ? 0 : m->length;
+	}
+	w->member = i;
+	w->offset = m->offset;
+	w->first = m->length;
+
+	if (!w->damaged && (unsigned long)i+1 < r->gz.num_members && m[1].offset == m->offset + m->length
+		&& aldl_gz_file_inflate(&r->gz, i+1, w->buf + w->first) == 0)
+		w->length = w->first + m[1].length;
+	return 0;
+}
+
+// returns the log bytes at offset and sets left to how many there are from
+// there on, or returns NULL and sets left to how many can't be read: a hole
+// in a compressed log, or a member that can't be decompressed. c is only
+// used for compressed logs, whose bytes are in its window.
+static const char* aldl_log_reader_at(aldl_log_reader_t* r, aldl_log_cursor_t* c,
+									uint64_t offset, uint64_t* left)
+{
+	aldl_log_window_t* w;
+
+	if (r->gz.num_members == 0)
+	{
+		*left = r->size - offset;
+		return r->map + offset;
+	}
+
+	w = &c->window;
+	if ((w->member < 0 || offset < w->offset || offset >= w->offset + w->first)
+		&& aldl_log_reader_load(r, c, offset, left) != 0)
+		return NULL;
+	if (w->damaged)
+	{
+		*left = w->offset + w->first - offset;
+		return NULL;
+	}
+	*left = w->length - (offset - w->offset);
+	return w->buf + (offset - w->offset);
+}
+
+// maps the raw log filename and reads its first segment header.
+// returns 0 on success, -1 on failure.
+int aldl_log_reader_open(aldl_log_reader_t* r, const char* filename)
+{
+	aldl_log_cursor_t* c = NULL;
+	struct stat st;
+	const char* p;
+	uint64_t left;
+	void* map;
+	long res;
+
+	memset(r, 0, sizeof(aldl_log_reader_t));
+	r->fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (r->fd == -1)
+	{
+		fprintf(stderr,"Couldn't open %s: %s\n",filename,strerror(errno));
+		return -1;
+	}
+	if (fstat(r->fd, &st) != 0 || st.st_size < ALDL_GZ_HEADER_SIZE)
+	{
+		fprintf(stderr,"%s is not a raw log file.\n",filename);
+		close(r->fd);
+		return -1;
+	}
+
+	// the pages are only read from the disk when a frame on them is looked at
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, r->fd, 0);
+	if (map == MAP_FAILED)
+	{
+		fprintf(stderr,"Couldn't map %s: %s\n",filename,strerror(errno));
+		close(r->fd);
+		return -1;
+	}
+	r->map = map;
+	r->file_size = r->size = st.st_size;
+	if (aldl_gz_is_member(r->map, r->file_size))
+	{
+		// only the member headers are read. the header of the log is read
+		// through a cursor of its own, which decompresses the first member.
+		if (aldl_gz_file_scan(&r->gz, r->map, r->file_size) != 0
+			|| (c = malloc(sizeof(aldl_log_cursor_t))) == NULL)
+		{
+			fprintf(stderr,"%s is not a compressed log, or is too damaged to read.\n",filename);
+			aldl_log_reader_close(r);
+			return -1;
+		}
+		r->size = r->gz.length;
+		aldl_log_reader_rewind(r, c);
+	}
+
+	p = aldl_log_reader_at(r, c, 0, &left);
+	res = (p != NULL) ? aldl_raw_parse_header(p, left, &r->header) : -1;
+	free(c);
+	if (res <= 0)
+	{
+		fprintf(stderr,"%s is not a raw log file, or was written by an older version.\n",filename);
+		aldl_log_reader_close(r);
+		return -1;
+	}
+	r->definition = aldl_log_reader_definition(&r->header);
+	if (r->definition == NULL)
+		fprintf(stderr,"%s was recorded with definition \"%s\", which isn't known or has changed since.\n",
+						filename, r->header.name);
+	return 0;
+}
+
+// unmaps the file.
+void aldl_log_reader_close(aldl_log_reader_t* r)
+{
+	if (r->map != NULL)
+		munmap((void*)r->map, r->file_size);
+	if (r->fd != -1)
+		close(r->fd);
+	aldl_gz_file_free(&r->gz);
+	free(r->segments);
+	r->map = NULL;
+	r->fd = -1;
+	r->segments = NULL;
+	r->num_segments = 0;
+}
+
+// positions c at the start of r.
+void aldl_log_reader_rewind(aldl_log_reader_t* r, aldl_log_cursor_t* c)
+{
+	// the window's buffer is left as it is
+	memset(c, 0, offsetof(aldl_log_cursor_t, window));
+	c->window.member = -1;
+}
+
+// positions c at the record at file offset offset, in the segment whose
+// header is at segment_offset. returns 0 on success, -1 on failure.
+int aldl_log_reader_position(aldl_log_reader_t* r, aldl_log_cursor_t* c,
+							uint64_t segment_offset, uint64_t offset)
+{
+	aldl_raw_record_t rec;
+	const char* p;
+	uint64_t left;
+
+	aldl_log_reader_rewind(r, c);
+	if (segment_offset >= r->size || offset >= r->size)
+		return -1;
+	// a fresh cursor reads the header itself
+	if (offset == segment_offset)
+	{
+		c->offset = offset;
+		p = aldl_log_reader_at(r, c, offset, &left);
+		return (p != NULL && aldl_raw_is_header(p, left)) ? 0 : -1;
+	}
+
+	// the segment header gives the records their definition and time base
+	p = aldl_log_reader_at(r, c, segment_offset, &left);
+	if (p == NULL || aldl_raw_parse_header(p, left, &c->header) <= 0
+		|| (p = aldl_log_reader_at(r, c, offset, &left)) == NULL
+		|| aldl_raw_parse_record(p, left, &rec) <= 0)
+	{
+		aldl_log_reader_rewind(r, c);
+		return -1;
+	}
+	c->definition = aldl_log_reader_definition(&c->header);
+	c->segment = 1;
+	c->offset = offset;
+	return 0;
+}
+
+// returns the offset of the first valid record or segment header at or
+// after offset, or the size of the log if there is none.
+static uint64_t aldl_log_reader_resync(aldl_log_reader_t* r, aldl_log_cursor_t* c, uint64_t offset)
+{
+	const char* p;
+	aldl_raw_header_t h;
+	aldl_raw_record_t rec;
+	uint64_t left;
+
+	for (; offset+1 < r->size; offset++)
+	{
+		p = aldl_log_reader_at(r, c, offset, &left);
+		if (p == NULL)
+		{
+			// on past what can't be read
+			offset += left-1;
+			continue;
+		}
+		// the first byte of a record mark (little-endian) or of the magic
+		if (left > 1 && (unsigned char)p[0] == (ALDL_RAW_RECORD_MARK & 0xff)
+			&& (unsigned char)p[1] == (ALDL_RAW_RECORD_MARK >> 8)
+			&& aldl_raw_parse_record(p, left, &rec) > 0)
+			return offset;
+		if (p[0] == ALDL_RAW_MAGIC[0] && aldl_raw_parse_header(p, left, &h) > 0)
+			return offset;
+	}
+	return r->size;
+}
+
+// finds the offset of every segment header in r, reading with c.
+// returns 0 on success, -1 if memory runs out.
+static int aldl_log_reader_find_segments(aldl_log_reader_t* r, aldl_log_cursor_t* c)
+{
+	unsigned long allocated = 0;
+	aldl_raw_header_t h;
+	uint64_t* segments;
+	uint64_t offset = 0, left;
+	const char* p;
+	const char* q;
+
+	while (offset < r->size)
+	{
+		p = aldl_log_reader_at(r, c, offset, &left);
+		if (p == NULL || (q = memchr(p, ALDL_RAW_MAGIC[0], left)) == NULL)
+		{
+			offset += left;
+			continue;
+		}
+		// read it again from where it is: a compressed log's window may move
+		offset += q - p;
+		p = aldl_log_reader_at(r, c, offset, &left);
+		if (p != NULL && aldl_raw_parse_header(p, left, &h) > 0)
+		{
+			if (r->num_segments == allocated)
+			{
+				allocated = allocated ? allocated*2 : 16;
+				segments = realloc(r->segments, allocated*sizeof(uint64_t));
+				if (segments == NULL)
+					return -1;
+				r->segments = segments;
+			}
+			r->segments[r->num_segments++] = offset;
+		}
+		offset++;
+	}
+	return 0;
+}
+
+// positions c at the first segment header or full record at or after offset.
+// returns 0 on success, -1 if there is nothing more to read.
+int aldl_log_reader_locate(aldl_log_reader_t* r, aldl_log_cursor_t* c, uint64_t offset)
+{
+	unsigned long lo = 0, hi, mid;
+
+	const char* p;
+	uint64_t left;
+
+	aldl_log_reader_rewind(r, c);
+	// the file starts with a header, so there is always one
+	if (r->segments == NULL && aldl_log_reader_find_segments(r, c) != 0)
+		return -1;
+
+	c->offset = aldl_log_reader_resync(r, c, offset);
+	if (c->offset >= r->size)
+		return -1;
+	// a fresh cursor reads a header itself
+	p = aldl_log_reader_at(r, c, c->offset, &left);
+	if (p != NULL && aldl_raw_is_header(p, left))
+		return 0;
+
+	// a record belongs to the last segment header before it
+	hi = r->num_segments;
+	while (hi - lo > 1)
+	{
+		mid = lo + (hi-lo)/2;
+		if (r->segments[mid] < c->offset)
+			lo = mid;
+		else hi = mid;
+	}
+	return aldl_log_reader_position(r, c, r->segments[lo], c->offset);
+}
+
+// reads the frame at c into frame and moves c past it.
+// returns 1 if a frame was read, 0 at the end of the log.
+int aldl_log_reader_next(aldl_log_reader_t* r, aldl_log_cursor_t* c, aldl_log_frame_t* frame)
+{
+	aldl_raw_header_t h;
+	aldl_raw_record_t rec, prev;
+	const char* p;
+	uint64_t left, usec, next;
+	long res;
+
+	while (c->offset < r->size)
+	{
+		p = aldl_log_reader_at(r, c, c->offset, &left);
+
+		// p is NULL in a lost member of a compressed log
+		if (p != NULL && aldl_raw_is_header(p, left))
+		{
+			res = aldl_raw_parse_header(p, left, &h);
+			if (res > 0)
+			{
+				c->header = h;
+				c->definition = aldl_log_reader_definition(&h);
+				c->segment++;
+				c->offset += res;
+				c->frame_length = 0;
+				continue;
+			}
+		}
+		// records before the first valid header can't be placed in time
+		else if (p != NULL && c->segment != 0)
+		{
+			if ((unsigned char)p[0] == ALDL_RAW_DELTA_TAG && c->frame_length != 0)
+			{
+				prev.length = c->frame_length;
+				prev.seq = c->seq;
+				prev.time = c->time;
+				prev.frame = c->frame;
+				res = aldl_raw_parse_delta(p, left, &prev, c->frame, &rec);
+			}
+			else
+			{
+				res = aldl_raw_parse_record(p, left, &rec);
+				// a delta record may follow it
+				c->frame_length = 0;
+				if (res > 0 && c->header.version == ALDL_RAW_VERSION_DELTA
+					&& rec.length <= ALDL_RAW_DELTA_MAX_FRAME)
+				{
+					memcpy(c->frame, rec.frame, rec.length);
+					c->frame_length = rec.length;
+				}
+			}
+			if (res > 0)
+			{
+				c->seq = rec.seq;
+				c->time = rec.time;
+				frame->data = rec.frame;
+				frame->length = rec.length;
+				frame->seq = rec.seq;
+				frame->time = rec.time;
+				frame->offset = c->offset;
+				frame->data_offset = (c->definition == NULL) ? 0
+								: aldl_definition_data_offset(c->definition, rec.frame, rec.length);
+				usec = c->header.start.tv_usec + rec.time/1000;
+				frame->timestamp.tv_sec = c->header.start.tv_sec + usec/1000000;
+				frame->timestamp.tv_usec = usec%1000000;
+				c->offset += res;
+				return 1;
+			}
+		}
+
+		// corrupt or cut short: skip to the next thing that checks out
+		next = aldl_log_reader_resync(r, c, c->offset+1);
+		c->skipped += next - c->offset;
+		c->offset = next;
+		c->frame_length = 0;
+	}
+	return 0;
+}
+
+// ============================================================================
+// SEEKING WITH AN INDEX
+// ============================================================================
+
+// positions c at the first record of block, in the log r is reading.
+// returns 0 on success, -1 if the index doesn't match the log.
+int aldl_log_index_position(aldl_log_index_t* x, unsigned long block,
+							aldl_log_reader_t* r, aldl_log_cursor_t* c)
+{
+	if (block >= x->num_blocks)
+		return -1;
+	return aldl_log_reader_position(r, c, x->blocks[block].segment_offset, x->blocks[block].offset);
+}
+
+// positions c at the first record received at or after t.
+// returns 0 on success, -1 if the index doesn't match the log.
+int aldl_log_index_seek(aldl_log_index_t* x, aldl_log_reader_t* r, aldl_log_cursor_t* c,
+						const struct timeval* t)
+{
+	aldl_log_frame_t frame;
+	char prev[ALDL_RAW_DELTA_MAX_FRAME];
+	unsigned int prev_length;
+	uint32_t prev_seq;
+	uint64_t prev_time;
+	long block = -1;
+	int res = 0;
+
+	if (x != NULL)
+		block = aldl_log_index_lookup(x, t);
+	if (block < 0 || aldl_log_index_position(x, block, r, c) != 0)
+	{
+		res = (block < 0) ? 0 : -1;
+		aldl_log_reader_rewind(r, c);
+	}
+
+	// the rest of the way one record at a time: at most a block with an index.
+	// the first frame at or after t is put back by moving c to its record
+	// with the frame before it, which a delta record is rebuilt from. (the
+	// cursor itself is too big to copy for every frame.)
+	for (;;)
+	{
+		prev_length = c->frame_length;
+		prev_seq = c->seq;
+		prev_time = c->time;
+		memcpy(prev, c->frame, prev_length);
+		if (!aldl_log_reader_next(r, c, &frame))
+			break;
+		if (frame.timestamp.tv_sec > t->tv_sec
+			|| (frame.timestamp.tv_sec == t->tv_sec && frame.timestamp.tv_usec >= t->tv_usec))
+		{
+			c->offset = frame.offset;
+			memcpy(c->frame, prev, prev_length);
+			c->frame_length = prev_length;
+			c->seq = prev_seq;
+			c->time = prev_time;
+			break;
+		}
+	}
+	return res;
+}
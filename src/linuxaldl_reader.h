@@ -0,0 +1,176 @@
+#ifndef LINUXALDL_READER_INCLUDED
+#define LINUXALDL_READER_INCLUDED
+
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <sys/time.h>
+#include "linuxaldl_core.h"
+#include "linuxaldl_log.h"
+#include "linuxaldl_index.h"
+
+// ============================================================================
+// RAW LOG READER
+// ============================================================================
+// an aldl_log_reader_t maps a raw format log file (see linuxaldl_log.h) into
+// memory instead of reading it. opening only checks the first segment
+// header, however big the file is, and the pages of the file are read by the
+// kernel as frames are looked at. frames are handed out as views into the
+// mapping, so nothing is copied; they are valid until the reader is closed.
+// only frames stored as delta records (see linuxaldl_log.h) have to be
+// rebuilt, in the cursor, and are valid until the cursor moves on.
+//
+// frames are read in order with an aldl_log_cursor_t; any number of cursors
+// can walk the same reader, from any number of threads. nothing is decoded
+// by the reader: a frame's data block (at data_offset) goes to
+// aldl_decode_plan_run_batch() or aldl_update_data_set() only when its
+// values are wanted.
+//
+// a corrupt record (bad mark or crc) is skipped by searching forward for the
+// next valid (full) record or segment header; the delta records in between
+// can't be rebuilt. a record cut short at the end of the
+// file (or one whose length was corrupted to run past it) is skipped the
+// same way, which ends the log.
+//
+// a compressed log (see linuxaldl_gz.h) can't be read in place. opening it
+// only finds its members; each cursor decompresses the member it is in when
+// it gets there, into a window of its own, and frames point into that
+// window: they are valid until the cursor moves on, like rebuilt ones.
+// offsets are offsets in the log the file holds, and a member that can't be
+// decompressed is skipped like any other damage.
+//
+// the whole file is mapped at once, so logs over 2GB need a 64 bit build.
+
+// aldl_log_reader_t: a mapped raw log file
+typedef struct _aldl_log_reader
+{
+	int fd;
+	const char* map;			// the file
+	uint64_t file_size;			// its size when it was opened
+	uint64_t size;				// size of the log: of the file, or of the log it holds
+	aldl_gz_file_t gz;			// a compressed file's members. num_members is 0 for others.
+	aldl_raw_header_t header;	// header of the first segment
+	aldl_definition* definition; // definition of the first segment, NULL if there is
+								 // no definition with its name and hash
+	uint64_t* segments;			// offset of every segment header, in order. found by the
+	unsigned long num_segments;	// first aldl_log_reader_locate()
+} aldl_log_reader_t;
+
+// aldl_log_window_t: the members of a compressed log a cursor is reading.
+// a member and the one after it (if it follows on) are decompressed side by
+// side, so a record that starts at the end of one is whole: records are cut
+// between members only when a member is full, and are smaller than one.
+typedef struct _aldl_log_window
+{
+	long member;				// member at the start of buf, -1 if none
+	uint64_t offset;			// its log offset
+	unsigned long first;		// its length
+	unsigned long length;		// bytes in buf: it, and the member after it
+	int damaged;				// 1 if member couldn't be decompressed
+	char buf[2*ALDL_GZ_MEMBER_SIZE];
+} aldl_log_window_t;
+
+// aldl_log_cursor_t: a position in a reader
+typedef struct _aldl_log_cursor
+{
+	uint64_t offset;			// file offset of the next record or segment header
+	aldl_raw_header_t header;	// header of the segment offset is in
+	aldl_definition* definition; // its definition, NULL if unknown
+	unsigned int segment;		// number of segments started, counting the current one
+	unsigned long skipped;		// bytes of corrupt data skipped so far
+
+	// version 3 segments: the last frame read, which a delta record is rebuilt from
+	char frame[ALDL_RAW_DELTA_MAX_FRAME];
+	unsigned int frame_length;	// its length, 0 if a delta record can't follow
+	uint32_t seq;				// its sequence number
+	uint64_t time;				// and nanoseconds from time 0
+
+	aldl_log_window_t window;	// compressed logs: what is decompressed. last, so a
+								// cursor can be reset without clearing it.
+} aldl_log_cursor_t;
+
+// aldl_log_frame_t: a frame read from the log
+typedef struct _aldl_log_frame
+{
+	const char* data;			// the whole frame: in the mapping, or for a delta
+								// record or a compressed log in the cursor until
+								// it moves on
+	unsigned int length;
+	unsigned int data_offset;	// offset of the mode1 data block in data, 0 if the
+								// frame has none or the definition is unknown
+	uint32_t seq;				// sequence number in the segment
+	uint64_t time;				// nanoseconds from the segment's time 0
+	struct timeval timestamp;	// wall clock time it was received
+	uint64_t offset;			// file offset of its record
+} aldl_log_frame_t;
+
+// function prototypes
+// =================================================
+
+int aldl_log_reader_open(aldl_log_reader_t* r, const char* filename);
+// maps the raw log filename (or finds the members of a compressed one) and
+// reads its first segment header.
+// returns 0 on success, -1 if the file can't be mapped or doesn't start
+// with a valid raw log header (a message is printed).
+
+void aldl_log_reader_close(aldl_log_reader_t* r);
+// unmaps the file. frames read from r are no longer valid.
+
+void aldl_log_reader_rewind(aldl_log_reader_t* r, aldl_log_cursor_t* c);
+// positions c at the start of r.
+
+int aldl_log_reader_position(aldl_log_reader_t* r, aldl_log_cursor_t* c,
+							uint64_t segment_offset, uint64_t offset);
+// positions c at the record at file offset offset, in the segment whose
+// header is at segment_offset (see linuxaldl_index.h). c->segment only counts
+// segments from there on.
+// returns 0 on success, -1 if there isn't a valid header and record there.
+
+int aldl_log_reader_locate(aldl_log_reader_t* r, aldl_log_cursor_t* c, uint64_t offset);
+// positions c at the first record at or after file offset offset that can be
+// read without the ones before it: a segment header or a full record. this
+// is how a log is split into parts that can be read at the same time; the
+// cursor for a part reads until it gets to where the next one was located.
+// the first call finds every segment header in the log, so make it before
+// r is shared between threads.
+// returns 0 on success, -1 if there is nothing more to read (c is then at
+// the end of the log).
+
+int aldl_log_reader_next(aldl_log_reader_t* r, aldl_log_cursor_t* c, aldl_log_frame_t* frame);
+// reads the frame at c into frame and moves c past it, going on into the
+// next segment where one starts.
+// returns 1 if a frame was read, 0 at the end of the log.
+
+// with an index (linuxaldl_index.h)
+// ------------------------------------
+int aldl_log_index_position(aldl_log_index_t* x, unsigned long block,
+							aldl_log_reader_t* r, aldl_log_cursor_t* c);
+// positions c at the first record of block, in the log r is reading.
+// c->segment only counts segments from there on.
+// returns 0 on success, -1 if the index doesn't match the log.
+
+int aldl_log_index_seek(aldl_log_index_t* x, aldl_log_reader_t* r, aldl_log_cursor_t* c,
+						const struct timeval* t);
+// positions c at the first record received at or after t. with x NULL (no
+// index) the log is read from the start to find it.
+// returns 0 on success, -1 if the index doesn't match the log (t is then
+// found by reading from the start).
+
+#endif
@@ -0,0 +1,169 @@
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <gtk/gtk.h>
+#include "linuxaldl_readout.h"
+
+static gboolean aldl_readout_expose(GtkWidget* widget, GdkEventExpose* event, gpointer data);
+
+// sets the text of layout and returns its size in pixels.
+static void aldl_readout_measure(PangoLayout* layout, const char* text, int* width, int* height)
+{
+	pango_layout_set_text(layout, text, -1);
+	pango_layout_get_pixel_size(layout, width, height);
+}
+
+// lays out a readout for def with every value showing "N/A".
+aldl_readout_t* aldl_readout_new(aldl_definition* def)
+{
+	aldl_readout_t* r;
+	byte_def_t* defs = def->mode1_def;
+	PangoFontDescription* bold;
+	unsigned int i;
+	int width, height;
+	int label_width = 0, units_width = 0, header_width = 0;
+
+	r = g_malloc0(sizeof(aldl_readout_t));
+	r->definition = def;
+	while (defs[r->num_items].label != NULL)
+		r->num_items++;
+	r->shown = g_malloc0(r->num_items*ALDL_STRING_SLOT_SIZE);
+
+	r->area = gtk_drawing_area_new();
+	r->layout = gtk_widget_create_pango_layout(r->area, NULL);
+	r->header_layout = gtk_widget_create_pango_layout(r->area, NULL);
+	bold = pango_font_description_copy(r->area->style->font_desc);
+	pango_font_description_set_weight(bold, PANGO_WEIGHT_BOLD);
+	pango_layout_set_font_description(r->header_layout, bold);
+	pango_font_description_free(bold);
+
+	// every column is as wide as its widest text, every row as high as the tallest
+	aldl_readout_measure(r->layout, ALDL_READOUT_VALUE_SAMPLE, &r->value_width, &r->row_height);
+	for (i=0; i<r->num_items; i++)
+	{
+		if (defs[i].operation == ALDL_OP_SEPERATOR)
+		{
+			aldl_readout_measure(r->header_layout, defs[i].label, &width, &height);
+			header_width = MAX(header_width, width);
+			r->row_height = MAX(r->row_height, height);
+			continue;
+		}
+		aldl_readout_measure(r->layout, defs[i].label, &width, &height);
+		label_width = MAX(label_width, width);
+		r->row_height = MAX(r->row_height, height);
+		aldl_readout_measure(r->layout, defs[i].units, &width, &height);
+		units_width = MAX(units_width, width);
+		strcpy(r->shown + i*ALDL_STRING_SLOT_SIZE, "N/A");
+	}
+
+	r->value_x = ALDL_READOUT_PAD + label_width + 2*ALDL_READOUT_PAD;
+	r->units_x = r->value_x + r->value_width + ALDL_READOUT_PAD;
+	width = MAX(r->units_x + units_width, ALDL_READOUT_PAD + header_width) + ALDL_READOUT_PAD;
+	gtk_widget_set_size_request(r->area, width, r->num_items*r->row_height + 2*ALDL_READOUT_PAD);
+
+	g_signal_connect(G_OBJECT(r->area), "expose_event", G_CALLBACK(aldl_readout_expose), r);
+	return r;
+}
+
+// sets the text of item i's value. if it differs from what the cell shows,
+// only that cell is queued to be redrawn.
+void aldl_readout_set_text(aldl_readout_t* r, unsigned int i, const char* text)
+{
+	char* shown = r->shown + i*ALDL_STRING_SLOT_SIZE;
+
+	if (strncmp(shown, text, ALDL_STRING_SLOT_SIZE) == 0)
+		return;
+	g_strlcpy(shown, text, ALDL_STRING_SLOT_SIZE);
+	gtk_widget_queue_draw_area(r->area, r->value_x, ALDL_READOUT_PAD + i*r->row_height,
+								r->value_width, r->row_height);
+}
+
+// frees r. r->area must already have been destroyed.
+void aldl_readout_free(aldl_readout_t* r)
+{
+	if (r == NULL)
+		return;
+	g_object_unref(r->layout);
+	g_object_unref(r->header_layout);
+	g_free(r->shown);
+	g_free(r);
+}
+
+// draws text with layout at x,y if the rectangle x,y,width,row_height is in region.
+static void aldl_readout_draw_cell(aldl_readout_t* r, cairo_t* cr, GdkRegion* region,
+									PangoLayout* layout, const char* text, int x, int y, int width)
+{
+	GdkRectangle cell = { x, y, width, r->row_height };
+
+	if (gdk_region_rect_in(region, &cell) == GDK_OVERLAP_RECTANGLE_OUT)
+		return;
+	cairo_save(cr);
+	cairo_rectangle(cr, x, y, width, r->row_height);
+	cairo_clip(cr);
+	cairo_move_to(cr, x, y);
+	pango_layout_set_text(layout, text, -1);
+	pango_cairo_show_layout(cr, layout);
+	cairo_restore(cr);
+}
+
+// "expose_event" handler: repaints the exposed rows of the grid.
+static gboolean aldl_readout_expose(GtkWidget* widget, GdkEventExpose* event, gpointer data)
+{
+	aldl_readout_t* r = (aldl_readout_t*)data;
+	byte_def_t* defs = r->definition->mode1_def;
+	int first, last, i, y;
+	int width = widget->allocation.width;
+	cairo_t* cr;
+
+	if (r->num_items == 0)
+		return TRUE;
+
+	cr = gdk_cairo_create(widget->window);
+	gdk_cairo_region(cr, event->region);
+	cairo_clip(cr);
+	gdk_cairo_set_source_color(cr, &widget->style->bg[GTK_STATE_NORMAL]);
+	cairo_paint(cr);
+	gdk_cairo_set_source_color(cr, &widget->style->fg[GTK_STATE_NORMAL]);
+
+	// only the rows the exposed area covers
+	first = MAX(event->area.y - ALDL_READOUT_PAD, 0)/r->row_height;
+	last = MIN((event->area.y + event->area.height - ALDL_READOUT_PAD)/r->row_height,
+				(int)r->num_items - 1);
+
+	for (i=first; i<=last; i++)
+	{
+		y = ALDL_READOUT_PAD + i*r->row_height;
+		if (defs[i].operation == ALDL_OP_SEPERATOR)
+		{
+			aldl_readout_draw_cell(r, cr, event->region, r->header_layout, defs[i].label,
+									ALDL_READOUT_PAD, y, width - 2*ALDL_READOUT_PAD);
+			continue;
+		}
+		aldl_readout_draw_cell(r, cr, event->region, r->layout, defs[i].label,
+								2*ALDL_READOUT_PAD, y, r->value_x - 3*ALDL_READOUT_PAD);
+		aldl_readout_draw_cell(r, cr, event->region, r->layout, r->shown + i*ALDL_STRING_SLOT_SIZE,
+								r->value_x, y, r->value_width);
+		aldl_readout_draw_cell(r, cr, event->region, r->layout, defs[i].units,
+								r->units_x, y, width - r->units_x - ALDL_READOUT_PAD);
+	}
+
+	cairo_destroy(cr);
+	return TRUE;
+}
@@ -0,0 +1,70 @@
+#ifndef LINUXALDL_READOUT_INCLUDED
+#define LINUXALDL_READOUT_INCLUDED
+
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <gtk/gtk.h>
+#include "linuxaldl_core.h"
+
+// ============================================================================
+// DRAWN DATA READOUT
+// ============================================================================
+// the whole Data Readout of a definition as one GtkDrawingArea painted with
+// cairo, instead of a name, value and units GtkLabel (each in a GtkAlignment)
+// for every item. the grid is laid out once when the readout is made: every
+// text metric is measured then, so drawing never measures anything.
+// a value that changes only invalidates its own cell, and an expose only
+// draws the rows the exposed area covers.
+
+#define ALDL_READOUT_PAD 6 // pixels around the grid and between its columns
+#define ALDL_READOUT_VALUE_SAMPLE "-888888.8" // the widest value text the value
+											  // column is sized for. wider text is clipped.
+
+typedef struct _aldl_readout
+{
+	GtkWidget* area;			// the drawing area. put it in a container to show it.
+	aldl_definition* definition;
+	unsigned int num_items;		// entries in definition->mode1_def (seperators included)
+	char* shown;				// the text each value cell shows, ALDL_STRING_SLOT_SIZE per item
+	PangoLayout* layout;		// draws names, values and units
+	PangoLayout* header_layout;	// draws seperator labels, in bold
+
+	// text metrics, measured by aldl_readout_new(). item i is drawn on row i.
+	int row_height;
+	int value_x;				// x of the value column. names are indented under their seperator.
+	int value_width;
+	int units_x;				// x of the units column
+} aldl_readout_t;
+
+// function prototypes
+// =================================================
+
+aldl_readout_t* aldl_readout_new(aldl_definition* def);
+// lays out a readout for def with every value showing "N/A".
+
+void aldl_readout_set_text(aldl_readout_t* r, unsigned int i, const char* text);
+// sets the text of item i's value. if it differs from what the cell shows,
+// only that cell is queued to be redrawn.
+
+void aldl_readout_free(aldl_readout_t* r);
+// frees r. r->area must already have been destroyed (destroying its
+// container does that).
+
+#endif
@@ -0,0 +1,711 @@
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <termios.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include "linuxaldl_session.h"
+
+// epoll data for the mux's wakeup eventfd. session descriptors are tagged
+// with (index << 1), plus 1 for the session's timer, and descriptors added
+// with aldl_mux_watch() with ALDL_MUX_WATCH_TAG + their index.
+#define ALDL_MUX_WAKE_TAG (~(uint64_t)0)
+#define ALDL_MUX_WATCH_TAG ((uint64_t)1 << 32)
+#define ALDL_MUX_MAX_EVENTS 32
+
+// ============================================================================
+// TIME HELPERS
+// ============================================================================
+
+// adds msec milliseconds to ts
+static void timespec_add_msec(struct timespec* ts, unsigned int msec)
+{
+	ts->tv_sec += msec/1000;
+	ts->tv_nsec += (long)(msec%1000)*1000000;
+	if (ts->tv_nsec >= 1000000000)
+	{
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+// returns nonzero if a is earlier than b
+static int timespec_before(struct timespec* a, struct timespec* b)
+{
+	return (a->tv_sec < b->tv_sec) || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+// ============================================================================
+// SESSIONS
+// ============================================================================
+
+// connects to the ALDL interface on portname and sets up the session.
+// returns 0 on success, -1 on failure.
+int aldl_session_open(aldl_session_t* s, const char* portname, aldl_definition* def)
+{
+	int fd = serial_connect(portname,O_RDWR | O_NOCTTY | O_NONBLOCK,BAUDRATE);
+	if (fd == -1)
+	{
+		fprintf(stderr," Couldn't open %s\n",portname);
+		return -1;
+	}
+
+	// the ALDL runs at 8192 baud. 9600 works too; framing errors are
+	// caught by bad checksums.
+	if (set_custom_baud_rate(fd,8192)!=0)
+		fprintf(stderr," %s: couldn't set baud rate to 8192. Using standard rate (9600).\n",portname);
+
+	if (aldl_session_attach(s, fd, def) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	s->portname = portname;
+	s->owns_fd = 1;
+	return 0;
+}
+
+// sets up a session for an already open port fd.
+// returns 0 on success, -1 on failure.
+int aldl_session_attach(aldl_session_t* s, int fd, aldl_definition* def)
+{
+	size_t seq_size, floats_size;
+	unsigned int num_items = 0;
+	char* pool;
+
+	memset(s,0,sizeof(aldl_session_t));
+	s->portname = "";
+	s->fd = fd;
+	s->definition = def;
+	s->scan_mode = ALDL_SCAN_INTERVAL;
+	s->scan_interval = ALDL_SESSION_DEFAULT_INTERVAL;
+	s->scan_timeout = ALDL_SESSION_DEFAULT_TIMEOUT;
+	s->bus_guard_time = ALDL_SESSION_DEFAULT_GUARD_TIME;
+
+	while (def->mode1_def[num_items].label != NULL)
+		num_items++;
+	s->num_items = num_items;
+	s->frame_size = aldl_definition_max_frame(def);
+
+	// sequence numbers and floats first so they stay aligned, then the byte arrays
+	seq_size = num_items*sizeof(unsigned long);
+	floats_size = num_items*sizeof(float);
+	pool = calloc(1, seq_size + floats_size + 2*def->mode1_data_length + s->frame_size);
+	if (pool == NULL)
+		return -1;
+	s->pool = pool;
+	s->data_set_changed = (unsigned long*)pool;
+	s->data_set_floats = (float*)(pool + seq_size);
+	s->data_set_raw = pool + seq_size + floats_size;
+	s->decoded_raw = s->data_set_raw + def->mode1_data_length;
+	s->frame = s->decoded_raw + def->mode1_data_length;
+
+	if (aldl_decode_plan_compile(&s->plan, def) != 0)
+	{
+		free(s->pool);
+		s->pool = NULL;
+		return -1;
+	}
+	// the floats start out decoded from an all zero block
+	s->data_set_seq = 1;
+	aldl_decode_plan_update(&s->plan, NULL, s->decoded_raw, s->data_set_floats, s->data_set_changed, 1);
+
+	s->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (s->timerfd == -1)
+	{
+		aldl_decode_plan_free(&s->plan);
+		free(s->pool);
+		s->pool = NULL;
+		return -1;
+	}
+
+	// the request with its checksum is the same every time
+	memcpy(s->mode1_request,def->mode1_request,def->mode1_request_length-1);
+	s->mode1_request[def->mode1_request_length-1] = get_checksum(s->mode1_request,def->mode1_request_length-1);
+
+	return 0;
+}
+
+// frees the session's buffers and timer, and closes the port if the session opened it.
+void aldl_session_close(aldl_session_t* s)
+{
+	if (s->timerfd != -1)
+		close(s->timerfd);
+	s->timerfd = -1;
+	if (s->owns_fd && s->fd != -1)
+		close(s->fd);
+	s->fd = -1;
+	free(s->pool);
+	s->pool = NULL;
+	aldl_decode_plan_free(&s->plan);
+}
+
+// converts the session's data_set_raw into data_set_floats, decoding only
+// the items that changed since the last call.
+void aldl_session_update_floats(aldl_session_t* s)
+{
+	s->data_set_seq++;
+	aldl_decode_plan_update(&s->plan, s->decoded_raw, s->data_set_raw,
+							s->data_set_floats, s->data_set_changed, s->data_set_seq);
+}
+
+// marks the session failed, keeping the errno that caused it
+static void aldl_session_fail(aldl_session_t* s, const char* what)
+{
+	s->error = errno;
+	s->state = ALDL_SESSION_FAILED;
+	fprintf(stderr,"%s: %s: %s. Stopping this port.\n",s->portname,what,strerror(s->error));
+}
+
+// sets the session's timer to go off at the absolute time when
+static void aldl_session_arm(aldl_session_t* s, struct timespec* when)
+{
+	struct itimerspec its;
+
+	memset(&its,0,sizeof(its));
+	its.it_value = *when;
+	timerfd_settime(s->timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+// writes a complete message to the port. the messages are a few bytes, so
+// they always fit in the output queue of a non-blocking port.
+static int aldl_session_send(aldl_session_t* s, const char* msg, unsigned int len)
+{
+	if (write(s->fd, msg, len) != (ssize_t)len)
+	{
+		aldl_session_fail(s,"write failed");
+		return -1;
+	}
+	return 0;
+}
+
+// clears anything received so far and sends the mode 1 request
+static void aldl_session_request(aldl_session_t* s, struct timespec* now)
+{
+	struct timespec deadline;
+
+	tcflush(s->fd,TCIFLUSH);
+	aldl_stream_reset(&s->stream);
+	s->request_bad_checksums = s->stream.bad_checksums;
+	s->request_discarded = s->stream.discarded;
+
+	if (aldl_session_send(s, s->mode1_request, s->definition->mode1_request_length) != 0)
+		return;
+
+	s->state = ALDL_SESSION_WAITING;
+	deadline = *now;
+	timespec_add_msec(&deadline, __atomic_load_n(&s->scan_timeout, __ATOMIC_RELAXED));
+	aldl_session_arm(s, &deadline);
+}
+
+// counts the polls in a row that received bytes outside any frame. one
+// stray byte (line noise, or one skipped past a bad checksum) isn't enough;
+// ALDL_SESSION_CHATTER_POLLS in a row mean the ECM is chattering in a way
+// the parser doesn't recognize and has to be silenced again.
+static void aldl_session_count_chatter(aldl_session_t* s)
+{
+	if (s->stream.discarded == s->request_discarded)
+		s->chatter_polls = 0;
+	else if (++s->chatter_polls >= ALDL_SESSION_CHATTER_POLLS)
+		s->silenced = 0;
+}
+
+// schedules the next request after a response or timeout. if the cycle
+// overran the interval the next one starts right away rather than bursting.
+// the interval and guard time may be stored by another thread (see
+// aldl_session_t), so they are loaded atomically.
+static void aldl_session_schedule(aldl_session_t* s, struct timespec* now)
+{
+	if (s->scan_mode == ALDL_SCAN_THROUGHPUT)
+	{
+		// only leave the bus idle for the guard time
+		s->next_poll = *now;
+		timespec_add_msec(&s->next_poll, __atomic_load_n(&s->bus_guard_time, __ATOMIC_RELAXED));
+	}
+	else timespec_add_msec(&s->next_poll, __atomic_load_n(&s->scan_interval, __ATOMIC_RELAXED));
+
+	if (timespec_before(&s->next_poll, now))
+		s->next_poll = *now;
+
+	s->state = ALDL_SESSION_IDLE;
+	aldl_session_arm(s, &s->next_poll);
+}
+
+// hands the frame in s->frame to the session's sink
+static void aldl_session_deliver(aldl_session_t* s, int len, unsigned int data_offset)
+{
+	struct timeval timestamp;
+
+	gettimeofday(&timestamp, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &s->frame_time);
+	s->frames++;
+
+	if (data_offset != 0)
+		memcpy(s->data_set_raw, s->frame+data_offset, s->definition->mode1_data_length);
+	else s->undecoded++;
+
+	if (s->sink != NULL)
+		s->sink(s, s->frame, len, data_offset, &timestamp, s->sink_arg);
+}
+
+// starts the session's state machine. the session fails if the definition
+// gives the parser no frames to look for in the scan mode.
+static void aldl_session_start(aldl_session_t* s, struct timespec* now)
+{
+	s->silenced = 0;
+	s->chatter_polls = 0;
+	if (aldl_definition_setup_stream(&s->stream, s->definition, s->scan_mode) != 0)
+	{
+		errno = EINVAL;
+		aldl_session_fail(s,"no frames to receive with this definition and scan mode");
+		return;
+	}
+
+	if (s->scan_mode == ALDL_SCAN_PASSIVE)
+	{
+		s->state = ALDL_SESSION_LISTENING;
+		return;
+	}
+
+	// first poll right away
+	s->next_poll = *now;
+	s->state = ALDL_SESSION_IDLE;
+	aldl_session_arm(s, now);
+}
+
+// handles the session's timer going off
+static void aldl_session_on_timer(aldl_session_t* s)
+{
+	struct timespec now, settle;
+	uint64_t expirations;
+
+	// clear the timer's readiness. a stale expiration (from a timer rearmed
+	// after it fired) leaves nothing to read.
+	if (read(s->timerfd, &expirations, sizeof(expirations)) != sizeof(expirations))
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	switch (s->state)
+	{
+	case ALDL_SESSION_IDLE:
+		// silence the ecm if it has fallen back to normal mode chatter,
+		// and let the line settle before the request goes out
+		if (!s->silenced)
+		{
+			if (aldl_session_send(s, s->definition->mode8_request, s->definition->mode8_request_length) != 0)
+				return;
+			s->silence_requests++;
+			s->chatter_polls = 0;
+			s->state = ALDL_SESSION_SILENCING;
+			settle = now;
+			timespec_add_msec(&settle, ALDL_SESSION_SETTLE_TIME);
+			aldl_session_arm(s, &settle);
+			return;
+		}
+		aldl_session_request(s, &now);
+		break;
+
+	case ALDL_SESSION_SILENCING:
+		s->silenced = 1;
+		aldl_session_request(s, &now);
+		break;
+
+	case ALDL_SESSION_WAITING:
+		// no complete response. if nothing at all came back the ecm may
+		// have been reset and resumed normal mode.
+		if (s->stream.bad_checksums != s->request_bad_checksums)
+		{
+			s->bad_checksums++;
+			aldl_session_count_chatter(s);
+		}
+		else
+		{
+			s->timeouts++;
+			s->silenced = 0;
+		}
+		aldl_session_schedule(s, &now);
+		break;
+
+	default:
+		break;
+	}
+}
+
+// handles bytes arriving on the session's port
+static void aldl_session_on_readable(aldl_session_t* s)
+{
+	struct timespec now;
+	unsigned int space;
+	char* ptr;
+	int res, id;
+	ssize_t n;
+
+	// read everything available straight into the frame parser
+	for (;;)
+	{
+		space = aldl_stream_reserve(&s->stream, &ptr);
+		if (space == 0)
+		{
+			// can't happen while frames fit in half the buffer
+			s->stream.overruns += s->stream.tail - s->stream.head;
+			aldl_stream_reset(&s->stream);
+			continue;
+		}
+		n = read(s->fd, ptr, space);
+		if (n > 0)
+		{
+			aldl_stream_commit(&s->stream, n);
+			if ((unsigned int)n < space)
+				break;
+			continue;
+		}
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (n == 0)
+			errno = EIO; // the device went away
+		aldl_session_fail(s,"read failed");
+		return;
+	}
+
+	switch (s->state)
+	{
+	case ALDL_SESSION_LISTENING:
+		while ((res = aldl_stream_next_frame(&s->stream, s->frame, s->frame_size, &id)) != 0)
+		{
+			if (res > 0 && id >= 0)
+				aldl_session_deliver(s, res, s->definition->broadcast_frames[id].data_offset);
+		}
+		break;
+
+	case ALDL_SESSION_WAITING:
+		// the echo of the request and normal mode frames can come ahead of
+		// the response. a normal mode frame means the ECM has to be
+		// silenced again; the echo is just consumed.
+		while ((res = aldl_stream_next_frame(&s->stream, s->frame, s->frame_size, &id)) > 0 && id != -1)
+		{
+			if (id != ALDL_FRAME_ECHO)
+				s->silenced = 0;
+		}
+		if (res == 0)
+			break; // wait for the rest of the response
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (res > 0)
+			aldl_session_deliver(s, res, s->definition->mode1_data_offset);
+		else s->bad_checksums++;
+
+		aldl_session_count_chatter(s);
+		aldl_session_schedule(s, &now);
+		break;
+
+	default:
+		// nothing is expected between polls. the input is flushed
+		// before the next request.
+		aldl_stream_reset(&s->stream);
+		break;
+	}
+}
+
+// ============================================================================
+// MULTIPLEXER
+// ============================================================================
+
+// sets up an empty mux. returns 0 on success, -1 on failure.
+int aldl_mux_init(aldl_mux_t* mux)
+{
+	struct epoll_event ev;
+
+	memset(mux,0,sizeof(aldl_mux_t));
+	mux->running = 1;
+
+	mux->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (mux->epfd == -1)
+		return -1;
+
+	mux->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (mux->wakefd == -1)
+	{
+		close(mux->epfd);
+		return -1;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.u64 = ALDL_MUX_WAKE_TAG;
+	if (epoll_ctl(mux->epfd, EPOLL_CTL_ADD, mux->wakefd, &ev) != 0)
+	{
+		close(mux->wakefd);
+		close(mux->epfd);
+		return -1;
+	}
+	return 0;
+}
+
+// releases the mux. the sessions are not closed.
+void aldl_mux_destroy(aldl_mux_t* mux)
+{
+	close(mux->wakefd);
+	close(mux->epfd);
+	mux->num_sessions = 0;
+	mux->num_watches = 0;
+}
+
+// adds s to the mux.
+// returns 0 on success, -1 if the mux is full or the session can't be watched.
+int aldl_mux_add(aldl_mux_t* mux, aldl_session_t* s)
+{
+	struct epoll_event ev;
+	uint64_t tag = (uint64_t)mux->num_sessions << 1;
+
+	if (mux->num_sessions >= ALDL_MUX_MAX_SESSIONS)
+		return -1;
+
+	ev.events = EPOLLIN;
+	ev.data.u64 = tag;
+	if (epoll_ctl(mux->epfd, EPOLL_CTL_ADD, s->fd, &ev) != 0)
+		return -1;
+
+	ev.events = EPOLLIN;
+	ev.data.u64 = tag | 1;
+	if (epoll_ctl(mux->epfd, EPOLL_CTL_ADD, s->timerfd, &ev) != 0)
+	{
+		epoll_ctl(mux->epfd, EPOLL_CTL_DEL, s->fd, NULL);
+		return -1;
+	}
+
+	mux->sessions[mux->num_sessions++] = s;
+	mux->active++;
+	return 0;
+}
+
+// makes the mux call handler whenever fd is readable.
+// returns 0 on success, -1 if the mux is full or fd can't be watched.
+int aldl_mux_watch(aldl_mux_t* mux, int fd, aldl_mux_handler_t handler, void* arg)
+{
+	struct epoll_event ev;
+
+	if (mux->num_watches >= ALDL_MUX_MAX_WATCHES)
+		return -1;
+
+	ev.events = EPOLLIN;
+	ev.data.u64 = ALDL_MUX_WATCH_TAG + mux->num_watches;
+	if (epoll_ctl(mux->epfd, EPOLL_CTL_ADD, fd, &ev) != 0)
+		return -1;
+	mux->watches[mux->num_watches].fd = fd;
+	mux->watches[mux->num_watches].handler = handler;
+	mux->watches[mux->num_watches].arg = arg;
+	mux->num_watches++;
+	return 0;
+}
+
+// stops watching a session that has failed
+static void aldl_mux_drop(aldl_mux_t* mux, aldl_session_t* s)
+{
+	epoll_ctl(mux->epfd, EPOLL_CTL_DEL, s->fd, NULL);
+	epoll_ctl(mux->epfd, EPOLL_CTL_DEL, s->timerfd, NULL);
+	mux->active--;
+}
+
+// starts every session and runs them until aldl_mux_stop() is called or
+// every session has failed. returns 0, or -1 if waiting for events failed.
+int aldl_mux_run(aldl_mux_t* mux)
+{
+	struct epoll_event events[ALDL_MUX_MAX_EVENTS];
+	struct timespec now;
+	aldl_session_t* s;
+	aldl_mux_watch_t* w;
+	uint64_t tag, count;
+	unsigned int i;
+	int n, res = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (i=0; i<mux->num_sessions; i++)
+	{
+		aldl_session_start(mux->sessions[i], &now);
+		if (mux->sessions[i]->state == ALDL_SESSION_FAILED)
+			aldl_mux_drop(mux, mux->sessions[i]);
+	}
+
+	while (__atomic_load_n(&mux->running, __ATOMIC_ACQUIRE) && mux->active > 0)
+	{
+		n = epoll_wait(mux->epfd, events, ALDL_MUX_MAX_EVENTS, -1);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			res = -1;
+			break;
+		}
+
+		for (i=0; i<(unsigned int)n; i++)
+		{
+			tag = events[i].data.u64;
+			if (tag == ALDL_MUX_WAKE_TAG)
+			{
+				if (read(mux->wakefd, &count, sizeof(count)) < 0)
+				{ /* already cleared */ }
+				continue;
+			}
+			if (tag >= ALDL_MUX_WATCH_TAG)
+			{
+				w = mux->watches + (tag - ALDL_MUX_WATCH_TAG);
+				w->handler(mux, w->fd, w->arg);
+				continue;
+			}
+
+			s = mux->sessions[tag >> 1];
+			if (s->state == ALDL_SESSION_FAILED)
+				continue; // dropped earlier in this batch
+
+			if (tag & 1)
+				aldl_session_on_timer(s);
+			else if (events[i].events & EPOLLIN)
+				aldl_session_on_readable(s);
+			else
+			{
+				errno = EIO; // EPOLLHUP/EPOLLERR with nothing to read
+				aldl_session_fail(s,"port error");
+			}
+
+			if (s->state == ALDL_SESSION_FAILED)
+				aldl_mux_drop(mux, s);
+		}
+	}
+
+	// send a mode 9 message to let the ecms resume normal mode
+	for (i=0; i<mux->num_sessions; i++)
+	{
+		s = mux->sessions[i];
+		if (s->state == ALDL_SESSION_FAILED || s->state == ALDL_SESSION_LISTENING)
+			continue;
+		if (write(s->fd, s->definition->mode9_request, s->definition->mode9_request_length) > 0)
+			tcdrain(s->fd);
+		s->silenced = 0;
+	}
+
+	return res;
+}
+
+// makes aldl_mux_run() return. async-signal-safe.
+void aldl_mux_stop(aldl_mux_t* mux)
+{
+	uint64_t one = 1;
+
+	__atomic_store_n(&mux->running, 0, __ATOMIC_RELEASE);
+	if (write(mux->wakefd, &one, sizeof(one)) < 0)
+	{ /* the counter is already nonzero */ }
+}
+
+// thread body for aldl_mux_start_thread()
+static void* aldl_mux_thread(void* arg)
+{
+	aldl_mux_run((aldl_mux_t*)arg);
+	return NULL;
+}
+
+// runs aldl_mux_run() on a new thread. returns 0 on success, -1 on failure.
+int aldl_mux_start_thread(aldl_mux_t* mux)
+{
+	int res = pthread_create(&mux->thread, NULL, aldl_mux_thread, mux);
+	if (res != 0)
+	{
+		fprintf(stderr,"Couldn't start the acquisition thread: %s\n",strerror(res));
+		return -1;
+	}
+	return 0;
+}
+
+// stops a mux started with aldl_mux_start_thread() and waits for its thread.
+void aldl_mux_join(aldl_mux_t* mux)
+{
+	aldl_mux_stop(mux);
+	pthread_join(mux->thread, NULL);
+}
+
+// spreads the sessions round-robin over nthreads muxes and runs each on its
+// own thread. returns the number of threads started (never more than
+// nsessions), or -1 on failure (nothing is left running).
+int aldl_mux_start_sharded(aldl_mux_t* muxes, unsigned int nthreads,
+							aldl_session_t** sessions, unsigned int nsessions)
+{
+	unsigned int i, started = 0;
+
+	if (nthreads == 0 || nthreads > ALDL_MUX_MAX_SHARDS || nsessions == 0)
+		return -1;
+	if (nthreads > nsessions)
+		nthreads = nsessions;
+
+	for (i=0; i<nthreads; i++)
+	{
+		if (aldl_mux_init(muxes+i) != 0)
+			goto fail;
+		started++;
+	}
+
+	for (i=0; i<nsessions; i++)
+	{
+		if (aldl_mux_add(muxes + (i%nthreads), sessions[i]) != 0)
+		{
+			fprintf(stderr,"Couldn't add %s to the multiplexer.\n",sessions[i]->portname);
+			goto fail;
+		}
+	}
+
+	for (i=0; i<nthreads; i++)
+	{
+		if (aldl_mux_start_thread(muxes+i) != 0)
+		{
+			aldl_mux_stop_sharded(muxes, i);
+			for (; i<nthreads; i++)
+				aldl_mux_destroy(muxes+i);
+			return -1;
+		}
+	}
+	return nthreads;
+
+fail:
+	for (i=0; i<started; i++)
+		aldl_mux_destroy(muxes+i);
+	return -1;
+}
+
+// stops and destroys muxes started with aldl_mux_start_sharded().
+void aldl_mux_stop_sharded(aldl_mux_t* muxes, unsigned int nthreads)
+{
+	unsigned int i;
+
+	// stop them all first so the ports wind down together
+	for (i=0; i<nthreads; i++)
+		aldl_mux_stop(muxes+i);
+	for (i=0; i<nthreads; i++)
+	{
+		pthread_join(muxes[i].thread, NULL);
+		aldl_mux_destroy(muxes+i);
+	}
+}
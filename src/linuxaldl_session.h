@@ -0,0 +1,226 @@
+#ifndef LINUXALDL_SESSION_INCLUDED
+#define LINUXALDL_SESSION_INCLUDED
+
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <pthread.h>
+#include <sys/time.h>
+#include "linuxaldl_core.h"
+
+// ============================================================================
+// ALDL SESSIONS AND THE PORT MULTIPLEXER
+// ============================================================================
+// an aldl_session_t holds everything needed to scan one ECM: the port, the
+// definition, scan settings, the frame parser, receive and data buffers,
+// statistics and where frames go. nothing in it refers to the global
+// aldl_settings, so any number of sessions can run in one process.
+//
+// sessions are driven by an aldl_mux_t: one epoll loop that waits on every
+// session's port and deadline timer at once. each session is a small state
+// machine (send request, wait for response or deadline, wait for the next
+// poll) that only runs when one of its descriptors is ready, so an idle
+// port costs nothing. a mux can run in the calling thread or its own thread,
+// and aldl_mux_start_sharded() spreads sessions over several muxes/threads.
+// other descriptors (a log's flush timer, a signalfd) can be watched by the
+// same loop with aldl_mux_watch().
+
+#define ALDL_MUX_MAX_SESSIONS 64 // max number of sessions in one mux
+#define ALDL_MUX_MAX_SHARDS 16 // max number of threads for aldl_mux_start_sharded()
+#define ALDL_MUX_MAX_WATCHES 8 // max number of descriptors added with aldl_mux_watch()
+
+// scan settings given to a session by aldl_session_attach()
+#define ALDL_SESSION_DEFAULT_INTERVAL 150 // msec
+#define ALDL_SESSION_DEFAULT_TIMEOUT 100 // msec
+#define ALDL_SESSION_DEFAULT_GUARD_TIME 10 // msec
+
+#define ALDL_SESSION_SETTLE_TIME 10 // msec to wait after a mode 8 message
+#define ALDL_SESSION_CHATTER_POLLS 3 // polls in a row with stray bytes before the
+									 // ECM is taken to have resumed normal mode
+									// before the first request
+
+typedef enum _ALDL_SESSION_STATE {
+	ALDL_SESSION_IDLE=0,		// waiting for the next poll
+	ALDL_SESSION_SILENCING=1,	// mode 8 sent, waiting for the line to settle
+	ALDL_SESSION_WAITING=2,		// mode 1 request sent, waiting for the response
+	ALDL_SESSION_LISTENING=3,	// ALDL_SCAN_PASSIVE: only receiving
+	ALDL_SESSION_FAILED=4		// the port failed. see error.
+} ALDL_SESSION_STATE_t;
+
+typedef struct _aldl_session aldl_session_t;
+
+// called by the mux for every checksum-verified frame a session receives.
+// frame is only valid during the call; timestamp is the wall clock time it
+// was received and s->frame_time the monotonic time. data_offset is the
+// offset of the mode1 data block in frame, or 0 if the frame doesn't carry one.
+typedef void (*aldl_frame_sink_t)(aldl_session_t* s, const char* frame, unsigned int length,
+								unsigned int data_offset, const struct timeval* timestamp, void* arg);
+
+struct _aldl_session
+{
+	// port
+	const char* portname;	// for messages only
+	int fd;					// serial port, opened with O_NONBLOCK
+	int owns_fd;			// 1 if aldl_session_close() should close fd
+	int timerfd;			// CLOCK_MONOTONIC deadline for the current state
+
+	// definition and scan settings. the scan mode must not be changed while
+	// the session is running: aldl_session_start() sets the parser up for it.
+	// the other settings may be, from any thread, with __atomic_store_n();
+	// the session loads them atomically each time a poll is scheduled.
+	aldl_definition* definition;
+	ALDL_SCAN_MODE_t scan_mode;
+	unsigned int scan_interval;	// msec between requests in ALDL_SCAN_INTERVAL mode
+	unsigned int scan_timeout;	// msec to wait for a response
+	unsigned int bus_guard_time;// msec between a response and the next request
+								// in ALDL_SCAN_THROUGHPUT mode
+
+	// state machine, owned by the mux
+	ALDL_SESSION_STATE_t state;
+	int silenced;				// 1 while the ECM is known to be in mode 8
+	unsigned int chatter_polls;	// polls in a row that received bytes outside any frame
+	struct timespec next_poll;	// when the next request is due
+	unsigned long request_bad_checksums; // stream statistics when the request
+	unsigned long request_discarded;	 // went out, to classify the outcome
+	char mode1_request[__MAX_REQUEST_SIZE]; // mode 1 request with its checksum
+	aldl_stream_t stream;		// frame parser for bytes received on fd
+
+	// buffers, allocated in one block by aldl_session_attach()
+	void* pool;
+	char* frame;				// the frame being delivered
+	struct timespec frame_time;	// CLOCK_MONOTONIC time the frame being delivered was received
+	unsigned int frame_size;	// size of frame: the largest frame the definition has
+	char* data_set_raw;			// data block of the newest decodable frame
+	float* data_set_floats;		// filled in by aldl_session_update_floats()
+	char* decoded_raw;			// the data block data_set_floats was decoded from
+	unsigned long* data_set_changed; // data_set_seq when each value last changed
+								// (0 for seperators and items that aren't decoded)
+	unsigned long data_set_seq;	// counts calls to aldl_session_update_floats()
+	unsigned int num_items;		// entries in definition->mode1_def (seperators included)
+	aldl_decode_plan_t plan;	// definition->mode1_def compiled for decoding
+
+	// frame sink. use an aldl_logger_t (linuxaldl_log.h) as the sink to log to a file.
+	aldl_frame_sink_t sink;		// called for every frame received
+	void* sink_arg;				// passed to sink
+
+	// statistics
+	unsigned long frames;		// frames received
+	unsigned long timeouts;		// requests that got no complete response
+	unsigned long bad_checksums;// responses that failed the checksum
+	unsigned long silence_requests; // mode 8 messages sent
+	unsigned long undecoded;	// passive mode: frames that carry no data block
+	int error;					// errno of the failure that stopped the session
+};
+
+typedef struct _aldl_mux aldl_mux_t;
+
+// called by the mux when a descriptor added with aldl_mux_watch() is
+// readable. it has to read whatever made it readable.
+typedef void (*aldl_mux_handler_t)(aldl_mux_t* mux, int fd, void* arg);
+
+// a descriptor watched by a mux
+typedef struct _aldl_mux_watch
+{
+	int fd;
+	aldl_mux_handler_t handler;
+	void* arg;					// passed to handler
+} aldl_mux_watch_t;
+
+struct _aldl_mux
+{
+	int epfd;					// epoll instance watching every port and timer
+	int wakefd;					// eventfd written by aldl_mux_stop()
+	aldl_session_t* sessions[ALDL_MUX_MAX_SESSIONS];
+	unsigned int num_sessions;
+	unsigned int active;		// sessions that haven't failed
+	int running;				// cleared by aldl_mux_stop()
+	pthread_t thread;			// set by aldl_mux_start_thread()
+	aldl_mux_watch_t watches[ALDL_MUX_MAX_WATCHES];
+	unsigned int num_watches;
+};
+
+// function prototypes
+// =================================================
+
+// sessions
+// --------
+int aldl_session_open(aldl_session_t* s, const char* portname, aldl_definition* def);
+// connects to the ALDL interface on portname at 8192 baud (9600 if the
+// custom rate can't be set) and sets up the session like aldl_session_attach().
+// returns 0 on success, -1 on failure.
+
+int aldl_session_attach(aldl_session_t* s, int fd, aldl_definition* def);
+// sets up a session for an already open port fd (which is not closed by
+// aldl_session_close()). scan settings get the ALDL_SESSION_DEFAULT_ values,
+// and sink is NULL; change them before the session is started.
+// returns 0 on success, -1 on failure.
+
+void aldl_session_close(aldl_session_t* s);
+// frees the session's buffers and timer, and closes the port if the session opened it.
+
+void aldl_session_update_floats(aldl_session_t* s);
+// converts the session's data_set_raw into data_set_floats. only the items
+// whose bytes changed since the last call are decoded; they are marked in
+// data_set_changed with the new data_set_seq.
+
+// multiplexer
+// -----------
+int aldl_mux_init(aldl_mux_t* mux);
+// sets up an empty mux. returns 0 on success, -1 on failure.
+
+void aldl_mux_destroy(aldl_mux_t* mux);
+// releases the mux. the sessions are not closed.
+
+int aldl_mux_add(aldl_mux_t* mux, aldl_session_t* s);
+// adds s to the mux. must be called before the mux is run.
+// returns 0 on success, -1 if the mux is full or the session can't be watched.
+
+int aldl_mux_watch(aldl_mux_t* mux, int fd, aldl_mux_handler_t handler, void* arg);
+// makes the mux call handler (in the thread running it) whenever fd is
+// readable. fd isn't closed by aldl_mux_destroy().
+// returns 0 on success, -1 if the mux is full or fd can't be watched.
+
+int aldl_mux_run(aldl_mux_t* mux);
+// starts every session and runs them in the calling thread until
+// aldl_mux_stop() is called or every session has failed. polling sessions
+// send a mode 9 message before this returns.
+// returns 0, or -1 if waiting for events failed.
+
+void aldl_mux_stop(aldl_mux_t* mux);
+// makes aldl_mux_run() return. safe to call from another thread or from a
+// signal handler.
+
+int aldl_mux_start_thread(aldl_mux_t* mux);
+// runs aldl_mux_run() on a new thread. returns 0 on success, -1 on failure.
+
+void aldl_mux_join(aldl_mux_t* mux);
+// stops a mux started with aldl_mux_start_thread() and waits for its thread.
+
+int aldl_mux_start_sharded(aldl_mux_t* muxes, unsigned int nthreads,
+							aldl_session_t** sessions, unsigned int nsessions);
+// spreads nsessions sessions round-robin over nthreads muxes (muxes must
+// point to nthreads uninitialized aldl_mux_t) and runs each on its own thread.
+// returns the number of threads started, which is less than nthreads if there
+// are fewer sessions than threads, or -1 on failure (nothing is left running).
+
+void aldl_mux_stop_sharded(aldl_mux_t* muxes, unsigned int nthreads);
+// stops and destroys muxes started with aldl_mux_start_sharded(). nthreads
+// is the number it returned.
+
+#endif
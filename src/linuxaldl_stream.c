@@ -0,0 +1,267 @@
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h> // for memcpy/memset
+#include "linuxaldl_stream.h"
+
+#define ALDL_STREAM_MASK (ALDL_STREAM_BUFSIZE-1)
+
+// returns the byte at free-running index i
+#define STREAM_BYTE(s,i) ((s)->buf[(i) & ALDL_STREAM_MASK])
+
+// clears the parser, its statistics and its list of headers.
+void aldl_stream_init(aldl_stream_t* s)
+{
+	memset(s,0,sizeof(aldl_stream_t));
+}
+
+// adds a frame header to search for. seq points to ALDL_HEADER_SIZE header bytes
+// and length is the total length of frames starting with it.
+// returns 0 on success, -1 if the header table is full or length is invalid.
+int aldl_stream_add_header(aldl_stream_t* s, const char* seq, unsigned int length, int id)
+{
+	aldl_frame_header_t* h;
+
+	if (s->num_headers >= ALDL_STREAM_MAX_HEADERS)
+		return -1;
+	// a frame has to hold the header and checksum, and the ring buffer
+	// has to be able to hold a whole frame plus the start of the next one
+	if (length <= ALDL_HEADER_SIZE || length > ALDL_STREAM_BUFSIZE/2)
+		return -1;
+
+	h = s->headers + s->num_headers;
+	memcpy(h->seq,seq,ALDL_HEADER_SIZE);
+	h->length = length;
+	h->id = id;
+	s->first_byte[h->seq[0]] = 1;
+	s->num_headers++;
+	return 0;
+}
+
+// drops all buffered bytes (e.g. after the serial line has been flushed).
+// headers and statistics are kept.
+void aldl_stream_reset(aldl_stream_t* s)
+{
+	s->head = s->tail = 0;
+	s->cand_length = 0;
+}
+
+// appends len bytes to the stream. if the ring buffer is full the oldest
+// bytes are dropped and counted as overruns. returns len.
+unsigned int aldl_stream_feed(aldl_stream_t* s, const char* data, unsigned int len)
+{
+	unsigned int free_bytes, drop, pos, first;
+	unsigned int total = len;
+
+	// only the newest ALDL_STREAM_BUFSIZE bytes can be kept
+	if (len > ALDL_STREAM_BUFSIZE)
+	{
+		s->overruns += s->tail - s->head + len - ALDL_STREAM_BUFSIZE;
+		data += len - ALDL_STREAM_BUFSIZE;
+		len = ALDL_STREAM_BUFSIZE;
+		s->head = s->tail;
+		s->cand_length = 0;
+	}
+
+	free_bytes = ALDL_STREAM_BUFSIZE - (s->tail - s->head);
+	if (len > free_bytes)
+	{
+		drop = len - free_bytes;
+		s->head += drop;
+		s->overruns += drop;
+		s->cand_length = 0; // the candidate lost its first bytes
+	}
+
+	// copy in up to two pieces around the end of the ring buffer
+	pos = s->tail & ALDL_STREAM_MASK;
+	first = ALDL_STREAM_BUFSIZE - pos;
+	if (first > len)
+		first = len;
+	memcpy(s->buf+pos, data, first);
+	memcpy(s->buf, data+first, len-first);
+	s->tail += len;
+
+	return total;
+}
+
+// sets *ptr to the largest contiguous free area of the ring buffer and
+// returns its size.
+unsigned int aldl_stream_reserve(aldl_stream_t* s, char** ptr)
+{
+	unsigned int free_bytes = ALDL_STREAM_BUFSIZE - (s->tail - s->head);
+	unsigned int pos = s->tail & ALDL_STREAM_MASK;
+
+	if (free_bytes > ALDL_STREAM_BUFSIZE - pos)
+		free_bytes = ALDL_STREAM_BUFSIZE - pos;
+	*ptr = (char*)s->buf + pos;
+	return free_bytes;
+}
+
+// marks len bytes written at the pointer from aldl_stream_reserve() as received.
+void aldl_stream_commit(aldl_stream_t* s, unsigned int len)
+{
+	s->tail += len;
+}
+
+// checks the buffered bytes at head against each header.
+// returns the index of the matching header, -2 if the buffered bytes are
+// the start of some header but more bytes are needed to tell, or -1 if
+// no header can start at head.
+static int aldl_stream_match_header(aldl_stream_t* s)
+{
+	unsigned int avail = s->tail - s->head;
+	unsigned int i, j, n;
+	int partial = 0;
+
+	n = (avail < ALDL_HEADER_SIZE) ? avail : ALDL_HEADER_SIZE;
+	for (i=0; i<s->num_headers; i++)
+	{
+		for (j=0; j<n; j++)
+		{
+			if (STREAM_BYTE(s,s->head+j) != s->headers[i].seq[j])
+				break;
+		}
+		if (j == ALDL_HEADER_SIZE)
+			return i;
+		if (j == n)
+			partial = 1;
+	}
+	return partial ? -2 : -1;
+}
+
+// looks for the next complete, checksum-verified frame in the stream.
+// returns the frame length, 0 if no complete frame is buffered yet,
+// or -1 if a frame was found but does not fit in size bytes.
+int aldl_stream_next_frame(aldl_stream_t* s, char* frame, unsigned int size, int* id)
+{
+	unsigned int i, len, pos, first;
+	unsigned char sum;
+	int match;
+
+	for (;;)
+	{
+		// look for a header at head, discarding bytes that can't start one
+		while (s->cand_length == 0)
+		{
+			if (s->head == s->tail)
+				return 0;
+
+			// quick reject on the first byte before comparing whole headers
+			if (!s->first_byte[STREAM_BYTE(s,s->head)])
+				match = -1;
+			else match = aldl_stream_match_header(s);
+
+			if (match >= 0)
+			{
+				s->cand_length = s->headers[match].length;
+				s->cand_id = s->headers[match].id;
+			}
+			else if (match == -2)
+				return 0; // wait for the rest of the header
+			else
+			{
+				s->head++;
+				s->discarded++;
+			}
+		}
+
+		len = s->cand_length;
+		if (s->tail - s->head < len)
+			return 0; // wait for the rest of the frame
+
+		// the sum of every byte in a frame, including the checksum, is zero
+		sum = 0;
+		for (i=0; i<len; i++)
+			sum += STREAM_BYTE(s,s->head+i);
+
+		if (sum != 0)
+		{
+			// false match or corrupted frame. resume the search one byte
+			// past the candidate's start so a header inside it is still found.
+			s->bad_checksums++;
+			s->cand_length = 0;
+			s->head++;
+			s->discarded++;
+			continue;
+		}
+
+		if (id != NULL)
+			*id = s->cand_id;
+		s->cand_length = 0;
+
+		if (len > size)
+		{
+			s->head += len;
+			return -1;
+		}
+
+		pos = s->head & ALDL_STREAM_MASK;
+		first = ALDL_STREAM_BUFSIZE - pos;
+		if (first > len)
+			first = len;
+		memcpy(frame, s->buf+pos, first);
+		memcpy(frame+first, s->buf, len-first);
+		s->head += len;
+		s->frames++;
+		return len;
+	}
+}
+
+// reads from the receive engine rx into the stream until a complete frame is
+// available or usecs microseconds pass, then returns it like aldl_stream_next_frame().
+// if usecs is 0 this waits until a frame arrives.
+// returns 0 on timeout, -1 on a read failure or a frame too large for size.
+int aldl_stream_read_frame(aldl_stream_t* s, serial_rx_t* rx, char* frame, unsigned int size, int* id, long usecs)
+{
+	int res;
+	unsigned int space;
+	char* ptr;
+
+	// a frame may already be buffered from a previous read
+	res = aldl_stream_next_frame(s, frame, size, id);
+	if (res != 0)
+		return res;
+
+	if (serial_rx_arm(rx, 0, usecs) != 0)
+		return -1;
+
+	while (res == 0)
+	{
+		space = aldl_stream_reserve(s, &ptr);
+		if (space == 0)
+		{
+			// can't happen while headers fit in half the buffer, but never spin
+			s->overruns += s->tail - s->head;
+			aldl_stream_reset(s);
+			continue;
+		}
+
+		res = serial_rx_read(rx, ptr, space);
+		if (res <= 0)
+			break; // timeout or read failure
+		aldl_stream_commit(s, res);
+
+		res = aldl_stream_next_frame(s, frame, size, id);
+	}
+
+	// disarm the deadline so it can't fire into the next read
+	serial_rx_arm(rx, 0, 0);
+	return res;
+}
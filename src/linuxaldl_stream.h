@@ -0,0 +1,109 @@
+#ifndef LINUXALDL_STREAM_INCLUDED
+#define LINUXALDL_STREAM_INCLUDED
+
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sts_serial.h"
+
+// ============================================================================
+// STREAMING ALDL FRAME PARSER
+// ============================================================================
+// the parser keeps every byte received from the interface in a ring buffer
+// until it is either returned as part of a checksum-verified frame or ruled
+// out as the start of any frame. a frame starts with a three byte header:
+//		device id (e.g. 0xF4), 0x52 + frame length, mode
+// and ends with a checksum byte that makes the sum of all bytes zero.
+// when a candidate frame fails its checksum the search resumes one byte past
+// the candidate's start, so a header that begins inside a false match is
+// still found and no bytes are lost across reads.
+
+#define ALDL_STREAM_BUFSIZE 1024 // ring buffer size. must be a power of two and
+								 // at least twice the longest frame.
+#define ALDL_STREAM_MAX_HEADERS 8 // max number of frame headers to search for
+#define ALDL_HEADER_SIZE 3 // device id, length, mode
+
+typedef struct _aldl_frame_header
+{
+	unsigned char seq[ALDL_HEADER_SIZE]; // the header bytes that start the frame
+	unsigned int length; // total length of the frame, including header and checksum
+	int id; // tag returned with frames that start with this header
+} aldl_frame_header_t;
+
+typedef struct _aldl_stream
+{
+	unsigned char buf[ALDL_STREAM_BUFSIZE];
+	unsigned int head; // free-running index of the oldest byte still held
+	unsigned int tail; // free-running index one past the newest byte
+
+	aldl_frame_header_t headers[ALDL_STREAM_MAX_HEADERS];
+	unsigned int num_headers;
+	unsigned char first_byte[256]; // nonzero for bytes that begin some header
+
+	unsigned int cand_length; // length of the candidate frame at head, 0 if none
+	int cand_id; // id of the candidate's header
+
+	// statistics
+	unsigned long frames; // checksum-verified frames returned
+	unsigned long bad_checksums; // candidates rejected on checksum
+	unsigned long discarded; // bytes that were not part of any frame
+	unsigned long overruns; // bytes dropped because the ring buffer was full
+} aldl_stream_t;
+
+// function prototypes
+// =================================================
+
+void aldl_stream_init(aldl_stream_t* s);
+// clears the parser, its statistics and its list of headers.
+
+int aldl_stream_add_header(aldl_stream_t* s, const char* seq, unsigned int length, int id);
+// adds a frame header to search for. seq points to ALDL_HEADER_SIZE header bytes
+// and length is the total length of frames starting with it.
+// returns 0 on success, -1 if the header table is full or length is invalid.
+
+void aldl_stream_reset(aldl_stream_t* s);
+// drops all buffered bytes (e.g. after the serial line has been flushed).
+// headers and statistics are kept.
+
+unsigned int aldl_stream_feed(aldl_stream_t* s, const char* data, unsigned int len);
+// appends len bytes to the stream. if the ring buffer is full the oldest
+// bytes are dropped and counted as overruns. returns len.
+
+unsigned int aldl_stream_reserve(aldl_stream_t* s, char** ptr);
+// sets *ptr to the largest contiguous free area of the ring buffer and
+// returns its size, so bytes can be read from the interface directly into
+// the stream. call aldl_stream_commit() with the number of bytes stored.
+// returns 0 if the buffer is full; call aldl_stream_next_frame() to make room.
+
+void aldl_stream_commit(aldl_stream_t* s, unsigned int len);
+// marks len bytes written at the pointer from aldl_stream_reserve() as received.
+
+int aldl_stream_next_frame(aldl_stream_t* s, char* frame, unsigned int size, int* id);
+// looks for the next complete, checksum-verified frame in the stream.
+// if one is found it is copied into frame, *id (if id is not NULL) is set to
+// the id of its header, and the frame length is returned.
+// returns 0 if no complete frame is buffered yet, or -1 if a frame was found
+// but does not fit in size bytes (the frame is dropped).
+
+int aldl_stream_read_frame(aldl_stream_t* s, serial_rx_t* rx, char* frame, unsigned int size, int* id, long usecs);
+// reads from the receive engine rx into the stream until a complete frame is
+// available or usecs microseconds pass, then returns it like aldl_stream_next_frame().
+// returns 0 on timeout, -1 on a read failure or a frame too large for size.
+
+#endif
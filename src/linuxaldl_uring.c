@@ -0,0 +1,683 @@
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include "linuxaldl_uring.h"
+
+// user_data of a sync. a write's is its buffer number << 32 | its length,
+// and an index entry's is ALDL_URING_INDEX | the address of its log's file.
+#define ALDL_URING_SYNC 0xffffffffffffffffull
+#define ALDL_URING_INDEX (1ull << 62)
+
+// ============================================================================
+// SYSTEM CALLS
+// ============================================================================
+// glibc has no wrappers for the io_uring system calls
+
+static int aldl_io_uring_setup(unsigned int entries, struct io_uring_params* p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int aldl_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int aldl_io_uring_register(int fd, unsigned int opcode, void* arg, unsigned int nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// ============================================================================
+// RING SETUP
+// ============================================================================
+
+// unmaps the queues and closes the io_uring instance, if there is one
+static void aldl_log_uring_unmap(aldl_log_uring_t* u)
+{
+	if (u->sqes != NULL)
+		munmap(u->sqes, u->sqes_size);
+	if (u->cq_ring != NULL && u->cq_ring != u->sq_ring)
+		munmap(u->cq_ring, u->cq_ring_size);
+	if (u->sq_ring != NULL)
+		munmap(u->sq_ring, u->sq_ring_size);
+	if (u->fd != -1)
+		close(u->fd);
+	u->sqes = NULL;
+	u->cq_ring = NULL;
+	u->sq_ring = NULL;
+	u->fd = -1;
+}
+
+// maps an mmap() failure to NULL
+static void* aldl_log_uring_map(int fd, size_t size, off_t offset)
+{
+	void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+	return (p == MAP_FAILED) ? NULL : p;
+}
+
+// creates the io_uring instance, maps its queues and registers the buffers.
+// returns 0 on success, -1 if io_uring can't be used.
+static int aldl_log_uring_setup(aldl_log_uring_t* u)
+{
+	struct io_uring_params p;
+	struct iovec iov[ALDL_URING_BUFFERS];
+	char* sq;
+	char* cq;
+	unsigned int i;
+
+	memset(&p, 0, sizeof(p));
+	u->fd = aldl_io_uring_setup(ALDL_URING_ENTRIES, &p);
+	if (u->fd < 0)
+	{
+		u->fd = -1;
+		return -1;
+	}
+
+	u->sq_ring_size = p.sq_off.array + p.sq_entries*sizeof(unsigned int);
+	u->cq_ring_size = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+	// newer kernels map both rings with one mmap()
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (u->cq_ring_size > u->sq_ring_size)
+			u->sq_ring_size = u->cq_ring_size;
+		u->cq_ring_size = u->sq_ring_size;
+	}
+	u->sq_ring = aldl_log_uring_map(u->fd, u->sq_ring_size, IORING_OFF_SQ_RING);
+	if (u->sq_ring == NULL)
+		return -1;
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		u->cq_ring = u->sq_ring;
+	else
+		u->cq_ring = aldl_log_uring_map(u->fd, u->cq_ring_size, IORING_OFF_CQ_RING);
+	u->sqes_size = p.sq_entries*sizeof(struct io_uring_sqe);
+	u->sqes = aldl_log_uring_map(u->fd, u->sqes_size, IORING_OFF_SQES);
+	if (u->cq_ring == NULL || u->sqes == NULL)
+		return -1;
+
+	sq = (char*)u->sq_ring;
+	u->sq_head = (unsigned int*)(sq + p.sq_off.head);
+	u->sq_tail = (unsigned int*)(sq + p.sq_off.tail);
+	u->sq_mask = *(unsigned int*)(sq + p.sq_off.ring_mask);
+	u->sq_array = (unsigned int*)(sq + p.sq_off.array);
+	cq = (char*)u->cq_ring;
+	u->cq_head = (unsigned int*)(cq + p.cq_off.head);
+	u->cq_tail = (unsigned int*)(cq + p.cq_off.tail);
+	u->cq_mask = *(unsigned int*)(cq + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+	// entry i of the submission queue is always sqes[i]
+	for (i=0; i<p.sq_entries; i++)
+		u->sq_array[i] = i;
+
+	// registered buffers count against RLIMIT_MEMLOCK. without them the
+	// writes are plain IORING_OP_WRITE, which works just as well.
+	for (i=0; i<ALDL_URING_BUFFERS; i++)
+	{
+		iov[i].iov_base = u->buffers + i*ALDL_URING_BUFFER_SIZE;
+		iov[i].iov_len = ALDL_URING_BUFFER_SIZE;
+	}
+	u->registered = (aldl_io_uring_register(u->fd, IORING_REGISTER_BUFFERS, iov, ALDL_URING_BUFFERS) == 0);
+	return 0;
+}
+
+// sets up an io_uring instance and its buffers in u.
+// returns 0 on success, -1 if io_uring can't be used or the buffers
+// couldn't be allocated.
+int aldl_log_uring_init(aldl_log_uring_t* u)
+{
+	void* buffers;
+	unsigned int i;
+	int err;
+
+	memset(u, 0, sizeof(aldl_log_uring_t));
+	u->fd = -1;
+
+	err = posix_memalign(&buffers, sysconf(_SC_PAGESIZE), ALDL_URING_BUFFERS*ALDL_URING_BUFFER_SIZE);
+	if (err != 0)
+	{
+		errno = err;
+		return -1;
+	}
+	u->buffers = buffers;
+	for (i=0; i<ALDL_URING_BUFFERS; i++)
+		u->free[i] = ALDL_URING_BUFFERS-1-i;
+	u->num_free = ALDL_URING_BUFFERS;
+
+	u->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (u->timerfd == -1 || aldl_log_uring_setup(u) != 0)
+	{
+		err = errno;
+		aldl_log_uring_unmap(u);
+		if (u->timerfd != -1)
+			close(u->timerfd);
+		free(u->buffers);
+		u->buffers = NULL;
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+// waits for every write in progress and releases u.
+void aldl_log_uring_destroy(aldl_log_uring_t* u)
+{
+	aldl_log_uring_wait(u);
+	aldl_log_uring_unmap(u);
+	close(u->timerfd);
+	u->timerfd = -1;
+	free(u->buffers);
+	u->buffers = NULL;
+}
+
+// ============================================================================
+// SUBMISSION AND COMPLETION
+// ============================================================================
+// the kernel stores sq_head and cq_tail, and we store sq_tail and cq_head.
+// like the frame ring, each side reads the other's index with acquire
+// ordering and publishes its own with release ordering.
+
+// drops a reference to buffer, freeing it when nothing uses it any more
+static void aldl_log_uring_unref(aldl_log_uring_t* u, unsigned int buffer)
+{
+	if (--u->refs[buffer] == 0)
+		u->free[u->num_free++] = buffer;
+}
+
+static void aldl_log_uring_write_index(aldl_log_uring_file_t* f);
+
+// collects every completion the kernel has posted, freeing the buffers
+// nothing uses any more, then queues the index entries whose records are
+// now written.
+static void aldl_log_uring_reap(aldl_log_uring_t* u)
+{
+	struct io_uring_cqe* cqe;
+	aldl_log_uring_file_t* f;
+	unsigned int head, tail;
+
+	head = *u->cq_head;
+	tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail; head++)
+	{
+		cqe = u->cqes + (head & u->cq_mask);
+		if (cqe->user_data == ALDL_URING_SYNC)
+		{
+			// a pipe or terminal can't be synced, and doesn't need to be
+			if (cqe->res < 0 && cqe->res != -EINVAL)
+				u->errors++;
+		}
+		else if (cqe->user_data & ALDL_URING_INDEX)
+		{
+			f = (aldl_log_uring_file_t*)(uintptr_t)(cqe->user_data & ~ALDL_URING_INDEX);
+			aldl_index_writer_done(f->index, cqe->res == (int)f->index->entry_size);
+			f->index_writing = 0;
+		}
+		else
+		{
+			f = u->owner[cqe->user_data >> 32];
+			if (cqe->res != (int)(cqe->user_data & 0xffffffff))
+			{
+				u->errors++;
+				f->failed = 1;
+			}
+			if (--f->writing == 0)
+				f->written = f->offset;
+			aldl_log_uring_unref(u, cqe->user_data >> 32);
+		}
+		u->in_flight--;
+	}
+	__atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+
+	for (f=u->files; f!=NULL; f=f->next)
+		aldl_log_uring_write_index(f);
+}
+
+// hands every queued write to the kernel and collects the completed ones.
+void aldl_log_uring_submit(aldl_log_uring_t* u)
+{
+	int res;
+
+	if (u->to_submit != 0)
+	{
+		res = aldl_io_uring_enter(u->fd, u->to_submit, 0, 0);
+		u->syscalls++;
+		// EAGAIN and EBUSY: the kernel is short of memory or completion
+		// queue space. the entries stay queued for the next call.
+		if (res > 0)
+			u->to_submit -= res;
+		else if (res < 0 && errno != EAGAIN && errno != EBUSY && errno != EINTR)
+			u->errors++;
+	}
+	aldl_log_uring_reap(u);
+}
+
+// waits until every write and sync in progress is complete.
+// returns 0, or -1 if waiting failed.
+int aldl_log_uring_wait(aldl_log_uring_t* u)
+{
+	int res;
+
+	while (u->in_flight != 0 || u->to_submit != 0)
+	{
+		res = aldl_io_uring_enter(u->fd, u->to_submit, 1, IORING_ENTER_GETEVENTS);
+		u->syscalls++;
+		if (res < 0 && errno != EAGAIN && errno != EBUSY && errno != EINTR)
+			return -1;
+		if (res > 0)
+			u->to_submit -= res;
+		aldl_log_uring_reap(u);
+	}
+	return 0;
+}
+
+// returns the next free submission queue entry, cleared, or NULL if the
+// queue is still full after submitting what's in it.
+static struct io_uring_sqe* aldl_log_uring_get_sqe(aldl_log_uring_t* u)
+{
+	struct io_uring_sqe* sqe;
+	unsigned int tail = *u->sq_tail;
+
+	if (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) > u->sq_mask)
+	{
+		aldl_log_uring_submit(u);
+		if (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) > u->sq_mask)
+			return NULL;
+	}
+	sqe = u->sqes + (tail & u->sq_mask);
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	return sqe;
+}
+
+// publishes the entry returned by aldl_log_uring_get_sqe()
+static void aldl_log_uring_push(aldl_log_uring_t* u)
+{
+	__atomic_store_n(u->sq_tail, *u->sq_tail+1, __ATOMIC_RELEASE);
+	u->to_submit++;
+	u->in_flight++;
+}
+
+// ============================================================================
+// FILES
+// ============================================================================
+
+// returns the number of msec from a to b
+static long aldl_log_uring_msec_between(const struct timespec* a, const struct timespec* b)
+{
+	return (b->tv_sec - a->tv_sec)*1000 + (b->tv_nsec - a->tv_nsec)/1000000;
+}
+
+// returns ts plus msec milliseconds
+static struct timespec aldl_log_uring_after(const struct timespec* ts, unsigned int msec)
+{
+	struct timespec t = *ts;
+
+	t.tv_sec += msec/1000;
+	t.tv_nsec += (long)(msec%1000)*1000000;
+	if (t.tv_nsec >= 1000000000)
+	{
+		t.tv_sec++;
+		t.tv_nsec -= 1000000000;
+	}
+	return t;
+}
+
+// returns nonzero if a is earlier than b
+static int aldl_log_uring_before(const struct timespec* a, const struct timespec* b)
+{
+	return (a->tv_sec < b->tv_sec) || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+// sets *due to when f next needs the timer: to write records that have
+// waited for the flush interval, for an interval sync, or (now is the
+// time) to collect its writes in progress, which index entries may be
+// waiting for. returns 1, or 0 if f needs none of them.
+static int aldl_log_uring_due(aldl_log_uring_file_t* f, const struct timespec* now, struct timespec* due)
+{
+	struct timespec t;
+	int res = 0;
+
+	if (f->buffer >= 0 && f->used != f->queued)
+	{
+		*due = aldl_log_uring_after(&f->first, ALDL_URING_FLUSH_INTERVAL);
+		res = 1;
+	}
+	if (f->fsync_policy == ALDL_FSYNC_INTERVAL && f->unsynced != 0)
+	{
+		t = aldl_log_uring_after(&f->synced, f->fsync_every);
+		if (!res || aldl_log_uring_before(&t, due))
+			*due = t;
+		res = 1;
+	}
+	if (f->index != NULL && (f->writing != 0 || f->index_writing))
+	{
+		t = aldl_log_uring_after(now, ALDL_URING_RETRY);
+		if (!res || aldl_log_uring_before(&t, due))
+			*due = t;
+		res = 1;
+	}
+	return res;
+}
+
+// sets u's timer to go off at due, unless it goes off earlier already.
+// due==NULL stops it.
+static void aldl_log_uring_arm(aldl_log_uring_t* u, const struct timespec* due)
+{
+	struct itimerspec its;
+
+	if (due != NULL && (u->armed.tv_sec != 0 || u->armed.tv_nsec != 0)
+		&& !aldl_log_uring_before(due, &u->armed))
+		return;
+	memset(&its, 0, sizeof(its));
+	if (due != NULL)
+		its.it_value = *due;
+	if (timerfd_settime(u->timerfd, TFD_TIMER_ABSTIME, &its, NULL) == 0)
+		u->armed = its.it_value;
+}
+
+// queues the write of the part of f's buffer not queued yet at f's
+// offset. if release is 1 f gives up the buffer, so its next record
+// starts a new one.
+static void aldl_log_uring_write(aldl_log_uring_file_t* f, int release)
+{
+	aldl_log_uring_t* u = f->ring;
+	struct io_uring_sqe* sqe;
+	unsigned int len;
+	char* buf;
+
+	if (f->buffer < 0)
+		return;
+	// a buffer being given up always gets written, since it can't be
+	// refilled. other writes wait while a lot is in progress, so the
+	// completion queue (twice the size of the submission queue) can't overflow.
+	if (!release && u->in_flight >= ALDL_URING_ENTRIES/2)
+		return;
+	buf = u->buffers + f->buffer*ALDL_URING_BUFFER_SIZE + f->queued;
+	len = f->used - f->queued;
+
+	if (len == 0)
+		;
+	else if ((sqe = aldl_log_uring_get_sqe(u)) == NULL)
+	{
+		// can't happen: the queue has room for every buffer and the syncs
+		u->errors++;
+	}
+	else
+	{
+		sqe->opcode = u->registered ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+		sqe->fd = f->fd;
+		sqe->addr = (unsigned long)buf;
+		sqe->len = len;
+		sqe->off = f->offset;
+		sqe->buf_index = f->buffer;
+		sqe->user_data = ((uint64_t)f->buffer << 32) | len;
+		u->refs[f->buffer]++;
+		u->owner[f->buffer] = f;
+		u->writes++;
+		f->writing++;
+		aldl_log_uring_push(u);
+	}
+	f->offset += len;
+	f->queued = f->used;
+
+	if (release)
+	{
+		aldl_log_uring_unref(u, f->buffer);
+		f->buffer = -1;
+		f->used = 0;
+		f->queued = 0;
+	}
+}
+
+// queues the write of the next entry of f's index if every write of its
+// records has completed. entries are written one at a time, so they reach
+// the index (opened with O_APPEND) in order.
+static void aldl_log_uring_write_index(aldl_log_uring_file_t* f)
+{
+	aldl_log_uring_t* u = f->ring;
+	struct io_uring_sqe* sqe;
+	const unsigned char* e;
+
+	if (f->index == NULL || f->index_writing)
+		return;
+	// entries to come could point past the end of the log
+	if (f->failed)
+		aldl_index_writer_fail(f->index);
+	e = aldl_index_writer_next(f->index, f->written);
+	if (e == NULL)
+		return;
+	// getting an entry can collect completions, which comes back here
+	f->index_writing = 1;
+	if ((sqe = aldl_log_uring_get_sqe(u)) == NULL)
+	{
+		f->index_writing = 0;
+		return;
+	}
+	sqe->opcode = IORING_OP_WRITE;
+	sqe->fd = f->index->fd;
+	sqe->addr = (unsigned long)e;
+	sqe->len = f->index->entry_size;
+	sqe->user_data = ALDL_URING_INDEX | (uintptr_t)f;
+	aldl_log_uring_push(u);
+}
+
+// syncs f, after every write queued before it. the sync is put off until
+// the next record or the timer if too much is in progress already.
+static void aldl_log_uring_sync(aldl_log_uring_file_t* f, const struct timespec* now)
+{
+	aldl_log_uring_t* u = f->ring;
+	struct io_uring_sqe* sqe;
+
+	if (u->in_flight >= ALDL_URING_ENTRIES/2 || (sqe = aldl_log_uring_get_sqe(u)) == NULL)
+		return;
+	sqe->opcode = IORING_OP_FSYNC;
+	sqe->flags = IOSQE_IO_DRAIN;
+	sqe->fd = f->fd;
+	sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+	sqe->user_data = ALDL_URING_SYNC;
+	aldl_log_uring_push(u);
+	u->syncs++;
+	f->unsynced = 0;
+	f->synced = *now;
+}
+
+// starts writing the open file fd through u, after whatever it holds now.
+// returns 0 on success, -1 on failure.
+int aldl_log_uring_open(aldl_log_uring_file_t* f, aldl_log_uring_t* u, int fd,
+						aldl_fsync_policy_t policy, unsigned int every)
+{
+	off_t end;
+	int flags;
+
+	memset(f, 0, sizeof(aldl_log_uring_file_t));
+	f->ring = u;
+	f->fd = fd;
+	f->buffer = -1;
+	f->fsync_policy = policy;
+	f->fsync_every = every;
+	clock_gettime(CLOCK_MONOTONIC, &f->synced);
+
+	// O_APPEND would make the kernel ignore the offsets, and writes in
+	// progress together could land in any order
+	flags = fcntl(fd, F_GETFL);
+	if (flags == -1 || ((flags & O_APPEND) && fcntl(fd, F_SETFL, flags & ~O_APPEND) == -1))
+		return -1;
+	end = lseek(fd, 0, SEEK_END);
+	if (end == -1)
+		return -1;
+	f->offset = end;
+	f->written = end;
+	f->next = u->files;
+	u->files = f;
+	return 0;
+}
+
+// adds one record to f. never waits for the disk.
+// returns 0, or -1 if the record was dropped.
+int aldl_log_uring_put(aldl_log_uring_file_t* f, const void* data, unsigned int len,
+						const struct timespec* now)
+{
+	aldl_log_uring_t* u = f->ring;
+	struct timespec due;
+	int sync;
+
+	if (len > ALDL_URING_BUFFER_SIZE)
+	{
+		f->dropped++;
+		return -1;
+	}
+
+	// a record never spans two buffers
+	if (f->buffer >= 0 && f->used + len > ALDL_URING_BUFFER_SIZE)
+		aldl_log_uring_write(f, 1);
+	if (f->buffer < 0)
+	{
+		if (u->num_free == 0)
+			aldl_log_uring_submit(u);
+		if (u->num_free == 0)
+		{
+			f->dropped++;
+			return -1;
+		}
+		f->buffer = u->free[--u->num_free];
+		u->refs[f->buffer] = 1;
+	}
+
+	if (f->used == f->queued)
+		f->first = *now;
+	memcpy(u->buffers + f->buffer*ALDL_URING_BUFFER_SIZE + f->used, data, len);
+	f->used += len;
+	f->records++;
+	f->unsynced++;
+
+	switch (f->fsync_policy)
+	{
+		case ALDL_FSYNC_INTERVAL:
+			sync = aldl_log_uring_msec_between(&f->synced, now) >= (long)f->fsync_every;
+			break;
+		case ALDL_FSYNC_RECORDS:
+			sync = f->unsynced >= f->fsync_every;
+			break;
+		default:
+			sync = 0;
+	}
+	if (sync || f->used == ALDL_URING_BUFFER_SIZE
+		|| aldl_log_uring_msec_between(&f->first, now) >= ALDL_URING_FLUSH_INTERVAL)
+		aldl_log_uring_write(f, f->used == ALDL_URING_BUFFER_SIZE);
+	if (sync)
+		aldl_log_uring_sync(f, now);
+	// the timer handles what is left if no more records come
+	if (aldl_log_uring_due(f, now, &due))
+		aldl_log_uring_arm(u, &due);
+
+	if (u->to_submit != 0)
+		aldl_log_uring_submit(u);
+	return 0;
+}
+
+// writes the records that have waited the flush interval and syncs the
+// files due a sync, then sets the timer for the next.
+void aldl_log_uring_timer(aldl_log_uring_t* u)
+{
+	aldl_log_uring_file_t* f;
+	struct timespec now, due, next;
+	uint64_t expirations;
+	int pending = 0;
+
+	if (read(u->timerfd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+		u->errors++;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	// completions first, so there is room for the writes
+	aldl_log_uring_submit(u);
+
+	for (f=u->files; f!=NULL; f=f->next)
+	{
+		if (f->buffer >= 0 && f->used != f->queued
+			&& aldl_log_uring_msec_between(&f->first, &now) >= ALDL_URING_FLUSH_INTERVAL)
+			aldl_log_uring_write(f, 0);
+		if (f->fsync_policy == ALDL_FSYNC_INTERVAL && f->unsynced != 0
+			&& aldl_log_uring_msec_between(&f->synced, &now) >= (long)f->fsync_every)
+		{
+			aldl_log_uring_write(f, 0);
+			aldl_log_uring_sync(f, &now);
+		}
+		if (!aldl_log_uring_due(f, &now, &due))
+			continue;
+		// a write or sync put off while too much is in progress is tried again soon
+		if (!aldl_log_uring_before(&now, &due))
+			due = aldl_log_uring_after(&now, ALDL_URING_RETRY);
+		if (!pending || aldl_log_uring_before(&due, &next))
+			next = due;
+		pending = 1;
+	}
+	if (u->to_submit != 0)
+		aldl_log_uring_submit(u);
+
+	u->armed.tv_sec = 0;
+	u->armed.tv_nsec = 0;
+	aldl_log_uring_arm(u, pending ? &next : NULL);
+}
+
+// calls aldl_log_uring_timer() for a mux
+static void aldl_log_uring_on_timer(aldl_mux_t* mux, int fd, void* arg)
+{
+	aldl_log_uring_timer((aldl_log_uring_t*)arg);
+}
+
+// has mux call aldl_log_uring_timer() when u's timer goes off.
+// returns 0 on success, -1 on failure.
+int aldl_log_uring_watch(aldl_log_uring_t* u, aldl_mux_t* mux)
+{
+	return aldl_mux_watch(mux, u->timerfd, aldl_log_uring_on_timer, u);
+}
+
+// writes what f still holds and waits for every write u has in progress.
+// returns 0 on success, -1 if a record was dropped or a write failed.
+int aldl_log_uring_close(aldl_log_uring_file_t* f)
+{
+	aldl_log_uring_file_t** p;
+	int res = 0;
+
+	// waiting queues the index entries as their records complete
+	aldl_log_uring_write(f, 1);
+	aldl_log_uring_write_index(f);
+	if (aldl_log_uring_wait(f->ring) != 0)
+		res = -1;
+	for (p=&f->ring->files; *p!=NULL; p=&(*p)->next)
+	{
+		if (*p == f)
+		{
+			*p = f->next;
+			break;
+		}
+	}
+	if (f->dropped != 0 || f->ring->errors != 0)
+		res = -1;
+	return res;
+}
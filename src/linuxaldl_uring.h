@@ -0,0 +1,189 @@
+#ifndef LINUXALDL_URING_INCLUDED
+#define LINUXALDL_URING_INCLUDED
+
+/*(C) copyright 2008, Steven Snyder, All Rights Reserved
+
+Steven T. Snyder, <stsnyder@ucla.edu> http://www.steventsnyder.com
+
+LICENSING INFORMATION:
+ This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <time.h>
+#include "linuxaldl_core.h"
+#include "linuxaldl_session.h"
+#include "linuxaldl_index.h"
+
+// ============================================================================
+// IO_URING LOG BACKEND
+// ============================================================================
+// an aldl_log_uring_t lets one thread write any number of log files (one
+// per session, say) without a writer thread for each. records are copied
+// into a file's current buffer. when it is full, a sync is due or records
+// have waited ALDL_URING_FLUSH_INTERVAL msec, the part of the buffer not
+// written yet is queued as a single write at the file's next offset (the
+// file goes on filling the rest of the buffer). queued writes for every file go to the kernel in one
+// io_uring_enter() call, and their completions are read from shared
+// memory without a system call.
+//
+// the buffers are registered with the kernel once (IORING_OP_WRITE_FIXED),
+// so it doesn't have to map them again for every write. if io_uring isn't
+// available (old kernel, seccomp, kernel.io_uring_disabled)
+// aldl_log_uring_init() fails, and the log should use a writer thread
+// (aldl_logger_start_writer()) instead.
+//
+// nothing here ever waits for the disk except aldl_log_uring_wait(): when
+// all the buffers are still being written, records are dropped and counted.
+// an aldl_log_uring_t and its files must only be used from one thread.
+// records that wait for the flush interval, and syncs that fall due, are
+// handled when the next record is put, or by a timer (timerfd) the thread
+// watches, so they also happen when no more records arrive. see
+// aldl_log_uring_watch().
+//
+// writes to one file can complete in any order, so a crash can leave a hole
+// of zeros in front of a buffer that did make it to the disk. the entries of
+// a log's index are only queued once every write before the end of their
+// block has completed, one at a time.
+
+#define ALDL_URING_ENTRIES 64			// submission queue entries
+#define ALDL_URING_BUFFERS 64			// registered buffers, shared by every file
+#define ALDL_URING_BUFFER_SIZE 65536	// bytes per buffer. a record must fit in one.
+#define ALDL_URING_FLUSH_INTERVAL 250	// msec a partly filled buffer waits for more records
+#define ALDL_URING_RETRY 10				// msec before the timer tries a write or sync put off again
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct _aldl_log_uring_file;
+
+// aldl_log_uring_t: an io_uring instance and the buffers its files share
+typedef struct _aldl_log_uring
+{
+	int fd;						// io_uring instance
+	int timerfd;				// CLOCK_MONOTONIC timer for the next flush or sync due
+	struct timespec armed;		// when it goes off, 0 if it isn't set
+	struct _aldl_log_uring_file* files; // open files, for the timer
+
+	// submission and completion queues, mapped from fd
+	void* sq_ring;
+	size_t sq_ring_size;
+	unsigned int* sq_head;
+	unsigned int* sq_tail;
+	unsigned int sq_mask;
+	unsigned int* sq_array;
+	struct io_uring_sqe* sqes;
+	size_t sqes_size;
+	void* cq_ring;				// the same mapping as sq_ring on newer kernels
+	size_t cq_ring_size;
+	unsigned int* cq_head;
+	unsigned int* cq_tail;
+	unsigned int cq_mask;
+	struct io_uring_cqe* cqes;
+	unsigned int to_submit;		// entries filled in since the last io_uring_enter()
+	int registered;				// 1 if the kernel took the buffers for IORING_OP_WRITE_FIXED
+
+	char* buffers;				// ALDL_URING_BUFFERS buffers, page aligned
+	unsigned int refs[ALDL_URING_BUFFERS]; // writes in progress from each buffer, plus 1
+								// while a file is filling it. 0 when it is free.
+	struct _aldl_log_uring_file* owner[ALDL_URING_BUFFERS]; // the file writing from each
+	int free[ALDL_URING_BUFFERS]; // stack of buffers that aren't in use
+	unsigned int num_free;
+	unsigned int in_flight;		// writes and syncs the kernel hasn't completed
+
+	// statistics
+	unsigned long syscalls;		// io_uring_enter() calls
+	unsigned long writes;		// buffers written
+	unsigned long syncs;		// syncs requested
+	unsigned long errors;		// writes or syncs that failed or were short
+} aldl_log_uring_t;
+
+// aldl_log_uring_file_t: a file written through an aldl_log_uring_t
+typedef struct _aldl_log_uring_file
+{
+	aldl_log_uring_t* ring;
+	struct _aldl_log_uring_file* next; // next of ring's open files
+	int fd;
+	uint64_t offset;			// where the next buffer goes in the file
+	unsigned int writing;		// writes queued and not completed
+	uint64_t written;			// offset every write before has completed up to
+	int failed;					// 1 once a write failed
+	aldl_index_writer_t* index;	// the log's index, NULL if none
+	int index_writing;			// 1 while one of its entries is being written
+	int buffer;					// buffer being filled, -1 if none
+	unsigned int used;			// bytes in it
+	unsigned int queued;		// bytes of it already queued for writing
+	struct timespec first;		// CLOCK_MONOTONIC time its first record was put
+
+	aldl_fsync_policy_t fsync_policy;
+	unsigned int fsync_every;	// msec for ALDL_FSYNC_INTERVAL, records for ALDL_FSYNC_RECORDS
+	unsigned long unsynced;		// records since the last sync
+	struct timespec synced;		// CLOCK_MONOTONIC time of the last sync
+
+	// statistics
+	unsigned long records;		// records put
+	unsigned long dropped;		// records dropped because every buffer was in use
+} aldl_log_uring_file_t;
+
+// function prototypes
+// =================================================
+
+int aldl_log_uring_init(aldl_log_uring_t* u);
+// sets up an io_uring instance and its buffers in u.
+// returns 0 on success, -1 if io_uring can't be used here (errno is set)
+// or the buffers couldn't be allocated. u needs no aldl_log_uring_destroy() then.
+
+void aldl_log_uring_destroy(aldl_log_uring_t* u);
+// waits for every write in progress and releases u. its files must have
+// been closed with aldl_log_uring_close().
+
+int aldl_log_uring_open(aldl_log_uring_file_t* f, aldl_log_uring_t* u, int fd,
+						aldl_fsync_policy_t policy, unsigned int every);
+// starts writing the open file fd through u, after whatever it holds now.
+// O_APPEND is turned off for fd, since every write gets its own offset.
+// set f->index to have the entries of the log's index (which is added to
+// by the thread using u) written once their records are.
+// returns 0 on success, -1 on failure.
+
+int aldl_log_uring_put(aldl_log_uring_file_t* f, const void* data, unsigned int len,
+						const struct timespec* now);
+// adds one record of len bytes (at most ALDL_URING_BUFFER_SIZE) to f. now
+// is the CLOCK_MONOTONIC time, for the flush interval and the fsync policy.
+// never waits for the disk. returns 0, or -1 if the record was dropped.
+
+void aldl_log_uring_submit(aldl_log_uring_t* u);
+// hands every write queued by aldl_log_uring_put() to the kernel now, and
+// collects the ones that have completed. aldl_log_uring_put() does this
+// itself when it queues a write.
+
+void aldl_log_uring_timer(aldl_log_uring_t* u);
+// writes the records of every file that have waited ALDL_URING_FLUSH_INTERVAL
+// msec and syncs the files due a sync, then sets u->timerfd for the next
+// one. call it when u->timerfd is readable.
+
+int aldl_log_uring_watch(aldl_log_uring_t* u, aldl_mux_t* mux);
+// has mux, the thread using u, call aldl_log_uring_timer() when u->timerfd
+// goes off. returns 0 on success, -1 if mux is watching too many fds.
+
+int aldl_log_uring_close(aldl_log_uring_file_t* f);
+// writes what f still holds, and waits until every write u has in progress
+// (and every entry of f->index that can be written) is complete. call
+// aldl_index_writer_finish() first for the last entry. fd is left open.
+// returns 0 on success, -1 if any of f's records were dropped or any write
+// through u failed.
+
+int aldl_log_uring_wait(aldl_log_uring_t* u);
+// waits until every write and sync in progress is complete.
+// returns 0, or -1 if waiting failed.
+
+#endif
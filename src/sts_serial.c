@@ -32,6 +32,9 @@ LICENSING INFORMATION:
 #include <string.h> // for strerror
 #include <stdlib.h> // for malloc
 #include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <stdint.h>
 #include "sts_serial.h"
 
 // global variables
@@ -110,6 +113,29 @@ int read_sequence(int fd, void *buf, size_t count, char *seq, size_t seq_size, l
 
 
 
+int serial_rx_open(serial_rx_t* rx, int fd);
+// sets up the receive engine for the serial port fd.
+// fd should have been opened with O_NONBLOCK.
+// returns 0 on success, -1 on failure (errno is set).
+
+void serial_rx_close(serial_rx_t* rx);
+// releases the epoll instance and timer. does not close the serial port.
+
+int serial_rx_arm(serial_rx_t* rx, long secs, long usecs);
+// (re)arms the deadline secs seconds + usecs microseconds from now.
+// if both are 0, the deadline is disarmed and reads wait indefinitely.
+
+int serial_rx_read(serial_rx_t* rx, void *buf, size_t count);
+// sleeps until bytes are available or the armed deadline passes, then reads
+// up to count bytes into buf.
+// returns the number of bytes read, 0 if the deadline passed, -1 on failure.
+
+int read_sequence_rx(serial_rx_t* rx, void *buf, size_t count, char *seq, size_t seq_size, long secs, long usecs);
+// same behavior and return values as read_sequence(), but waits on the
+// receive engine rx instead of spinning and using SIGALRM/ITIMER_REAL.
+
+
+
 unsigned int convert_baudrate(speed_t baudrate);
 // returns the speed_t baudrate defined in <termios.h> in unsigned integer format
 // e.g. convert_baudrate(B57600) returns 57600
@@ -309,6 +335,216 @@ int read_sequence(int fd, void *buf, size_t count, char *seq, size_t seq_size, l
 }
 
 
+// sets up the receive engine for the serial port fd.
+// the port and the deadline timer are both registered with a private
+// epoll instance so serial_rx_read() can sleep on either one.
+// returns 0 on success, -1 on failure (errno is set).
+int serial_rx_open(serial_rx_t* rx, int fd)
+{
+	struct epoll_event ev;
+
+	rx->fd = fd;
+	rx->expired = 0;
+	rx->timerfd = -1;
+
+	rx->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (rx->epfd == -1)
+	{
+		printf(" serial_rx_open() call to epoll_create1() failed: %s\n",strerror(errno));
+		return -1;
+	}
+
+	rx->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (rx->timerfd == -1)
+	{
+		printf(" serial_rx_open() call to timerfd_create() failed: %s\n",strerror(errno));
+		serial_rx_close(rx);
+		return -1;
+	}
+
+	memset(&ev,0,sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	if (epoll_ctl(rx->epfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+	{
+		printf(" serial_rx_open() could not watch the serial port: %s\n",strerror(errno));
+		serial_rx_close(rx);
+		return -1;
+	}
+
+	ev.data.fd = rx->timerfd;
+	if (epoll_ctl(rx->epfd, EPOLL_CTL_ADD, rx->timerfd, &ev) == -1)
+	{
+		printf(" serial_rx_open() could not watch the deadline timer: %s\n",strerror(errno));
+		serial_rx_close(rx);
+		return -1;
+	}
+
+	return 0;
+}
+
+// releases the epoll instance and timer. does not close the serial port.
+void serial_rx_close(serial_rx_t* rx)
+{
+	if (rx->timerfd != -1)
+		close(rx->timerfd);
+	if (rx->epfd != -1)
+		close(rx->epfd);
+	rx->timerfd = -1;
+	rx->epfd = -1;
+}
+
+// (re)arms the deadline secs seconds + usecs microseconds from now.
+// if both are 0, the deadline is disarmed and reads wait indefinitely.
+// rearming discards any expiration of the previous deadline that
+// has not been consumed yet.
+int serial_rx_arm(serial_rx_t* rx, long secs, long usecs)
+{
+	struct itimerspec deadline;
+
+	secs += usecs / 1000000;
+	usecs = usecs % 1000000;
+
+	deadline.it_interval.tv_sec = 0;
+	deadline.it_interval.tv_nsec = 0;
+	deadline.it_value.tv_sec = secs;
+	deadline.it_value.tv_nsec = usecs*1000;
+
+	rx->expired = 0;
+	if (timerfd_settime(rx->timerfd, 0, &deadline, NULL) == -1)
+	{
+		printf(" serial_rx_arm() call to timerfd_settime() failed: %s\n",strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+// sleeps until bytes are available or the armed deadline passes, then reads
+// up to count bytes into buf.
+// returns the number of bytes read, 0 if the deadline passed,
+// or -1 on a read/wait failure (errno is set).
+// once the deadline has passed every call returns 0 until serial_rx_arm()
+// is called again, even if more bytes arrive.
+int serial_rx_read(serial_rx_t* rx, void *buf, size_t count)
+{
+	struct epoll_event events[2];
+	uint64_t expirations;
+	int n, i, res, readable;
+
+	while (rx->expired == 0)
+	{
+		n = epoll_wait(rx->epfd, events, 2, -1);
+		if (n == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		readable = 0;
+		for (i=0; i<n; i++)
+		{
+			if (events[i].data.fd == rx->timerfd)
+			{
+				// consume the expiration so the timer stops reporting readable
+				res = read(rx->timerfd, &expirations, sizeof(expirations));
+				rx->expired = 1;
+			}
+			else if (events[i].events & (EPOLLHUP | EPOLLERR))
+			{
+				errno = EIO;
+				return -1;
+			}
+			else readable = 1;
+		}
+
+		// the deadline takes priority over bytes that arrived with it
+		if (rx->expired)
+			break;
+		if (!readable)
+			continue;
+
+		res = read(rx->fd, buf, count);
+		if (res > 0)
+			return res;
+		else if (res < 0 && errno != EAGAIN && errno != EINTR)
+			return -1;
+		// spurious wakeup, go back to sleep
+	}
+	return 0;
+}
+
+// same behavior and return values as read_sequence(), but waits on the
+// receive engine rx instead of spinning and using SIGALRM/ITIMER_REAL.
+// bytes read before the start sequence is matched go through a small
+// stack buffer, so no memory is allocated.
+int read_sequence_rx(serial_rx_t* rx, void *buf, size_t count, char *seq, size_t seq_size, long secs, long usecs)
+{
+	unsigned int seq_matched = 0, bytes_read = 0, i;
+	int res;
+	char seqbuf[64];
+	size_t seqbuf_size = (count < sizeof(seqbuf)) ? count : sizeof(seqbuf);
+
+	if (serial_rx_arm(rx, secs, usecs) != 0)
+		return -1;
+
+	while (bytes_read < count)
+	{
+		// if the sequence has been matched, read the rest of the message directly into buf
+		if (seq_matched == seq_size)
+		{
+			res = serial_rx_read(rx, (char*)buf+bytes_read, count-bytes_read);
+			if (res == 0)
+				break; // timeout
+			else if (res < 0)
+			{
+				printf(" read_sequence_rx() read failed: %s\n",strerror(errno));
+				serial_rx_arm(rx, 0, 0);
+				return -1;
+			}
+			bytes_read += res;
+			continue;
+		}
+
+		// otherwise look for the start sequence
+		res = serial_rx_read(rx, seqbuf, seqbuf_size);
+		if (res == 0)
+			break; // timeout
+		else if (res < 0)
+		{
+			printf(" read_sequence_rx() read failed: %s\n",strerror(errno));
+			serial_rx_arm(rx, 0, 0);
+			return -1;
+		}
+
+		// for each byte read
+		for (i=0; i<(unsigned)res && bytes_read<count; i++)
+		{
+			// if the byte matches the next byte of the sequence to match,
+			// or the sequence has been matched and there are bytes left in the buffer
+			if (seq_matched == seq_size || seqbuf[i]==seq[seq_matched])
+			{
+				// copy the byte into the buffer
+				((char *)buf)[bytes_read] = seqbuf[i];
+				bytes_read++;
+				if (seq_matched<seq_size)
+					seq_matched++;
+			}
+			else // otherwise the sequence didn't match, reset the counts
+			{
+				seq_matched = 0;
+				bytes_read = 0;
+			}
+		}
+	}
+
+	// disarm the deadline so it can't fire into the next read
+	serial_rx_arm(rx, 0, 0);
+
+	return bytes_read;
+}
+
+
 // Attempts to set the baud rate to the closest rate possible to 
 // the desired_baudrate argument using divisors.
 // fport is the file descriptor for the port opened by a call to serial_connect() or open()
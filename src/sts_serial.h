@@ -23,6 +23,7 @@ LICENSING INFORMATION:
 #include <termios.h>
 #include <sys/types.h>
 #include <fcntl.h>
+#include <stdio.h>
 
 // serial helper function prototypes
 // ====================================================
@@ -95,6 +96,47 @@ int read_sequence(int fd, void *buf, size_t count, char *seq, size_t seq_size, l
 
 
 
+// event-driven receive engine
+// ====================================================
+// a serial_rx_t pairs a serial port with an epoll instance and a timerfd
+// that holds the deadline for the current read. waiting for bytes sleeps
+// in epoll_wait() instead of spinning on a non-blocking read(), and the
+// deadline is private to the port, so no signal handler or process-wide
+// timer is needed.
+
+typedef struct _sts_serial_rx
+{
+	int fd;			// serial port file descriptor (opened with O_NONBLOCK)
+	int epfd;		// epoll instance watching fd and timerfd
+	int timerfd;	// CLOCK_MONOTONIC deadline timer for the current read
+	int expired;	// set to 1 once the deadline armed by serial_rx_arm() passes
+} serial_rx_t;
+
+int serial_rx_open(serial_rx_t* rx, int fd);
+// sets up the receive engine for the serial port fd.
+// fd should have been opened with O_NONBLOCK.
+// returns 0 on success, -1 on failure (errno is set).
+
+void serial_rx_close(serial_rx_t* rx);
+// releases the epoll instance and timer. does not close the serial port.
+
+int serial_rx_arm(serial_rx_t* rx, long secs, long usecs);
+// (re)arms the deadline secs seconds + usecs microseconds from now.
+// if both are 0, the deadline is disarmed and reads wait indefinitely.
+// returns 0 on success, -1 on failure.
+
+int serial_rx_read(serial_rx_t* rx, void *buf, size_t count);
+// sleeps until bytes are available or the armed deadline passes, then reads
+// up to count bytes into buf.
+// returns the number of bytes read, 0 if the deadline passed,
+// or -1 on a read/wait failure (errno is set).
+
+int read_sequence_rx(serial_rx_t* rx, void *buf, size_t count, char *seq, size_t seq_size, long secs, long usecs);
+// same behavior and return values as read_sequence(), but waits on the
+// receive engine rx instead of spinning and using SIGALRM/ITIMER_REAL.
+
+
+
 unsigned int convert_baudrate(speed_t baudrate);
 // returns the speed_t baudrate defined in <termios.h> in unsigned integer format
 // e.g. convert_baudrate(B57600) returns 57600